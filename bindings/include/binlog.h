@@ -28,13 +28,26 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "binlog_driver.h"
 #include "tcp_driver.h"
 #include "file_driver.h"
+#include "mmap_driver.h"
+#include "readahead_driver.h"
+#include "sequence_driver.h"
+#include "tail_driver.h"
+#include "pipeline_driver.h"
+#include "binlog_multiplexer.h"
+#include "multi_source_reader.h"
+#include "relay_log_writer.h"
+#include "event_filter.h"
 #include "access_method_factory.h"
 #include "basic_content_handler.h"
 #include "basic_transaction_parser.h"
 #include "binary_log.h"
 #include "field_iterator.h"
 #include "rowset.h"
+#include "column_batch.h"
 #include "decoder.h"
+#include "parallel_decoder.h"
+#include "binlog_index.h"
+#include "gtid_set.h"
 #include <iosfwd>
 #include <list>
 #include <cassert>
@@ -120,6 +133,8 @@ private:
   Dummy_driver m_dummy_driver;
   unsigned long m_binlog_position;
   std::string m_binlog_file;
+
+  int load_index(const std::string &filename, Binlog_index *index);
 public:
   Binary_log(system::Binary_log_driver *drv);
   ~Binary_log()
@@ -151,6 +166,38 @@ public:
    */
   int set_position(unsigned long position);
 
+  /**
+   * Set the binlog position, in the current file, to the first transaction
+   * which starts at or after a point in time, see Binlog_index::find_time().
+   *
+   * The sidecar index of the file is used if it exists and the file has
+   * not changed since, see Binlog_index. Otherwise the file is indexed first.
+   *
+   * @param when The point in time
+   *
+   * @return Error_code
+   *  @retval ERR_OK The position is updated.
+   *  @retval ERR_EOF No transaction starts at or after when
+   *  @retval ERR_FAIL The file cannot be read
+   */
+  int set_position_by_time(time_t when);
+
+  /**
+   * Set the binlog position, in the current file, to the Gtid_event of a
+   * transaction.
+   *
+   * The sidecar index of the file is used if it exists and the file has
+   * not changed since, see Binlog_index. Otherwise the file is indexed first.
+   *
+   * @param gtid The GTID, in the form uuid:gno
+   *
+   * @return Error_code
+   *  @retval ERR_OK The position is updated.
+   *  @retval ERR_EOF The GTID is not in the file
+   *  @retval ERR_FAIL The GTID is malformed or the file cannot be read
+   */
+  int set_position_by_gtid(const std::string &gtid);
+
   /**
    * Fetch the binlog position for the current file
    */
@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #define	BINLOG_DRIVER_INCLUDED
 
 #include "binlog_event.h"
+#include "event_buffer.h"
 #include <utility>
 
 namespace binary_log {
@@ -34,7 +35,7 @@ public:
   Binary_log_driver(const FilenameT& filename = FilenameT(),
                     unsigned int offset = 0)
   : m_binlog_file_name(filename), m_binlog_offset(offset), buf(NULL),
-    last_event_len(0)
+    last_event_len(0), m_stream_checksum_len(0)
   {
   }
 
@@ -91,6 +92,61 @@ public:
              >0             Error code
   */
   virtual int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen)=0;
+
+  /**
+    Gets the next event in an Event_buffer, for the Rows_events decoded
+    from it with Decoder::decode_event(Event_buffer*, ...) to reference
+    it rather than copy their rows. The byte following the event is
+    readable, as with the buffers of get_next_event().
+
+    @param[in,out] buffer  The buffer of the last call, or NULL. It is
+                           reused if the caller holds its only reference,
+                           and released and replaced by a new buffer
+                           otherwise. The caller releases the last one.
+    @param[out]    length  The length of the event
+    @retval  0             Success
+             >0            Error code
+
+    This one copies the buffer of get_next_event(), once, with a zero
+    byte after it. Binlog_mmap_driver wraps the event in its mapping
+    instead, see Event_buffer::wrap(), and Binlog_tcp_driver copies it
+    straight out of the network buffer.
+  */
+  virtual int get_next_event_buffer(Event_buffer **buffer, size_t *length);
+
+  /**
+    Makes a get_next_event() call blocked in another thread return with an
+    error, so that the thread can be stopped. The driver must still be
+    disconnected afterwards. Drivers which never block for long need not
+    implement it.
+  */
+  virtual void abort_read() {}
+
+  /**
+    Copies an event buffer returned by get_next_event(), for a consumer
+    which keeps the event after the next call to get_next_event().
+
+    Drivers may return buffers which they do not own, such as a network or
+    a mapped file buffer, so the copy is the only way to retain an event.
+    The copy has a terminating zero byte after the event, like the buffers
+    of the drivers.
+
+    @param   buffer_buflen  The event buffer and its length
+    @retval  The copy, to be released with bapi_free(), or NULL if out of
+             memory
+  */
+  static unsigned char *
+  retain_event(const std::pair<unsigned char *, size_t> &buffer_buflen)
+  {
+    unsigned char *copy= static_cast<unsigned char*>
+      (bapi_malloc(buffer_buflen.second + 1, 0));
+    if (copy)
+    {
+      memcpy(copy, buffer_buflen.first, buffer_buflen.second);
+      copy[buffer_buflen.second]= 0;
+    }
+    return copy;
+  }
 protected:
   unsigned char *buf;
   /**
@@ -109,6 +165,85 @@ protected:
    * offset position.
    */
   unsigned long m_binlog_offset;
+
+  /**
+    Moves m_binlog_file_name and m_binlog_offset past an event handed to
+    the consumer, for drivers which cannot ask their source cheaply.
+  */
+  void track_position(const unsigned char *event, size_t length)
+  {
+    track_event_position(event, length, &m_binlog_file_name, &m_binlog_offset,
+                         &m_stream_checksum_len);
+  }
+
+public:
+  /**
+    Moves a position past an event of a stream.
+
+    A Rotate_event sets the file and the position it names. Any other
+    event sets the position to the end position in its header, unless it
+    is zero, as in the events the server makes up.
+
+    @param          event        The event
+    @param          length       The length of the event
+    @param[in,out]  file_name    The file of the position
+    @param[in,out]  offset       The offset of the position
+    @param[in,out]  checksum_len The length of the checksum of the events,
+                                 updated from each Format_description_event
+  */
+  static void track_event_position(const unsigned char *event, size_t length,
+                                   std::string *file_name,
+                                   unsigned long *offset,
+                                   unsigned int *checksum_len)
+  {
+    if (length < LOG_EVENT_MINIMAL_HEADER_LEN)
+      return;
+    unsigned char type= event[EVENT_TYPE_OFFSET];
+    if (type == FORMAT_DESCRIPTION_EVENT)
+      *checksum_len=
+        Log_event_footer::get_checksum_alg((const char*) event, length) ==
+        BINLOG_CHECKSUM_ALG_CRC32 ? BINLOG_CHECKSUM_LEN : 0;
+
+    uint32_t log_pos;
+    memcpy(&log_pos, event + LOG_POS_OFFSET, 4);
+    log_pos= le32toh(log_pos);
+    if (type == ROTATE_EVENT)
+    {
+      /*
+        The Rotate_event starting a dump is made up by the server, before
+        the Format_description_event. It only has a checksum if the client
+        asked for the checksums, so it is checked.
+      */
+      size_t rotate_checksum_len= log_pos ? *checksum_len : 0;
+      if (log_pos == 0 && length >= LOG_EVENT_MINIMAL_HEADER_LEN +
+                                    Binary_log_event::ROTATE_HEADER_LEN +
+                                    BINLOG_CHECKSUM_LEN)
+      {
+        uint32_t checksum;
+        memcpy(&checksum, event + length - BINLOG_CHECKSUM_LEN, 4);
+        if (le32toh(checksum) ==
+            checksum_crc32(checksum_crc32(0, NULL, 0), event,
+                           length - BINLOG_CHECKSUM_LEN))
+          rotate_checksum_len= BINLOG_CHECKSUM_LEN;
+      }
+      size_t ident_offset= LOG_EVENT_MINIMAL_HEADER_LEN +
+                           Binary_log_event::ROTATE_HEADER_LEN;
+      if (length > ident_offset + rotate_checksum_len)
+      {
+        uint64_t position;
+        memcpy(&position, event + LOG_EVENT_MINIMAL_HEADER_LEN, 8);
+        file_name->assign((const char*) event + ident_offset,
+                          length - ident_offset - rotate_checksum_len);
+        *offset= le64toh(position);
+      }
+    }
+    else if (log_pos != 0)
+      *offset= log_pos;
+  }
+
+private:
+  /** Length of the checksum of the events, from the last FDE tracked */
+  unsigned int m_stream_checksum_len;
 };
 
 } // namespace binary_log::system
@@ -0,0 +1,194 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file binlog_index.h
+
+  @brief Contains the sidecar index which maps timestamps and GTIDs to
+  positions in a binary log file.
+*/
+
+#ifndef BINLOG_INDEX_INCLUDED
+#define BINLOG_INDEX_INCLUDED
+
+#include "binlog_event.h"
+#include <ctime>
+#include <string>
+#include <vector>
+
+/** Default number of bytes of the binlog between two index entries */
+#define BINLOG_INDEX_INTERVAL (64 * 1024)
+/** Extension of the sidecar index file, appended to the binlog file name */
+#define BINLOG_INDEX_EXTENSION ".idx"
+
+namespace binary_log {
+
+/**
+  @struct Binlog_index_entry
+
+  One sampled transaction start of a binary log file.
+*/
+struct Binlog_index_entry
+{
+  enum enum_entry_flags
+  {
+    /** The transaction starts with a Gtid_event, sid and gno are set */
+    HAS_GTID= 1
+  };
+
+  /** Offset of the first event of the transaction */
+  unsigned long long offset;
+  /** Timestamp of the first event of the transaction */
+  uint32_t timestamp;
+  /**
+    Latest timestamp of the transactions from this one up to the one of
+    the next entry
+  */
+  uint32_t max_timestamp;
+  uint32_t flags;
+  unsigned char sid[16];
+  long long gno;
+};
+
+/**
+  @class Binlog_index
+
+  A sidecar index of a binary log file, which allows to find the position
+  of the first transaction at or after a point in time, or the position of
+  a GTID, without decoding the whole file.
+
+  The index records the Format_description_event of the file and, every
+  interval bytes of the binlog, the offset of the next transaction start
+  together with its timestamp and its GTID, if any. A lookup starts at the
+  closest entry before the target and decodes the file from there, so only
+  a small part of the file is read.
+
+  The timestamp of a transaction is the one of its first event, which is
+  when its first statement started, while the transactions are written in
+  the order they commit: the timestamps do not always grow along the
+  file. An entry also records the latest timestamp up to the next entry,
+  so that a lookup by time does not miss a transaction which is not the
+  one sampled.
+
+  The index is stored next to the binlog, in a file with the name of the
+  binlog followed by BINLOG_INDEX_EXTENSION. The format is, with all
+  integers stored little-endian:
+
+  <table>
+  <tr><th>Field</th><th>Format</th></tr>
+  <tr><td>magic "BLIX"</td><td>4 bytes</td></tr>
+  <tr><td>format version, 2</td><td>4 byte integer</td></tr>
+  <tr><td>size of the binlog when indexed</td><td>8 byte integer</td></tr>
+  <tr><td>length of the FDE</td><td>4 byte integer</td></tr>
+  <tr><td>the FDE</td><td>variable</td></tr>
+  <tr><td>number of entries</td><td>4 byte integer</td></tr>
+  <tr><td>entries: offset, timestamp, max_timestamp, flags, sid, gno</td>
+      <td>8 + 4 + 4 + 4 + 16 + 8 bytes each</td></tr>
+  </table>
+*/
+class Binlog_index
+{
+public:
+  Binlog_index() : m_binlog_size(0) {}
+
+  /** Returns the name of the sidecar index of a binlog file */
+  static std::string sidecar_name(const std::string &binlog_file)
+  {
+    return binlog_file + BINLOG_INDEX_EXTENSION;
+  }
+
+  /**
+    Builds the index of a binlog file by decoding it.
+
+    @param binlog_file  The binlog file to index
+    @param interval     Number of binlog bytes between two entries
+
+    @retval ERR_OK             The index is built
+    @retval ERR_FAIL           The binlog file cannot be read
+    @retval ERR_BINLOG_VERSION The first event is not a
+                               Format_description_event
+  */
+  int build(const std::string &binlog_file,
+            unsigned long interval= BINLOG_INDEX_INTERVAL);
+
+  /** Writes the index to a sidecar file */
+  int save(const std::string &index_file) const;
+
+  /**
+    Reads the index from a sidecar file.
+
+    @retval ERR_OK   The index is loaded
+    @retval ERR_FAIL The file cannot be read or is not a binlog index
+  */
+  int load(const std::string &index_file);
+
+  /**
+    Checks that a binlog file has the size it had when it was indexed.
+    The server appends to the file it is writing, and a file may be
+    replaced by another one of the same name: the index of a file which
+    does not match it must be built again.
+  */
+  bool is_stale(const std::string &binlog_file) const;
+
+  /**
+    Finds the first transaction of the file, in the order of the file,
+    whose timestamp is at or after a point in time.
+
+    @param      binlog_file The indexed binlog file
+    @param      when        The point in time
+    @param[out] position    The offset of the first event of the transaction
+
+    @retval ERR_OK   The position is found
+    @retval ERR_EOF  No transaction of the file starts at or after when
+    @retval ERR_FAIL The binlog file cannot be read, or does not match
+                     the index
+  */
+  int find_time(const std::string &binlog_file, time_t when,
+                unsigned long *position) const;
+
+  /**
+    Finds the Gtid_event of a transaction.
+
+    @param      binlog_file The indexed binlog file
+    @param      gtid        The GTID, in the form uuid:gno
+    @param[out] position    The offset of the Gtid_event
+
+    @retval ERR_OK   The position is found
+    @retval ERR_EOF  The GTID is not in the file
+    @retval ERR_FAIL The GTID is malformed, the binlog file cannot be read,
+                     or it does not match the index
+  */
+  int find_gtid(const std::string &binlog_file, const std::string &gtid,
+                unsigned long *position) const;
+
+  const std::vector<Binlog_index_entry> &entries() const { return m_entries; }
+  const std::vector<char> &fde() const { return m_fde; }
+  unsigned long long binlog_size() const { return m_binlog_size; }
+
+private:
+  /** Size of the binlog file when it was indexed */
+  unsigned long long m_binlog_size;
+  std::vector<char> m_fde;
+  std::vector<Binlog_index_entry> m_entries;
+};
+
+} // namespace binary_log
+
+#endif /* BINLOG_INDEX_INCLUDED */
@@ -0,0 +1,281 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file binlog_multiplexer.h
+
+  @brief Contains a non-blocking client of the replication protocol, and
+  an event loop reading many binlog streams from one thread.
+*/
+
+#ifndef BINLOG_MULTIPLEXER_INCLUDED
+#define	BINLOG_MULTIPLEXER_INCLUDED
+
+#include "binlog_driver.h"
+#include "gtid_set.h"
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/** Size of the input buffer of a stream, grown for larger packets */
+#define STREAM_BUFFER_SIZE (64 * 1024)
+/** Maximum number of ready streams handled by one epoll_wait() call */
+#define MULTIPLEXER_MAX_EVENTS 64
+
+namespace binary_log {
+namespace system {
+
+class Binlog_stream;
+class Binlog_multiplexer;
+
+/**
+  @class Binlog_stream_handler
+
+  Receives the events and the errors of the streams of a
+  Binlog_multiplexer, in the thread running it.
+*/
+class Binlog_stream_handler
+{
+public:
+  virtual ~Binlog_stream_handler() {}
+
+  /**
+    Called for every event of a stream.
+
+    The event is in the input buffer of the stream, and is only valid
+    during the call; Binary_log_driver::retain_event() copies it. One
+    readable byte follows the event, as with the drivers.
+
+    The handler may remove any stream from the multiplexer, but must not
+    delete a stream before the multiplexer returns.
+  */
+  virtual void on_event(Binlog_stream *stream, const unsigned char *event,
+                        size_t length)= 0;
+
+  /**
+    Called when a stream stops. The stream is closed and already removed
+    from the multiplexer, so the handler may delete it, or add it again to
+    resume after the last event handled.
+
+    @param error    ERR_CONNECT if the server could not be reached, refused
+                    the client or dropped the connection, ERR_EOF if the
+                    server ended the stream, ERR_FAIL on an error of the
+                    server or of the protocol
+    @param message  The error message
+  */
+  virtual void on_error(Binlog_stream *stream, int error,
+                        const std::string &message)= 0;
+};
+
+/**
+  @class Binlog_stream
+
+  The binlog stream of one server, read with a native, non-blocking
+  implementation of the client side of the replication protocol: the
+  handshake, COM_REGISTER_SLAVE and COM_BINLOG_DUMP or
+  COM_BINLOG_DUMP_GTID. A stream does nothing by itself, it is driven by
+  the Binlog_multiplexer it is added to.
+
+  Only the mysql_native_password authentication is supported, without
+  TLS. The host name is resolved when the stream is added, which may
+  block.
+
+  The stream tracks the position of the last event handed to the
+  handler, and resumes from it when it is added again.
+*/
+class Binlog_stream
+{
+public:
+  Binlog_stream(Binlog_stream_handler *handler,
+                const std::string &user, const std::string &passwd,
+                const std::string &host, unsigned int port,
+                unsigned int server_id= 1);
+  ~Binlog_stream();
+
+  /** Sets the position the next dump starts at */
+  void set_position(const std::string &file, unsigned long position);
+  /** Makes the next dump send the transactions which are not in gtids */
+  void set_position(const Gtid_set &gtids);
+  /** Returns the position after the last event handed to the handler */
+  void get_position(std::string *file, unsigned long *position) const;
+
+  /**
+    Sets whether the stream asks for the checksum algorithm of the binlog
+    rather than none, so that the events the server makes up have a
+    checksum too, as Binlog_tcp_driver::set_stream_checksum().
+  */
+  void set_stream_checksum(bool checksum) { m_stream_checksum= checksum; }
+  bool stream_checksum() const { return m_stream_checksum; }
+
+  const std::string &host() const { return m_host; }
+  unsigned int port() const { return m_port; }
+  unsigned int server_id() const { return m_server_id; }
+  /** True once the dump is requested, until the stream stops */
+  bool is_streaming() const { return m_state == STREAMING; }
+  unsigned long long events_received() const { return m_events_received; }
+
+private:
+  friend class Binlog_multiplexer;
+
+  enum State
+  {
+    IDLE,
+    CONNECTING,
+    READ_HANDSHAKE,
+    READ_AUTH_RESULT,
+    READ_CHECKSUM_RESULT,
+    READ_REGISTER_RESULT,
+    STREAMING
+  };
+
+  int open();
+  void close();
+  int on_writable();
+  int on_readable();
+  int handle_packet(unsigned char *packet, size_t length);
+  int handle_handshake(const unsigned char *packet, size_t length);
+  int handle_auth_result(const unsigned char *packet, size_t length);
+  int handle_event_packet(unsigned char *packet, size_t length);
+  int send_auth_response(const unsigned char *scramble_data);
+  void send_command(unsigned char command, const unsigned char *data,
+                    size_t length);
+  void send_register_slave();
+  void send_binlog_dump();
+  void queue_packet(const unsigned char *payload, size_t length);
+  int flush_output();
+  int fail(int error, const std::string &message);
+  int server_error(int error, const unsigned char *packet, size_t length);
+  unsigned int wanted_events() const;
+
+  Binlog_stream_handler *m_handler;
+  std::string m_user;
+  std::string m_passwd;
+  std::string m_host;
+  unsigned int m_port;
+  unsigned int m_server_id;
+
+  State m_state;
+  int m_fd;
+  /** The epoll events the socket is registered for */
+  unsigned int m_events;
+  /** Set while the stream is added to a multiplexer */
+  Binlog_multiplexer *m_multiplexer;
+  /**
+    Counts the connections, so that the reading of a stream notices when
+    its handler removes it, or removes it and adds it again.
+  */
+  unsigned long m_session;
+
+  /** Input bytes, from m_in_start to m_in_end */
+  std::vector<unsigned char> m_in;
+  size_t m_in_start;
+  size_t m_in_end;
+  /** A payload split over several packets, being put together */
+  std::vector<unsigned char> m_packet;
+  /** Output bytes not sent yet, from m_out_start */
+  std::vector<unsigned char> m_out;
+  size_t m_out_start;
+  /** Sequence number of the next packet sent */
+  unsigned char m_seq;
+  bool m_checksum_aware;
+  bool m_stream_checksum;
+
+  std::string m_error_message;
+
+  std::string m_binlog_file_name;
+  unsigned long m_binlog_offset;
+  unsigned int m_checksum_len;
+  bool m_gtid_mode;
+  Gtid_set m_gtids;
+  unsigned long long m_events_received;
+};
+
+/**
+  @class Binlog_multiplexer
+
+  An epoll event loop reading the streams added to it, so that one thread
+  reads the binlogs of many servers. Each stream goes through the
+  handshake and the dump request as its socket becomes ready, then hands
+  its events to its handler.
+
+  The multiplexer is not thread-safe, except for stop().
+*/
+class Binlog_multiplexer
+{
+public:
+  Binlog_multiplexer();
+  ~Binlog_multiplexer();
+
+  /**
+    Adds a stream and starts connecting it to its server.
+
+    @retval ERR_OK      The stream is connecting
+    @retval ERR_CONNECT The host cannot be resolved or no socket can be
+                        opened
+    @retval ERR_FAIL    The stream is already added, or the multiplexer
+                        has no epoll instance
+  */
+  int add(Binlog_stream *stream);
+  /** Closes a stream and removes it, without calling its handler */
+  void remove(Binlog_stream *stream);
+  size_t size() const { return m_streams.size(); }
+
+  /**
+    Waits for the sockets of the streams and handles those which are
+    ready.
+
+    @param timeout_ms  Longest wait in milliseconds, -1 for no limit
+
+    @retval ERR_OK    Success, even if no stream was ready
+    @retval ERR_FAIL  The wait failed
+  */
+  int run_once(int timeout_ms);
+  /**
+    Handles the streams until stop() is called or no stream is left.
+
+    @retval ERR_OK    Stopped or no stream left
+    @retval ERR_FAIL  The wait failed
+  */
+  int run();
+  /** Makes run() return, it may be called from any thread */
+  void stop();
+
+private:
+  friend class Binlog_stream;
+
+  void dispatch(Binlog_stream *stream, unsigned int events);
+  void update_events(Binlog_stream *stream);
+  void stream_failed(Binlog_stream *stream, int error);
+
+  int m_epoll_fd;
+  /** An eventfd waking up epoll_wait() on stop() */
+  int m_wakeup_fd;
+  bool m_stop;
+  std::set<Binlog_stream*> m_streams;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_SYS_EPOLL_H */
+
+#endif	/* BINLOG_MULTIPLEXER_INCLUDED */
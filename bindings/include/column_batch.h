@@ -0,0 +1,149 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file column_batch.h
+
+  @brief Contains the decoding of the rows of a Rows_event into an array
+  of values per column.
+*/
+
+#ifndef COLUMN_BATCH_INCLUDED
+#define	COLUMN_BATCH_INCLUDED
+
+#include "binary_log_funcs.h"
+#include "rows_event.h"
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace binary_log {
+
+/** How the values of a Column_vector are stored */
+enum Column_kind
+{
+  /**
+    The integer types, YEAR, BIT, and ENUM and SET as their index and
+    bitmap. The binary log does not tell whether an integer column is
+    unsigned: its values are sign extended from their size, and are
+    read back by the caller with the unsigned type of that size.
+  */
+  COLUMN_INT64,
+  /** FLOAT and DOUBLE */
+  COLUMN_DOUBLE,
+  /**
+    The strings and the blobs, without their length. The other types,
+    like DECIMAL and the temporal ones, are kept as the bytes of their
+    binary format, to decode with binary_log::Value when needed.
+  */
+  COLUMN_BINARY
+};
+
+/**
+  @class Column_vector
+
+  The values of one column for all the rows of a Column_batch, laid out as
+  Arrow lays out its arrays: the values one after the other, a value per
+  row for the numbers; for the binary values, their bytes one after the
+  other, and row_count() + 1 offsets, the value of row i being the bytes
+  from offsets[i] to offsets[i + 1].
+
+  The validity bitmap has a bit per row, the first row in the lowest bit
+  of the first byte, set if the value is not NULL. The slot of a NULL
+  value is 0, or an empty range of bytes.
+*/
+struct Column_vector
+{
+  /** The type of the column, ENUM and SET for those stored as STRING */
+  unsigned char type;
+  Column_kind kind;
+  std::vector<int64_t> int64_values;
+  std::vector<double> double_values;
+  std::vector<uint32_t> offsets;
+  std::vector<unsigned char> bytes;
+  std::vector<uint8_t> validity;
+  size_t null_count;
+
+  bool is_null(size_t row) const
+  {
+    return !((validity[row / 8] >> (row % 8)) & 0x01);
+  }
+};
+
+/**
+  @class Column_batch
+
+  Decodes all the rows of a Rows_event at once, into a Column_vector per
+  column of its table, rather than into a Row_of_fields per row. The
+  values of a column being contiguous, they can be processed in a loop
+  over an array, or handed to a columnar format without being copied one
+  by one. The rows are read with the Column_layout of the Table_map_event,
+  in one pass over the event.
+
+  The rows are the row images of the event in their order: for an
+  Update_rows_event, the image before the update of a row, then the one
+  after it, as Row_event_set iterates them. A column which is not in an
+  image is NULL in its row.
+
+  A batch keeps the memory of its vectors from one decode() to the next:
+  decoding the events of a stream into the same batch stops allocating
+  once it is large enough for them.
+*/
+class Column_batch
+{
+public:
+  Column_batch() : m_column_count(0), m_row_count(0) {}
+
+  /**
+    Decodes the rows of an event, replacing those the batch held.
+
+    @param rows       The rows to decode
+    @param table_map  The Table_map_event of the table of the rows, decoded
+                      from a stream, as it has a Column_layout
+
+    @return false if the rows do not match the columns of table_map, the
+            size of a value of the table is unknown, or a FLOAT or DOUBLE
+            column is not of 4 or 8 bytes; the batch is then empty
+  */
+  bool decode(const Rows_event &rows, const Table_map_event &table_map);
+  /** Removes the rows and the columns, keeping their memory */
+  void clear();
+
+  size_t row_count() const { return m_row_count; }
+  size_t column_count() const { return m_column_count; }
+  const Column_vector &column(size_t col) const { return m_columns[col]; }
+
+private:
+  bool decode_row(const unsigned char **pos, const unsigned char *end,
+                  const Buffer_slice &image, const Table_map_event &table_map);
+  void append_null(Column_vector *column);
+
+  /*
+    The vectors of the columns past m_column_count, left by a table of
+    more columns, are kept for their memory.
+  */
+  std::vector<Column_vector> m_columns;
+  size_t m_column_count;
+  size_t m_row_count;
+};
+
+} // end namespace binary_log
+
+#endif	/* COLUMN_BATCH_INCLUDED */
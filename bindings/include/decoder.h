@@ -26,6 +26,13 @@
 #ifndef DECODER_INCLUDED
 #define DECODER_INCLUDED
 #include "binary_log.h"
+#include "event_arena.h"
+#include "event_filter.h"
+#include "event_view.h"
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
 
 namespace binary_log {
 
@@ -72,9 +79,15 @@ public:
     */
     des_ev= new Format_description_event(3, "");
     force_read= force_read_arg;
+    m_arena= NULL;
+    m_pool_size= 0;
+    m_filter= NULL;
+    m_table_map_cache_size= 0;
   }
   ~Decoder()
   {
+    set_table_map_cache(0);
+    set_event_pool(0);
     delete des_ev;
   }
   /**
@@ -92,12 +105,121 @@ public:
     @param   crc_check: If set true it will lead to compare the
                         incoming and outgoing checksum value for all events.
 
-    @return  An event object pointer of type Binary_log_event
+    @return  An event object pointer of type Binary_log_event, or NULL.
+             NULL with *error set means the event could not be decoded.
+             NULL with *error left NULL means the filter rejected the
+             event, see set_filter(): it is not an error nor the end of
+             the stream, and the caller goes on with the next event,
+             having a Binlog_file_driver skip it with update_pos(size_t).
     @note
-    Allocates memory;  The caller is responsible for clean-up.
+    Allocates memory;  The caller is responsible for clean-up, unless
+    an arena is set, see set_arena().
   */
   Binary_log_event* decode_event(const char* buf, size_t  event_len,
                                    const char **error, bool crc_check);
+  /**
+    Decodes an event held in an Event_buffer, from its start, see
+    decode_event() above. The column bitmaps and the rows of a Rows_event
+    reference the buffer instead of being copied: the event keeps the
+    buffer alive, so it can outlive the next event read, a driver reading
+    it into a new buffer while the last one is still referenced. See
+    Binary_log_driver::get_next_event_buffer().
+  */
+  Binary_log_event* decode_event(Event_buffer *buffer, size_t event_len,
+                                 const char **error, bool crc_check);
+  /**
+    Decodes the next events in an arena, or on the heap if NULL.
+
+    The events, the memory they get from bapi_malloc() and their
+    Event_buffers, like the columns of a Table_map_event and the body of a
+    Rows_event, are allocated from the arena. They must not be deleted:
+    Event_arena::reset() runs their destructors and gives their memory
+    back at once. The caller picks how many events an arena holds, e.g.
+    resetting it after each event, or after the Xid_event or the COMMIT
+    ending a transaction. The members of the events which are standard
+    containers still allocate from the heap, and so does the table map
+    cache, see set_table_map_cache(), which outlives the arena.
+
+    The arena must outlive its events, or be reset before the Decoder
+    is destroyed.
+  */
+  void set_arena(Event_arena *arena) { m_arena= arena; }
+  Event_arena *arena() const { return m_arena; }
+
+  /**
+    Keeps up to max_per_type events of each of the types a transaction
+    is made of (Gtid_event, Query_event, Table_map_event, Rows_event and
+    Xid_event) once they are given back with release_event(), and
+    decodes the next events of the same type into them in place rather
+    than allocating new ones. Table_map_event and Rows_event keep the
+    memory of their buffers too, so that a stream of similar
+    transactions is decoded without allocating memory.
+
+    0 turns the pool off and deletes the events it holds. The pool is not
+    used while an arena is set.
+  */
+  void set_event_pool(size_t max_per_type);
+  /**
+    Gives back an event returned by decode_event(): it is kept in the pool
+    if there is room for it, and deleted otherwise. The events of an
+    arena are left to it.
+  */
+  void release_event(Binary_log_event *ev);
+  /**
+    Skips the events a filter rejects, or none if NULL: decode_event()
+    returns NULL for them, with no error, after reading their common
+    header, and the table id of the events of a table. Their checksum is
+    not checked. The filter must outlive its use by the Decoder.
+
+    The Decoder remembers which table ids the Table_map_events it read
+    mapped to accepted tables, to filter the Rows_events which follow
+    them; setting a filter forgets them.
+  */
+  void set_filter(const Event_filter *filter)
+  {
+    m_filter= filter;
+    m_accepted_tables.clear();
+  }
+  const Event_filter *filter() const { return m_filter; }
+  /**
+    Keeps the schema of the last Table_map_event of up to max_tables
+    table ids: the columns decoded from it, with a copy of its body. A
+    Table_map_event whose body is the same as the last one of its table
+    id, as the server writes before the rows of each transaction, is then
+    not parsed again: it shares the columns of the cached one, see
+    Table_map_event::share_schema(), and allocates nothing when it is
+    decoded into an event of the pool. When a table id is new and the
+    cache is full, the table id mapped least recently is dropped.
+
+    0 turns the cache off and drops what it holds.
+  */
+  void set_table_map_cache(size_t max_tables);
+  /**
+    Checks an event and returns a view over it, which reads its fields
+    from the buffer when asked, rather than decoding it. Only a
+    Format_description_event is decoded, as it tells how to read the
+    events after it.
+
+    @param   buf:       The buf containing the event data
+    @param   event_len: Length of the event buffer
+    @param   view:      Set to the view over the event, valid as long as
+                        the buffer is
+    @param   error:     Set to the error if the event is not valid
+    @param   crc_check: Whether to compare the checksum of the event
+
+    @return  false if the event is not valid
+  */
+  bool view_event(const char* buf, size_t event_len, Event_view *view,
+                  const char **error, bool crc_check);
+  /**
+    Decodes the event of a view returned by view_event(), see
+    decode_event() above.
+  */
+  Binary_log_event* decode_event(const Event_view &view, const char **error,
+                                 bool crc_check)
+  {
+    return decode_event(view.data(), view.length(), error, crc_check);
+  }
   /**
     Returns the checksum_algorithm implemented at the server side
     @param:  buf         buf containing the complete event data
@@ -110,8 +232,39 @@ public:
                                               unsigned int event_type,
                                               size_t event_len);
 private:
+  Binary_log_event* decode(const char* buf, size_t event_len,
+                           Event_buffer *buffer, const char **error,
+                           bool crc_check);
+  bool check_event(const char *buf, size_t event_len, const char **error);
+  bool accept_event(const char *buf, size_t event_len);
+  void set_format_description(const char *buf, size_t event_len);
+  Binary_log_event *take_pooled(unsigned int event_type);
+  Binary_log_event *decode_table_map(const char *buf, size_t event_len);
+
   Format_description_event *des_ev;
   bool force_read;
+  Event_arena *m_arena;
+  size_t m_pool_size;
+  /** The events released, by type */
+  std::vector<Binary_log_event*> m_pool[ENUM_END_EVENT];
+  const Event_filter *m_filter;
+  /** Whether the filter accepts the table of each table id mapped */
+  std::map<uint64_t, bool> m_accepted_tables;
+
+  /** The last Table_map_event of a table id, see set_table_map_cache() */
+  struct Cached_table_map
+  {
+    /** The body of the event, after the post-header */
+    std::string body;
+    /** Holds the decoded columns, shared with the events */
+    Table_map_event *schema;
+    /** The place of the table id in m_table_map_lru */
+    std::list<uint64_t>::iterator lru;
+  };
+  size_t m_table_map_cache_size;
+  std::map<uint64_t, Cached_table_map> m_table_maps;
+  /** The table ids of m_table_maps, the one mapped last first */
+  std::list<uint64_t> m_table_map_lru;
 };
 }
 #endif
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file event_filter.h
+
+  @brief Contains the rules a Decoder uses to skip the events of a stream
+  without decoding them.
+*/
+
+#ifndef EVENT_FILTER_INCLUDED
+#define	EVENT_FILTER_INCLUDED
+
+#include "binlog_event.h"
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace binary_log {
+
+/**
+  @class Event_filter
+
+  The events a Decoder decodes, by type, by the server they come from and
+  by the table their rows belong to. Given to Decoder::set_filter(), it
+  is checked against the common header of an event and, for the events
+  of a table, against its table id, so that the events it rejects are
+  skipped without being decoded.
+
+  A Table_map_event is checked against the table rules with the names it
+  maps; the Rows_events after it are accepted or rejected as it was,
+  through their table id. The rows of a table id which no Table_map_event
+  of the stream mapped yet are accepted. The table rules apply to the
+  Table_map_events and the Rows_events only: statements, and the BEGIN
+  and COMMIT of the transactions, are filtered by type and server only.
+
+  A Format_description_event is always accepted, as the events after it
+  are read with it.
+
+  With no rule, every event is accepted.
+*/
+class Event_filter
+{
+public:
+  /**
+    A rule on the tables, called with the names of the database and of
+    the table, which are not null terminated.
+  */
+  typedef bool (*Table_predicate)(const char *db, size_t db_len,
+                                  const char *table, size_t table_len,
+                                  void *arg);
+
+  Event_filter();
+
+  /**
+    Accepts the events of a type. Until this is called, the events of all
+    the types are accepted; after, only those of the types added.
+  */
+  void add_event_type(Log_event_type type);
+  /**
+    Accepts the events of a server. Until this is called, the events of
+    all the servers are accepted; after, only those of the servers added.
+  */
+  void add_server_id(uint32_t server_id);
+  /** Rejects the events of a server, e.g. the events of this client */
+  void ignore_server_id(uint32_t server_id);
+
+  /**
+    Accepts the rows of a table, or of all the tables of a database if
+    table is empty. Once one is added, the rows of the tables which are
+    not are rejected.
+  */
+  void add_table(const std::string &db, const std::string &table= "");
+  /**
+    Rejects the rows of a table, or of all the tables of a database if
+    table is empty. This comes before add_table().
+  */
+  void ignore_table(const std::string &db, const std::string &table= "");
+  /**
+    Rejects the rows of the tables for which predicate returns false,
+    e.g. for matching their names against a regular expression. It is
+    checked after the other table rules, NULL removes it.
+  */
+  void set_table_predicate(Table_predicate predicate, void *arg);
+
+  bool accept_event_type(unsigned int type) const
+  {
+    return type == FORMAT_DESCRIPTION_EVENT ||
+           (type < ENUM_END_EVENT && m_event_types[type]);
+  }
+  bool accept_server_id(uint32_t server_id) const
+  {
+    if (m_server_ids.empty() && m_ignored_server_ids.empty())
+      return true;
+    return m_ignored_server_ids.count(server_id) == 0 &&
+           (m_server_ids.empty() || m_server_ids.count(server_id) != 0);
+  }
+  bool accept_table(const char *db, size_t db_len,
+                    const char *table, size_t table_len) const;
+
+  /** Whether there are rules on the tables */
+  bool has_table_rules() const
+  {
+    return !m_tables.empty() || !m_ignored_tables.empty() || m_predicate;
+  }
+
+private:
+  /** A database and a table, empty for all the tables of the database */
+  typedef std::pair<std::string, std::string> Table_name;
+  /*
+    The rules are few, and searching a vector compares them with the
+    names in the event without building strings.
+  */
+  typedef std::vector<Table_name> Table_set;
+
+  static bool find_table(const Table_set &tables,
+                         const char *db, size_t db_len,
+                         const char *table, size_t table_len);
+
+  bool m_all_event_types;
+  bool m_event_types[ENUM_END_EVENT];
+  std::set<uint32_t> m_server_ids;
+  std::set<uint32_t> m_ignored_server_ids;
+  Table_set m_tables;
+  Table_set m_ignored_tables;
+  Table_predicate m_predicate;
+  void *m_predicate_arg;
+};
+
+} // end namespace binary_log
+
+#endif	/* EVENT_FILTER_INCLUDED */
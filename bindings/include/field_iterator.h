@@ -89,13 +89,15 @@ public:
     field value).
 
     @param field_type The input column type
-    @return           number of bytes required to store metadata information
-
+    @return           number of bytes required to store metadata information,
+                      see Table_map_event::metadata_size()
   */
   int lookup_metadata_field_size(enum_field_types field_type);
 
   /**
-    Returns the metadata information of a column.
+    Returns the metadata information of a column, from the Column_layout of
+    the table map. Throws std::logic_error for a table map without one,
+    built directly rather than decoded, whose rows cannot be iterated.
 
     @param map    Table_map_event. It contains the information of the col type.
     @param col_no The index of the column for which the metadata info is needed.
@@ -107,6 +109,7 @@ public:
   //Row_iterator end() const;
 private:
     uint32_t fields(Iterator_value_type& fields_vector );
+    unsigned long skip_row(unsigned long offset);
     const Rows_event *m_row_event;
     const Table_map_event *m_table_map;
     unsigned long m_new_field_offset_calculated;
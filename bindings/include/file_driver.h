@@ -69,6 +69,16 @@ public:
              >ERR_OK   error occured while updating position in file
     */
     int update_pos(binary_log::Binary_log_event *event);
+    /**
+     To update the position of binlog_file and position after an event
+     which decode_event did not return, the filter of the decoder having
+     rejected it
+     @param   event_len  length of the event read by get_next_event
+
+     @retval  ERR_OK   position is updated successfully
+             >ERR_OK   error occured while updating position in file
+    */
+    int update_pos(size_t event_len);
 
     /**
       Returns the size of the binlog file currently being read
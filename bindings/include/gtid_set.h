@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file gtid_set.h
+
+  @brief Contains a set of GTIDs, as used to start streaming from a server
+  with COM_BINLOG_DUMP_GTID.
+*/
+
+#ifndef GTID_SET_INCLUDED
+#define	GTID_SET_INCLUDED
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace binary_log {
+
+/**
+  @class Gtid_set
+
+  A set of GTIDs: for every server UUID, a sorted list of disjoint
+  intervals of transaction numbers (GNOs).
+
+  The text form is the one of the server, e.g.
+  "3e11fa47-71ca-11e1-9e33-c80aa9429562:1-5:7,
+   5f3b7b8c-71ca-11e1-9e33-c80aa9429562:1-3".
+*/
+class Gtid_set
+{
+public:
+  /** An interval of GNOs, both ends included */
+  typedef std::pair<int64_t, int64_t> Interval;
+  typedef std::vector<Interval> Interval_list;
+  /** The intervals of each server, keyed by the 16 bytes of its UUID */
+  typedef std::map<std::string, Interval_list> Sid_map;
+
+  /**
+    Replaces the content of the set with a set in text form. Spaces and
+    new lines are ignored, and an empty string is the empty set.
+
+    @retval 0 The set is parsed
+    @retval 1 The text is not a GTID set, the set is left empty
+  */
+  int parse(const std::string &text);
+
+  /** Adds one GTID */
+  void add(const unsigned char *sid, int64_t gno) { add(sid, gno, gno); }
+  /** Adds the GTIDs from first to last, both included */
+  void add(const unsigned char *sid, int64_t first, int64_t last);
+  bool contains(const unsigned char *sid, int64_t gno) const;
+
+  bool empty() const { return m_sids.empty(); }
+  void clear() { m_sids.clear(); }
+  const Sid_map &sids() const { return m_sids; }
+
+  /** Returns the set in text form, with the UUIDs in ascending order */
+  std::string to_string() const;
+
+  /** Returns the size of the set in the encoding used by the protocol */
+  size_t encoded_length() const;
+  /**
+    Stores the set in the encoding of COM_BINLOG_DUMP_GTID, with all
+    integers little-endian:
+
+    <table>
+    <tr><th>Field</th><th>Format</th></tr>
+    <tr><td>number of UUIDs</td><td>8 byte integer</td></tr>
+    <tr><td>for each UUID: the UUID</td><td>16 bytes</td></tr>
+    <tr><td>number of intervals</td><td>8 byte integer</td></tr>
+    <tr><td>for each interval: first GNO, last GNO + 1</td>
+        <td>8 + 8 bytes</td></tr>
+    </table>
+
+    @param buf Room for encoded_length() bytes
+  */
+  void encode(unsigned char *buf) const;
+
+private:
+  const char *parse_sid_intervals(const char *text);
+
+  Sid_map m_sids;
+};
+
+} // namespace binary_log
+
+#endif	/* GTID_SET_INCLUDED */
@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef MMAP_DRIVER_INCLUDED
+#define	MMAP_DRIVER_INCLUDED
+
+#include "binlog_driver.h"
+#include <string>
+
+#ifdef HAVE_SYS_MMAN_H
+
+namespace binary_log {
+namespace system {
+
+/**
+  @class Binlog_mmap_driver
+
+  A file driver which maps the complete binary log file into memory and
+  returns pointers into the mapping from get_next_event(), instead of
+  reading every event through a stream into a private buffer.
+
+  The driver keeps track of the offset of the next event itself, so there
+  is no need to call update_pos() after decoding an event, and no seek or
+  read system call is issued per event.
+
+  The buffer returned by get_next_event() stays valid until the driver is
+  disconnected or connected to another file. The Event_buffers of
+  get_next_event_buffer() reference the mapping instead, which is only
+  unmapped once the driver is disconnected and they are all released.
+
+  The mapping is private and writable, since the decoder temporarily
+  clears the LOG_EVENT_BINLOG_IN_USE_F flag of the Format_description_event
+  while verifying its checksum; these writes are never propagated to the
+  file.
+*/
+class Binlog_mmap_driver
+  : public Binary_log_driver
+{
+public:
+  template <class TFilename>
+  Binlog_mmap_driver(const TFilename& filename = TFilename(),
+                     unsigned int offset = 0)
+    : Binary_log_driver(filename, offset), m_map(NULL), m_map_size(0),
+      m_mapping(NULL), m_bytes_read(0), m_fde_pending(false), m_buf_size(0)
+  {
+  }
+
+  ~Binlog_mmap_driver()
+  {
+    disconnect();
+  }
+
+  int connect();
+  int connect(const std::string &filename, unsigned long offset);
+  int disconnect();
+  int set_position(const std::string &str, unsigned long position);
+  int get_position(std::string *str, unsigned long *position);
+
+  /**
+    Fetches a pointer to the next event inside the mapping, and the length
+    of the event, and stores them in a C++ pair.
+
+    @retval ERR_OK   The pair points to the next event
+    @retval ERR_EOF  There are no more events in the file
+    @retval ERR_FAIL The event at the current position is truncated or
+                     the file is not mapped
+  */
+  int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+  /**
+    Gets the next event in an Event_buffer wrapping it in the mapping,
+    rather than a copy of it, see Binary_log_driver::get_next_event_buffer().
+    Only the last event of the file is copied, as with get_next_event().
+    The event is not followed by a zero byte, but by the next event.
+  */
+  int get_next_event_buffer(Event_buffer **buffer, size_t *length);
+
+  /**
+    Returns the size of the binlog file currently being mapped
+
+    @retval   size of file
+  */
+  size_t file_size() const;
+
+private:
+  /** Start of the mapping, or NULL if no file is mapped */
+  unsigned char *m_map;
+
+  /** Length of the mapping, which is the size of the file */
+  size_t m_map_size;
+
+  /**
+    The mapping, as a buffer holding a reference for the driver and one
+    for every Event_buffer of get_next_event_buffer() wrapping an event in
+    it; unmapped when the last one is released. NULL if no file is mapped.
+  */
+  Event_buffer *m_mapping;
+
+  /** Offset of the next event to be returned by get_next_event() */
+  unsigned long m_bytes_read;
+
+  /**
+    Set when reading starts in the middle of a file, in which case the
+    Format_description_event at offset 4 is returned before the event at
+    m_bytes_read, so that the decoder can be initialized.
+  */
+  bool m_fde_pending;
+
+  /**
+    Allocated size of the inherited buf, which is only used for the last
+    event of the file.
+  */
+  size_t m_buf_size;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_SYS_MMAN_H */
+
+#endif	/* MMAP_DRIVER_INCLUDED */
@@ -0,0 +1,205 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef MULTI_SOURCE_READER_INCLUDED
+#define	MULTI_SOURCE_READER_INCLUDED
+
+#include "binlog_driver.h"
+#include "pipeline_driver.h"
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+
+/** Default number of events buffered for each source */
+#define MULTI_SOURCE_BUFFER_SIZE 256
+/**
+  Default time the timestamp merge waits for a source which has no event
+  buffered, in milliseconds
+*/
+#define MULTI_SOURCE_MERGE_DELAY 1000
+
+namespace binary_log {
+namespace system {
+
+/**
+  @class Multi_source_reader
+
+  Reads the events of several drivers at once, each in its own thread,
+  and merges them into one stream of events tagged with their source.
+
+  Every source has a bounded buffer of events. A source whose buffer is
+  full stops reading until the consumer takes its events, so that a busy
+  source can neither use more memory than its buffer nor delay the events
+  of the other sources by more than its buffer.
+
+  The order of the merged stream is one of:
+  - MERGE_ARRIVAL: the order in which the events were read.
+  - MERGE_TIMESTAMP: the order of the timestamps in the event headers,
+    which the server sets to the start of the statement, to the second.
+    The merge waits for an event of every source, and keeps the arrival
+    order between events of the same second. A source which has had
+    nothing to read for the merge delay is left out of the merge until its
+    next event, so that an idle source delays the stream only once.
+  - MERGE_ROUND_ROBIN: one event of each source with events buffered in
+    turn.
+
+  The reader takes ownership of the drivers.
+*/
+class Multi_source_reader
+{
+public:
+  enum Merge_policy
+  {
+    MERGE_ARRIVAL,
+    MERGE_TIMESTAMP,
+    MERGE_ROUND_ROBIN
+  };
+
+  Multi_source_reader(Merge_policy policy= MERGE_ARRIVAL,
+                      size_t buffer_size= MULTI_SOURCE_BUFFER_SIZE);
+  ~Multi_source_reader();
+
+  /**
+    Adds a driver, before connect().
+
+    @return the number tagging the events of the driver
+  */
+  size_t add_source(Binary_log_driver *driver);
+  size_t source_count() const { return m_sources.size(); }
+  Binary_log_driver *source(size_t index) const
+  { return m_sources[index]->driver; }
+
+  /**
+    Connects every driver and starts reading them.
+
+    @retval ERR_OK   Every source is being read
+    @retval >ERR_OK  The error of the first driver which failed to connect,
+                     no source is read then
+  */
+  int connect();
+  /** Stops reading and disconnects every driver */
+  int disconnect();
+  /** Makes a get_next_event() call blocked in another thread return */
+  void abort_read();
+
+  /**
+    Takes the next event of the merged stream. The event is valid until
+    the next call.
+
+    A source which ends with ERR_EOF is left out of the merge silently.
+
+    @param[out] source         The source of the event or the error
+    @param[out] buffer_buflen  The event and its length
+
+    @retval ERR_OK   The next event
+    @retval ERR_EOF  Every source has ended
+    @retval >ERR_OK  A source failed with this error, after all its events;
+                     the other sources are still read
+  */
+  int get_next_event(size_t *source,
+                     std::pair<unsigned char *, size_t> *buffer_buflen);
+
+  /** Returns the position after the last event taken from a source */
+  int get_position(size_t source, std::string *str,
+                   unsigned long *position) const;
+  /** Takes a snapshot of the buffer metrics of a source */
+  void get_stats(size_t source, Pipeline_stats *stats) const;
+
+  Merge_policy merge_policy() const { return m_policy; }
+  /** Sets how long MERGE_TIMESTAMP waits for a source without events */
+  void set_merge_delay(unsigned long msec) { m_merge_delay= msec; }
+  unsigned long merge_delay() const { return m_merge_delay; }
+
+private:
+  struct Slot
+  {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    /** Error returned by the driver instead of an event, or ERR_OK */
+    int error;
+    /** Order in which the events of all the sources were read */
+    unsigned long long seq;
+    uint32_t timestamp;
+  };
+
+  struct Source
+  {
+    Multi_source_reader *reader;
+    size_t index;
+    Binary_log_driver *driver;
+    std::vector<Slot> slots;
+    /** Number of slots filled and released, under m_mutex */
+    size_t head;
+    size_t tail;
+    /** Set once the error ending the source is taken */
+    bool ended;
+    /**
+      When MERGE_TIMESTAMP stops waiting for the source, in microseconds of
+      the monotonic clock, set while the source has no event buffered, or 0
+    */
+    unsigned long long idle_deadline;
+    /** Signalled when a slot is released, or on stop */
+    pthread_cond_t space_cond;
+    pthread_t thread;
+    bool running;
+
+    std::string file_name;
+    unsigned long offset;
+    unsigned int checksum_len;
+
+    size_t high_water_mark;
+    unsigned long long events_read;
+    unsigned long long reader_stalls;
+    unsigned long long reader_stall_usec;
+    unsigned long long consumer_stalls;
+  };
+
+  static void *reader_thread(void *arg);
+  void run_reader(Source *source);
+  void stop_readers();
+  void release_held();
+  int choose_source(unsigned long long now);
+
+  Merge_policy m_policy;
+  size_t m_buffer_size;
+  unsigned long m_merge_delay;
+  std::vector<Source*> m_sources;
+
+  mutable pthread_mutex_t m_mutex;
+  /** Signalled when an event is buffered, or on stop */
+  pthread_cond_t m_data_cond;
+  bool m_stop;
+  bool m_running;
+  unsigned long long m_next_seq;
+  /** The source of the event the consumer holds, or -1 */
+  int m_held;
+  /** The source after which the round-robin merge looks for an event */
+  size_t m_next_source;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
+
+#endif	/* MULTI_SOURCE_READER_INCLUDED */
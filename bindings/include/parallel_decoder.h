@@ -0,0 +1,170 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file parallel_decoder.h
+
+  @brief Contains the class decoding the events of one binary log file
+  with several threads.
+*/
+
+#ifndef PARALLEL_DECODER_INCLUDED
+#define PARALLEL_DECODER_INCLUDED
+
+#include "decoder.h"
+#include <string>
+#include <vector>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_MMAN_H)
+#include <pthread.h>
+
+/** Default number of decoding threads */
+#define PARALLEL_DECODER_WORKERS 4
+/** Default number of bytes of events handed to a decoding thread at once */
+#define PARALLEL_DECODER_CHUNK_SIZE (4 * 1024 * 1024)
+
+namespace binary_log {
+
+/**
+  @class Parallel_decoder
+
+  Decodes the events of a binary log file with several threads, and
+  returns the decoded events in the order of the file.
+
+  The file is mapped into memory and split into chunks of about
+  chunk_size bytes by following the event lengths in the common headers.
+  A chunk preferably ends after an Xid_event, so that a transaction is
+  decoded by one thread, but a chunk which grows to twice chunk_size
+  ends at the next event boundary.
+
+  Every thread has its own Decoder, initialized with a private copy of the
+  Format_description_event of the file, and decodes whole chunks. Decoded
+  chunks are kept in a reorder buffer of two chunks per thread, from which
+  next_event() returns the events in log order. The threads stop when the
+  reorder buffer is full, which bounds the memory used.
+
+  The events returned by next_event() are owned by the caller, as with
+  Decoder::decode_event(), but some of them point into the mapped file,
+  so they must be deleted before close() is called.
+*/
+class Parallel_decoder
+{
+public:
+  Parallel_decoder(unsigned int workers= PARALLEL_DECODER_WORKERS,
+                   size_t chunk_size= PARALLEL_DECODER_CHUNK_SIZE,
+                   bool crc_check= false);
+  ~Parallel_decoder();
+
+  /**
+    Maps the file and starts the decoding threads.
+
+    @retval ERR_OK             The file is being decoded
+    @retval ERR_FAIL           The file cannot be read or is not a binlog
+    @retval ERR_BINLOG_VERSION The first event is not a
+                               Format_description_event
+  */
+  int open(const std::string &filename);
+
+  /**
+    Returns the next decoded event of the file, including the
+    Format_description_event.
+
+    @param[out] event     The decoded event, owned by the caller
+    @param[out] position  If not NULL, the offset of the event in the file
+
+    @retval ERR_OK   An event is returned
+    @retval ERR_EOF  All the events of the file have been returned
+    @retval ERR_FAIL An event could not be decoded, see get_error()
+  */
+  int next_event(Binary_log_event **event, unsigned long *position= NULL);
+
+  /**
+    Stops the decoding threads, deletes the events which have not been
+    returned yet and unmaps the file.
+  */
+  int close();
+
+  /** The error of the event which could not be decoded, if any */
+  const char *get_error() const { return m_error; }
+
+private:
+  struct Chunk
+  {
+    unsigned long start;
+    unsigned long end;
+    std::vector<Binary_log_event*> events;
+    std::vector<unsigned long> positions;
+    const char *error;
+    bool done;
+  };
+
+  static void *worker_thread(void *arg);
+  void run_worker();
+  bool claim_chunk(unsigned long *seq);
+  void decode_chunk(Decoder *decoder, Chunk *chunk);
+  unsigned long scan_chunk_end(unsigned long start, const char **error);
+  void clear_chunk(Chunk *chunk);
+
+  unsigned int m_worker_count;
+  size_t m_chunk_size;
+  bool m_crc_check;
+
+  /**
+    The mapping is one page longer than the file, since some event
+    constructors look at the byte following the event.
+  */
+  unsigned char *m_map;
+  size_t m_map_size;
+  size_t m_file_size;
+
+  /** Copy of the Format_description_event, given to every worker */
+  std::vector<char> m_fde;
+
+  std::vector<pthread_t> m_workers;
+  pthread_mutex_t m_mutex;
+  /** Signalled when a chunk has been decoded */
+  pthread_cond_t m_done_cond;
+  /** Signalled when a chunk has been consumed or scanned, or on stop */
+  pthread_cond_t m_space_cond;
+  bool m_stop;
+
+  /** Reorder buffer, chunk number n is kept in slot n % size */
+  std::vector<Chunk> m_chunks;
+  /** Offset at which the next chunk starts */
+  unsigned long m_scan_pos;
+  /** Set when the whole file has been split into chunks */
+  bool m_scan_done;
+  /** Set while a worker looks for the end of the next chunk */
+  bool m_scanning;
+  /** Number of the next chunk to be claimed by a worker */
+  unsigned long m_next_chunk;
+  /** Number of the chunk whose events are being returned */
+  unsigned long m_read_chunk;
+  /** Index of the next event to return in the chunk being read */
+  size_t m_read_event;
+
+  const char *m_error;
+};
+
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H && HAVE_SYS_MMAN_H */
+
+#endif /* PARALLEL_DECODER_INCLUDED */
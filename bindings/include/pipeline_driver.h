@@ -0,0 +1,167 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef PIPELINE_DRIVER_INCLUDED
+#define	PIPELINE_DRIVER_INCLUDED
+
+#include "binlog_driver.h"
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+
+/** Default number of events the ring can hold */
+#define PIPELINE_RING_SIZE 1024
+
+namespace binary_log {
+namespace system {
+
+/**
+  @struct Pipeline_stats
+
+  Occupancy and backpressure metrics of a Binlog_pipeline_driver.
+*/
+struct Pipeline_stats
+{
+  /** Number of events the ring can hold */
+  size_t capacity;
+  /** Number of events in the ring, waiting to be consumed */
+  size_t occupancy;
+  /** Highest occupancy seen */
+  size_t high_water_mark;
+  /** Events read by the reader thread */
+  unsigned long long events_read;
+  /** Times the reader thread waited because the ring was full */
+  unsigned long long reader_stalls;
+  /** Total time the reader thread waited for room, in microseconds */
+  unsigned long long reader_stall_usec;
+  /** Times the consumer waited because the ring was empty */
+  unsigned long long consumer_stalls;
+};
+
+/**
+  @class Binlog_pipeline_driver
+
+  A driver which reads the events of another driver in a dedicated
+  thread, so that the network is read while the consumer decodes and
+  handles the previous events.
+
+  The reader thread copies every event into a slot of a bounded ring,
+  which is shared with the consumer without locks; one thread only ever
+  advances the head and the other one the tail. A thread only takes a
+  lock to sleep when the ring is full or empty. When the consumer does
+  not keep up, the ring fills and the reader thread stops reading, which
+  in turn makes the server stop sending: this is the backpressure, and
+  it is reported by get_stats().
+
+  The event returned by get_next_event() stays in its slot until the next
+  call, so it is valid until then, as with the other drivers. Since the
+  events are copied anyway, a Binlog_tcp_driver is best used in zero-copy
+  mode underneath.
+
+  The driver takes ownership of the driver it reads from. get_position()
+  is tracked from the events popped off the ring, so it follows what the
+  consumer has read rather than what the reader thread has. file_size() is
+  answered by the source driver.
+*/
+class Binlog_pipeline_driver
+  : public Binary_log_driver
+{
+public:
+  Binlog_pipeline_driver(Binary_log_driver *source,
+                         size_t ring_size= PIPELINE_RING_SIZE);
+  ~Binlog_pipeline_driver();
+
+  int connect();
+  int connect(const std::string &filename, unsigned long offset);
+  int disconnect();
+
+  /** Stops the reader thread, empties the ring and moves the source */
+  int set_position(const std::string &str, unsigned long position);
+  int get_position(std::string *str, unsigned long *position);
+
+  /**
+    Pops the next event off the ring, waiting for the reader thread if
+    the ring is empty.
+
+    @retval ERR_OK   The pair points to the next event
+    @retval >ERR_OK  The error the source driver returned, after all the
+                     events read before it
+  */
+  int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+  size_t file_size() const;
+  void abort_read();
+
+  /** Takes a snapshot of the ring metrics */
+  void get_stats(Pipeline_stats *stats) const;
+
+  Binary_log_driver *source() const { return m_source; }
+
+private:
+  struct Slot
+  {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    /** Error returned by the source instead of an event, or ERR_OK */
+    int error;
+  };
+
+  static void *reader_thread(void *arg);
+  void run_reader();
+  int start_reader();
+  void stop_reader();
+  void release_slot();
+
+  Binary_log_driver *m_source;
+  std::vector<Slot> m_slots;
+
+  /** Number of events pushed, only written by the reader thread */
+  size_t m_head;
+  /** Number of events released, only written by the consumer */
+  size_t m_tail;
+  /** Set while the consumer holds the slot at m_tail */
+  bool m_holding;
+
+  pthread_t m_reader;
+  bool m_reader_running;
+  bool m_stop;
+  bool m_reader_waiting;
+  bool m_consumer_waiting;
+  pthread_mutex_t m_mutex;
+  /** Signalled when an event is pushed */
+  pthread_cond_t m_data_cond;
+  /** Signalled when a slot is released, or on stop */
+  pthread_cond_t m_space_cond;
+
+  size_t m_high_water_mark;
+  unsigned long long m_events_read;
+  unsigned long long m_reader_stalls;
+  unsigned long long m_reader_stall_usec;
+  unsigned long long m_consumer_stalls;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
+
+#endif	/* PIPELINE_DRIVER_INCLUDED */
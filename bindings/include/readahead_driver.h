@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef READAHEAD_DRIVER_INCLUDED
+#define	READAHEAD_DRIVER_INCLUDED
+
+#include "binlog_driver.h"
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <sys/types.h>
+
+/** Default size of one read-ahead block, a multiple of READAHEAD_ALIGNMENT */
+#define READAHEAD_BLOCK_SIZE (1024 * 1024)
+/** Default number of blocks in the read-ahead ring */
+#define READAHEAD_BLOCK_COUNT 4
+/** Default number of threads issuing reads */
+#define READAHEAD_READER_COUNT 2
+/** Alignment of the block buffers and of the file offsets being read */
+#define READAHEAD_ALIGNMENT 4096
+
+namespace binary_log {
+namespace system {
+
+/**
+  @class Binlog_readahead_driver
+
+  A file driver which reads the binary log ahead of the consumer.
+
+  The file is read in large aligned blocks into a ring of buffers by a
+  small pool of reader threads using pread(), so that several reads are
+  in flight while the consumer thread decodes the events of the blocks
+  which have already completed.
+
+  get_next_event() returns a pointer into a completed block when the event
+  is contained in a single block. Only the events which span two or more
+  blocks are assembled in the driver buffer. In both cases the buffer is
+  valid until the next call to get_next_event(), as for the other drivers.
+  The driver keeps track of the position of the next event itself, so
+  there is no need to call update_pos() after decoding an event.
+*/
+class Binlog_readahead_driver
+  : public Binary_log_driver
+{
+public:
+  template <class TFilename>
+  Binlog_readahead_driver(const TFilename& filename = TFilename(),
+                          unsigned int offset = 0,
+                          size_t block_size= READAHEAD_BLOCK_SIZE,
+                          unsigned int block_count= READAHEAD_BLOCK_COUNT,
+                          unsigned int reader_count= READAHEAD_READER_COUNT)
+    : Binary_log_driver(filename, offset), m_fd(-1), m_file_size(0),
+      m_block_size(block_size), m_block_count(block_count),
+      m_reader_count(reader_count), m_claim_idx(0), m_read_idx(0),
+      m_next_offset(0), m_cursor(0), m_bytes_read(0), m_fde_pending(false),
+      m_stop(false), m_buf_size(0)
+  {
+    /* Round the block size up to the alignment */
+    m_block_size= (m_block_size + READAHEAD_ALIGNMENT - 1) &
+                  ~((size_t)READAHEAD_ALIGNMENT - 1);
+    if (m_block_count < 2)
+      m_block_count= 2;
+    if (m_reader_count < 1)
+      m_reader_count= 1;
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_data_cond, NULL);
+    pthread_cond_init(&m_space_cond, NULL);
+  }
+
+  ~Binlog_readahead_driver()
+  {
+    disconnect();
+    pthread_cond_destroy(&m_space_cond);
+    pthread_cond_destroy(&m_data_cond);
+    pthread_mutex_destroy(&m_mutex);
+  }
+
+  int connect();
+  int connect(const std::string &filename, unsigned long offset);
+  int disconnect();
+  int set_position(const std::string &str, unsigned long position);
+  int get_position(std::string *str, unsigned long *position);
+
+  /**
+    Fetches the next event out of the completed read-ahead blocks and
+    stores a pointer to it, and its length, in a C++ pair.
+
+    @retval ERR_OK   The pair points to the next event
+    @retval ERR_EOF  There are no more events in the file
+    @retval ERR_FAIL A read failed, or the event is truncated
+  */
+  int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+
+  /**
+    Returns the size of the binlog file currently being read
+
+    @retval   size of file
+  */
+  size_t file_size() const;
+
+private:
+  enum Block_state
+  {
+    BLOCK_FREE,                                 /* Can be claimed by a reader */
+    BLOCK_READING,                              /* A read is in flight */
+    BLOCK_READY,                                /* Data can be consumed */
+    BLOCK_FAILED                                /* The read failed */
+  };
+
+  struct Readahead_block
+  {
+    unsigned char *data;
+    off_t offset;                               /* File offset of data[0] */
+    size_t length;                              /* Bytes read into data */
+    Block_state state;
+  };
+
+  static void *reader_thread(void *arg);
+  void run_reader();
+  void start_readers();
+  void stop_readers();
+  /** Drops the blocks read ahead and restarts the readers at position */
+  void restart_readers(unsigned long position);
+
+  /**
+    Waits for the block holding the byte at m_cursor, releasing all the
+    blocks before it.
+  */
+  int current_block(Readahead_block **blk);
+  void release_block();
+
+  /**
+    Copies len bytes starting at m_cursor to dest, crossing block
+    boundaries if needed.
+  */
+  int copy_bytes(unsigned char *dest, size_t len);
+  /**
+    Moves m_cursor back to m_bytes_read after an event could not be
+    assembled, reading its blocks again if they have been released.
+  */
+  void rewind_cursor();
+  int reserve_buf(size_t size);
+  int read_fde(std::pair<unsigned char *, size_t> *buffer_buflen);
+
+  int m_fd;
+  size_t m_file_size;
+  size_t m_block_size;
+  unsigned int m_block_count;
+  unsigned int m_reader_count;
+
+  /** Ring of blocks, filled and consumed in ring order */
+  std::vector<Readahead_block> m_blocks;
+  std::vector<pthread_t> m_readers;
+
+  /** Index of the next block to be claimed by a reader */
+  unsigned int m_claim_idx;
+  /** Index of the block currently being consumed */
+  unsigned int m_read_idx;
+  /** File offset to be read by the next claimed block */
+  off_t m_next_offset;
+
+  /** File offset of the next byte to be consumed */
+  unsigned long m_cursor;
+  /** Offset of the next event to be returned by get_next_event() */
+  unsigned long m_bytes_read;
+  /**
+    Set when reading starts in the middle of a file, in which case the
+    Format_description_event at offset 4 is returned first.
+  */
+  bool m_fde_pending;
+
+  bool m_stop;
+  pthread_mutex_t m_mutex;
+  /** Signalled when a block has been read */
+  pthread_cond_t m_data_cond;
+  /** Signalled when a block has been released, or on stop */
+  pthread_cond_t m_space_cond;
+
+  /** Allocated size of the inherited buf */
+  size_t m_buf_size;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
+
+#endif	/* READAHEAD_DRIVER_INCLUDED */
@@ -0,0 +1,198 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file relay_log_writer.h
+
+  @brief Contains a sink writing the events of a replication stream to
+  local binlog files, as the relay log of a replica.
+*/
+
+#ifndef RELAY_LOG_WRITER_INCLUDED
+#define	RELAY_LOG_WRITER_INCLUDED
+
+#include "binlog_driver.h"
+#include <string>
+#include <vector>
+
+/** Default size after which a relay log file is rotated, in bytes */
+#define RELAY_LOG_MAX_SIZE (256UL * 1024 * 1024)
+/** Default number of bytes written between two syncs */
+#define RELAY_LOG_SYNC_BYTES (1024 * 1024)
+/** Default time between two syncs, in milliseconds */
+#define RELAY_LOG_SYNC_PERIOD 1000
+/** Size of the buffer gathering the events before they are written */
+#define RELAY_LOG_BUFFER_SIZE (64 * 1024)
+
+namespace binary_log {
+namespace system {
+
+/**
+  Counters of a Relay_log_writer.
+*/
+struct Relay_log_stats
+{
+  unsigned long long events_written;
+  unsigned long long bytes_written;
+  unsigned long long files_created;
+  unsigned long long syncs;
+  /** Time spent in the syncs, in microseconds */
+  unsigned long long sync_usec;
+};
+
+/**
+  @class Relay_log_writer
+
+  Appends the events of a replication stream, as returned by
+  Binlog_tcp_driver::get_next_event(), to binlog files in a directory, so
+  that they can be read again from the disk, e.g. with a
+  Binlog_sequence_driver or a Binlog_tail_driver, rather than pulled again
+  from the master.
+
+  The files are named base_name.000001, base_name.000002, ... and listed
+  in base_name.index, as the server does. Like a relay log of the
+  server, each file starts with the Format_description_event of the
+  master, which carries the server id of the writer, and ends with a
+  Rotate_event of the writer, flagged with LOG_EVENT_RELAY_LOG_F, when it
+  grows over the maximum size. The other events are written as they are
+  received, including the Rotate_events of the master; the heartbeats are
+  left out. A file started by a rotation begins with a Rotate_event of
+  the master naming its current position, so that every file tells the
+  master position of its events. The server id of the writer must then
+  differ from the one of the master.
+
+  The events are written in batches and the files are synced on a byte
+  and time policy, so that a sync costs little per event. The time policy
+  is only checked when an event is written; the heartbeats the master
+  sends when it has nothing to send keep it going on an idle stream.
+
+  open() continues after the files already in the directory: it cuts the
+  last one after its last complete event, as left by a crash, and finds
+  the master position after that event, see get_master_position(). The
+  events not synced before a crash are pulled again from there.
+*/
+class Relay_log_writer
+{
+public:
+  Relay_log_writer(const std::string &directory, unsigned int server_id,
+                   const std::string &base_name= "relay-bin");
+  ~Relay_log_writer();
+
+  /** Sets the size after which a file is rotated */
+  void set_max_size(size_t size) { m_max_size= size; }
+  /**
+    Sets when the files are synced: once that many bytes are written or
+    that many milliseconds passed since the last sync. 0 turns a limit
+    off, and a byte limit of 1 syncs every event.
+  */
+  void set_sync_policy(size_t bytes, unsigned long msec)
+  {
+    m_sync_bytes= bytes;
+    m_sync_period= msec;
+  }
+
+  /**
+    Recovers the files in the directory. The next file is created by the
+    first Format_description_event written.
+
+    @retval ERR_OK    Ready for the events
+    @retval ERR_FAIL  The directory or the last file cannot be read, or
+                      the index cannot be written
+  */
+  int open();
+  /**
+    Appends an event.
+
+    The events before the first Format_description_event, like the
+    Rotate_event starting a dump, are kept until it is received.
+
+    @retval ERR_OK    The event is written, or buffered
+    @retval ERR_FAIL  A write or a sync failed; the writer must be closed
+  */
+  int write_event(const unsigned char *event, size_t length);
+  /** Writes the events buffered and syncs the file */
+  int sync();
+  /** Ends the current file; the next one starts with the next event */
+  int rotate();
+  /** Syncs and closes the current file */
+  int close();
+
+  /**
+    Returns the master position after the last event written, from which
+    the stream resumes. The file is empty if no event tells it.
+  */
+  void get_master_position(std::string *file, unsigned long *position) const
+  {
+    *file= m_master_file;
+    *position= m_master_offset;
+  }
+  /** The path of the current file, empty before the first one is created */
+  const std::string &file_name() const { return m_file_name; }
+  /** The size of the current file, with the events not written yet */
+  unsigned long position() const { return m_position; }
+  void get_stats(Relay_log_stats *stats) const { *stats= m_stats; }
+
+private:
+  int recover(const std::string &path);
+  int create_file();
+  int finish_file();
+  int append(const unsigned char *event, size_t length);
+  int write_buffer();
+  void make_event(unsigned char type, unsigned int server_id,
+                  unsigned int flags, uint32_t log_pos,
+                  const std::string &body, std::vector<unsigned char> *event);
+  void copy_fde(const unsigned char *fde, size_t length, bool header,
+                std::vector<unsigned char> *event);
+  std::string file_path(unsigned long number) const;
+
+  std::string m_directory;
+  std::string m_base_name;
+  unsigned int m_server_id;
+  size_t m_max_size;
+  size_t m_sync_bytes;
+  unsigned long m_sync_period;
+
+  int m_fd;
+  std::string m_file_name;
+  /** Number of the last file created or found */
+  unsigned long m_file_number;
+  unsigned long m_position;
+  /** Events not written yet */
+  std::vector<unsigned char> m_buffer;
+  size_t m_unsynced;
+  unsigned long long m_last_sync_usec;
+
+  /** The last Format_description_event of the master */
+  std::vector<unsigned char> m_fde;
+  unsigned int m_checksum_len;
+  /** Events received before the first Format_description_event */
+  std::vector<std::vector<unsigned char> > m_pending;
+
+  std::string m_master_file;
+  unsigned long m_master_offset;
+  unsigned int m_master_server_id;
+
+  Relay_log_stats m_stats;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif	/* RELAY_LOG_WRITER_INCLUDED */
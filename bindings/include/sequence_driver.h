@@ -0,0 +1,166 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef SEQUENCE_DRIVER_INCLUDED
+#define	SEQUENCE_DRIVER_INCLUDED
+
+#include "binlog_driver.h"
+#include "readahead_driver.h"
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+
+namespace binary_log {
+namespace system {
+
+/**
+  @class Binlog_sequence_driver
+
+  A driver which reads a sequence of binary log files as one continuous
+  stream of events.
+
+  The sequence is given either as a binlog index file, listing one file
+  name per line as the server writes it, or as a directory, in which case
+  the files of one base name with a numeric extension (binlog.000001,
+  binlog.000002, ...) are read in the order of their sequence numbers.
+  The base name is the one of the file connect() starts at, or of the
+  first file of the directory, unless set with set_base_name().
+
+  Each file is read with a Binlog_readahead_driver. When the current file
+  reaches its end, which is after its Rotate_event if the server rotated
+  the log, the driver switches to the file the Rotate_event names, or to
+  the next file of the list if the file has none, and continues with the
+  Format_description_event of that file. The next file is opened while the
+  current one is still being read, so that its first blocks have already
+  been read ahead when the switch happens. The list of files is read again
+  when the file to switch to is not in it, to pick up files which have
+  been added since connect().
+
+  get_position() and file_size() refer to the file being read. The name
+  given to the constructor is the name of the index file or directory.
+*/
+class Binlog_sequence_driver
+  : public Binary_log_driver
+{
+public:
+  template <class TFilename>
+  Binlog_sequence_driver(const TFilename& index = TFilename(),
+                         unsigned int offset = 0)
+    : Binary_log_driver(index, offset), m_index_path(index), m_current(0),
+      m_driver(NULL), m_next_driver(NULL), m_checksum_len(0),
+      m_server_id(0), m_fde_seen(false)
+  {
+  }
+
+  ~Binlog_sequence_driver()
+  {
+    disconnect();
+  }
+
+  /**
+    Reads the list of files and starts reading at the beginning of
+    the first one.
+  */
+  int connect();
+
+  /**
+    Reads the list of files and starts reading at the given position
+    of one of them.
+  */
+  int connect(const std::string &filename, unsigned long offset);
+  int disconnect();
+
+  /**
+    Moves to a position of a file in the sequence, which may be given
+    either with its full path or with its base name.
+  */
+  int set_position(const std::string &str, unsigned long position);
+  int get_position(std::string *str, unsigned long *position);
+
+  /**
+    Fetches the next event, moving to the next file of the sequence
+    when the current one is exhausted.
+
+    @retval ERR_OK   The pair points to the next event
+    @retval ERR_EOF  All the files of the sequence have been read
+    @retval ERR_FAIL A file could not be read
+  */
+  int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+
+  /**
+    Returns the size of the binlog file currently being read
+
+    @retval   size of file
+  */
+  size_t file_size() const;
+
+  /**
+    The files of the sequence, as found by the last connect() or
+    the last time the end of the sequence was reached.
+  */
+  const std::vector<std::string> &files() const { return m_files; }
+
+  /**
+    Restricts a directory to the files of a base name, e.g. "binlog" for
+    binlog.000001, binlog.000002, ..., when it also holds the files of
+    other logs, like the relay logs of the server. Takes effect at the
+    next connect().
+  */
+  void set_base_name(const std::string &base_name) { m_base_name= base_name; }
+
+private:
+  int load_file_list();
+  int find_file(const std::string &name, size_t *index) const;
+  int open_file(size_t index, unsigned long position);
+  int open_next_file();
+  void prefetch_next_file();
+  void check_rotate(const unsigned char *event, size_t length);
+
+  /** Index file or directory which lists the files */
+  std::string m_index_path;
+  std::vector<std::string> m_files;
+  /** Index of the file being read in m_files */
+  size_t m_current;
+  /** Driver of the file being read */
+  Binlog_readahead_driver *m_driver;
+  /** Driver of the next file, connected ahead of time */
+  Binlog_readahead_driver *m_next_driver;
+  /** Base name given with set_base_name() */
+  std::string m_base_name;
+  /** Base name the files of a directory are filtered with */
+  std::string m_log_base_name;
+
+  /** Checksum length of the events, from the FDE of the current file */
+  unsigned int m_checksum_len;
+  /** Server id of the FDE, to tell own Rotate_events from relayed ones */
+  uint32_t m_server_id;
+  /** Whether the first FDE of the current file has been read */
+  bool m_fde_seen;
+  /** Base name of the file named by the last Rotate_event, read next */
+  std::string m_rotate_to;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
+
+#endif	/* SEQUENCE_DRIVER_INCLUDED */
@@ -0,0 +1,160 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#ifndef TAIL_DRIVER_INCLUDED
+#define	TAIL_DRIVER_INCLUDED
+
+#include "binlog_driver.h"
+#include <string>
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+namespace binary_log {
+namespace system {
+
+/**
+  @class Binlog_tail_driver
+
+  A file driver which follows a binary log while the server is writing it,
+  like <code>tail -f</code>.
+
+  When the end of the file is reached, get_next_event() blocks on an
+  inotify descriptor until more bytes are appended, instead of returning
+  ERR_EOF. An event which has only partially been written is not returned
+  until it is complete.
+
+  When a Rotate_event written by the server which owns the file is
+  returned, the next call to get_next_event() continues with the file the
+  event names, waiting for it to be created if needed. If the server stops
+  without writing a Rotate_event, the driver moves on to the file with the
+  next sequence number once that file appears and nothing more is written
+  to the current one.
+
+  With follow mode off, the driver reads the file up to its current end
+  and returns ERR_EOF, as Binlog_file_driver does. The driver keeps track
+  of the position of the next event itself, so there is no need to call
+  update_pos() after decoding an event.
+*/
+class Binlog_tail_driver
+  : public Binary_log_driver
+{
+public:
+  template <class TFilename>
+  Binlog_tail_driver(const TFilename& filename = TFilename(),
+                     unsigned int offset = 0, bool follow= true)
+    : Binary_log_driver(filename, offset), m_fd(-1), m_inotify_fd(-1),
+      m_file_wd(-1), m_dir_wd(-1), m_file_size(0), m_bytes_read(0),
+      m_magic_checked(false), m_fde_pending(false), m_follow(follow),
+      m_wait_timeout(-1), m_checksum_len(0), m_server_id(0), m_fde_seen(false),
+      m_buf_size(0)
+  {
+  }
+
+  ~Binlog_tail_driver()
+  {
+    disconnect();
+  }
+
+  int connect();
+  int connect(const std::string &filename, unsigned long offset);
+  int disconnect();
+  int set_position(const std::string &str, unsigned long position);
+  int get_position(std::string *str, unsigned long *position);
+
+  /**
+    Fetches the next complete event of the binary log, waiting for it to
+    be written in follow mode.
+
+    @retval ERR_OK   The pair points to the next event
+    @retval ERR_EOF  The end of the file has been reached and follow mode
+                     is off, or the wait timeout expired
+    @retval ERR_FAIL The file could not be read or is not a binlog file
+  */
+  int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+
+  /**
+    Returns the size of the binlog file currently being read, as last
+    seen by the driver
+
+    @retval   size of file
+  */
+  size_t file_size() const;
+
+  void set_follow(bool follow) { m_follow= follow; }
+  bool get_follow() const { return m_follow; }
+
+  /**
+    Sets how long get_next_event() waits for new data before returning
+    ERR_EOF, in milliseconds. A negative value, the default, waits forever.
+  */
+  void set_wait_timeout(int timeout_ms) { m_wait_timeout= timeout_ms; }
+
+private:
+  int open_file(const std::string &filename, bool wait);
+  void close_file();
+  int refresh_size();
+  int wait_for_bytes(unsigned long end);
+  int wait_for_change();
+  std::string next_file_name() const;
+  bool file_exists(const std::string &filename) const;
+  int reserve_buf(size_t size);
+
+  int m_fd;
+  int m_inotify_fd;
+  /** Watch for writes to the current file */
+  int m_file_wd;
+  /** Watch for files created in the directory of the current file */
+  int m_dir_wd;
+
+  /** Size of the file when it was last checked */
+  unsigned long m_file_size;
+  /** Offset of the next event to be returned by get_next_event() */
+  unsigned long m_bytes_read;
+  bool m_magic_checked;
+  /**
+    Set when reading starts in the middle of a file, in which case the
+    Format_description_event at offset 4 is returned first.
+  */
+  bool m_fde_pending;
+  bool m_follow;
+  int m_wait_timeout;
+
+  /** Checksum length of the events, from the FDE of the current file */
+  unsigned int m_checksum_len;
+  /**
+    Server id of the first FDE of the current file, to tell its own
+    Rotate_events from the relayed ones
+  */
+  uint32_t m_server_id;
+  /** Whether the first FDE of the current file has been read */
+  bool m_fde_seen;
+  /** File named by the last Rotate_event, to be opened next */
+  std::string m_rotate_to;
+
+  /** Allocated size of the inherited buf */
+  size_t m_buf_size;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_SYS_INOTIFY_H */
+
+#endif	/* TAIL_DRIVER_INCLUDED */
@@ -23,6 +23,7 @@
 
 #include "binlog.h"
 #include "binlog_driver.h"
+#include "gtid_set.h"
 #include <my_global.h>
 #include <mysql.h>
 #ifdef min // need not check for max, checking one is fine
@@ -33,6 +34,12 @@
 #include <cstring>
 #include <map>
 #define MAX_PACKAGE_SIZE 0xffffff
+/** Default time the results of the metadata queries are reused, in ms */
+#define TCP_METADATA_TTL 1000
+/** Default delay before the second reconnect attempt, in ms */
+#define TCP_RECONNECT_DELAY 100
+/** Default longest delay between two reconnect attempts, in ms */
+#define TCP_RECONNECT_MAX_DELAY 30000
 
 
 namespace binary_log { namespace system {
@@ -44,14 +51,24 @@ public:
     Binlog_tcp_driver(const std::string& user, const std::string& passwd,
                       const std::string& host, uint port)
     : Binary_log_driver("", 4), m_user(user), m_passwd(passwd), m_host(host),
-      m_port(port), m_shutdown(false), m_total_bytes_transferred(0)
+      m_port(port), m_shutdown(false), m_zero_copy(false), m_stream_checksum(false),
+      m_mysql(NULL),
+      m_total_bytes_transferred(0), m_control(NULL),
+      m_metadata_ttl(TCP_METADATA_TTL), m_binlog_map_expiry(0),
+      m_master_status_expiry(0), m_master_position(0),
+      m_reconnect_attempts(0), m_reconnect_delay(TCP_RECONNECT_DELAY),
+      m_reconnect_max_delay(TCP_RECONNECT_MAX_DELAY),
+      m_resume_at_transaction(false), m_aborted(false),
+      m_reconnect_failures(0), m_reconnect_count(0), m_gtid_mode(false),
+      m_in_transaction(false), m_trx_begun(false), m_trx_offset(4), m_pending_gno(0)
     {
     }
 
     ~Binlog_tcp_driver()
     {
-      if (!m_shutdown)
+      if (!m_shutdown && m_mysql)
         mysql_close(m_mysql);
+      close_control();
     }
 
 
@@ -64,11 +81,23 @@ public:
      * start reading from the binlog_file where starting_pos= offset
      */
     int connect(const std::string &binlog_filename, unsigned long offset);
+    /**
+     * Connect using previously declared connection parameters, and
+     * start reading from the first transaction which is not in gtids,
+     * with COM_BINLOG_DUMP_GTID. The server finds the binlog file, so no
+     * position is needed; it must run with GTID_MODE=ON.
+     */
+    int connect(const Gtid_set &gtids);
 
     /**
      * Reconnects to the master with a new binlog dump request.
      */
     int set_position(const std::string &str, unsigned long position);
+    /**
+     * Reconnects to the master with a new GTID binlog dump request, which
+     * skips the transactions in gtids.
+     */
+    int set_position(const Gtid_set &gtids);
     /**
      * Disconnect from the server. The io service must have been stopped before
      * this function is called.
@@ -81,15 +110,115 @@ public:
      @param   buffer_buflen  It stores the buffer and the buffer_len in a C++ pair
      @retval  0              Success
               >0             Error code
+
+     In zero-copy mode the buffer points into the network buffer of the
+     client library. It is only valid until the next call to any method of
+     the driver, since the next read reuses the network buffer. Use
+     retain_event() to keep an event longer.
     */
     int get_next_event(std::pair<unsigned char *, size_t> *buffer_buflen);
+    /**
+     Gets the next event in an Event_buffer, see
+     Binary_log_driver::get_next_event_buffer(). The event is copied once,
+     out of the network buffer of the client library which the next read
+     reuses, instead of through the driver buffer.
+    */
+    int get_next_event_buffer(Event_buffer **buffer, size_t *length);
+
+    /**
+     Sets whether get_next_event() returns events directly out of the
+     network buffer instead of copying every packet into the driver buffer.
+    */
+    void set_zero_copy(bool zero_copy) { m_zero_copy= zero_copy; }
+    bool zero_copy() const { return m_zero_copy; }
+
+    /**
+     Sets whether the driver asks for the checksum algorithm of the binlog
+     of the server rather than none, from the next connection on.
+
+     The events of the binlog keep their checksums either way, but the
+     events the server makes up for the stream, like the first
+     Rotate_event and the Heartbeat_log_events, only have one when asked
+     for. With it, every event of the stream can be verified, with the
+     crc_check of Decoder::decode_event().
+    */
+    void set_stream_checksum(bool checksum) { m_stream_checksum= checksum; }
+    bool stream_checksum() const { return m_stream_checksum; }
+
+    /**
+     Shuts the socket down, so that a get_next_event() call blocked in
+     another thread returns with an error.
+    */
+    void abort_read();
+
+    /**
+     Enables the automatic reconnection of get_next_event() when the
+     connection to the server is lost.
+
+     The first attempt is immediate. The following ones wait delay ms,
+     doubled after every failed attempt up to max_delay ms. get_next_event()
+     returns an error after attempts failed attempts in a row.
+
+     The stream resumes after the last event returned, or at the last
+     transaction boundary, see set_resume_at_transaction(). A driver
+     connected with a Gtid_set always resumes with the GTIDs of the
+     transactions it has returned completely, so at a transaction boundary.
+     The server starts the resumed stream with a Rotate_event and a
+     Format_description_event, as for a new connection.
+
+     @param attempts   Attempts in a row before giving up, 0 disables
+                       reconnection
+    */
+    void set_auto_reconnect(unsigned int attempts,
+                            unsigned long delay= TCP_RECONNECT_DELAY,
+                            unsigned long max_delay= TCP_RECONNECT_MAX_DELAY)
+    {
+      m_reconnect_attempts= attempts;
+      m_reconnect_delay= delay;
+      m_reconnect_max_delay= max_delay;
+    }
+    unsigned int auto_reconnect() const { return m_reconnect_attempts; }
+
+    /**
+     Sets whether a reconnection resumes at the start of the interrupted
+     transaction instead of after the last event returned. The events of
+     the transaction are then returned again, for consumers which drop an
+     incomplete transaction.
+    */
+    void set_resume_at_transaction(bool resume)
+    { m_resume_at_transaction= resume; }
+    bool resume_at_transaction() const { return m_resume_at_transaction; }
+
+    /** Returns the number of successful automatic reconnections */
+    unsigned long reconnect_count() const { return m_reconnect_count; }
 
     /**
      * Get the file size of Binary Log file.
      * @retval   Size of file
      */
     size_t file_size() const;
+    /**
+     * Get the position following the last event returned by
+     * get_next_event(), which is tracked from the events without asking
+     * the server. The file name is empty until the server sends the first
+     * Rotate_event, when no file was given to connect().
+     */
     int get_position(std::string *str, unsigned long *position);
+    /**
+     * Get the position the server is writing at, from SHOW MASTER STATUS.
+     */
+    int get_master_position(std::string *str, unsigned long *position);
+
+    /**
+     Sets how long the results of SHOW BINARY LOGS and SHOW MASTER STATUS
+     are reused by set_position(), get_master_position() and file_size(),
+     in milliseconds. 0 queries the server on every call.
+
+     The queries run on a control connection of the driver, which is
+     opened on first use and kept until disconnect().
+    */
+    void set_metadata_ttl(unsigned long msec) { m_metadata_ttl= msec; }
+    unsigned long metadata_ttl() const { return m_metadata_ttl; }
     const std::string& user() const { return m_user; }
     const std::string& password() const { return m_passwd; }
     const std::string& host() const { return m_host; }
@@ -116,6 +245,7 @@ protected:
 
 private:
     void start_binlog_dump(const char *binlog, size_t offset);
+    int start_binlog_dump_gtid(const Gtid_set &gtids);
     void start_event_loop(void);
 
     /**
@@ -129,6 +259,28 @@ private:
      */
     void shutdown(void);
 
+    /**
+     * Returns the control connection, connecting it if needed.
+     */
+    MYSQL *control_connection() const;
+    /** Closes the connection the events are read from */
+    void close_stream();
+    /**
+     Reads the next event into the network buffer, reconnecting if needed,
+     and tracks the position of the stream.
+     @param[out] event      The event, in the network buffer
+     @param[out] event_len  The length of the event
+    */
+    int read_event(unsigned char **event, size_t *event_len);
+    int connect_gtid(const Gtid_set &gtids);
+    void start_tracking(bool gtid_mode);
+    bool is_connection_error();
+    int resume_stream();
+    bool track_transaction(const unsigned char *event, size_t length);
+    void close_control() const;
+    int refresh_binlog_map(bool force) const;
+    int refresh_master_status(bool force) const;
+
     /**
      * each bin log event starts with a 19 byte long header
      * We use this sturcture every time we initiate an async
@@ -162,8 +314,49 @@ private:
 
     bool m_shutdown;
 
+    /** Return events from the network buffer, see set_zero_copy() */
+    bool m_zero_copy;
+    /** Ask for the checksums of the binlog, see set_stream_checksum() */
+    bool m_stream_checksum;
+
     MYSQL *m_mysql;
     uint64_t m_total_bytes_transferred;
+
+    /** Connection for the metadata queries, NULL until needed */
+    mutable MYSQL *m_control;
+    unsigned long m_metadata_ttl;
+    /** Cached SHOW BINARY LOGS, valid until m_binlog_map_expiry */
+    mutable std::map<std::string, unsigned long> m_binlog_map;
+    mutable unsigned long long m_binlog_map_expiry;
+    /** Cached SHOW MASTER STATUS, valid until m_master_status_expiry */
+    mutable unsigned long long m_master_status_expiry;
+    mutable std::string m_master_file;
+    mutable unsigned long m_master_position;
+
+    /** Reconnect policy, see set_auto_reconnect() */
+    unsigned int m_reconnect_attempts;
+    unsigned long m_reconnect_delay;
+    unsigned long m_reconnect_max_delay;
+    bool m_resume_at_transaction;
+    /** Set by abort_read(), the stream must not be resumed */
+    bool m_aborted;
+    /** Reconnect attempts since the last event read */
+    unsigned int m_reconnect_failures;
+    unsigned long m_reconnect_count;
+
+    /** Set when streaming by GTID, m_gtids then holds what was received */
+    bool m_gtid_mode;
+    Gtid_set m_gtids;
+    /** Whether the last event returned is inside a transaction */
+    bool m_in_transaction;
+    /** Whether the transaction started with a BEGIN */
+    bool m_trx_begun;
+    /** End of the last transaction returned completely */
+    std::string m_trx_file;
+    unsigned long m_trx_offset;
+    /** GTID of the transaction being returned, if any */
+    unsigned char m_pending_sid[16];
+    int64_t m_pending_gno;
 };
 
 /**
@@ -175,12 +368,19 @@ private:
 bool fetch_master_status(MYSQL *mysql, std::string *filename,
                          unsigned long *position);
 
+/**
+ * Sends a SHOW BINARY LOGS command to the server and retrieves the names
+ * and the sizes of its binlog files.
+ *
+ * @return False if the operation succeeded, true if it failed.
+ */
 bool fetch_binlog_name_and_size(MYSQL *mysql, std::map<std::string, unsigned long> *binlog_map);
 
 int sync_connect_and_authenticate(MYSQL *mysql, const std::string &user,
                                   const std::string &passwd,
                                   const std::string &host, uint port,
-                                  long offset= 4);
+                                  long offset= 4,
+                                  bool stream_checksum= false);
 } }
 
 
@@ -20,10 +20,24 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include "access_method_factory.h"
 #include "tcp_driver.h"
 #include "file_driver.h"
+#include "mmap_driver.h"
+#include "readahead_driver.h"
+#include "sequence_driver.h"
+#include "tail_driver.h"
 
 using binary_log::system::Binary_log_driver;
 using binary_log::system::Binlog_tcp_driver;
 using binary_log::system::Binlog_file_driver;
+#ifdef HAVE_SYS_MMAN_H
+using binary_log::system::Binlog_mmap_driver;
+#endif
+#ifdef HAVE_PTHREAD_H
+using binary_log::system::Binlog_readahead_driver;
+using binary_log::system::Binlog_sequence_driver;
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+using binary_log::system::Binlog_tail_driver;
+#endif
 
 /**
    Parse the body of a MySQL URI.
@@ -99,6 +113,85 @@ static Binary_log_driver *parse_file_url(const char *body, size_t length)
   return new Binlog_file_driver(body + 2);
 }
 
+#ifdef HAVE_SYS_MMAN_H
+/**
+   Parse the body of a memory mapped file URI.
+
+   The format is the same as for the file URI, <code>///path</code>
+*/
+static Binary_log_driver *parse_mmap_url(const char *body, size_t length)
+{
+  /* Find the beginning of the file name */
+  if (strncmp(body, "//", 2) != 0)
+    return 0;
+
+  /* Host information is not supported, just like for file URIs */
+  if (body[2] != '/')
+    return 0;
+
+  return new Binlog_mmap_driver(body + 2);
+}
+#endif
+
+#ifdef HAVE_PTHREAD_H
+/**
+   Parse the body of a read-ahead file URI.
+
+   The format is the same as for the file URI, <code>///path</code>
+*/
+static Binary_log_driver *parse_readahead_url(const char *body, size_t length)
+{
+  /* Find the beginning of the file name */
+  if (strncmp(body, "//", 2) != 0)
+    return 0;
+
+  /* Host information is not supported, just like for file URIs */
+  if (body[2] != '/')
+    return 0;
+
+  return new Binlog_readahead_driver(body + 2);
+}
+
+/**
+   Parse the body of a binlog sequence URI.
+
+   The format is the same as for the file URI, <code>///path</code>, where
+   the path is either a binlog index file or a directory.
+*/
+static Binary_log_driver *parse_sequence_url(const char *body, size_t length)
+{
+  /* Find the beginning of the file name */
+  if (strncmp(body, "//", 2) != 0)
+    return 0;
+
+  /* Host information is not supported, just like for file URIs */
+  if (body[2] != '/')
+    return 0;
+
+  return new Binlog_sequence_driver(body + 2);
+}
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+/**
+   Parse the body of a binlog tail URI.
+
+   The format is the same as for the file URI, <code>///path</code>
+*/
+static Binary_log_driver *parse_tail_url(const char *body, size_t length)
+{
+  /* Find the beginning of the file name */
+  if (strncmp(body, "//", 2) != 0)
+    return 0;
+
+  /* Host information is not supported, just like for file URIs */
+  if (body[2] != '/')
+    return 0;
+
+  return new Binlog_tail_driver(body + 2);
+}
+#endif
+
 /**
    URI parser information.
  */
@@ -113,6 +206,16 @@ struct Parser {
 static Parser url_parser[] = {
   { "mysql", parse_mysql_url },
   { "file",  parse_file_url },
+#ifdef HAVE_SYS_MMAN_H
+  { "mmap",  parse_mmap_url },
+#endif
+#ifdef HAVE_PTHREAD_H
+  { "readahead",  parse_readahead_url },
+  { "sequence",  parse_sequence_url },
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+  { "tail",  parse_tail_url },
+#endif
 };
 
 Binary_log_driver *
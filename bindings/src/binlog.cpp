@@ -64,6 +64,23 @@ const char* str_error(int error_no)
    return msg;
 }
 
+int Binary_log_driver::get_next_event_buffer(Event_buffer **buffer,
+                                             size_t *length)
+{
+  std::pair<unsigned char *, size_t> buffer_buflen;
+  int error= get_next_event(&buffer_buflen);
+  if (error != ERR_OK)
+    return error;
+  Event_buffer *next= Event_buffer::reuse(*buffer, buffer_buflen.second + 1);
+  *buffer= next;
+  if (!next)
+    return ERR_FAIL;
+  memcpy(next->data(), buffer_buflen.first, buffer_buflen.second);
+  next->data()[buffer_buflen.second]= 0;
+  *length= buffer_buflen.second;
+  return ERR_OK;
+}
+
 Binary_log::Binary_log(Binary_log_driver *drv) : m_binlog_position(4),
                                                  m_binlog_file("")
 {
@@ -95,6 +112,51 @@ int Binary_log::set_position(unsigned long position)
   return this->set_position(filename, position);
 }
 
+/**
+  Loads the sidecar index of a binlog file, or builds the index when there
+  is no sidecar, or when the file has changed since the sidecar was saved.
+  A built index is saved for the next seek; failing to write the sidecar,
+  e.g. in a read-only directory, does not fail the seek.
+*/
+int Binary_log::load_index(const std::string &filename, Binlog_index *index)
+{
+  std::string sidecar= Binlog_index::sidecar_name(filename);
+  if (index->load(sidecar) == ERR_OK && !index->is_stale(filename))
+    return ERR_OK;
+  int status= index->build(filename);
+  if (status == ERR_OK)
+    index->save(sidecar);
+  return status;
+}
+
+int Binary_log::set_position_by_time(time_t when)
+{
+  std::string filename;
+  unsigned long position;
+  Binlog_index index;
+  m_driver->get_position(&filename, NULL);
+  int status= load_index(filename, &index);
+  if (status == ERR_OK)
+    status= index.find_time(filename, when, &position);
+  if (status == ERR_OK)
+    status= set_position(filename, position);
+  return status;
+}
+
+int Binary_log::set_position_by_gtid(const std::string &gtid)
+{
+  std::string filename;
+  unsigned long position;
+  Binlog_index index;
+  m_driver->get_position(&filename, NULL);
+  int status= load_index(filename, &index);
+  if (status == ERR_OK)
+    status= index.find_gtid(filename, gtid, &position);
+  if (status == ERR_OK)
+    status= set_position(filename, position);
+  return status;
+}
+
 unsigned long Binary_log::get_position(void)
 {
   return m_binlog_position;
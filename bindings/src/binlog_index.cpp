@@ -0,0 +1,438 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "binlog_index.h"
+#include <fstream>
+#include <stdlib.h>
+#include <strings.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "BLIX"
+#define INDEX_VERSION 2
+/** Position of the GTID in the post-header of a Gtid_event */
+#define GTID_SID_OFFSET (LOG_EVENT_MINIMAL_HEADER_LEN + 1)
+#define GTID_GNO_OFFSET (GTID_SID_OFFSET + 16)
+
+namespace binary_log {
+
+/**
+  @class Transaction_scanner
+
+  Reads the events of a binlog file sequentially and reports where the
+  transactions start.
+
+  A transaction starts with a Gtid_event, or else with the first event
+  following the end of the previous transaction. It ends with an
+  Xid_event, a COMMIT or ROLLBACK query, or with its only query when it
+  does not begin with BEGIN, as for DDL.
+*/
+class Transaction_scanner
+{
+public:
+  Transaction_scanner() : m_pos(0), m_in_trx(false), m_begin_seen(false) {}
+
+  /**
+    Opens a binlog file and prepares to read from start, which must be
+    the start of a transaction.
+
+    @param fde  If not empty, the FDE the file is expected to have
+  */
+  int open(const std::string &binlog_file, const std::vector<char> &fde,
+           unsigned long start)
+  {
+    unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+    char magic_buf[BIN_LOG_HEADER_SIZE];
+
+    m_file.open(binlog_file.c_str(), std::ios::in | std::ios::binary);
+    if (!m_file.read(magic_buf, BIN_LOG_HEADER_SIZE) ||
+        memcmp(magic, magic_buf, BIN_LOG_HEADER_SIZE))
+      return ERR_FAIL;                          // Not a valid binlog file.
+
+    m_pos= BIN_LOG_HEADER_SIZE;
+    if (read_event() != ERR_OK)
+      return ERR_FAIL;
+    if (m_buf[EVENT_TYPE_OFFSET] != FORMAT_DESCRIPTION_EVENT)
+      return ERR_BINLOG_VERSION;
+    m_fde.assign(m_buf.begin(), m_buf.end());
+    if (!fde.empty() && fde != m_fde)
+      return ERR_FAIL;                          // Not the indexed file
+
+    const char *error= NULL;
+    m_buf.push_back(0);
+    delete m_decoder.decode_event(&m_buf[0], m_fde.size(), &error, false);
+
+    if (start > BIN_LOG_HEADER_SIZE)
+    {
+      m_file.seekg(start);
+      m_pos= start;
+    }
+    m_in_trx= false;
+    m_begin_seen= false;
+    return m_file ? ERR_OK : ERR_FAIL;
+  }
+
+  /**
+    Reads events up to the start of the next transaction.
+
+    @retval ERR_OK   entry describes the transaction start
+    @retval ERR_EOF  There are no more complete events
+  */
+  int next_start(Binlog_index_entry *entry)
+  {
+    while (true)
+    {
+      unsigned long offset= m_pos;
+      if (read_event() != ERR_OK)
+        return ERR_EOF;
+
+      unsigned char type= m_buf[EVENT_TYPE_OFFSET];
+      switch (type)
+      {
+      case FORMAT_DESCRIPTION_EVENT:
+      case PREVIOUS_GTIDS_LOG_EVENT:
+      case ROTATE_EVENT:
+      case STOP_EVENT:
+      case INCIDENT_EVENT:
+      case HEARTBEAT_LOG_EVENT:
+        continue;
+      default:
+        break;
+      }
+
+      bool is_start= !m_in_trx || type == GTID_LOG_EVENT ||
+                     type == ANONYMOUS_GTID_LOG_EVENT;
+      if (is_start)
+      {
+        uint32_t timestamp;
+        memcpy(&timestamp, &m_buf[0], 4);
+        entry->offset= offset;
+        entry->timestamp= le32toh(timestamp);
+        entry->max_timestamp= entry->timestamp;
+        entry->flags= 0;
+        entry->gno= 0;
+        memset(entry->sid, 0, sizeof(entry->sid));
+        if (type == GTID_LOG_EVENT && m_buf.size() >= GTID_GNO_OFFSET + 8)
+        {
+          int64_t gno;
+          memcpy(entry->sid, &m_buf[GTID_SID_OFFSET], sizeof(entry->sid));
+          memcpy(&gno, &m_buf[GTID_GNO_OFFSET], 8);
+          entry->gno= le64toh(gno);
+          entry->flags|= Binlog_index_entry::HAS_GTID;
+        }
+        m_in_trx= true;
+        m_begin_seen= false;
+      }
+
+      if (type == XID_EVENT)
+        m_in_trx= false;
+      else if (type == QUERY_EVENT)
+      {
+        std::string query= query_text();
+        if (query == "BEGIN")
+          m_begin_seen= true;
+        else if (!m_begin_seen || query == "ROLLBACK" ||
+                 strncasecmp(query.c_str(), "COMMIT", 6) == 0)
+          m_in_trx= false;
+      }
+
+      if (is_start)
+        return ERR_OK;
+    }
+  }
+
+  const std::vector<char> &fde() const { return m_fde; }
+
+  /** Offset following the last event read */
+  unsigned long position() const { return m_pos; }
+
+private:
+  /** Reads the event at m_pos into m_buf */
+  int read_event()
+  {
+    m_buf.resize(LOG_EVENT_MINIMAL_HEADER_LEN);
+    if (!m_file.read(&m_buf[0], LOG_EVENT_MINIMAL_HEADER_LEN))
+      return ERR_EOF;
+    uint32_t data_len;
+    memcpy(&data_len, &m_buf[EVENT_LEN_OFFSET], 4);
+    data_len= le32toh(data_len);
+    if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN)
+      return ERR_FAIL;
+    m_buf.resize(data_len);
+    if (data_len > LOG_EVENT_MINIMAL_HEADER_LEN &&
+        !m_file.read(&m_buf[LOG_EVENT_MINIMAL_HEADER_LEN],
+                     data_len - LOG_EVENT_MINIMAL_HEADER_LEN))
+      return ERR_EOF;                           // Partially written event
+    m_pos+= data_len;
+    return ERR_OK;
+  }
+
+  std::string query_text()
+  {
+    const char *error= NULL;
+    size_t event_len= m_buf.size();
+    m_buf.push_back(0);
+    Binary_log_event *ev= m_decoder.decode_event(&m_buf[0], event_len,
+                                                 &error, false);
+    std::string query;
+    if (ev && ev->get_event_type() == QUERY_EVENT)
+    {
+      Query_event *qev= static_cast<Query_event*>(ev);
+      if (qev->query)
+        query.assign(qev->query, qev->q_len);
+    }
+    delete ev;
+    m_buf.pop_back();
+    return query;
+  }
+
+  std::ifstream m_file;
+  Decoder m_decoder;
+  std::vector<char> m_fde;
+  std::vector<char> m_buf;
+  unsigned long m_pos;
+  bool m_in_trx;
+  bool m_begin_seen;
+};
+
+int Binlog_index::build(const std::string &binlog_file,
+                        unsigned long interval)
+{
+  Transaction_scanner scanner;
+  int error= scanner.open(binlog_file, std::vector<char>(),
+                          BIN_LOG_HEADER_SIZE);
+  if (error != ERR_OK)
+    return error;
+
+  m_fde= scanner.fde();
+  m_entries.clear();
+
+  Binlog_index_entry entry;
+  unsigned long long next_sample= 0;
+  while (scanner.next_start(&entry) == ERR_OK)
+  {
+    if (entry.offset >= next_sample)
+    {
+      m_entries.push_back(entry);
+      next_sample= entry.offset + interval;
+    }
+    else if (entry.timestamp > m_entries.back().max_timestamp)
+      m_entries.back().max_timestamp= entry.timestamp;
+  }
+  m_binlog_size= scanner.position();
+  return ERR_OK;
+}
+
+/*
+  Converting from host to little-endian order swaps the same bytes as
+  converting from little-endian to host order, so le*toh() serve both ways.
+*/
+static void write_int4(std::ofstream &out, uint32_t value)
+{
+  value= le32toh(value);
+  out.write((const char*) &value, 4);
+}
+
+static void write_int8(std::ofstream &out, uint64_t value)
+{
+  value= le64toh(value);
+  out.write((const char*) &value, 8);
+}
+
+static bool read_int4(std::ifstream &in, uint32_t *value)
+{
+  if (!in.read((char*) value, 4))
+    return false;
+  *value= le32toh(*value);
+  return true;
+}
+
+static bool read_int8(std::ifstream &in, uint64_t *value)
+{
+  if (!in.read((char*) value, 8))
+    return false;
+  *value= le64toh(*value);
+  return true;
+}
+
+int Binlog_index::save(const std::string &index_file) const
+{
+  std::ofstream out(index_file.c_str(),
+                    std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out)
+    return ERR_FAIL;
+
+  out.write(INDEX_MAGIC, 4);
+  write_int4(out, INDEX_VERSION);
+  write_int8(out, m_binlog_size);
+  write_int4(out, m_fde.size());
+  if (!m_fde.empty())
+    out.write(&m_fde[0], m_fde.size());
+  write_int4(out, m_entries.size());
+  for (size_t i= 0; i < m_entries.size(); i++)
+  {
+    const Binlog_index_entry &entry= m_entries[i];
+    write_int8(out, entry.offset);
+    write_int4(out, entry.timestamp);
+    write_int4(out, entry.max_timestamp);
+    write_int4(out, entry.flags);
+    out.write((const char*) entry.sid, sizeof(entry.sid));
+    write_int8(out, entry.gno);
+  }
+  out.close();
+  return out ? ERR_OK : ERR_FAIL;
+}
+
+int Binlog_index::load(const std::string &index_file)
+{
+  std::ifstream in(index_file.c_str(), std::ios::in | std::ios::binary);
+  char magic[4];
+  uint32_t version, fde_len, count;
+  uint64_t binlog_size;
+
+  if (!in.read(magic, 4) || memcmp(magic, INDEX_MAGIC, 4) ||
+      !read_int4(in, &version) || version != INDEX_VERSION ||
+      !read_int8(in, &binlog_size) || !read_int4(in, &fde_len) ||
+      fde_len < LOG_EVENT_MINIMAL_HEADER_LEN)
+    return ERR_FAIL;
+
+  std::vector<char> fde(fde_len);
+  if (!in.read(&fde[0], fde_len) || !read_int4(in, &count))
+    return ERR_FAIL;
+
+  std::vector<Binlog_index_entry> entries(count);
+  for (uint32_t i= 0; i < count; i++)
+  {
+    Binlog_index_entry &entry= entries[i];
+    uint64_t offset, gno;
+    if (!read_int8(in, &offset) || !read_int4(in, &entry.timestamp) ||
+        !read_int4(in, &entry.max_timestamp) ||
+        !read_int4(in, &entry.flags) ||
+        !in.read((char*) entry.sid, sizeof(entry.sid)) ||
+        !read_int8(in, &gno))
+      return ERR_FAIL;
+    entry.offset= offset;
+    entry.gno= gno;
+  }
+
+  m_binlog_size= binlog_size;
+  m_fde.swap(fde);
+  m_entries.swap(entries);
+  return ERR_OK;
+}
+
+bool Binlog_index::is_stale(const std::string &binlog_file) const
+{
+  struct stat stat_buff;
+  return stat(binlog_file.c_str(), &stat_buff) == -1 ||
+         (unsigned long long) stat_buff.st_size != m_binlog_size;
+}
+
+int Binlog_index::find_time(const std::string &binlog_file, time_t when,
+                            unsigned long *position) const
+{
+  /*
+    The transaction is in the interval of the first entry whose latest
+    timestamp is at or after when, whatever the order of the timestamps.
+    If there is none, it may have been written after the file was
+    indexed, so the last interval is read up to the end of the file.
+  */
+  size_t first= 0;
+  while (first < m_entries.size() &&
+         (time_t) m_entries[first].max_timestamp < when)
+    first++;
+  if (first == m_entries.size() && first > 0)
+    first--;
+  unsigned long start= m_entries.empty() ? BIN_LOG_HEADER_SIZE :
+                                           m_entries[first].offset;
+
+  Transaction_scanner scanner;
+  int error= scanner.open(binlog_file, m_fde, start);
+  if (error != ERR_OK)
+    return ERR_FAIL;
+
+  Binlog_index_entry entry;
+  while ((error= scanner.next_start(&entry)) == ERR_OK)
+  {
+    if ((time_t) entry.timestamp >= when)
+    {
+      *position= entry.offset;
+      return ERR_OK;
+    }
+  }
+  return error;
+}
+
+int Binlog_index::find_gtid(const std::string &binlog_file,
+                            const std::string &gtid,
+                            unsigned long *position) const
+{
+  size_t colon= gtid.find(':');
+  if (colon == std::string::npos || colon + 1 == gtid.size())
+    return ERR_FAIL;
+  Uuid sid;
+  if (sid.parse(gtid.substr(0, colon).c_str()))
+    return ERR_FAIL;
+  char *end;
+  long long gno= strtoll(gtid.c_str() + colon + 1, &end, 10);
+  if (*end != '\0' || gno <= 0)
+    return ERR_FAIL;
+
+  /*
+    The GNOs of a server grow along the file, so the transaction is after
+    the last entry of the same server with a smaller or equal GNO.
+  */
+  unsigned long start= BIN_LOG_HEADER_SIZE;
+  for (size_t i= 0; i < m_entries.size(); i++)
+  {
+    const Binlog_index_entry &entry= m_entries[i];
+    if ((entry.flags & Binlog_index_entry::HAS_GTID) &&
+        !memcmp(entry.sid, sid.bytes, sizeof(entry.sid)))
+    {
+      if (entry.gno > gno)
+        break;
+      start= entry.offset;
+    }
+  }
+
+  Transaction_scanner scanner;
+  int error= scanner.open(binlog_file, m_fde, start);
+  if (error != ERR_OK)
+    return ERR_FAIL;
+
+  Binlog_index_entry entry;
+  while ((error= scanner.next_start(&entry)) == ERR_OK)
+  {
+    if ((entry.flags & Binlog_index_entry::HAS_GTID) &&
+        !memcmp(entry.sid, sid.bytes, sizeof(entry.sid)))
+    {
+      if (entry.gno == gno)
+      {
+        *position= entry.offset;
+        return ERR_OK;
+      }
+      if (entry.gno > gno)
+        break;
+    }
+  }
+  return ERR_EOF;
+}
+
+} // namespace binary_log
@@ -0,0 +1,758 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "binlog_multiplexer.h"
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <my_global.h>
+#include <mysql_com.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef BINLOG_THROUGH_GTID
+/** Flag of COM_BINLOG_DUMP_GTID telling that a GTID set follows */
+#define BINLOG_THROUGH_GTID 0x04
+#endif
+
+/** Payload length of a packet continued by the next one */
+#define MAX_PACKET_LENGTH 0xffffff
+
+/** What the client tells the server it supports */
+#define STREAM_CLIENT_FLAGS (CLIENT_LONG_PASSWORD | CLIENT_LONG_FLAG | \
+                             CLIENT_PROTOCOL_41 | CLIENT_TRANSACTIONS | \
+                             CLIENT_SECURE_CONNECTION | CLIENT_PLUGIN_AUTH)
+
+namespace binary_log { namespace system {
+
+static const char native_password_plugin[]= "mysql_native_password";
+
+/**
+  Answers a mysql_native_password challenge.
+
+  @param  challenge  SCRAMBLE_LENGTH bytes, followed by a zero byte
+  @param  to         Room for SCRAMBLE_LENGTH + 1 bytes
+  @return the length of the answer, which is empty without a password
+*/
+static size_t scramble_password(const unsigned char *challenge,
+                                const std::string &passwd,
+                                unsigned char *to)
+{
+  if (passwd.empty())
+    return 0;
+  scramble((char*) to, (const char*) challenge, passwd.c_str());
+  return SCRAMBLE_LENGTH;
+}
+
+/** Appends a string with a one byte length, as COM_REGISTER_SLAVE has */
+static void store_short_string(std::vector<unsigned char> *buf,
+                               const std::string &str)
+{
+  size_t length= str.size() < 250 ? str.size() : 250;
+  buf->push_back((unsigned char) length);
+  buf->insert(buf->end(), str.begin(), str.begin() + length);
+}
+
+Binlog_stream::Binlog_stream(Binlog_stream_handler *handler,
+                             const std::string &user,
+                             const std::string &passwd,
+                             const std::string &host, unsigned int port,
+                             unsigned int server_id)
+  : m_handler(handler), m_user(user), m_passwd(passwd), m_host(host),
+    m_port(port), m_server_id(server_id), m_state(IDLE), m_fd(-1),
+    m_events(0), m_multiplexer(NULL), m_session(0), m_in_start(0),
+    m_in_end(0), m_out_start(0), m_seq(0), m_checksum_aware(false),
+    m_stream_checksum(false),
+    m_binlog_file_name(""), m_binlog_offset(4), m_checksum_len(0),
+    m_gtid_mode(false), m_events_received(0)
+{
+}
+
+Binlog_stream::~Binlog_stream()
+{
+  if (m_multiplexer)
+    m_multiplexer->remove(this);
+  close();
+}
+
+void Binlog_stream::set_position(const std::string &file,
+                                 unsigned long position)
+{
+  m_binlog_file_name= file;
+  m_binlog_offset= position;
+  m_gtid_mode= false;
+  m_gtids.clear();
+}
+
+void Binlog_stream::set_position(const Gtid_set &gtids)
+{
+  m_binlog_file_name= "";
+  m_binlog_offset= 4;
+  m_gtid_mode= true;
+  m_gtids= gtids;
+}
+
+void Binlog_stream::get_position(std::string *file,
+                                 unsigned long *position) const
+{
+  if (file)
+    *file= m_binlog_file_name;
+  if (position)
+    *position= m_binlog_offset;
+}
+
+/**
+  Resolves the host and starts connecting a non-blocking socket to it.
+*/
+int Binlog_stream::open()
+{
+  struct addrinfo hints, *result;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family= AF_UNSPEC;
+  hints.ai_socktype= SOCK_STREAM;
+  char port[16];
+  snprintf(port, sizeof(port), "%u", m_port);
+  if (getaddrinfo(m_host.c_str(), port, &hints, &result) != 0)
+    return fail(ERR_CONNECT, "Unknown MySQL server host '" + m_host + "'");
+
+  int fd= -1;
+  int connect_errno= 0;
+  for (struct addrinfo *ai= result; ai != NULL; ai= ai->ai_next)
+  {
+    fd= socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               ai->ai_protocol);
+    if (fd < 0)
+    {
+      connect_errno= errno;
+      continue;
+    }
+    if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+        errno == EINPROGRESS)
+      break;
+    connect_errno= errno;
+    ::close(fd);
+    fd= -1;
+  }
+  freeaddrinfo(result);
+  if (fd < 0)
+    return fail(ERR_CONNECT, "Can't connect to MySQL server on '" + m_host +
+                             "': " + strerror(connect_errno));
+
+  int on= 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  m_fd= fd;
+  m_state= CONNECTING;
+  m_session++;
+  if (m_in.size() < STREAM_BUFFER_SIZE)
+    m_in.resize(STREAM_BUFFER_SIZE);
+  m_in_start= m_in_end= 0;
+  m_packet.clear();
+  m_out.clear();
+  m_out_start= 0;
+  m_seq= 0;
+  return ERR_OK;
+}
+
+void Binlog_stream::close()
+{
+  if (m_fd >= 0)
+    ::close(m_fd);
+  m_fd= -1;
+  m_state= IDLE;
+  m_events= 0;
+  m_in_start= m_in_end= 0;
+  m_packet.clear();
+  m_out.clear();
+  m_out_start= 0;
+}
+
+int Binlog_stream::fail(int error, const std::string &message)
+{
+  m_error_message= message;
+  return error;
+}
+
+/**
+  Takes the message of an error packet of the server.
+*/
+int Binlog_stream::server_error(int error, const unsigned char *packet,
+                                size_t length)
+{
+  if (length < 3)
+    return fail(error, "Malformed error packet");
+  const unsigned char *message= packet + 3;
+  /* Skip the SQL state of the 4.1 protocol */
+  if (length >= 9 && *message == '#')
+    message+= 6;
+  char code[32];
+  snprintf(code, sizeof(code), "Error %u: ", (unsigned) uint2korr(packet + 1));
+  return fail(error, code + std::string((const char*) message,
+                                        (const char*) packet + length));
+}
+
+unsigned int Binlog_stream::wanted_events() const
+{
+  if (m_state == CONNECTING)
+    return EPOLLOUT;
+  return (uint32_t) EPOLLIN |
+         (m_out_start < m_out.size() ? (uint32_t) EPOLLOUT : 0U);
+}
+
+/**
+  Frames a payload into packets, with the sequence numbers following the
+  last packet received, and appends them to the output.
+*/
+void Binlog_stream::queue_packet(const unsigned char *payload, size_t length)
+{
+  while (true)
+  {
+    size_t chunk= length < MAX_PACKET_LENGTH ? length : MAX_PACKET_LENGTH;
+    unsigned char header[4];
+    int3store(header, chunk);
+    header[3]= m_seq++;
+    m_out.insert(m_out.end(), header, header + 4);
+    m_out.insert(m_out.end(), payload, payload + chunk);
+    payload+= chunk;
+    length-= chunk;
+    /* A full packet is followed by another one, even if empty */
+    if (chunk < MAX_PACKET_LENGTH)
+      break;
+  }
+}
+
+void Binlog_stream::send_command(unsigned char command,
+                                 const unsigned char *data, size_t length)
+{
+  std::vector<unsigned char> buf(1, command);
+  buf.insert(buf.end(), data, data + length);
+  m_seq= 0;
+  queue_packet(&buf[0], buf.size());
+}
+
+int Binlog_stream::flush_output()
+{
+  while (m_out_start < m_out.size())
+  {
+    ssize_t sent= send(m_fd, &m_out[m_out_start], m_out.size() - m_out_start,
+                       MSG_NOSIGNAL);
+    if (sent < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return ERR_OK;                          // Sent when writable
+      return fail(ERR_CONNECT, "Lost connection to MySQL server on '" +
+                               m_host + "': " + strerror(errno));
+    }
+    m_out_start+= sent;
+  }
+  m_out.clear();
+  m_out_start= 0;
+  return ERR_OK;
+}
+
+/**
+  Completes the connection to the server, which then sends its handshake.
+*/
+int Binlog_stream::on_writable()
+{
+  int so_error= 0;
+  socklen_t so_error_len= sizeof(so_error);
+  if (getsockopt(m_fd, SOL_SOCKET, SO_ERROR, &so_error, &so_error_len) != 0)
+    so_error= errno;
+  if (so_error != 0)
+    return fail(ERR_CONNECT, "Can't connect to MySQL server on '" + m_host +
+                             "': " + strerror(so_error));
+  m_state= READ_HANDSHAKE;
+  return ERR_OK;
+}
+
+/**
+  Reads what the socket has, and handles every complete packet.
+
+  A packet is handled in place in the input buffer, which always keeps one
+  byte after the data read, so that an event is followed by a readable
+  byte without being copied.
+*/
+int Binlog_stream::on_readable()
+{
+  if (m_in_start == m_in_end)
+    m_in_start= m_in_end= 0;
+  if (m_in_end + 1 >= m_in.size())
+  {
+    if (m_in_start > 0)
+    {
+      memmove(&m_in[0], &m_in[m_in_start], m_in_end - m_in_start);
+      m_in_end-= m_in_start;
+      m_in_start= 0;
+    }
+    else
+      m_in.resize(m_in.size() * 2);
+  }
+
+  ssize_t received= recv(m_fd, &m_in[m_in_end], m_in.size() - m_in_end - 1, 0);
+  if (received == 0)
+    return fail(ERR_CONNECT, "Lost connection to MySQL server on '" +
+                             m_host + "'");
+  if (received < 0)
+  {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+      return ERR_OK;
+    return fail(ERR_CONNECT, "Lost connection to MySQL server on '" +
+                             m_host + "': " + strerror(errno));
+  }
+  m_in_end+= received;
+
+  const unsigned long session= m_session;
+  while (m_in_end - m_in_start >= 4)
+  {
+    unsigned char *header= &m_in[m_in_start];
+    size_t length= uint3korr(header);
+    if (m_in_end - m_in_start < 4 + length)
+    {
+      /* Make room for the rest of the packet and the byte after it */
+      if (m_in.size() - m_in_start < 4 + length + 1)
+      {
+        memmove(&m_in[0], header, m_in_end - m_in_start);
+        m_in_end-= m_in_start;
+        m_in_start= 0;
+        if (m_in.size() < 4 + length + 1)
+          m_in.resize(4 + length + 1);
+      }
+      break;
+    }
+
+    unsigned char *payload= header + 4;
+    m_seq= header[3] + 1;
+    m_in_start+= 4 + length;
+
+    int error;
+    if (length == MAX_PACKET_LENGTH || !m_packet.empty())
+    {
+      m_packet.insert(m_packet.end(), payload, payload + length);
+      if (length == MAX_PACKET_LENGTH)
+        continue;
+      size_t total= m_packet.size();
+      m_packet.push_back(0);
+      error= handle_packet(&m_packet[0], total);
+      m_packet.clear();
+    }
+    else
+      error= handle_packet(payload, length);
+
+    /* The handler removed the stream, and maybe added it again */
+    if (m_session != session || m_multiplexer == NULL)
+      return ERR_OK;
+    if (error != ERR_OK)
+      return error;
+  }
+  return ERR_OK;
+}
+
+int Binlog_stream::handle_packet(unsigned char *packet, size_t length)
+{
+  if (length == 0)
+    return fail(ERR_FAIL, "Malformed packet");
+
+  int error= ERR_OK;
+  switch (m_state)
+  {
+  case READ_HANDSHAKE:
+    error= handle_handshake(packet, length);
+    break;
+  case READ_AUTH_RESULT:
+    error= handle_auth_result(packet, length);
+    break;
+  case READ_CHECKSUM_RESULT:
+    if (packet[0] == 0xff)
+      return server_error(ERR_CHECKSUM_QUERY_FAIL, packet, length);
+    send_register_slave();
+    break;
+  case READ_REGISTER_RESULT:
+    if (packet[0] == 0xff)
+      return server_error(ERR_FAIL, packet, length);
+    send_binlog_dump();
+    break;
+  case STREAMING:
+    return handle_event_packet(packet, length);
+  default:
+    return fail(ERR_FAIL, "Unexpected packet");
+  }
+  if (error == ERR_OK)
+    error= flush_output();
+  return error;
+}
+
+/**
+  Reads the handshake of the protocol version 10, and answers it.
+
+  The packets of the stream are parsed in place, in the buffer the
+  socket is read into. The Protocol chunks of protocol.h read from a
+  std::istream over a blocking connection, which a stream does not have.
+*/
+int Binlog_stream::handle_handshake(const unsigned char *packet,
+                                    size_t length)
+{
+  if (packet[0] == 0xff)
+    return server_error(ERR_CONNECT, packet, length);
+  if (packet[0] != 10)
+    return fail(ERR_CONNECT, "Unsupported protocol version");
+
+  const unsigned char *end= packet + length;
+  const unsigned char *version_end= static_cast<const unsigned char*>
+    (memchr(packet + 1, 0, length - 1));
+  /* The thread id, the scramble, a filler and the capability flags */
+  if (version_end == NULL || end - version_end < 1 + 4 + 8 + 1 + 2)
+    return fail(ERR_CONNECT, "Malformed handshake packet");
+  std::string server_version((const char*) packet + 1,
+                             (const char*) version_end);
+
+  unsigned char challenge[SCRAMBLE_LENGTH + 1];
+  const unsigned char *pos= version_end + 1 + 4;
+  memcpy(challenge, pos, 8);
+  pos+= 8 + 1;
+  unsigned long capabilities= uint2korr(pos);
+  pos+= 2;
+  if (!(capabilities & CLIENT_PROTOCOL_41) ||
+      !(capabilities & CLIENT_SECURE_CONNECTION))
+    return fail(ERR_CONNECT, "The server does not support the 4.1 protocol");
+
+  /*
+    The character set, the status and the upper capability flags, the
+    length of the scramble, ten reserved bytes and the rest of the scramble
+  */
+  if (end - pos < 1 + 2 + 2 + 1 + 10 + (SCRAMBLE_LENGTH - 8))
+    return fail(ERR_CONNECT, "Malformed handshake packet");
+  pos+= 1 + 2 + 2 + 1 + 10;
+  memcpy(challenge + 8, pos, SCRAMBLE_LENGTH - 8);
+  challenge[SCRAMBLE_LENGTH]= 0;
+
+  unsigned char version_split[3];
+  do_server_version_split(server_version.c_str(), version_split);
+  m_checksum_aware=
+    version_product(version_split) >= checksum_version_product;
+
+  m_state= READ_AUTH_RESULT;
+  return send_auth_response(challenge);
+}
+
+/**
+  Sends the HandshakeResponse41 packet, authenticating with
+  mysql_native_password.
+*/
+int Binlog_stream::send_auth_response(const unsigned char *challenge)
+{
+  std::vector<unsigned char> buf(4 + 4 + 1 + 23, 0);
+  int4store(&buf[0], STREAM_CLIENT_FLAGS);
+  int4store(&buf[4], MAX_PACKET_LENGTH + 1);
+  buf[8]= 33;                                   // utf8_general_ci
+  buf.insert(buf.end(), m_user.begin(), m_user.end());
+  buf.push_back(0);
+
+  unsigned char auth[SCRAMBLE_LENGTH + 1];
+  size_t auth_length= scramble_password(challenge, m_passwd, auth);
+  buf.push_back((unsigned char) auth_length);
+  buf.insert(buf.end(), auth, auth + auth_length);
+  buf.insert(buf.end(), native_password_plugin,
+             native_password_plugin + sizeof(native_password_plugin));
+  queue_packet(&buf[0], buf.size());
+  return ERR_OK;
+}
+
+int Binlog_stream::handle_auth_result(const unsigned char *packet,
+                                      size_t length)
+{
+  if (packet[0] == 0x00)
+  {
+    if (m_checksum_aware)
+    {
+      /*
+        Make a notice to the server that this client is checksum-aware.
+        Unless asked for the checksums, it does not need the first fake
+        Rotate necessary checksummed.
+      */
+      const char *query= m_stream_checksum ?
+        "SET @master_binlog_checksum= @@global.binlog_checksum" :
+        "SET @master_binlog_checksum='NONE'";
+      send_command(COM_QUERY, (const unsigned char*) query, strlen(query));
+      m_state= READ_CHECKSUM_RESULT;
+    }
+    else
+      send_register_slave();
+    return ERR_OK;
+  }
+  if (packet[0] == 0xff)
+    return server_error(ERR_CONNECT, packet, length);
+  if (packet[0] != 0xfe)
+    return fail(ERR_CONNECT, "Unsupported authentication method");
+
+  /* An AuthSwitchRequest: the name of a plugin, and its challenge */
+  const unsigned char *plugin_end= static_cast<const unsigned char*>
+    (memchr(packet + 1, 0, length - 1));
+  if (plugin_end == NULL)
+    return fail(ERR_CONNECT, "Malformed authentication switch packet");
+  std::string plugin((const char*) packet + 1, (const char*) plugin_end);
+  if (plugin != native_password_plugin ||
+      (size_t) (packet + length - (plugin_end + 1)) < SCRAMBLE_LENGTH)
+    return fail(ERR_CONNECT, "Authentication plugin '" + plugin +
+                             "' is not supported");
+
+  unsigned char challenge[SCRAMBLE_LENGTH + 1];
+  memcpy(challenge, plugin_end + 1, SCRAMBLE_LENGTH);
+  challenge[SCRAMBLE_LENGTH]= 0;
+  unsigned char auth[SCRAMBLE_LENGTH + 1];
+  size_t auth_length= scramble_password(challenge, m_passwd, auth);
+  queue_packet(auth, auth_length);
+  return ERR_OK;
+}
+
+void Binlog_stream::send_register_slave()
+{
+  std::vector<unsigned char> buf(4);
+  int4store(&buf[0], m_server_id);
+  store_short_string(&buf, m_host);
+  store_short_string(&buf, m_user);
+  store_short_string(&buf, m_passwd);
+  size_t pos= buf.size();
+  /* The port, the fake rpl_recovery_rank and the master id */
+  buf.resize(pos + 2 + 4 + 4, 0);
+  int2store(&buf[pos], m_port);
+  send_command(COM_REGISTER_SLAVE, &buf[0], buf.size());
+  m_state= READ_REGISTER_RESULT;
+}
+
+/**
+  Requests the events from the tracked position, or the transactions
+  which are not in the GTID set until the first position is known.
+*/
+void Binlog_stream::send_binlog_dump()
+{
+  std::vector<unsigned char> buf;
+  if (m_gtid_mode && m_binlog_file_name.empty())
+  {
+    size_t gtids_length= m_gtids.encoded_length();
+    buf.resize(2 + 4 + 4 + 8 + 4 + gtids_length);
+    unsigned char *pos= &buf[0];
+    int2store(pos, BINLOG_THROUGH_GTID); pos+= 2;
+    int4store(pos, m_server_id); pos+= 4;
+    int4store(pos, 0); pos+= 4;                 // Length of the binlog name
+    int8store(pos, 4); pos+= 8;
+    int4store(pos, gtids_length); pos+= 4;
+    m_gtids.encode(pos);
+    send_command(COM_BINLOG_DUMP_GTID, &buf[0], buf.size());
+  }
+  else
+  {
+    buf.resize(4 + 2 + 4);
+    int4store(&buf[0], m_binlog_offset);
+    int2store(&buf[4], 0);
+    int4store(&buf[6], m_server_id);
+    buf.insert(buf.end(), m_binlog_file_name.begin(),
+               m_binlog_file_name.end());
+    send_command(COM_BINLOG_DUMP, &buf[0], buf.size());
+  }
+  m_checksum_len= 0;
+  m_state= STREAMING;
+}
+
+int Binlog_stream::handle_event_packet(unsigned char *packet, size_t length)
+{
+  if (packet[0] == 0x00)
+  {
+    unsigned char *event= packet + 1;
+    size_t event_length= length - 1;
+    Binary_log_driver::track_event_position(event, event_length,
+                                            &m_binlog_file_name,
+                                            &m_binlog_offset,
+                                            &m_checksum_len);
+    m_events_received++;
+    m_handler->on_event(this, event, event_length);
+    return ERR_OK;
+  }
+  if (packet[0] == 0xfe && length < 9)
+    return fail(ERR_EOF, "The server ended the binlog stream");
+  if (packet[0] == 0xff)
+    return server_error(ERR_FAIL, packet, length);
+  return fail(ERR_FAIL, "Malformed binlog stream packet");
+}
+
+Binlog_multiplexer::Binlog_multiplexer()
+  : m_epoll_fd(epoll_create1(EPOLL_CLOEXEC)),
+    m_wakeup_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), m_stop(false)
+{
+  if (m_epoll_fd >= 0 && m_wakeup_fd >= 0)
+  {
+    struct epoll_event event;
+    event.events= EPOLLIN;
+    event.data.ptr= NULL;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, m_wakeup_fd, &event) != 0)
+    {
+      ::close(m_epoll_fd);
+      m_epoll_fd= -1;
+    }
+  }
+}
+
+Binlog_multiplexer::~Binlog_multiplexer()
+{
+  while (!m_streams.empty())
+    remove(*m_streams.begin());
+  if (m_wakeup_fd >= 0)
+    ::close(m_wakeup_fd);
+  if (m_epoll_fd >= 0)
+    ::close(m_epoll_fd);
+}
+
+int Binlog_multiplexer::add(Binlog_stream *stream)
+{
+  if (m_epoll_fd < 0 || m_wakeup_fd < 0 || stream->m_multiplexer != NULL)
+    return ERR_FAIL;
+  int error= stream->open();
+  if (error != ERR_OK)
+    return error;
+
+  struct epoll_event event;
+  event.events= stream->wanted_events();
+  event.data.ptr= stream;
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, stream->m_fd, &event) != 0)
+  {
+    stream->close();
+    return ERR_FAIL;
+  }
+  stream->m_events= event.events;
+  stream->m_multiplexer= this;
+  m_streams.insert(stream);
+  return ERR_OK;
+}
+
+void Binlog_multiplexer::remove(Binlog_stream *stream)
+{
+  if (stream->m_multiplexer != this)
+    return;
+  epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, stream->m_fd, NULL);
+  stream->close();
+  stream->m_multiplexer= NULL;
+  m_streams.erase(stream);
+}
+
+void Binlog_multiplexer::update_events(Binlog_stream *stream)
+{
+  unsigned int wanted= stream->wanted_events();
+  if (wanted == stream->m_events)
+    return;
+  struct epoll_event event;
+  event.events= wanted;
+  event.data.ptr= stream;
+  if (epoll_ctl(m_epoll_fd, EPOLL_CTL_MOD, stream->m_fd, &event) == 0)
+    stream->m_events= wanted;
+}
+
+void Binlog_multiplexer::stream_failed(Binlog_stream *stream, int error)
+{
+  std::string message= stream->m_error_message;
+  remove(stream);
+  /* The handler may delete the stream, or add it again */
+  stream->m_handler->on_error(stream, error, message);
+}
+
+void Binlog_multiplexer::dispatch(Binlog_stream *stream, unsigned int events)
+{
+  int error= ERR_OK;
+  if (stream->m_state == Binlog_stream::CONNECTING)
+  {
+    if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+      error= stream->on_writable();
+  }
+  else
+  {
+    if (events & EPOLLOUT)
+      error= stream->flush_output();
+    if (error == ERR_OK && (events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+      error= stream->on_readable();
+  }
+
+  /* The handler may have removed the stream */
+  if (m_streams.find(stream) == m_streams.end())
+    return;
+  if (error != ERR_OK)
+    stream_failed(stream, error);
+  else
+    update_events(stream);
+}
+
+int Binlog_multiplexer::run_once(int timeout_ms)
+{
+  if (m_epoll_fd < 0)
+    return ERR_FAIL;
+  struct epoll_event events[MULTIPLEXER_MAX_EVENTS];
+  int ready= epoll_wait(m_epoll_fd, events, MULTIPLEXER_MAX_EVENTS,
+                        timeout_ms);
+  if (ready < 0)
+    return errno == EINTR ? ERR_OK : ERR_FAIL;
+
+  for (int i= 0; i < ready; i++)
+  {
+    Binlog_stream *stream= static_cast<Binlog_stream*>(events[i].data.ptr);
+    if (stream == NULL)
+    {
+      /* Drain the counter of stop(), run() then reads m_stop */
+      uint64_t count;
+      while (read(m_wakeup_fd, &count, sizeof(count)) > 0)
+        ;
+      continue;
+    }
+    /* A handler called earlier may have removed the stream */
+    if (m_streams.find(stream) == m_streams.end())
+      continue;
+    dispatch(stream, events[i].events);
+  }
+  return ERR_OK;
+}
+
+int Binlog_multiplexer::run()
+{
+  int error= ERR_OK;
+  while (!__atomic_load_n(&m_stop, __ATOMIC_SEQ_CST) && !m_streams.empty())
+    if ((error= run_once(-1)) != ERR_OK)
+      break;
+  __atomic_store_n(&m_stop, false, __ATOMIC_SEQ_CST);
+  return error;
+}
+
+void Binlog_multiplexer::stop()
+{
+  __atomic_store_n(&m_stop, true, __ATOMIC_SEQ_CST);
+  uint64_t one= 1;
+  if (write(m_wakeup_fd, &one, sizeof(one)) < 0)
+    return;                                     // The counter is set anyway
+}
+
+} } // end namespace binary_log::system
+
+#endif /* HAVE_SYS_EPOLL_H */
@@ -0,0 +1,264 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "column_batch.h"
+#include <climits>
+#include <string.h>
+
+namespace binary_log {
+
+static Column_kind column_kind(unsigned char type)
+{
+  switch (type) {
+  case MYSQL_TYPE_TINY:
+  case MYSQL_TYPE_SHORT:
+  case MYSQL_TYPE_INT24:
+  case MYSQL_TYPE_LONG:
+  case MYSQL_TYPE_LONGLONG:
+  case MYSQL_TYPE_YEAR:
+  case MYSQL_TYPE_BIT:
+  case MYSQL_TYPE_ENUM:
+  case MYSQL_TYPE_SET:
+    return COLUMN_INT64;
+  case MYSQL_TYPE_FLOAT:
+  case MYSQL_TYPE_DOUBLE:
+    return COLUMN_DOUBLE;
+  default:
+    return COLUMN_BINARY;
+  }
+}
+
+/** Reads an integer value of size bytes, see COLUMN_INT64 */
+static int64_t read_int64(unsigned char type, const unsigned char *value,
+                          uint32_t size)
+{
+  uint64_t result= 0;
+  switch (type) {
+  case MYSQL_TYPE_YEAR:
+    /* 0 is the year 0000, the others are counted from 1900 */
+    return value[0] ? value[0] + 1900 : 0;
+  case MYSQL_TYPE_BIT:
+    /* The bits are stored as a big endian number */
+    for (uint32_t i= 0; i < size; i++)
+      result= (result << 8) | value[i];
+    return (int64_t) result;
+  case MYSQL_TYPE_ENUM:
+  case MYSQL_TYPE_SET:
+    memcpy(&result, value, size);
+    return (int64_t) le64toh(result);
+  default:
+    memcpy(&result, value, size);
+    result= le64toh(result);
+    if (size < 8 && (result >> (size * 8 - 1)) & 0x01)
+      result|= ~(uint64_t) 0 << (size * 8);
+    return (int64_t) result;
+  }
+}
+
+/**
+  Reads a FLOAT or a DOUBLE value, of the size checked by
+  has_double_size()
+*/
+static double read_double(unsigned char type, const unsigned char *value)
+{
+  if (type == MYSQL_TYPE_FLOAT)
+  {
+    uint32_t bits;
+    float result;
+    memcpy(&bits, value, 4);
+    bits= le32toh(bits);
+    memcpy(&result, &bits, 4);
+    return result;
+  }
+  uint64_t bits;
+  double result;
+  memcpy(&bits, value, 8);
+  bits= le64toh(bits);
+  memcpy(&result, &bits, 8);
+  return result;
+}
+
+/**
+  Whether the values of a FLOAT or a DOUBLE column have the size of the
+  type, which read_double() reads, rather than the one of a corrupt or
+  unexpected metadata
+*/
+static bool has_double_size(const Column_layout &layout)
+{
+  return layout.fixed_size ==
+         (layout.real_type == MYSQL_TYPE_FLOAT ? 4U : 8U);
+}
+
+/** Appends the bit of the next row to the validity bitmap */
+static void add_validity(Column_vector *column, size_t row, bool valid)
+{
+  if (row % 8 == 0)
+    column->validity.push_back(0);
+  if (valid)
+    column->validity.back()|= (uint8_t) (1 << (row % 8));
+}
+
+void Column_batch::clear()
+{
+  for (size_t col= 0; col < m_columns.size(); col++)
+  {
+    Column_vector &column= m_columns[col];
+    column.int64_values.clear();
+    column.double_values.clear();
+    column.offsets.clear();
+    column.bytes.clear();
+    column.validity.clear();
+    column.null_count= 0;
+  }
+  m_column_count= 0;
+  m_row_count= 0;
+}
+
+void Column_batch::append_null(Column_vector *column)
+{
+  add_validity(column, m_row_count, false);
+  column->null_count++;
+  switch (column->kind) {
+  case COLUMN_INT64:
+    column->int64_values.push_back(0);
+    break;
+  case COLUMN_DOUBLE:
+    column->double_values.push_back(0);
+    break;
+  case COLUMN_BINARY:
+    column->offsets.push_back((uint32_t) column->bytes.size());
+    break;
+  }
+}
+
+bool Column_batch::decode(const Rows_event &rows,
+                          const Table_map_event &table_map)
+{
+  clear();
+  unsigned long colcnt= table_map.m_colcnt;
+  if (!table_map.m_columns || rows.row.empty() ||
+      rows.columns_before_image.size() * 8 < colcnt ||
+      rows.columns_after_image.size() * 8 < colcnt)
+    return false;
+
+  if (m_columns.size() < colcnt)
+    m_columns.resize(colcnt);
+  m_column_count= colcnt;
+  for (unsigned long col= 0; col < colcnt; col++)
+  {
+    Column_vector &column= m_columns[col];
+    column.type= table_map.m_columns[col].real_type;
+    column.kind= column_kind(column.type);
+    if (column.kind == COLUMN_BINARY)
+      column.offsets.push_back(0);
+    if (column.kind == COLUMN_DOUBLE &&
+        !has_double_size(table_map.m_columns[col]))
+    {
+      clear();
+      return false;
+    }
+  }
+
+  Log_event_type type= rows.get_event_type();
+  bool update= type == UPDATE_ROWS_EVENT || type == UPDATE_ROWS_EVENT_V1;
+  const unsigned char *pos= rows.row.data();
+  /* The rows end before the byte after the event, see Rows_event */
+  const unsigned char *end= pos + rows.row.size() - 1;
+  while (pos < end)
+  {
+    const Buffer_slice &image= update && m_row_count % 2 ?
+                               rows.columns_after_image :
+                               rows.columns_before_image;
+    if (!decode_row(&pos, end, image, table_map))
+    {
+      clear();
+      return false;
+    }
+    m_row_count++;
+  }
+  return true;
+}
+
+/**
+  Appends the values of the row image at pos to the columns, and moves pos
+  after it.
+
+  @return false if the row does not end before end
+*/
+bool Column_batch::decode_row(const unsigned char **pos,
+                              const unsigned char *end,
+                              const Buffer_slice &image,
+                              const Table_map_event &table_map)
+{
+  unsigned long colcnt= table_map.m_colcnt;
+  unsigned int image_columns= 0;
+  for (unsigned long col= 0; col < colcnt; col++)
+    image_columns+= (image[col / 8] >> (col % 8)) & 0x01;
+
+  const unsigned char *null_bits= *pos;
+  const unsigned char *value= null_bits + (image_columns + 7) / 8;
+  if (value > end)
+    return false;
+  unsigned int null_bit_index= 0;
+  for (unsigned long col= 0; col < colcnt; col++)
+  {
+    Column_vector *column= &m_columns[col];
+    if (!((image[col / 8] >> (col % 8)) & 0x01))
+    {
+      append_null(column);
+      continue;
+    }
+    bool is_null= (null_bits[null_bit_index / 8] >>
+                   (null_bit_index % 8)) & 0x01;
+    null_bit_index++;
+    if (is_null)
+    {
+      append_null(column);
+      continue;
+    }
+
+    const Column_layout &layout= table_map.m_columns[col];
+    if (layout.length_bytes > end - value)
+      return false;
+    uint32_t size= layout.value_size(value);
+    if (size == UINT_MAX || size > (size_t) (end - value))
+      return false;
+    add_validity(column, m_row_count, true);
+    switch (column->kind) {
+    case COLUMN_INT64:
+      column->int64_values.push_back(read_int64(layout.real_type, value,
+                                                size));
+      break;
+    case COLUMN_DOUBLE:
+      column->double_values.push_back(read_double(layout.real_type, value));
+      break;
+    case COLUMN_BINARY:
+      column->bytes.insert(column->bytes.end(), value + layout.length_bytes,
+                           value + size);
+      column->offsets.push_back((uint32_t) column->bytes.size());
+      break;
+    }
+    value+= size;
+  }
+  *pos= value;
+  return true;
+}
+
+} // end namespace binary_log
@@ -18,6 +18,277 @@
 #include <iostream>
 using namespace binary_log;
 
+/** The cleanup of the events built in an arena */
+static void destroy_event(void *ev)
+{
+  static_cast<Binary_log_event *>(ev)->~Binary_log_event();
+}
+
+/** The types of the events kept by the pool of a Decoder */
+static bool is_pooled(unsigned int event_type)
+{
+  switch (event_type) {
+  case QUERY_EVENT:
+  case XID_EVENT:
+  case GTID_LOG_EVENT:
+  case ANONYMOUS_GTID_LOG_EVENT:
+  case TABLE_MAP_EVENT:
+  case WRITE_ROWS_EVENT_V1:
+  case UPDATE_ROWS_EVENT_V1:
+  case DELETE_ROWS_EVENT_V1:
+  case WRITE_ROWS_EVENT:
+  case UPDATE_ROWS_EVENT:
+  case DELETE_ROWS_EVENT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Decoder::set_event_pool(size_t max_per_type)
+{
+  m_pool_size= max_per_type;
+  for (unsigned int type= 0; type < ENUM_END_EVENT; type++)
+  {
+    while (m_pool[type].size() > max_per_type)
+    {
+      delete m_pool[type].back();
+      m_pool[type].pop_back();
+    }
+    if (is_pooled(type))
+      m_pool[type].reserve(max_per_type);
+  }
+}
+
+void Decoder::release_event(Binary_log_event *ev)
+{
+  if (!ev || m_arena)
+    return;
+  unsigned int type= ev->get_event_type();
+  /*
+    The type code of an event is the one of its buffer, which the
+    permutation of an old Format_description_event maps to another class.
+  */
+  if (type < ENUM_END_EVENT && is_pooled(type) &&
+      m_pool[type].size() < m_pool_size && !des_ev->event_type_permutation)
+    m_pool[type].push_back(ev);
+  else
+    delete ev;
+}
+
+/**
+  Returns an event of the pool to decode an event of that type in, NULL
+  if there is none.
+*/
+Binary_log_event *Decoder::take_pooled(unsigned int event_type)
+{
+  if (m_arena || m_pool[event_type].empty() || des_ev->event_type_permutation)
+    return NULL;
+  Binary_log_event *ev= m_pool[event_type].back();
+  m_pool[event_type].pop_back();
+  return ev;
+}
+
+bool Decoder::check_event(const char *buf, size_t event_len,
+                          const char **error)
+{
+  uint32_t temp_event_len;
+  memcpy(&temp_event_len, buf + EVENT_LEN_OFFSET, 4);
+  temp_event_len= le32toh(temp_event_len);
+  if (event_len < EVENT_LEN_OFFSET ||
+      buf[EVENT_TYPE_OFFSET] >= ENUM_END_EVENT ||
+      (unsigned int) event_len != temp_event_len)
+  {
+    *error= "Sanity check failed";
+    return false;
+  }
+  return true;
+}
+
+/**
+  Checks an event against the filter, reading only its common header and,
+  for the events of a table, its table id. The names of the tables are
+  read from the Table_map_events, whose decision is kept for the
+  Rows_events of their table id.
+
+  @return false if the event is to be skipped
+*/
+bool Decoder::accept_event(const char *buf, size_t event_len)
+{
+  unsigned int event_type= (unsigned char) buf[EVENT_TYPE_OFFSET];
+  if (des_ev->event_type_permutation &&
+      event_type <= des_ev->number_of_event_types)
+    event_type= des_ev->event_type_permutation[event_type];
+  if (!m_filter->accept_event_type(event_type))
+    return false;
+  if (event_type == FORMAT_DESCRIPTION_EVENT)
+    return true;
+  uint32_t server_id;
+  memcpy(&server_id, buf + SERVER_ID_OFFSET, 4);
+  if (!m_filter->accept_server_id(le32toh(server_id)))
+    return false;
+  if (!m_filter->has_table_rules())
+    return true;
+
+  switch (event_type) {
+  case TABLE_MAP_EVENT:
+    {
+      Table_map_view view(Event_view(buf, event_len, des_ev));
+      size_t db_len, table_len;
+      const char *db= view.db(&db_len);
+      const char *table= view.table(&table_len);
+      /* A broken event is left to the decoding to report */
+      if (!db || !table)
+        return true;
+      bool accepted= m_filter->accept_table(db, db_len, table, table_len);
+      m_accepted_tables[view.table_id()]= accepted;
+      return accepted;
+    }
+  case WRITE_ROWS_EVENT_V1:
+  case UPDATE_ROWS_EVENT_V1:
+  case DELETE_ROWS_EVENT_V1:
+  case WRITE_ROWS_EVENT:
+  case UPDATE_ROWS_EVENT:
+  case DELETE_ROWS_EVENT:
+    {
+      Rows_view view(Event_view(buf, event_len, des_ev));
+      std::map<uint64_t, bool>::const_iterator it=
+        m_accepted_tables.find(view.table_id());
+      return it == m_accepted_tables.end() || it->second;
+    }
+  default:
+    return true;
+  }
+}
+
+void Decoder::set_table_map_cache(size_t max_tables)
+{
+  m_table_map_cache_size= max_tables;
+  while (m_table_maps.size() > max_tables)
+  {
+    std::map<uint64_t, Cached_table_map>::iterator it=
+      m_table_maps.find(m_table_map_lru.back());
+    delete it->second.schema;
+    m_table_maps.erase(it);
+    m_table_map_lru.pop_back();
+  }
+}
+
+/**
+  Decodes a Table_map_event sharing the schema the cache keeps for its
+  table id, which is decoded again when the body of the event is not the
+  one of the last event of the table id, see set_table_map_cache().
+
+  @param event_len  The length of the event, without the checksum
+*/
+Binary_log_event *Decoder::decode_table_map(const char *buf, size_t event_len)
+{
+  Table_map_event *ev=
+    static_cast<Table_map_event*>(take_pooled(TABLE_MAP_EVENT));
+  size_t headers_len= des_ev->common_header_len +
+                      des_ev->post_header_len[TABLE_MAP_EVENT - 1];
+  /* The permutation of an old FDE maps the type codes of the pool too */
+  if (m_table_map_cache_size == 0 || des_ev->event_type_permutation ||
+      event_len <= headers_len)
+  {
+    if (ev)
+      ev->reinit(buf, event_len, des_ev);
+    else
+      ev= new (m_arena) Table_map_event(buf, event_len, des_ev);
+    return ev;
+  }
+
+  const char *body= buf + headers_len;
+  size_t body_len= event_len - headers_len;
+  uint64_t table_id= 0;
+  /* Before 5.1.4, the table id had 4 bytes */
+  memcpy(&table_id, buf + des_ev->common_header_len,
+         des_ev->post_header_len[TABLE_MAP_EVENT - 1] == 6 ? 4 : 6);
+  table_id= le64toh(table_id);
+
+  std::map<uint64_t, Cached_table_map>::iterator it=
+    m_table_maps.find(table_id);
+  if (it != m_table_maps.end())
+  {
+    /* The table id is the most recently mapped now, whatever its body */
+    m_table_map_lru.splice(m_table_map_lru.begin(), m_table_map_lru,
+                           it->second.lru);
+  }
+  if (it == m_table_maps.end() || it->second.body.size() != body_len ||
+      memcmp(it->second.body.data(), body, body_len) != 0)
+  {
+    if (it == m_table_maps.end())
+    {
+      Table_map_event *schema;
+      if (m_table_maps.size() >= m_table_map_cache_size)
+      {
+        /* Drops the table id mapped least recently, reusing its schema */
+        std::map<uint64_t, Cached_table_map>::iterator last=
+          m_table_maps.find(m_table_map_lru.back());
+        schema= last->second.schema;
+        m_table_maps.erase(last);
+        m_table_map_lru.back()= table_id;
+        m_table_map_lru.splice(m_table_map_lru.begin(), m_table_map_lru,
+                               --m_table_map_lru.end());
+      }
+      else
+      {
+        schema= new Table_map_event();
+        m_table_map_lru.push_front(table_id);
+      }
+      it= m_table_maps.insert(std::make_pair(table_id,
+                                             Cached_table_map())).first;
+      it->second.schema= schema;
+      it->second.lru= m_table_map_lru.begin();
+    }
+    it->second.body.assign(body, body_len);
+    /* The cache outlives an arena: its columns are decoded on the heap */
+    Event_arena::Scope heap(NULL);
+    it->second.schema->reinit(buf, event_len, des_ev);
+  }
+
+  if (ev)
+    ev->reinit(buf, event_len, des_ev, *it->second.schema);
+  else
+    ev= new (m_arena) Table_map_event(buf, event_len, des_ev,
+                                      *it->second.schema);
+  return ev;
+}
+
+/**
+  Replaces the Format_description_event the next events are decoded with.
+
+  @param event_len  The length of the event, without the checksum
+*/
+void Decoder::set_format_description(const char *buf, size_t event_len)
+{
+  Format_description_event *temp= des_ev;
+  des_ev= new Format_description_event(buf, event_len, temp);
+  delete temp;
+}
+
+bool Decoder::view_event(const char* buf, size_t event_len, Event_view *view,
+                         const char **error, bool crc_check)
+{
+  if (!check_event(buf, event_len, error))
+    return false;
+  unsigned int event_type= (unsigned char) buf[EVENT_TYPE_OFFSET];
+  enum_binlog_checksum_alg alg= checksum_algorithm(buf, event_type,
+                                                   event_len);
+  if (crc_check &&
+      Log_event_footer::event_checksum_test((unsigned char *) buf,
+                                            event_len, alg))
+  {
+    *error= "Event crc check failed! Most likely there is event corruption.";
+    return false;
+  }
+  if (event_type == FORMAT_DESCRIPTION_EVENT)
+    set_format_description(buf, alg != BINLOG_CHECKSUM_ALG_UNDEF ?
+                                event_len - BINLOG_CHECKSUM_LEN : event_len);
+  *view= Event_view(buf, event_len, des_ev);
+  return true;
+}
+
 enum_binlog_checksum_alg Decoder::checksum_algorithm(const char *buf,
                                                      unsigned int event_type,
                                                      size_t event_len)
@@ -33,22 +304,42 @@ enum_binlog_checksum_alg Decoder::checksum_algorithm(const char *buf,
 Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
                                         const char **error,
                                         bool crc_check)
+{
+  return decode(buf, event_len, NULL, error, crc_check);
+}
+
+Binary_log_event* Decoder::decode_event(Event_buffer *buffer,
+                                        size_t event_len,
+                                        const char **error,
+                                        bool crc_check)
+{
+  return decode((const char *) buffer->data(), event_len, buffer, error,
+                crc_check);
+}
+
+/**
+  Decodes an event, see decode_event(). The Rows_events reference the
+  event in buffer if it is not NULL.
+*/
+Binary_log_event* Decoder::decode(const char* buf, size_t event_len,
+                                  Event_buffer *buffer, const char **error,
+                                  bool crc_check)
 {
   Binary_log_event* ev;
   enum_binlog_checksum_alg alg;
   assert(des_ev != 0);
+  /* What the events allocate comes from the arena too */
+  Event_arena::Scope scope(m_arena);
   //DBUG_DUMP("data", (unsigned char*) buf, event_len);
 
   /* Check the integrity */
-  uint32_t temp_event_len;
-  memcpy(&temp_event_len, buf + EVENT_LEN_OFFSET, 4);
-  temp_event_len= le32toh(temp_event_len);
-  if (event_len < EVENT_LEN_OFFSET ||
-      buf[EVENT_TYPE_OFFSET] >= ENUM_END_EVENT ||
-      (unsigned int) event_len != temp_event_len)
-  {
-    *error= "Sanity check failed";
+  if (!check_event(buf, event_len, error))
     return NULL; // general sanity check - will fail on a partial read
+
+  if (m_filter && !accept_event(buf, event_len))
+  {
+    *error= NULL;
+    return NULL;
   }
 
   unsigned int event_type= buf[EVENT_TYPE_OFFSET];
@@ -73,7 +364,9 @@ Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
     if (force_read)
     {
       // The user can skip this event, and move to next event.
-      ev= new Unknown_event(buf, des_ev);
+      ev= new (m_arena) Unknown_event(buf, des_ev);
+      if (m_arena)
+        m_arena->add_cleanup(destroy_event, ev);
       return ev;
     }
     return NULL;
@@ -113,87 +406,133 @@ Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
 
     switch(event_type) {
     case QUERY_EVENT:
-      ev  = new Query_event(buf, event_len, des_ev, QUERY_EVENT);
+      if ((ev= take_pooled(event_type)))
+      {
+        /* A Query_event allocates nothing, it points into the buffer */
+        Query_event *pooled= static_cast<Query_event*>(ev);
+        pooled->~Query_event();
+        ev= new (pooled) Query_event(buf, event_len, des_ev, QUERY_EVENT);
+      }
+      else
+        ev  = new (m_arena) Query_event(buf, event_len, des_ev, QUERY_EVENT);
       break;
     case LOAD_EVENT:
     case NEW_LOAD_EVENT:
-      ev= new Load_event(buf, event_len, des_ev);
+      ev= new (m_arena) Load_event(buf, event_len, des_ev);
       break;
     case ROTATE_EVENT:
-      ev = new Rotate_event(buf, event_len, des_ev);
+      ev = new (m_arena) Rotate_event(buf, event_len, des_ev);
       break;
     case CREATE_FILE_EVENT:
-      ev = new Create_file_event(buf, event_len, des_ev);
+      ev = new (m_arena) Create_file_event(buf, event_len, des_ev);
       break;
     case APPEND_BLOCK_EVENT:
-      ev = new Append_block_event(buf, event_len, des_ev);
+      ev = new (m_arena) Append_block_event(buf, event_len, des_ev);
       break;
     case DELETE_FILE_EVENT:
-      ev = new Delete_file_event(buf, event_len, des_ev);
+      ev = new (m_arena) Delete_file_event(buf, event_len, des_ev);
       break;
     case EXEC_LOAD_EVENT:
-      ev = new Execute_load_event(buf, event_len, des_ev);
+      ev = new (m_arena) Execute_load_event(buf, event_len, des_ev);
       break;
     case START_EVENT_V3: /* this is sent only by MySQL <=4.x */
-      ev = new Start_event_v3(buf, event_len, des_ev);
+      ev = new (m_arena) Start_event_v3(buf, event_len, des_ev);
       break;
     case STOP_EVENT:
-      ev = new Stop_event(buf, des_ev);
+      ev = new (m_arena) Stop_event(buf, des_ev);
       break;
     case INTVAR_EVENT:
-      ev = new Intvar_event(buf, des_ev);
+      ev = new (m_arena) Intvar_event(buf, des_ev);
       break;
     case XID_EVENT:
-      ev = new Xid_event(buf, des_ev);
+      if ((ev= take_pooled(event_type)))
+      {
+        Xid_event *pooled= static_cast<Xid_event*>(ev);
+        pooled->~Xid_event();
+        ev= new (pooled) Xid_event(buf, des_ev);
+      }
+      else
+        ev = new (m_arena) Xid_event(buf, des_ev);
       break;
     case RAND_EVENT:
-      ev = new Rand_event(buf, des_ev);
+      ev = new (m_arena) Rand_event(buf, des_ev);
       break;
     case USER_VAR_EVENT:
-      ev = new User_var_event(buf, event_len, des_ev);
+      ev = new (m_arena) User_var_event(buf, event_len, des_ev);
       break;
     case FORMAT_DESCRIPTION_EVENT:
-      ev = new Format_description_event(buf, event_len, des_ev);
+      ev = new (m_arena) Format_description_event(buf, event_len, des_ev);
       break;
     case WRITE_ROWS_EVENT_V1:
-      ev = new Write_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Write_rows_event(buf, event_len, des_ev, buffer);
       break;
     case UPDATE_ROWS_EVENT_V1:
-      ev = new Update_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Update_rows_event(buf, event_len, des_ev, buffer);
       break;
     case DELETE_ROWS_EVENT_V1:
-      ev = new Delete_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Delete_rows_event(buf, event_len, des_ev, buffer);
       break;
     case TABLE_MAP_EVENT:
-      ev = new Table_map_event(buf, event_len, des_ev);
+      ev= decode_table_map(buf, event_len);
       break;
     case BEGIN_LOAD_QUERY_EVENT:
-      ev = new Begin_load_query_event(buf, event_len, des_ev);
+      ev = new (m_arena) Begin_load_query_event(buf, event_len, des_ev);
       break;
     case EXECUTE_LOAD_QUERY_EVENT:
-      ev= new Execute_load_query_event(buf, event_len, des_ev);
+      ev= new (m_arena) Execute_load_query_event(buf, event_len, des_ev);
       break;
     case INCIDENT_EVENT:
-      ev = new Incident_event(buf, event_len, des_ev);
+      ev = new (m_arena) Incident_event(buf, event_len, des_ev);
       break;
     case ROWS_QUERY_LOG_EVENT:
-      ev= new Rows_query_event(buf, event_len, des_ev);
+      ev= new (m_arena) Rows_query_event(buf, event_len, des_ev);
       break;
     case GTID_LOG_EVENT:
     case ANONYMOUS_GTID_LOG_EVENT:
-      ev= new Gtid_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+      {
+        Gtid_event *pooled= static_cast<Gtid_event*>(ev);
+        pooled->~Gtid_event();
+        ev= new (pooled) Gtid_event(buf, event_len, des_ev);
+      }
+      else
+        ev= new (m_arena) Gtid_event(buf, event_len, des_ev);
       break;
     case PREVIOUS_GTIDS_LOG_EVENT:
-      ev= new Previous_gtids_event(buf, event_len, des_ev);
+      ev= new (m_arena) Previous_gtids_event(buf, event_len, des_ev);
       break;
     case WRITE_ROWS_EVENT:
-      ev = new Write_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Write_rows_event(buf, event_len, des_ev, buffer);
       break;
     case UPDATE_ROWS_EVENT:
-      ev = new Update_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Update_rows_event(buf, event_len, des_ev, buffer);
       break;
     case DELETE_ROWS_EVENT:
-      ev = new Delete_rows_event(buf, event_len, des_ev);
+      if ((ev= take_pooled(event_type)))
+        static_cast<Rows_event*>(ev)->reinit(buf, event_len, des_ev,
+                                              buffer);
+      else
+        ev = new (m_arena) Delete_rows_event(buf, event_len, des_ev, buffer);
       break;
     default:
       {
@@ -205,7 +544,7 @@ Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
         memcpy(&flag_temp, buf + FLAGS_OFFSET, 2);
         if ( le16toh(flag_temp) & LOG_EVENT_IGNORABLE_F)
         {
-          ev= new Ignorable_event(buf, des_ev);
+          ev= new (m_arena) Ignorable_event(buf, des_ev);
         }
         else
         {
@@ -219,9 +558,9 @@ Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
   {
     if ((ev)->header()->type_code == FORMAT_DESCRIPTION_EVENT)
        {
-          Format_description_event *temp= des_ev;
-          des_ev= new Format_description_event(buf, event_len, temp);
-          delete temp;
+          /* The decoder keeps its FDE past the resets of the arena */
+          Event_arena::Scope heap(NULL);
+          set_format_description(buf, event_len);
        }
   }
   if (ev)
@@ -238,15 +577,20 @@ Binary_log_event* Decoder::decode_event(const char* buf, size_t event_len,
 
   if (!ev  || (event_type == SLAVE_EVENT))
   {
-    delete ev;
+    if (m_arena && ev)
+      destroy_event(ev);
+    else
+      delete ev;
     if (!force_read) /* then program dies */
     {
       *error= "Found invalid event in binary log";
       return 0;
     }
     // the user can skip this event, and move to next event
-    ev= new Unknown_event(buf, des_ev);
+    ev= new (m_arena) Unknown_event(buf, des_ev);
   }
 
+  if (m_arena)
+    m_arena->add_cleanup(destroy_event, ev);
   return ev;
 }
@@ -0,0 +1,100 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "event_filter.h"
+#include <algorithm>
+#include <string.h>
+
+namespace binary_log {
+
+Event_filter::Event_filter()
+  : m_all_event_types(true), m_predicate(NULL), m_predicate_arg(NULL)
+{
+  std::fill(m_event_types, m_event_types + ENUM_END_EVENT, true);
+}
+
+void Event_filter::add_event_type(Log_event_type type)
+{
+  if (m_all_event_types)
+  {
+    std::fill(m_event_types, m_event_types + ENUM_END_EVENT, false);
+    m_all_event_types= false;
+  }
+  if (type < ENUM_END_EVENT)
+    m_event_types[type]= true;
+}
+
+void Event_filter::add_server_id(uint32_t server_id)
+{
+  m_server_ids.insert(server_id);
+}
+
+void Event_filter::ignore_server_id(uint32_t server_id)
+{
+  m_ignored_server_ids.insert(server_id);
+}
+
+void Event_filter::add_table(const std::string &db, const std::string &table)
+{
+  m_tables.push_back(Table_name(db, table));
+}
+
+void Event_filter::ignore_table(const std::string &db,
+                                const std::string &table)
+{
+  m_ignored_tables.push_back(Table_name(db, table));
+}
+
+void Event_filter::set_table_predicate(Table_predicate predicate, void *arg)
+{
+  m_predicate= predicate;
+  m_predicate_arg= arg;
+}
+
+bool Event_filter::find_table(const Table_set &tables,
+                              const char *db, size_t db_len,
+                              const char *table, size_t table_len)
+{
+  for (Table_set::const_iterator it= tables.begin(); it != tables.end(); ++it)
+  {
+    if (it->first.size() != db_len ||
+        memcmp(it->first.data(), db, db_len) != 0)
+      continue;
+    if (it->second.empty() ||
+        (it->second.size() == table_len &&
+         memcmp(it->second.data(), table, table_len) == 0))
+      return true;
+  }
+  return false;
+}
+
+bool Event_filter::accept_table(const char *db, size_t db_len,
+                                const char *table, size_t table_len) const
+{
+  if (find_table(m_ignored_tables, db, db_len, table, table_len))
+    return false;
+  if (!m_tables.empty() &&
+      !find_table(m_tables, db, db_len, table, table_len))
+    return false;
+  return !m_predicate ||
+         m_predicate(db, db_len, table, table_len, m_predicate_arg);
+}
+
+} // end namespace binary_log
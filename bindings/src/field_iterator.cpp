@@ -31,7 +31,8 @@ is_null(unsigned char *bitmap, int index)
 /**
   Return the number of columns getting modified.
 */
-unsigned int get_total_set_bit(std::vector<uint8_t> cols_bitmap, unsigned int colcnt)
+unsigned int get_total_set_bit(const Buffer_slice &cols_bitmap,
+                               unsigned int colcnt)
 {
   unsigned int i= 0;
   for (unsigned col_no= 0; col_no < colcnt; ++col_no)
@@ -46,57 +47,9 @@ template<class Iterator_value_type>
 uint32_t Row_event_iterator< Iterator_value_type>::
 extract_metadata(const Table_map_event *map, int col_no)
 {
-  int offset= 0;
-
-  for (int i= 0; i < col_no; ++i)
-  {
-    unsigned int type= (unsigned int)map->m_coltype[i] & 0xFF;
-    offset += lookup_metadata_field_size((enum_field_types)type);
-  }
-
-  uint16_t metadata= 0;
-  unsigned int type= (unsigned int)map->m_coltype[col_no] & 0xFF;
-  switch (lookup_metadata_field_size((enum_field_types)type))
-  {
-  case 1:
-    metadata= map->m_field_metadata[offset];
-  break;
-  case 2:
-    {
-      switch(type)
-      {
-      case MYSQL_TYPE_VARCHAR:
-        {
-          uint16_t tmp= 0;
-          memcpy(&tmp, (char*)&(map->m_field_metadata[offset]), 2);
-          metadata+= le16toh(tmp);
-          break;
-        }
-      case MYSQL_TYPE_SET:
-      case MYSQL_TYPE_ENUM:
-      case MYSQL_TYPE_STRING:
-      case MYSQL_TYPE_NEWDECIMAL:
-        {
-          /*
-            The metadata is arranged like this <TYPE><PACK_LENGTH>
-            type being in the most significant byte and pack length in the
-            least significant byte.
-          */
-          metadata= (map->m_field_metadata[offset] << 8U) |
-                     (map->m_field_metadata[offset + 1]);
-          break;
-        }
-      case MYSQL_TYPE_BIT:
-        {
-          metadata= map->m_field_metadata[offset] |
-                     (map->m_field_metadata[offset + 1] << 8U);
-          break;
-        }
-      }
-    }
-  break;
-  }
-  return metadata;
+  if (!map->m_columns)
+    throw std::logic_error("Table map without a column layout");
+  return map->m_columns[col_no].metadata;
 }
 
 
@@ -104,45 +57,7 @@ template<class Iterator_value_type>
 int Row_event_iterator< Iterator_value_type>::
 lookup_metadata_field_size(enum_field_types field_type)
 {
-  switch (field_type)
-  {
-    case MYSQL_TYPE_DOUBLE:
-    case MYSQL_TYPE_FLOAT:
-    case MYSQL_TYPE_BLOB:
-#if MYSQL_VERSION_ID >= 50604
-    case MYSQL_TYPE_DATETIME2:
-    case MYSQL_TYPE_TIMESTAMP2:
-    case MYSQL_TYPE_TIME2:
-#endif
-    case MYSQL_TYPE_GEOMETRY:
-     return 1;
-    case MYSQL_TYPE_BIT:
-    case MYSQL_TYPE_VARCHAR:
-    case MYSQL_TYPE_NEWDECIMAL:
-    case MYSQL_TYPE_STRING:
-    case MYSQL_TYPE_VAR_STRING:
-    case MYSQL_TYPE_ENUM:
-     return 2;
-    case MYSQL_TYPE_DECIMAL:
-    case MYSQL_TYPE_SET:
-    case MYSQL_TYPE_YEAR:
-    case MYSQL_TYPE_TINY:
-    case MYSQL_TYPE_SHORT:
-    case MYSQL_TYPE_INT24:
-    case MYSQL_TYPE_LONG:
-    case MYSQL_TYPE_LONGLONG:
-    case MYSQL_TYPE_NULL:
-    case MYSQL_TYPE_NEWDATE:
-    case MYSQL_TYPE_DATE:
-    case MYSQL_TYPE_TIME:
-    case MYSQL_TYPE_TIMESTAMP:
-    case MYSQL_TYPE_DATETIME:
-    case MYSQL_TYPE_TINY_BLOB:
-    case MYSQL_TYPE_MEDIUM_BLOB:
-    case MYSQL_TYPE_LONG_BLOB:
-    default:
-      return 0;
-  }
+  return Table_map_event::metadata_size(field_type);
 }
 
 template <class Iterator_value_type >
@@ -183,26 +98,9 @@ Row_event_iterator< Iterator_value_type >&
     /*
      * Advance the field offset to the next row
      */
-    int row_field_col_index= 0;
-    std::vector<uint8_t> nullbits(m_row_event->get_null_bits_len());
-    std::copy(m_row_event->row.begin() + m_field_offset,
-              m_row_event->row.begin() +
-              (m_field_offset + m_row_event->get_null_bits_len()),
-              nullbits.begin());
-    m_field_offset += m_row_event->get_null_bits_len();
-    for (unsigned col_no= 0; col_no < m_table_map->m_colcnt; ++col_no)
-    {
-      ++row_field_col_index;
-      binary_log::Value val((enum_field_types)m_table_map->m_coltype[col_no],
-                            m_table_map->m_field_metadata[col_no],
-                            (const unsigned char*)(&m_row_event->row[m_field_offset]));
-      int is_null= (nullbits[col_no/8] >> (col_no % 8)) & 0x01;
-      if (!is_null)
-      {
-        m_field_offset += val.length();
-      }
-    }
-
+    m_field_offset= skip_row(m_field_offset);
+    if (m_field_offset >= m_row_event->row.size() - 1)
+      m_field_offset= 0;
     return *this;
   }
 
@@ -237,6 +135,38 @@ bool Row_event_iterator< Iterator_value_type >::
 }
 
 
+/**
+  Returns the offset after the row at offset, read as fields() reads it,
+  with the layout of the columns of the Table_map_event only.
+*/
+template <class Iterator_value_type>
+unsigned long Row_event_iterator<Iterator_value_type>::
+skip_row(unsigned long offset)
+{
+  const Buffer_slice &row= m_row_event->row;
+  const Buffer_slice &columns= m_row_event->columns_before_image;
+  const unsigned char *nullbits= &row[offset];
+  unsigned int null_bit_index= 0;
+
+  if (m_table_map->m_colcnt && !m_table_map->m_columns)
+    throw std::logic_error("Table map without a column layout");
+  offset+= (get_total_set_bit(columns, m_table_map->m_colcnt) + 7) / 8;
+  for (unsigned col_no= 0; col_no < m_table_map->m_colcnt; ++col_no)
+  {
+    if (!((columns[col_no / 8] >> col_no % 8) & 0x01))
+      continue;
+    bool is_null= (nullbits[null_bit_index / 8] >> (null_bit_index % 8)) & 0x01;
+    null_bit_index++;
+    if (is_null)
+      continue;
+    uint32_t size= m_table_map->m_columns[col_no].value_size(&row[offset]);
+    if (size == UINT_MAX)
+      throw std::logic_error("Field type is unrecognized");
+    offset+= size;
+  }
+  return offset;
+}
+
 template <class Iterator_value_type>
 uint32_t Row_event_iterator<Iterator_value_type>::
        fields(Iterator_value_type& fields_vector)
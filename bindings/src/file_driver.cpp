@@ -173,11 +173,10 @@ int Binlog_file_driver::get_next_event(std::pair<unsigned char *, size_t> *buf_l
        of a file, in that case we have to force the code to read FDE as the
        first event.
       */
-      if (last_event_len == 0)
-        if (m_bytes_read > MAGIC_NUMBER_SIZE)
-        {
-           m_binlog_file.seekg(MAGIC_NUMBER_SIZE);
-        }
+      bool fde_forced= last_event_len == 0 &&
+                       m_bytes_read > MAGIC_NUMBER_SIZE;
+      if (fde_forced)
+        m_binlog_file.seekg(MAGIC_NUMBER_SIZE);
       m_binlog_file.read(head, header_size);
       size_t data_len= 0;
       memcpy(&data_len, head + EVENT_LEN_OFFSET, MAGIC_NUMBER_SIZE);
@@ -196,9 +195,10 @@ int Binlog_file_driver::get_next_event(std::pair<unsigned char *, size_t> *buf_l
        middle of the file, and we have changed it above to read the FDE.
        If this is not done then the m_binlog_file will be seek to a wrong position
        in the method update_pos which will be called after the call to this
-       method
+       method. A Format_description_event met later on, as in a relay log,
+       is read in place.
       */
-      if (head[EVENT_TYPE_OFFSET] == FORMAT_DESCRIPTION_EVENT && m_bytes_read > 4)
+      if (fde_forced)
       {
         m_binlog_file.seekg(m_bytes_read);
         m_bytes_read-= buf_len;
@@ -223,6 +223,12 @@ int Binlog_file_driver::get_next_event(std::pair<unsigned char *, size_t> *buf_l
   After we create the header we need to update the position of file pointer
 */
 int Binlog_file_driver::update_pos(binary_log::Binary_log_event *event)
+{
+  m_event_log_header= *(event->header());
+  return update_pos((size_t)m_event_log_header.data_written);
+}
+
+int Binlog_file_driver::update_pos(size_t event_len)
 {
   std::streamoff binlog_file_pos= m_binlog_file.tellg();
   assert(binlog_file_pos >= MAGIC_NUMBER_SIZE );
@@ -234,11 +240,8 @@ int Binlog_file_driver::update_pos(binary_log::Binary_log_event *event)
   */
   try
   {
-    m_event_log_header= *(event->header());
-    if (m_bytes_read + m_event_log_header.data_written !=
-        (unsigned long)binlog_file_pos)
-       m_binlog_file.seekg(m_bytes_read + m_event_log_header.data_written,
-                           ios::beg);
+    if (m_bytes_read + event_len != (unsigned long)binlog_file_pos)
+       m_binlog_file.seekg(m_bytes_read + event_len, ios::beg);
 
     m_bytes_read= binlog_file_pos;
   }
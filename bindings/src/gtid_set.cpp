@@ -0,0 +1,201 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "gtid_set.h"
+#include <cstdio>
+#include <stdlib.h>
+
+namespace binary_log {
+
+/**
+  Reads a GNO at text, which must be a positive number.
+
+  @return the character after the number, or NULL if there is no number
+*/
+static const char *parse_gno(const char *text, int64_t *gno)
+{
+  if (*text < '0' || *text > '9')
+    return NULL;
+  char *end;
+  long long value= strtoll(text, &end, 10);
+  if (value <= 0 || value == LLONG_MAX)
+    return NULL;
+  *gno= value;
+  return end;
+}
+
+int Gtid_set::parse(const std::string &text)
+{
+  clear();
+
+  std::string compact;
+  for (size_t i= 0; i < text.size(); i++)
+    if (text[i] != ' ' && text[i] != '\t' && text[i] != '\n' &&
+        text[i] != '\r')
+      compact+= text[i];
+
+  const char *pos= compact.c_str();
+  while (*pos)
+  {
+    if ((pos= parse_sid_intervals(pos)) == NULL)
+    {
+      clear();
+      return 1;
+    }
+    if (*pos == ',')
+      pos++;
+  }
+  return 0;
+}
+
+/**
+  Reads a UUID and its intervals, and adds them to the set.
+
+  @return the character after the last interval, or NULL on a syntax error
+*/
+const char *Gtid_set::parse_sid_intervals(const char *text)
+{
+  const char *colon= strchr(text, ':');
+  if (colon == NULL)
+    return NULL;
+  std::string uuid_text(text, colon - text);
+  Uuid sid;
+  if (uuid_text.size() != Uuid::TEXT_LENGTH || sid.parse(uuid_text.c_str()))
+    return NULL;
+
+  const char *pos= colon;
+  while (*pos == ':')
+  {
+    int64_t first, last;
+    if ((pos= parse_gno(pos + 1, &first)) == NULL)
+      return NULL;
+    last= first;
+    if (*pos == '-' &&
+        ((pos= parse_gno(pos + 1, &last)) == NULL || last < first))
+      return NULL;
+    add(sid.bytes, first, last);
+  }
+  if (*pos != ',' && *pos != '\0')
+    return NULL;
+  return pos;
+}
+
+void Gtid_set::add(const unsigned char *sid, int64_t first, int64_t last)
+{
+  Interval_list &intervals=
+    m_sids[std::string((const char*) sid, Uuid::BYTE_LENGTH)];
+
+  /* Find the first interval which ends at first - 1 or later */
+  size_t i= 0;
+  while (i < intervals.size() && intervals[i].second < first - 1)
+    i++;
+  if (i == intervals.size() || intervals[i].first > last + 1)
+  {
+    intervals.insert(intervals.begin() + i, Interval(first, last));
+    return;
+  }
+
+  /* Merge with the intervals it overlaps or touches */
+  if (first < intervals[i].first)
+    intervals[i].first= first;
+  if (last > intervals[i].second)
+    intervals[i].second= last;
+  size_t j= i + 1;
+  while (j < intervals.size() && intervals[j].first <= intervals[i].second + 1)
+  {
+    if (intervals[j].second > intervals[i].second)
+      intervals[i].second= intervals[j].second;
+    j++;
+  }
+  intervals.erase(intervals.begin() + i + 1, intervals.begin() + j);
+}
+
+bool Gtid_set::contains(const unsigned char *sid, int64_t gno) const
+{
+  Sid_map::const_iterator it=
+    m_sids.find(std::string((const char*) sid, Uuid::BYTE_LENGTH));
+  if (it == m_sids.end())
+    return false;
+  const Interval_list &intervals= it->second;
+  for (size_t i= 0; i < intervals.size() && intervals[i].first <= gno; i++)
+    if (gno <= intervals[i].second)
+      return true;
+  return false;
+}
+
+std::string Gtid_set::to_string() const
+{
+  std::string text;
+  for (Sid_map::const_iterator it= m_sids.begin(); it != m_sids.end(); ++it)
+  {
+    char buf[Uuid::TEXT_LENGTH + 1];
+    Uuid::to_string((const unsigned char*) it->first.data(), buf);
+    if (!text.empty())
+      text+= ",";
+    text+= buf;
+    for (size_t i= 0; i < it->second.size(); i++)
+    {
+      char interval[48];
+      const Interval &iv= it->second[i];
+      if (iv.first == iv.second)
+        snprintf(interval, sizeof(interval), ":%lld", (long long) iv.first);
+      else
+        snprintf(interval, sizeof(interval), ":%lld-%lld",
+                 (long long) iv.first, (long long) iv.second);
+      text+= interval;
+    }
+  }
+  return text;
+}
+
+size_t Gtid_set::encoded_length() const
+{
+  size_t length= 8;
+  for (Sid_map::const_iterator it= m_sids.begin(); it != m_sids.end(); ++it)
+    length+= Uuid::BYTE_LENGTH + 8 + it->second.size() * 16;
+  return length;
+}
+
+static unsigned char *store_int64(unsigned char *buf, uint64_t value)
+{
+  value= le64toh(value);
+  memcpy(buf, &value, 8);
+  return buf + 8;
+}
+
+void Gtid_set::encode(unsigned char *buf) const
+{
+  buf= store_int64(buf, m_sids.size());
+  for (Sid_map::const_iterator it= m_sids.begin(); it != m_sids.end(); ++it)
+  {
+    memcpy(buf, it->first.data(), Uuid::BYTE_LENGTH);
+    buf+= Uuid::BYTE_LENGTH;
+    buf= store_int64(buf, it->second.size());
+    for (size_t i= 0; i < it->second.size(); i++)
+    {
+      /* The protocol excludes the end of the interval */
+      buf= store_int64(buf, it->second[i].first);
+      buf= store_int64(buf, it->second[i].second + 1);
+    }
+  }
+}
+
+} // namespace binary_log
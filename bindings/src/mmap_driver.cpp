@@ -0,0 +1,244 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "mmap_driver.h"
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace binary_log { namespace system {
+
+/** Unmaps a mapping once nothing references it, see Event_buffer::wrap() */
+static void unmap_file(void *, unsigned char *map, size_t map_size)
+{
+  munmap(map, map_size);
+}
+
+/** Releases the reference to the mapping of an event of it */
+static void release_mapping(void *mapping, unsigned char *, size_t)
+{
+  static_cast<Event_buffer *>(mapping)->release();
+}
+
+int Binlog_mmap_driver::connect()
+{
+  unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+  struct stat stat_buff;
+
+  disconnect();
+
+  int fd= open(m_binlog_file_name.c_str(), O_RDONLY);
+  if (fd == -1)
+    return ERR_FAIL;                            // Can't open binlog file.
+
+  if (fstat(fd, &stat_buff) == -1 ||
+      stat_buff.st_size < (off_t)BIN_LOG_HEADER_SIZE)
+  {
+    close(fd);
+    return ERR_FAIL;
+  }
+
+  /*
+    The mapping is private and writable so that the decoder can modify
+    the event buffer in place, see the class description.
+  */
+  void *map= mmap(NULL, stat_buff.st_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE, fd, 0);
+  /* The mapping holds its own reference to the file */
+  close(fd);
+  if (map == MAP_FAILED)
+    return ERR_FAIL;
+
+  m_mapping= Event_buffer::wrap(static_cast<unsigned char*>(map),
+                                stat_buff.st_size, unmap_file, NULL);
+  if (m_mapping == NULL)
+  {
+    munmap(map, stat_buff.st_size);
+    return ERR_FAIL;
+  }
+  m_map= m_mapping->data();
+  m_map_size= stat_buff.st_size;
+  madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+
+  // Check if a valid MySQL binlog file is provided, BINLOG_MAGIC.
+  if (memcmp(magic, m_map, BIN_LOG_HEADER_SIZE))
+  {
+    disconnect();
+    return ERR_FAIL;                            // Not a valid binlog file.
+  }
+
+  // The first event must be a FDE, to check the binlog version
+  if (m_map_size >= BIN_LOG_HEADER_SIZE + LOG_EVENT_MINIMAL_HEADER_LEN &&
+      m_map[BIN_LOG_HEADER_SIZE + EVENT_TYPE_OFFSET] !=
+      FORMAT_DESCRIPTION_EVENT)
+  {
+    disconnect();
+    return ERR_BINLOG_VERSION;
+  }
+
+  m_bytes_read= BIN_LOG_HEADER_SIZE;
+  m_fde_pending= false;
+  last_event_len= 0;
+  return ERR_OK;
+}
+
+int Binlog_mmap_driver::connect(const std::string &filename,
+                                unsigned long position)
+{
+  m_binlog_file_name= filename;
+  if (connect() != ERR_OK)
+    return ERR_FAIL;
+  return set_position(filename, position);
+}
+
+int Binlog_mmap_driver::disconnect()
+{
+  /* The events of get_next_event_buffer() may still reference it */
+  if (m_mapping)
+    m_mapping->release();
+  m_mapping= NULL;
+  m_map= NULL;
+  m_map_size= 0;
+  return ERR_OK;
+}
+
+int Binlog_mmap_driver::set_position(const std::string &str,
+                                     unsigned long position)
+{
+  if (!str.empty() && str != m_binlog_file_name)
+    return connect(str, position);
+
+  if (m_map == NULL || position < BIN_LOG_HEADER_SIZE ||
+      position > m_map_size)
+    return ERR_FAIL;
+
+  m_bytes_read= position;
+  /*
+    As with Binlog_file_driver, if nothing has been read yet and we start
+    from the middle of the file, the FDE is returned first.
+  */
+  m_fde_pending= (last_event_len == 0 && position > BIN_LOG_HEADER_SIZE);
+  return ERR_OK;
+}
+
+int Binlog_mmap_driver::get_position(std::string *str, unsigned long *position)
+{
+  if (str)
+    *str= m_binlog_file_name;
+  if (position)
+    *position= m_bytes_read;
+  return ERR_OK;
+}
+
+int Binlog_mmap_driver::get_next_event(std::pair<unsigned char *, size_t>
+                                       *buf_len_pair)
+{
+  if (m_map == NULL)
+    return ERR_FAIL;
+
+  unsigned long event_pos= m_fde_pending ? BIN_LOG_HEADER_SIZE : m_bytes_read;
+  if (event_pos + LOG_EVENT_MINIMAL_HEADER_LEN > m_map_size)
+  {
+    if (event_pos == m_map_size)
+      return ERR_EOF;
+    return ERR_FAIL;                            // Truncated event header
+  }
+
+  uint32_t data_len;
+  memcpy(&data_len, m_map + event_pos + EVENT_LEN_OFFSET, 4);
+  data_len= le32toh(data_len);
+  if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+      event_pos + data_len > m_map_size)
+    return ERR_FAIL;                            // Truncated event body
+
+  unsigned char *event_buf= m_map + event_pos;
+  /*
+    Some event constructors look at the byte following the event, which
+    for the last event in the file may be outside the mapping. Only that
+    event is copied, into the buffer which other drivers use for all events.
+  */
+  if (event_pos + data_len == m_map_size)
+  {
+    if (data_len + 1 > m_buf_size)
+    {
+      buf= (unsigned char*) realloc(buf, data_len + 1);
+      m_buf_size= data_len + 1;
+    }
+    memcpy(buf, event_buf, data_len);
+    buf[data_len]= 0;
+    event_buf= buf;
+  }
+
+  if (m_fde_pending)
+    m_fde_pending= false;
+  else
+    m_bytes_read+= data_len;
+
+  last_event_len= data_len;
+  *buf_len_pair= std::make_pair(event_buf, (size_t)data_len);
+  return ERR_OK;
+}
+
+int Binlog_mmap_driver::get_next_event_buffer(Event_buffer **buffer,
+                                              size_t *length)
+{
+  std::pair<unsigned char *, size_t> buffer_buflen;
+  int error= get_next_event(&buffer_buflen);
+  if (error != ERR_OK)
+    return error;
+
+  Event_buffer *next;
+  if (buffer_buflen.first == buf)
+  {
+    /* The last event of the file, copied with the zero byte after it */
+    next= Event_buffer::reuse(*buffer, buffer_buflen.second + 1);
+    if (next)
+      memcpy(next->data(), buf, buffer_buflen.second + 1);
+  }
+  else
+  {
+    m_mapping->acquire();
+    next= Event_buffer::rewrap(*buffer, buffer_buflen.first,
+                               buffer_buflen.second, release_mapping,
+                               m_mapping);
+    if (!next)
+      m_mapping->release();
+  }
+  *buffer= next;
+  if (!next)
+    return ERR_FAIL;
+  *length= buffer_buflen.second;
+  return ERR_OK;
+}
+
+size_t Binlog_mmap_driver::file_size() const
+{
+  return m_map_size;
+}
+
+}// end namespace system
+}// end namespace binary_log
+
+#endif /* HAVE_SYS_MMAN_H */
@@ -0,0 +1,452 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "multi_source_reader.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+namespace binary_log { namespace system {
+
+static unsigned long long now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+Multi_source_reader::Multi_source_reader(Merge_policy policy,
+                                         size_t buffer_size)
+  : m_policy(policy),
+    m_buffer_size(buffer_size ? buffer_size : MULTI_SOURCE_BUFFER_SIZE),
+    m_merge_delay(MULTI_SOURCE_MERGE_DELAY), m_stop(false),
+    m_running(false), m_next_seq(0), m_held(-1), m_next_source(0)
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  /* The merge delay is measured with the monotonic clock */
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&m_data_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+Multi_source_reader::~Multi_source_reader()
+{
+  stop_readers();
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    Source *source= m_sources[i];
+    for (size_t j= 0; j < source->slots.size(); j++)
+      free(source->slots[j].data);
+    delete source->driver;
+    pthread_cond_destroy(&source->space_cond);
+    delete source;
+  }
+  pthread_cond_destroy(&m_data_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+size_t Multi_source_reader::add_source(Binary_log_driver *driver)
+{
+  Source *source= new Source();
+  Slot empty= { NULL, 0, 0, ERR_OK, 0, 0 };
+  source->reader= this;
+  source->index= m_sources.size();
+  source->driver= driver;
+  source->slots.resize(m_buffer_size, empty);
+  source->head= source->tail= 0;
+  source->ended= false;
+  source->idle_deadline= 0;
+  pthread_cond_init(&source->space_cond, NULL);
+  source->running= false;
+  source->offset= 4;
+  source->checksum_len= 0;
+  source->high_water_mark= 0;
+  source->events_read= 0;
+  source->reader_stalls= 0;
+  source->reader_stall_usec= 0;
+  source->consumer_stalls= 0;
+  m_sources.push_back(source);
+  return source->index;
+}
+
+int Multi_source_reader::connect()
+{
+  stop_readers();
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    int err= m_sources[i]->driver->connect();
+    if (err != ERR_OK)
+    {
+      /* Leave no source connected when the reader cannot start */
+      for (size_t j= 0; j < i; j++)
+        m_sources[j]->driver->disconnect();
+      return err;
+    }
+  }
+
+  m_stop= false;
+  m_next_seq= 0;
+  m_held= -1;
+  m_next_source= 0;
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    Source *source= m_sources[i];
+    source->head= source->tail= 0;
+    source->ended= false;
+    source->idle_deadline= 0;
+    source->checksum_len= 0;
+    /* The reader threads are not running, so the drivers can be asked */
+    source->driver->get_position(&source->file_name, &source->offset);
+  }
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    Source *source= m_sources[i];
+    if (pthread_create(&source->thread, NULL, reader_thread, source) != 0)
+    {
+      stop_readers();
+      return ERR_FAIL;
+    }
+    source->running= true;
+  }
+  m_running= true;
+  return ERR_OK;
+}
+
+int Multi_source_reader::disconnect()
+{
+  stop_readers();
+  int err= ERR_OK;
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    int source_err= m_sources[i]->driver->disconnect();
+    if (err == ERR_OK)
+      err= source_err;
+  }
+  return err;
+}
+
+void Multi_source_reader::abort_read()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_stop= true;
+  pthread_cond_broadcast(&m_data_cond);
+  for (size_t i= 0; i < m_sources.size(); i++)
+    pthread_cond_broadcast(&m_sources[i]->space_cond);
+  pthread_mutex_unlock(&m_mutex);
+  for (size_t i= 0; i < m_sources.size(); i++)
+    m_sources[i]->driver->abort_read();
+}
+
+void Multi_source_reader::stop_readers()
+{
+  abort_read();
+  for (size_t i= 0; i < m_sources.size(); i++)
+  {
+    Source *source= m_sources[i];
+    if (source->running)
+      pthread_join(source->thread, NULL);
+    source->running= false;
+  }
+  m_running= false;
+}
+
+void *Multi_source_reader::reader_thread(void *arg)
+{
+  Source *source= static_cast<Source*>(arg);
+  source->reader->run_reader(source);
+  return NULL;
+}
+
+void Multi_source_reader::run_reader(Source *source)
+{
+  const size_t capacity= source->slots.size();
+  while (true)
+  {
+    pthread_mutex_lock(&m_mutex);
+    if (source->head - source->tail == capacity)
+    {
+      /* The buffer is full, wait until the consumer takes an event */
+      unsigned long long start= now_usec();
+      source->reader_stalls++;
+      while (!m_stop && source->head - source->tail == capacity)
+        pthread_cond_wait(&source->space_cond, &m_mutex);
+      source->reader_stall_usec+= now_usec() - start;
+    }
+    bool stop= m_stop;
+    size_t head= source->head;
+    pthread_mutex_unlock(&m_mutex);
+    if (stop)
+      return;
+
+    /* The slot at the head is not seen by the consumer until it is pushed */
+    Slot *slot= &source->slots[head % capacity];
+    std::pair<unsigned char *, size_t> event;
+    int error= source->driver->get_next_event(&event);
+    if (error == ERR_OK)
+    {
+      /* Keep a readable byte after the event, as the drivers do */
+      if (event.second + 1 > slot->capacity)
+      {
+        unsigned char *data= static_cast<unsigned char*>
+          (realloc(slot->data, event.second + 1));
+        if (data == NULL)
+          error= ERR_FAIL;
+        else
+        {
+          slot->data= data;
+          slot->capacity= event.second + 1;
+        }
+      }
+      if (error == ERR_OK)
+      {
+        memcpy(slot->data, event.first, event.second);
+        slot->data[event.second]= 0;
+        slot->length= event.second;
+        uint32_t timestamp= 0;
+        if (event.second >= LOG_EVENT_MINIMAL_HEADER_LEN)
+          memcpy(&timestamp, event.first, 4);
+        slot->timestamp= le32toh(timestamp);
+      }
+    }
+    slot->error= error;
+
+    pthread_mutex_lock(&m_mutex);
+    if (m_stop)
+    {
+      pthread_mutex_unlock(&m_mutex);
+      return;                                   // Aborted, nobody reads it
+    }
+    slot->seq= m_next_seq++;
+    source->head= head + 1;
+    if (error == ERR_OK)
+    {
+      source->events_read++;
+      if (source->head - source->tail > source->high_water_mark)
+        source->high_water_mark= source->head - source->tail;
+    }
+    pthread_cond_signal(&m_data_cond);
+    pthread_mutex_unlock(&m_mutex);
+    /* The driver cannot be read any further, the error ends the source */
+    if (error != ERR_OK)
+      return;
+  }
+}
+
+/**
+  Gives the slot of the event returned by the previous call back to its
+  source. Called with m_mutex held.
+*/
+void Multi_source_reader::release_held()
+{
+  if (m_held < 0)
+    return;
+  Source *source= m_sources[m_held];
+  source->tail++;
+  pthread_cond_signal(&source->space_cond);
+  m_held= -1;
+}
+
+/**
+  Picks the source of the next event of the merged stream, with m_mutex
+  held.
+
+  MERGE_TIMESTAMP starts the merge delay of a source without events the
+  first time it finds the source empty, and waits for the source until the
+  delay has passed. The source is then left out of the merge until it has
+  an event again.
+
+  @param now  The time of the monotonic clock, in microseconds
+
+  @return the source, or -1 to wait for more events
+*/
+int Multi_source_reader::choose_source(unsigned long long now)
+{
+  const size_t count= m_sources.size();
+  int best= -1;
+  bool missing= false;
+  for (size_t k= 0; k < count; k++)
+  {
+    size_t i= m_policy == MERGE_ROUND_ROBIN ? (m_next_source + k) % count : k;
+    Source *source= m_sources[i];
+    if (source->ended)
+      continue;
+    if (source->head == source->tail)
+    {
+      if (source->idle_deadline == 0)
+        source->idle_deadline= now + (unsigned long long) m_merge_delay * 1000;
+      if (now < source->idle_deadline)
+        missing= true;
+      continue;
+    }
+    source->idle_deadline= 0;
+
+    const Slot *slot= &source->slots[source->tail % source->slots.size()];
+    /* The error ending a source does not wait for the other sources */
+    if (slot->error != ERR_OK)
+      return i;
+    if (m_policy == MERGE_ROUND_ROBIN)
+    {
+      m_next_source= i + 1;
+      return i;
+    }
+    if (best >= 0)
+    {
+      const Source *best_source= m_sources[best];
+      const Slot *best_slot=
+        &best_source->slots[best_source->tail % best_source->slots.size()];
+      if (m_policy == MERGE_TIMESTAMP &&
+          slot->timestamp != best_slot->timestamp)
+      {
+        if (slot->timestamp > best_slot->timestamp)
+          continue;
+      }
+      else if (slot->seq > best_slot->seq)
+        continue;
+    }
+    best= i;
+  }
+  if (m_policy == MERGE_TIMESTAMP && missing)
+    return -1;
+  return best;
+}
+
+int Multi_source_reader::get_next_event(size_t *source_index,
+                                        std::pair<unsigned char *, size_t>
+                                        *buffer_buflen)
+{
+  pthread_mutex_lock(&m_mutex);
+  /* The previous event is not used any more */
+  release_held();
+
+  bool stall_counted= false;
+  while (true)
+  {
+    if (!m_running || m_stop)
+    {
+      pthread_mutex_unlock(&m_mutex);
+      return ERR_FAIL;
+    }
+
+    unsigned long long now= now_usec();
+    int chosen= choose_source(now);
+    if (chosen < 0)
+    {
+      bool live= false;
+      bool buffered= false;
+      /* The first merge delay to end among the sources waited for */
+      unsigned long long wake= 0;
+      for (size_t i= 0; i < m_sources.size(); i++)
+      {
+        Source *source= m_sources[i];
+        if (source->ended)
+          continue;
+        live= true;
+        if (source->head != source->tail)
+          buffered= true;
+        else
+        {
+          if (!stall_counted)
+            source->consumer_stalls++;
+          if (source->idle_deadline > now &&
+              (wake == 0 || source->idle_deadline < wake))
+            wake= source->idle_deadline;
+        }
+      }
+      stall_counted= true;
+      if (!live)
+      {
+        pthread_mutex_unlock(&m_mutex);
+        return ERR_EOF;
+      }
+
+      if (buffered && wake != 0)
+      {
+        /* Only the timestamp merge waits while events are buffered */
+        struct timespec deadline;
+        deadline.tv_sec= wake / 1000000;
+        deadline.tv_nsec= (wake % 1000000) * 1000;
+        pthread_cond_timedwait(&m_data_cond, &m_mutex, &deadline);
+      }
+      else
+        pthread_cond_wait(&m_data_cond, &m_mutex);
+      continue;
+    }
+
+    Source *source= m_sources[chosen];
+    Slot *slot= &source->slots[source->tail % source->slots.size()];
+    if (slot->error != ERR_OK)
+    {
+      /* The reader thread has returned, the source is done */
+      int error= slot->error;
+      source->ended= true;
+      source->tail++;
+      if (error == ERR_EOF)
+        continue;
+      *source_index= chosen;
+      pthread_mutex_unlock(&m_mutex);
+      return error;
+    }
+
+    m_held= chosen;
+    Binary_log_driver::track_event_position(slot->data, slot->length,
+                                            &source->file_name,
+                                            &source->offset,
+                                            &source->checksum_len);
+    pthread_mutex_unlock(&m_mutex);
+    *source_index= chosen;
+    *buffer_buflen= std::make_pair(slot->data, slot->length);
+    return ERR_OK;
+  }
+}
+
+int Multi_source_reader::get_position(size_t source, std::string *str,
+                                      unsigned long *position) const
+{
+  if (source >= m_sources.size())
+    return ERR_FAIL;
+  if (str)
+    *str= m_sources[source]->file_name;
+  if (position)
+    *position= m_sources[source]->offset;
+  return ERR_OK;
+}
+
+void Multi_source_reader::get_stats(size_t index, Pipeline_stats *stats) const
+{
+  const Source *source= m_sources[index];
+  pthread_mutex_lock(&m_mutex);
+  stats->capacity= source->slots.size();
+  stats->occupancy= source->head - source->tail;
+  stats->high_water_mark= source->high_water_mark;
+  stats->events_read= source->events_read;
+  stats->reader_stalls= source->reader_stalls;
+  stats->reader_stall_usec= source->reader_stall_usec;
+  stats->consumer_stalls= source->consumer_stalls;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+} } // end namespace binary_log::system
+
+#endif /* HAVE_PTHREAD_H */
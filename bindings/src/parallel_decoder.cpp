@@ -0,0 +1,372 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "parallel_decoder.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace binary_log {
+
+Parallel_decoder::Parallel_decoder(unsigned int workers, size_t chunk_size,
+                                   bool crc_check)
+  : m_worker_count(workers ? workers : 1),
+    m_chunk_size(chunk_size ? chunk_size : PARALLEL_DECODER_CHUNK_SIZE),
+    m_crc_check(crc_check), m_map(NULL), m_map_size(0), m_file_size(0),
+    m_stop(false), m_scan_pos(0), m_scan_done(false), m_scanning(false),
+    m_next_chunk(0), m_read_chunk(0), m_read_event(0), m_error(NULL)
+{
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_done_cond, NULL);
+  pthread_cond_init(&m_space_cond, NULL);
+}
+
+Parallel_decoder::~Parallel_decoder()
+{
+  close();
+  pthread_cond_destroy(&m_space_cond);
+  pthread_cond_destroy(&m_done_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+int Parallel_decoder::open(const std::string &filename)
+{
+  unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+  struct stat stat_buff;
+
+  close();
+
+  int fd= ::open(filename.c_str(), O_RDONLY);
+  if (fd == -1)
+    return ERR_FAIL;                            // Can't open binlog file.
+  if (fstat(fd, &stat_buff) == -1 ||
+      stat_buff.st_size < (off_t)(BIN_LOG_HEADER_SIZE +
+                                  LOG_EVENT_MINIMAL_HEADER_LEN))
+  {
+    ::close(fd);
+    return ERR_FAIL;
+  }
+
+  /*
+    Reserve one page more than the file with an anonymous mapping, and map
+    the file over its beginning. The byte following the last event is then
+    always readable, even when the size of the file is a multiple of the
+    page size. The mapping is private and writable, since the decoder may
+    modify the buffer of an event while verifying its checksum.
+  */
+  m_file_size= stat_buff.st_size;
+  m_map_size= m_file_size + sysconf(_SC_PAGESIZE);
+  void *area= mmap(NULL, m_map_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (area == MAP_FAILED ||
+      mmap(area, m_file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+           fd, 0) == MAP_FAILED)
+  {
+    if (area != MAP_FAILED)
+      munmap(area, m_map_size);
+    ::close(fd);
+    m_map_size= 0;
+    return ERR_FAIL;
+  }
+  ::close(fd);
+  m_map= static_cast<unsigned char*>(area);
+  madvise(m_map, m_file_size, MADV_WILLNEED);
+
+  // Check if a valid MySQL binlog file is provided, BINLOG_MAGIC.
+  if (memcmp(magic, m_map, BIN_LOG_HEADER_SIZE))
+  {
+    close();
+    return ERR_FAIL;                            // Not a valid binlog file.
+  }
+
+  // The first event must be a FDE, which every worker needs
+  const unsigned char *fde= m_map + BIN_LOG_HEADER_SIZE;
+  uint32_t fde_len;
+  memcpy(&fde_len, fde + EVENT_LEN_OFFSET, 4);
+  fde_len= le32toh(fde_len);
+  if (fde[EVENT_TYPE_OFFSET] != FORMAT_DESCRIPTION_EVENT)
+  {
+    close();
+    return ERR_BINLOG_VERSION;
+  }
+  if (fde_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+      BIN_LOG_HEADER_SIZE + fde_len > m_file_size)
+  {
+    close();
+    return ERR_FAIL;
+  }
+  m_fde.assign(fde, fde + fde_len);
+  m_fde.push_back(0);
+
+  m_chunks.resize(2 * m_worker_count);
+  for (size_t i= 0; i < m_chunks.size(); i++)
+  {
+    m_chunks[i].error= NULL;
+    m_chunks[i].done= false;
+  }
+  m_stop= false;
+  m_scan_pos= BIN_LOG_HEADER_SIZE;
+  m_scan_done= false;
+  m_scanning= false;
+  m_next_chunk= 0;
+  m_read_chunk= 0;
+  m_read_event= 0;
+  m_error= NULL;
+
+  for (unsigned int i= 0; i < m_worker_count; i++)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, worker_thread, this) == 0)
+      m_workers.push_back(thread);
+  }
+  if (m_workers.empty())
+  {
+    close();
+    return ERR_FAIL;
+  }
+  return ERR_OK;
+}
+
+int Parallel_decoder::close()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_stop= true;
+  pthread_cond_broadcast(&m_space_cond);
+  pthread_mutex_unlock(&m_mutex);
+  for (size_t i= 0; i < m_workers.size(); i++)
+    pthread_join(m_workers[i], NULL);
+  m_workers.clear();
+
+  for (size_t i= 0; i < m_chunks.size(); i++)
+  {
+    /* The events of the chunk being read are partly owned by the caller */
+    if (m_chunks[i].done && i == m_read_chunk % m_chunks.size())
+      m_chunks[i].events.erase(m_chunks[i].events.begin(),
+                               m_chunks[i].events.begin() + m_read_event);
+    clear_chunk(&m_chunks[i]);
+  }
+  m_chunks.clear();
+  m_fde.clear();
+
+  if (m_map)
+    munmap(m_map, m_map_size);
+  m_map= NULL;
+  m_map_size= 0;
+  m_file_size= 0;
+  return ERR_OK;
+}
+
+void Parallel_decoder::clear_chunk(Chunk *chunk)
+{
+  for (size_t i= 0; i < chunk->events.size(); i++)
+    delete chunk->events[i];
+  chunk->events.clear();
+  chunk->positions.clear();
+  chunk->error= NULL;
+  chunk->done= false;
+}
+
+/**
+  Finds where the chunk starting at start ends, by following the lengths
+  in the event headers.
+
+  @return the offset of the end of the chunk, which is start if the event
+          at start is truncated
+*/
+unsigned long Parallel_decoder::scan_chunk_end(unsigned long start,
+                                               const char **error)
+{
+  unsigned long pos= start;
+  while (pos < m_file_size)
+  {
+    if (pos + LOG_EVENT_MINIMAL_HEADER_LEN > m_file_size)
+    {
+      *error= "Truncated event header";
+      break;
+    }
+    uint32_t data_len;
+    memcpy(&data_len, m_map + pos + EVENT_LEN_OFFSET, 4);
+    data_len= le32toh(data_len);
+    if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+        pos + data_len > m_file_size)
+    {
+      *error= "Truncated event";
+      break;
+    }
+    unsigned char type= m_map[pos + EVENT_TYPE_OFFSET];
+    pos+= data_len;
+
+    size_t length= pos - start;
+    if ((length >= m_chunk_size && type == XID_EVENT) ||
+        length >= 2 * m_chunk_size)
+      break;
+  }
+  return pos;
+}
+
+/**
+  Claims the next chunk to decode, waiting for room in the reorder buffer.
+
+  The chunk boundaries are found by one worker at a time, since a chunk
+  starts where the previous one ends, but the mutex is not held during
+  the scan, so the other workers can publish their decoded chunks.
+
+  @retval true  seq is the number of the chunk to decode
+  @retval false the worker must stop
+*/
+bool Parallel_decoder::claim_chunk(unsigned long *seq)
+{
+  pthread_mutex_lock(&m_mutex);
+  while (!m_stop && !m_scan_done &&
+         (m_scanning || m_next_chunk >= m_read_chunk + m_chunks.size()))
+    pthread_cond_wait(&m_space_cond, &m_mutex);
+  if (m_stop || m_scan_done)
+  {
+    pthread_mutex_unlock(&m_mutex);
+    return false;
+  }
+
+  Chunk *chunk= &m_chunks[m_next_chunk % m_chunks.size()];
+  unsigned long start= m_scan_pos;
+  *seq= m_next_chunk++;
+  m_scanning= true;
+  pthread_mutex_unlock(&m_mutex);
+
+  const char *error= NULL;
+  unsigned long end= scan_chunk_end(start, &error);
+
+  pthread_mutex_lock(&m_mutex);
+  chunk->start= start;
+  chunk->end= end;
+  chunk->error= error;
+  m_scan_pos= end;
+  /* Stop after a truncated event, it is reported by this chunk */
+  m_scan_done= (m_scan_pos >= m_file_size || error != NULL);
+  m_scanning= false;
+  pthread_cond_broadcast(&m_space_cond);
+  if (m_scan_done)
+    pthread_cond_broadcast(&m_done_cond);
+  pthread_mutex_unlock(&m_mutex);
+  return true;
+}
+
+void Parallel_decoder::decode_chunk(Decoder *decoder, Chunk *chunk)
+{
+  unsigned long pos= chunk->start;
+  while (pos < chunk->end)
+  {
+    uint32_t data_len;
+    memcpy(&data_len, m_map + pos + EVENT_LEN_OFFSET, 4);
+    data_len= le32toh(data_len);
+    const char *error= NULL;
+    Binary_log_event *event= decoder->decode_event((const char*) m_map + pos,
+                                                   data_len, &error,
+                                                   m_crc_check);
+    if (event == NULL)
+    {
+      chunk->error= error;
+      break;
+    }
+    chunk->events.push_back(event);
+    chunk->positions.push_back(pos);
+    pos+= data_len;
+  }
+}
+
+void *Parallel_decoder::worker_thread(void *arg)
+{
+  static_cast<Parallel_decoder*>(arg)->run_worker();
+  return NULL;
+}
+
+void Parallel_decoder::run_worker()
+{
+  /*
+    The decoder may write to the buffer of the FDE while checking its
+    checksum, so every worker works on its own copy.
+  */
+  std::vector<char> fde(m_fde);
+  const char *error= NULL;
+  Decoder decoder;
+  delete decoder.decode_event(&fde[0], fde.size() - 1, &error, false);
+
+  unsigned long seq;
+  while (claim_chunk(&seq))
+  {
+    Chunk *chunk= &m_chunks[seq % m_chunks.size()];
+    decode_chunk(&decoder, chunk);
+
+    pthread_mutex_lock(&m_mutex);
+    chunk->done= true;
+    pthread_cond_broadcast(&m_done_cond);
+    pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+int Parallel_decoder::next_event(Binary_log_event **event,
+                                 unsigned long *position)
+{
+  if (m_map == NULL)
+    return ERR_FAIL;
+
+  while (true)
+  {
+    Chunk *chunk= &m_chunks[m_read_chunk % m_chunks.size()];
+
+    pthread_mutex_lock(&m_mutex);
+    while (!chunk->done && !(m_scan_done && m_read_chunk == m_next_chunk))
+      pthread_cond_wait(&m_done_cond, &m_mutex);
+    bool done= chunk->done;
+    pthread_mutex_unlock(&m_mutex);
+    if (!done)
+      return ERR_EOF;                           // All chunks were returned
+
+    if (m_read_event < chunk->events.size())
+    {
+      *event= chunk->events[m_read_event];
+      if (position)
+        *position= chunk->positions[m_read_event];
+      m_read_event++;
+      return ERR_OK;
+    }
+    if (chunk->error)
+    {
+      m_error= chunk->error;
+      return ERR_FAIL;
+    }
+
+    /* The caller owns all the events of the chunk now */
+    chunk->events.clear();
+    clear_chunk(chunk);
+    pthread_mutex_lock(&m_mutex);
+    m_read_chunk++;
+    m_read_event= 0;
+    pthread_cond_broadcast(&m_space_cond);
+    pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H && HAVE_SYS_MMAN_H */
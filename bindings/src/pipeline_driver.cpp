@@ -0,0 +1,314 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "pipeline_driver.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <cstdlib>
+#include <cstring>
+#include <time.h>
+
+/*
+  The head and the tail of the ring are each written by one thread only,
+  and read by the other one. Publishing them with sequentially consistent
+  stores, and reading the waiting flag of the other side afterwards, makes
+  sure that a thread going to sleep is always woken up.
+*/
+#define RING_LOAD(x) __atomic_load_n(&(x), __ATOMIC_SEQ_CST)
+#define RING_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_SEQ_CST)
+#define STAT_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STAT_ADD(x, v) __atomic_add_fetch(&(x), (v), __ATOMIC_RELAXED)
+
+namespace binary_log { namespace system {
+
+static unsigned long long now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+Binlog_pipeline_driver::Binlog_pipeline_driver(Binary_log_driver *source,
+                                               size_t ring_size)
+  : Binary_log_driver("", 4), m_source(source), m_head(0), m_tail(0),
+    m_holding(false), m_reader_running(false), m_stop(false),
+    m_reader_waiting(false), m_consumer_waiting(false),
+    m_high_water_mark(0), m_events_read(0), m_reader_stalls(0),
+    m_reader_stall_usec(0), m_consumer_stalls(0)
+{
+  Slot empty= { NULL, 0, 0, ERR_OK };
+  m_slots.resize(ring_size ? ring_size : PIPELINE_RING_SIZE, empty);
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_data_cond, NULL);
+  pthread_cond_init(&m_space_cond, NULL);
+}
+
+Binlog_pipeline_driver::~Binlog_pipeline_driver()
+{
+  stop_reader();
+  for (size_t i= 0; i < m_slots.size(); i++)
+    free(m_slots[i].data);
+  delete m_source;
+  pthread_cond_destroy(&m_space_cond);
+  pthread_cond_destroy(&m_data_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+int Binlog_pipeline_driver::connect()
+{
+  stop_reader();
+  int err= m_source->connect();
+  if (err != ERR_OK)
+    return err;
+  /* The reader thread is not running, so the source can be asked */
+  m_source->get_position(&m_binlog_file_name, &m_binlog_offset);
+  return start_reader();
+}
+
+int Binlog_pipeline_driver::connect(const std::string &filename,
+                                    unsigned long offset)
+{
+  stop_reader();
+  int err= m_source->connect(filename, offset);
+  if (err != ERR_OK)
+    return err;
+  m_binlog_file_name= filename;
+  m_binlog_offset= offset;
+  return start_reader();
+}
+
+int Binlog_pipeline_driver::disconnect()
+{
+  stop_reader();
+  return m_source->disconnect();
+}
+
+int Binlog_pipeline_driver::set_position(const std::string &str,
+                                         unsigned long position)
+{
+  bool was_running= m_reader_running;
+  stop_reader();
+  int err= m_source->set_position(str, position);
+  if (err == ERR_OK)
+  {
+    m_binlog_file_name= str;
+    m_binlog_offset= position;
+  }
+  /*
+    The reader is restarted even if the source refused the position, the
+    consumer then gets the errors of the source in order.
+  */
+  if (was_running)
+  {
+    int start_err= start_reader();
+    if (err == ERR_OK)
+      err= start_err;
+  }
+  return err;
+}
+
+int Binlog_pipeline_driver::get_position(std::string *str,
+                                         unsigned long *position)
+{
+  if (str)
+    *str= m_binlog_file_name;
+  if (position)
+    *position= m_binlog_offset;
+  return ERR_OK;
+}
+
+size_t Binlog_pipeline_driver::file_size() const
+{
+  return m_source->file_size();
+}
+
+void Binlog_pipeline_driver::abort_read()
+{
+  pthread_mutex_lock(&m_mutex);
+  RING_STORE(m_stop, true);
+  pthread_cond_broadcast(&m_space_cond);
+  pthread_cond_broadcast(&m_data_cond);
+  pthread_mutex_unlock(&m_mutex);
+  m_source->abort_read();
+}
+
+int Binlog_pipeline_driver::start_reader()
+{
+  m_head= 0;
+  m_tail= 0;
+  m_holding= false;
+  m_stop= false;
+  m_reader_waiting= false;
+  m_consumer_waiting= false;
+  if (pthread_create(&m_reader, NULL, reader_thread, this) != 0)
+    return ERR_FAIL;
+  m_reader_running= true;
+  return ERR_OK;
+}
+
+void Binlog_pipeline_driver::stop_reader()
+{
+  if (!m_reader_running)
+    return;
+  abort_read();
+  pthread_join(m_reader, NULL);
+  m_reader_running= false;
+}
+
+void *Binlog_pipeline_driver::reader_thread(void *arg)
+{
+  static_cast<Binlog_pipeline_driver*>(arg)->run_reader();
+  return NULL;
+}
+
+void Binlog_pipeline_driver::run_reader()
+{
+  const size_t capacity= m_slots.size();
+  while (true)
+  {
+    size_t head= m_head;
+    if (head - RING_LOAD(m_tail) == capacity)
+    {
+      /* The ring is full, wait until the consumer releases a slot */
+      unsigned long long start= now_usec();
+      STAT_ADD(m_reader_stalls, 1);
+      pthread_mutex_lock(&m_mutex);
+      RING_STORE(m_reader_waiting, true);
+      while (!m_stop && head - RING_LOAD(m_tail) == capacity)
+        pthread_cond_wait(&m_space_cond, &m_mutex);
+      RING_STORE(m_reader_waiting, false);
+      pthread_mutex_unlock(&m_mutex);
+      STAT_ADD(m_reader_stall_usec, now_usec() - start);
+    }
+    if (RING_LOAD(m_stop))
+      return;
+
+    Slot *slot= &m_slots[head % capacity];
+    std::pair<unsigned char *, size_t> event;
+    int error= m_source->get_next_event(&event);
+    if (RING_LOAD(m_stop))
+      return;                                   // Aborted, nobody reads it
+    if (error == ERR_OK)
+    {
+      /* Keep a readable byte after the event, as the drivers do */
+      if (event.second + 1 > slot->capacity)
+      {
+        unsigned char *data= static_cast<unsigned char*>
+          (realloc(slot->data, event.second + 1));
+        if (data == NULL)
+          error= ERR_FAIL;
+        else
+        {
+          slot->data= data;
+          slot->capacity= event.second + 1;
+        }
+      }
+      if (error == ERR_OK)
+      {
+        memcpy(slot->data, event.first, event.second);
+        slot->data[event.second]= 0;
+        slot->length= event.second;
+      }
+    }
+    slot->error= error;
+
+    RING_STORE(m_head, head + 1);
+    if (error == ERR_OK)
+    {
+      STAT_ADD(m_events_read, 1);
+      size_t occupancy= head + 1 - RING_LOAD(m_tail);
+      if (occupancy > STAT_LOAD(m_high_water_mark))
+        __atomic_store_n(&m_high_water_mark, occupancy, __ATOMIC_RELAXED);
+    }
+    if (RING_LOAD(m_consumer_waiting))
+    {
+      pthread_mutex_lock(&m_mutex);
+      pthread_cond_signal(&m_data_cond);
+      pthread_mutex_unlock(&m_mutex);
+    }
+    /* The source cannot be read any further, the error ends the stream */
+    if (error != ERR_OK)
+      return;
+  }
+}
+
+void Binlog_pipeline_driver::release_slot()
+{
+  if (!m_holding)
+    return;
+  m_holding= false;
+  RING_STORE(m_tail, m_tail + 1);
+  if (RING_LOAD(m_reader_waiting))
+  {
+    pthread_mutex_lock(&m_mutex);
+    pthread_cond_signal(&m_space_cond);
+    pthread_mutex_unlock(&m_mutex);
+  }
+}
+
+int Binlog_pipeline_driver::get_next_event(std::pair<unsigned char *, size_t>
+                                           *buffer_buflen)
+{
+  if (!m_reader_running)
+    return ERR_FAIL;
+
+  /* The previous event is not used any more */
+  release_slot();
+
+  size_t tail= m_tail;
+  if (RING_LOAD(m_head) == tail)
+  {
+    STAT_ADD(m_consumer_stalls, 1);
+    pthread_mutex_lock(&m_mutex);
+    RING_STORE(m_consumer_waiting, true);
+    while (!m_stop && RING_LOAD(m_head) == tail)
+      pthread_cond_wait(&m_data_cond, &m_mutex);
+    RING_STORE(m_consumer_waiting, false);
+    pthread_mutex_unlock(&m_mutex);
+    if (RING_LOAD(m_head) == tail)
+      return ERR_FAIL;                          // Aborted
+  }
+
+  Slot *slot= &m_slots[tail % m_slots.size()];
+  /* An error stays in the ring, and is returned by every following call */
+  if (slot->error != ERR_OK)
+    return slot->error;
+  m_holding= true;
+  track_position(slot->data, slot->length);
+  *buffer_buflen= std::make_pair(slot->data, slot->length);
+  return ERR_OK;
+}
+
+void Binlog_pipeline_driver::get_stats(Pipeline_stats *stats) const
+{
+  stats->capacity= m_slots.size();
+  size_t tail= RING_LOAD(m_tail);
+  stats->occupancy= RING_LOAD(m_head) - tail;
+  stats->high_water_mark= STAT_LOAD(m_high_water_mark);
+  stats->events_read= STAT_LOAD(m_events_read);
+  stats->reader_stalls= STAT_LOAD(m_reader_stalls);
+  stats->reader_stall_usec= STAT_LOAD(m_reader_stall_usec);
+  stats->consumer_stalls= STAT_LOAD(m_consumer_stalls);
+}
+
+} } // end namespace binary_log::system
+
+#endif /* HAVE_PTHREAD_H */
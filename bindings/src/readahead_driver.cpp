@@ -0,0 +1,436 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "readahead_driver.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace binary_log { namespace system {
+
+/**
+  Reads exactly len bytes at offset, retrying on short reads and EINTR.
+
+  @retval true  on success
+  @retval false on a read error or an unexpected end of file
+*/
+static bool pread_fully(int fd, unsigned char *dest, size_t len, off_t offset)
+{
+  while (len > 0)
+  {
+    ssize_t n= pread(fd, dest, len, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    dest+= n;
+    len-= n;
+    offset+= n;
+  }
+  return true;
+}
+
+int Binlog_readahead_driver::connect()
+{
+  unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+  unsigned char header[BIN_LOG_HEADER_SIZE + LOG_EVENT_MINIMAL_HEADER_LEN];
+  struct stat stat_buff;
+
+  disconnect();
+
+  m_fd= open(m_binlog_file_name.c_str(), O_RDONLY);
+  if (m_fd == -1)
+    return ERR_FAIL;                            // Can't open binlog file.
+
+  if (fstat(m_fd, &stat_buff) == -1 ||
+      stat_buff.st_size < (off_t)BIN_LOG_HEADER_SIZE)
+  {
+    disconnect();
+    return ERR_FAIL;
+  }
+  m_file_size= stat_buff.st_size;
+
+  // Check if a valid MySQL binlog file is provided, BINLOG_MAGIC.
+  if (!pread_fully(m_fd, header, BIN_LOG_HEADER_SIZE, 0) ||
+      memcmp(magic, header, BIN_LOG_HEADER_SIZE))
+  {
+    disconnect();
+    return ERR_FAIL;                            // Not a valid binlog file.
+  }
+
+  // The first event must be a FDE, to check the binlog version
+  if (m_file_size >= sizeof(header) &&
+      (!pread_fully(m_fd, header, sizeof(header), 0) ||
+       header[BIN_LOG_HEADER_SIZE + EVENT_TYPE_OFFSET] !=
+       FORMAT_DESCRIPTION_EVENT))
+  {
+    disconnect();
+    return ERR_BINLOG_VERSION;
+  }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  /*
+    One extra aligned page per block, since some event constructors look
+    at the byte following the event. The reader threads set the byte past
+    the data to zero, so an event that ends a block reads a defined value.
+  */
+  m_blocks.resize(m_block_count);
+  for (unsigned int i= 0; i < m_block_count; i++)
+  {
+    void *data= NULL;
+    if (posix_memalign(&data, READAHEAD_ALIGNMENT,
+                       m_block_size + READAHEAD_ALIGNMENT))
+    {
+      m_blocks.resize(i);
+      disconnect();
+      return ERR_FAIL;
+    }
+    m_blocks[i].data= static_cast<unsigned char*>(data);
+    m_blocks[i].offset= 0;
+    m_blocks[i].length= 0;
+    m_blocks[i].state= BLOCK_FREE;
+  }
+
+  last_event_len= 0;
+  return set_position("", BIN_LOG_HEADER_SIZE);
+}
+
+int Binlog_readahead_driver::connect(const std::string &filename,
+                                     unsigned long position)
+{
+  m_binlog_file_name= filename;
+  if (connect() != ERR_OK)
+    return ERR_FAIL;
+  return set_position(filename, position);
+}
+
+int Binlog_readahead_driver::disconnect()
+{
+  stop_readers();
+  for (unsigned int i= 0; i < m_blocks.size(); i++)
+    free(m_blocks[i].data);
+  m_blocks.clear();
+  if (m_fd != -1)
+    close(m_fd);
+  m_fd= -1;
+  m_file_size= 0;
+  return ERR_OK;
+}
+
+int Binlog_readahead_driver::set_position(const std::string &str,
+                                          unsigned long position)
+{
+  if (!str.empty() && str != m_binlog_file_name)
+    return connect(str, position);
+
+  if (m_fd == -1 || position < BIN_LOG_HEADER_SIZE || position > m_file_size)
+    return ERR_FAIL;
+
+  restart_readers(position);
+  m_bytes_read= position;
+  /*
+    As with Binlog_file_driver, if nothing has been read yet and we start
+    from the middle of the file, the FDE is returned first.
+  */
+  m_fde_pending= (last_event_len == 0 && position > BIN_LOG_HEADER_SIZE);
+  return ERR_OK;
+}
+
+void Binlog_readahead_driver::restart_readers(unsigned long position)
+{
+  /* Drop whatever has been read ahead, and restart at the new position */
+  stop_readers();
+  for (unsigned int i= 0; i < m_blocks.size(); i++)
+    m_blocks[i].state= BLOCK_FREE;
+  m_claim_idx= 0;
+  m_read_idx= 0;
+  m_next_offset= position & ~((unsigned long)READAHEAD_ALIGNMENT - 1);
+  m_cursor= position;
+  start_readers();
+}
+
+int Binlog_readahead_driver::get_position(std::string *str,
+                                          unsigned long *position)
+{
+  if (str)
+    *str= m_binlog_file_name;
+  if (position)
+    *position= m_bytes_read;
+  return ERR_OK;
+}
+
+void *Binlog_readahead_driver::reader_thread(void *arg)
+{
+  static_cast<Binlog_readahead_driver*>(arg)->run_reader();
+  return NULL;
+}
+
+void Binlog_readahead_driver::run_reader()
+{
+  pthread_mutex_lock(&m_mutex);
+  while (true)
+  {
+    /*
+      Blocks are claimed in ring order, so a reader waits when the ring is
+      full or the whole file has been claimed.
+    */
+    while (!m_stop && ((size_t)m_next_offset >= m_file_size ||
+                       m_blocks[m_claim_idx].state != BLOCK_FREE))
+      pthread_cond_wait(&m_space_cond, &m_mutex);
+    if (m_stop)
+      break;
+
+    Readahead_block *blk= &m_blocks[m_claim_idx];
+    m_claim_idx= (m_claim_idx + 1) % m_block_count;
+    blk->state= BLOCK_READING;
+    blk->offset= m_next_offset;
+    blk->length= std::min(m_block_size, m_file_size - (size_t)m_next_offset);
+    m_next_offset+= blk->length;
+    pthread_mutex_unlock(&m_mutex);
+
+    bool read_ok= pread_fully(m_fd, blk->data, blk->length, blk->offset);
+    if (read_ok)
+      blk->data[blk->length]= 0;              // Terminate the block
+
+    pthread_mutex_lock(&m_mutex);
+    blk->state= read_ok ? BLOCK_READY : BLOCK_FAILED;
+    pthread_cond_broadcast(&m_data_cond);
+  }
+  pthread_mutex_unlock(&m_mutex);
+}
+
+void Binlog_readahead_driver::start_readers()
+{
+  m_stop= false;
+  for (unsigned int i= 0; i < m_reader_count; i++)
+  {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, reader_thread, this) == 0)
+      m_readers.push_back(thread);
+  }
+}
+
+void Binlog_readahead_driver::stop_readers()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_stop= true;
+  pthread_cond_broadcast(&m_space_cond);
+  pthread_mutex_unlock(&m_mutex);
+  for (unsigned int i= 0; i < m_readers.size(); i++)
+    pthread_join(m_readers[i], NULL);
+  m_readers.clear();
+}
+
+void Binlog_readahead_driver::release_block()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_blocks[m_read_idx].state= BLOCK_FREE;
+  m_read_idx= (m_read_idx + 1) % m_block_count;
+  pthread_cond_broadcast(&m_space_cond);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+int Binlog_readahead_driver::current_block(Readahead_block **blk)
+{
+  if (m_readers.empty() || m_cursor >= m_file_size)
+    return ERR_FAIL;
+
+  while (true)
+  {
+    Readahead_block *cur= &m_blocks[m_read_idx];
+    pthread_mutex_lock(&m_mutex);
+    while (cur->state == BLOCK_FREE || cur->state == BLOCK_READING)
+      pthread_cond_wait(&m_data_cond, &m_mutex);
+    Block_state state= cur->state;
+    pthread_mutex_unlock(&m_mutex);
+
+    if (state == BLOCK_FAILED)
+      return ERR_FAIL;
+    if (m_cursor < cur->offset + cur->length)
+    {
+      *blk= cur;
+      return ERR_OK;
+    }
+    release_block();
+  }
+}
+
+int Binlog_readahead_driver::copy_bytes(unsigned char *dest, size_t len)
+{
+  while (len > 0)
+  {
+    Readahead_block *blk;
+    if (current_block(&blk) != ERR_OK)
+      return ERR_FAIL;
+    size_t in_block= m_cursor - blk->offset;
+    size_t count= std::min(len, blk->length - in_block);
+    memcpy(dest, blk->data + in_block, count);
+    dest+= count;
+    len-= count;
+    m_cursor+= count;
+  }
+  return ERR_OK;
+}
+
+void Binlog_readahead_driver::rewind_cursor()
+{
+  /*
+    copy_bytes() releases the blocks it has gone past, so the start of the
+    event is only still held if the block being consumed begins before it.
+    The offset of a free block is the one of a previous turn of the ring.
+  */
+  Readahead_block *first= &m_blocks[m_read_idx];
+  pthread_mutex_lock(&m_mutex);
+  bool held= first->state != BLOCK_FREE &&
+             (unsigned long) first->offset <= m_bytes_read;
+  pthread_mutex_unlock(&m_mutex);
+
+  if (held)
+    m_cursor= m_bytes_read;
+  else
+    restart_readers(m_bytes_read);
+}
+
+int Binlog_readahead_driver::reserve_buf(size_t size)
+{
+  if (size <= m_buf_size)
+    return ERR_OK;
+  unsigned char *new_buf= (unsigned char*) realloc(buf, size);
+  if (new_buf == NULL)
+    return ERR_FAIL;
+  buf= new_buf;
+  m_buf_size= size;
+  return ERR_OK;
+}
+
+/**
+  The FDE is read synchronously, since it lies outside of the range being
+  read ahead.
+*/
+int Binlog_readahead_driver::read_fde(std::pair<unsigned char *, size_t>
+                                      *buffer_buflen)
+{
+  uint32_t data_len;
+  if (!pread_fully(m_fd, (unsigned char*) &data_len, 4,
+                   BIN_LOG_HEADER_SIZE + EVENT_LEN_OFFSET))
+    return ERR_FAIL;
+  data_len= le32toh(data_len);
+  if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+      BIN_LOG_HEADER_SIZE + data_len > m_file_size ||
+      reserve_buf(data_len + 1) != ERR_OK ||
+      !pread_fully(m_fd, buf, data_len, BIN_LOG_HEADER_SIZE))
+    return ERR_FAIL;
+  buf[data_len]= 0;
+
+  m_fde_pending= false;
+  last_event_len= data_len;
+  *buffer_buflen= std::make_pair(buf, (size_t)data_len);
+  return ERR_OK;
+}
+
+int Binlog_readahead_driver::get_next_event(std::pair<unsigned char *, size_t>
+                                            *buffer_buflen)
+{
+  if (m_fd == -1)
+    return ERR_FAIL;
+
+  if (m_fde_pending)
+    return read_fde(buffer_buflen);
+
+  if (m_bytes_read + LOG_EVENT_MINIMAL_HEADER_LEN > m_file_size)
+  {
+    if (m_bytes_read == m_file_size)
+      return ERR_EOF;
+    return ERR_FAIL;                            // Truncated event header
+  }
+
+  Readahead_block *blk;
+  if (current_block(&blk) != ERR_OK)
+    return ERR_FAIL;
+
+  size_t in_block= m_cursor - blk->offset;
+  size_t avail= blk->length - in_block;
+  uint32_t data_len;
+  unsigned char *event_buf;
+
+  if (avail >= LOG_EVENT_MINIMAL_HEADER_LEN)
+  {
+    memcpy(&data_len, blk->data + in_block + EVENT_LEN_OFFSET, 4);
+    data_len= le32toh(data_len);
+    if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+        m_bytes_read + data_len > m_file_size)
+      return ERR_FAIL;                          // Truncated event body
+  }
+  else
+    data_len= 0;                                // Header spans two blocks
+
+  if (data_len != 0 && data_len <= avail)
+  {
+    /* The whole event is in the block, no copy is needed */
+    event_buf= blk->data + in_block;
+    m_cursor+= data_len;
+  }
+  else
+  {
+    /* Assemble the event in buf out of consecutive blocks */
+    if (reserve_buf(LOG_EVENT_MINIMAL_HEADER_LEN + 1) != ERR_OK ||
+        copy_bytes(buf, LOG_EVENT_MINIMAL_HEADER_LEN) != ERR_OK)
+    {
+      rewind_cursor();
+      return ERR_FAIL;
+    }
+    memcpy(&data_len, buf + EVENT_LEN_OFFSET, 4);
+    data_len= le32toh(data_len);
+    if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN ||
+        m_bytes_read + data_len > m_file_size ||
+        reserve_buf(data_len + 1) != ERR_OK ||
+        copy_bytes(buf + LOG_EVENT_MINIMAL_HEADER_LEN,
+                   data_len - LOG_EVENT_MINIMAL_HEADER_LEN) != ERR_OK)
+    {
+      rewind_cursor();
+      return ERR_FAIL;
+    }
+    buf[data_len]= 0;
+    event_buf= buf;
+  }
+
+  m_bytes_read+= data_len;
+  last_event_len= data_len;
+  *buffer_buflen= std::make_pair(event_buf, (size_t)data_len);
+  return ERR_OK;
+}
+
+size_t Binlog_readahead_driver::file_size() const
+{
+  return m_file_size;
+}
+
+}// end namespace system
+}// end namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
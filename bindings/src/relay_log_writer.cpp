@@ -0,0 +1,511 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "relay_log_writer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace binary_log { namespace system {
+
+static unsigned long long now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Stores an integer in little-endian order */
+static void store_le(unsigned char *to, unsigned long long value,
+                     size_t bytes)
+{
+  for (size_t i= 0; i < bytes; i++, value>>= 8)
+    to[i]= (unsigned char) value;
+}
+
+static uint32_t load_le32(const unsigned char *from)
+{
+  return (uint32_t) from[0] | ((uint32_t) from[1] << 8) |
+         ((uint32_t) from[2] << 16) | ((uint32_t) from[3] << 24);
+}
+
+static bool write_all(int fd, const unsigned char *data, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t written= ::write(fd, data, length);
+    if (written < 0 && errno == EINTR)
+      continue;
+    if (written <= 0)
+      return false;
+    data+= written;
+    length-= written;
+  }
+  return true;
+}
+
+static int sync_fd(int fd)
+{
+#ifdef HAVE_FDATASYNC
+  return fdatasync(fd);
+#else
+  return fsync(fd);
+#endif
+}
+
+/**
+  Returns the number of a file named base_name.NNNNNN, or 0.
+*/
+static unsigned long file_number(const std::string &name,
+                                 const std::string &base_name)
+{
+  if (name.size() <= base_name.size() + 1 ||
+      name.compare(0, base_name.size(), base_name) != 0 ||
+      name[base_name.size()] != '.')
+    return 0;
+  const char *digits= name.c_str() + base_name.size() + 1;
+  for (const char *p= digits; *p; p++)
+    if (*p < '0' || *p > '9')
+      return 0;
+  return strtoul(digits, NULL, 10);
+}
+
+Relay_log_writer::Relay_log_writer(const std::string &directory,
+                                   unsigned int server_id,
+                                   const std::string &base_name)
+  : m_directory(directory), m_base_name(base_name), m_server_id(server_id),
+    m_max_size(RELAY_LOG_MAX_SIZE), m_sync_bytes(RELAY_LOG_SYNC_BYTES),
+    m_sync_period(RELAY_LOG_SYNC_PERIOD), m_fd(-1), m_file_number(0),
+    m_position(0), m_unsynced(0), m_last_sync_usec(0), m_checksum_len(0),
+    m_master_offset(BIN_LOG_HEADER_SIZE), m_master_server_id(0)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+}
+
+Relay_log_writer::~Relay_log_writer()
+{
+  close();
+}
+
+std::string Relay_log_writer::file_path(unsigned long number) const
+{
+  char suffix[32];
+  sprintf(suffix, ".%06lu", number);
+  return m_directory + "/" + m_base_name + suffix;
+}
+
+int Relay_log_writer::open()
+{
+  close();
+  m_pending.clear();
+  m_fde.clear();
+  m_checksum_len= 0;
+  m_master_file.clear();
+  m_master_offset= BIN_LOG_HEADER_SIZE;
+
+  DIR *dir= opendir(m_directory.c_str());
+  if (dir == NULL)
+    return ERR_FAIL;
+  std::vector<unsigned long> numbers;
+  struct dirent *entry;
+  while ((entry= readdir(dir)) != NULL)
+  {
+    unsigned long number= file_number(entry->d_name, m_base_name);
+    if (number > 0)
+      numbers.push_back(number);
+  }
+  closedir(dir);
+  std::sort(numbers.begin(), numbers.end());
+  m_file_number= numbers.empty() ? 0 : numbers.back();
+
+  /*
+    The index lists the files found, in case it was lost or is behind
+    the files.
+  */
+  std::string index= m_directory + "/" + m_base_name + ".index";
+  std::string tmp= index + ".tmp";
+  int fd= ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0)
+    return ERR_FAIL;
+  std::string lines;
+  for (size_t i= 0; i < numbers.size(); i++)
+  {
+    std::string path= file_path(numbers[i]);
+    lines+= path.substr(path.rfind('/') + 1) + "\n";
+  }
+  bool written= write_all(fd, (const unsigned char*) lines.data(),
+                          lines.size()) && sync_fd(fd) == 0;
+  ::close(fd);
+  if (!written || rename(tmp.c_str(), index.c_str()) != 0)
+    return ERR_FAIL;
+
+  /* The master position is in the last file which tells one */
+  for (size_t i= numbers.size(); i > 0 && m_master_file.empty(); i--)
+    if (recover(file_path(numbers[i - 1])) != ERR_OK)
+      return ERR_FAIL;
+  return ERR_OK;
+}
+
+/**
+  Reads the master position from a file, cuts the file after its last
+  complete event and marks it as closed.
+*/
+int Relay_log_writer::recover(const std::string &path)
+{
+  int fd= ::open(path.c_str(), O_RDWR);
+  struct stat stat_buff;
+  if (fd < 0 || fstat(fd, &stat_buff) != 0)
+  {
+    if (fd >= 0)
+      ::close(fd);
+    return ERR_FAIL;
+  }
+  unsigned long size= stat_buff.st_size;
+
+  std::string file;
+  unsigned long offset= BIN_LOG_HEADER_SIZE;
+  unsigned int checksum_len= 0;
+  unsigned int master_server_id= 0;
+  unsigned long pos= BIN_LOG_HEADER_SIZE;
+  std::vector<unsigned char> event(LOG_EVENT_HEADER_LEN);
+  while (pos + LOG_EVENT_HEADER_LEN <= size)
+  {
+    if (pread(fd, &event[0], LOG_EVENT_HEADER_LEN, pos) !=
+        LOG_EVENT_HEADER_LEN)
+      break;
+    uint32_t length= load_le32(&event[EVENT_LEN_OFFSET]);
+    if (length < LOG_EVENT_HEADER_LEN || length > size - pos)
+      break;
+
+    /* Only the events which name a file or set the checksums are read */
+    unsigned char type= event[EVENT_TYPE_OFFSET];
+    unsigned int flags= event[FLAGS_OFFSET] | (event[FLAGS_OFFSET + 1] << 8);
+    if (type == ROTATE_EVENT || type == FORMAT_DESCRIPTION_EVENT)
+    {
+      event.resize(length);
+      if (pread(fd, &event[0], length, pos) != (ssize_t) length)
+        break;
+    }
+    if (type != ROTATE_EVENT || !(flags & LOG_EVENT_RELAY_LOG_F))
+    {
+      Binary_log_driver::track_event_position(&event[0], event.size(),
+                                              &file, &offset,
+                                              &checksum_len);
+      if (type == ROTATE_EVENT)
+        master_server_id= load_le32(&event[SERVER_ID_OFFSET]);
+    }
+    event.resize(LOG_EVENT_HEADER_LEN);
+    pos+= length;
+  }
+
+  int error= ERR_OK;
+  if (pos < size && (ftruncate(fd, pos) != 0 || sync_fd(fd) != 0))
+    error= ERR_FAIL;
+
+  unsigned char flags[2];
+  if (pos > BIN_LOG_HEADER_SIZE &&
+      pread(fd, flags, 2, BIN_LOG_HEADER_SIZE + FLAGS_OFFSET) == 2 &&
+      (flags[0] & LOG_EVENT_BINLOG_IN_USE_F))
+  {
+    flags[0]&= ~LOG_EVENT_BINLOG_IN_USE_F;
+    if (pwrite(fd, flags, 1, BIN_LOG_HEADER_SIZE + FLAGS_OFFSET) != 1 ||
+        sync_fd(fd) != 0)
+      error= ERR_FAIL;
+  }
+  ::close(fd);
+
+  if (!file.empty())
+  {
+    m_master_file= file;
+    m_master_offset= offset;
+    m_master_server_id= master_server_id;
+  }
+  m_checksum_len= checksum_len;
+  return error;
+}
+
+int Relay_log_writer::write_event(const unsigned char *event, size_t length)
+{
+  if (length < LOG_EVENT_HEADER_LEN)
+    return ERR_FAIL;
+  unsigned char type= event[EVENT_TYPE_OFFSET];
+  unsigned int flags= event[FLAGS_OFFSET] | (event[FLAGS_OFFSET + 1] << 8);
+  int error= ERR_OK;
+
+  if (type != HEARTBEAT_LOG_EVENT)
+  {
+    /* The Rotate_events of another writer are not positions of the master */
+    if (type != ROTATE_EVENT || !(flags & LOG_EVENT_RELAY_LOG_F))
+    {
+      Binary_log_driver::track_event_position(event, length, &m_master_file,
+                                              &m_master_offset,
+                                              &m_checksum_len);
+      if (type == ROTATE_EVENT)
+        m_master_server_id= load_le32(event + SERVER_ID_OFFSET);
+    }
+
+    if (type == FORMAT_DESCRIPTION_EVENT)
+    {
+      m_fde.assign(event, event + length);
+      if (m_fd < 0)
+        error= create_file();
+      else
+      {
+        std::vector<unsigned char> fde;
+        copy_fde(event, length, false, &fde);
+        error= append(&fde[0], fde.size());
+      }
+    }
+    else if (m_fd < 0 && m_fde.empty())
+    {
+      m_pending.push_back(std::vector<unsigned char>(event, event + length));
+      return ERR_OK;
+    }
+    else
+    {
+      if (m_fd < 0)
+        error= create_file();
+      if (error == ERR_OK)
+        error= append(event, length);
+    }
+    if (error != ERR_OK)
+      return error;
+    m_stats.events_written++;
+
+    if (m_position >= m_max_size && (error= rotate()) != ERR_OK)
+      return error;
+  }
+
+  if (m_fd >= 0 && m_unsynced > 0 &&
+      ((m_sync_bytes && m_unsynced >= m_sync_bytes) ||
+       (m_sync_period &&
+        now_usec() - m_last_sync_usec >= m_sync_period * 1000ULL)))
+    error= sync();
+  return error;
+}
+
+int Relay_log_writer::append(const unsigned char *event, size_t length)
+{
+  m_buffer.insert(m_buffer.end(), event, event + length);
+  m_position+= length;
+  m_unsynced+= length;
+  m_stats.bytes_written+= length;
+  if (m_buffer.size() >= RELAY_LOG_BUFFER_SIZE)
+    return write_buffer();
+  return ERR_OK;
+}
+
+int Relay_log_writer::write_buffer()
+{
+  if (m_buffer.empty())
+    return ERR_OK;
+  bool written= write_all(m_fd, &m_buffer[0], m_buffer.size());
+  m_buffer.clear();
+  return written ? ERR_OK : ERR_FAIL;
+}
+
+int Relay_log_writer::sync()
+{
+  if (m_fd < 0)
+    return ERR_OK;
+  if (write_buffer() != ERR_OK)
+    return ERR_FAIL;
+  unsigned long long start= now_usec();
+  if (sync_fd(m_fd) != 0)
+    return ERR_FAIL;
+  m_last_sync_usec= now_usec();
+  m_stats.syncs++;
+  m_stats.sync_usec+= m_last_sync_usec - start;
+  m_unsynced= 0;
+  return ERR_OK;
+}
+
+/**
+  Creates the next file, starting with the Format_description_event of
+  the master, and adds it to the index.
+*/
+int Relay_log_writer::create_file()
+{
+  std::string path= file_path(m_file_number + 1);
+  int fd= ::open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0)
+    return ERR_FAIL;
+  m_file_number++;
+  m_fd= fd;
+  m_file_name= path;
+  m_position= 0;
+  m_stats.files_created++;
+
+  std::string base_name= path.substr(path.rfind('/') + 1) + "\n";
+  std::string index= m_directory + "/" + m_base_name + ".index";
+  int index_fd= ::open(index.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  bool indexed= index_fd >= 0 &&
+                write_all(index_fd, (const unsigned char*) base_name.data(),
+                          base_name.size()) &&
+                sync_fd(index_fd) == 0;
+  if (index_fd >= 0)
+    ::close(index_fd);
+  /* The new entry of the directory is made durable too */
+  int dir_fd= ::open(m_directory.c_str(), O_RDONLY);
+  if (dir_fd >= 0)
+  {
+    fsync(dir_fd);
+    ::close(dir_fd);
+  }
+  if (!indexed)
+    return ERR_FAIL;
+
+  int error= append((const unsigned char*) "\xfe" "bin", BIN_LOG_HEADER_SIZE);
+  std::vector<unsigned char> event;
+  copy_fde(&m_fde[0], m_fde.size(), true, &event);
+  if (error == ERR_OK)
+    error= append(&event[0], event.size());
+
+  if (!m_pending.empty())
+  {
+    for (size_t i= 0; i < m_pending.size() && error == ERR_OK; i++)
+    {
+      error= append(&m_pending[i][0], m_pending[i].size());
+      m_stats.events_written++;
+    }
+    m_pending.clear();
+  }
+  else if (!m_master_file.empty() && error == ERR_OK)
+  {
+    /* As a dump does, the file tells the master position it starts at */
+    std::string body(Binary_log_event::ROTATE_HEADER_LEN, '\0');
+    store_le((unsigned char*) &body[0], m_master_offset,
+             Binary_log_event::ROTATE_HEADER_LEN);
+    make_event(ROTATE_EVENT, m_master_server_id, LOG_EVENT_ARTIFICIAL_F, 0,
+               body + m_master_file, &event);
+    error= append(&event[0], event.size());
+  }
+  return error;
+}
+
+/**
+  Syncs the current file and marks it as closed.
+*/
+int Relay_log_writer::finish_file()
+{
+  if (m_fd < 0)
+    return ERR_OK;
+  int error= sync();
+  unsigned char flags[2];
+  if (error == ERR_OK &&
+      pread(m_fd, flags, 2, BIN_LOG_HEADER_SIZE + FLAGS_OFFSET) == 2)
+  {
+    flags[0]&= ~LOG_EVENT_BINLOG_IN_USE_F;
+    if (pwrite(m_fd, flags, 1, BIN_LOG_HEADER_SIZE + FLAGS_OFFSET) != 1 ||
+        sync_fd(m_fd) != 0)
+      error= ERR_FAIL;
+  }
+  ::close(m_fd);
+  m_fd= -1;
+  m_unsynced= 0;
+  m_buffer.clear();
+  return error;
+}
+
+int Relay_log_writer::rotate()
+{
+  if (m_fd < 0)
+    return ERR_OK;
+  std::string next= file_path(m_file_number + 1);
+  std::string body(Binary_log_event::ROTATE_HEADER_LEN, '\0');
+  store_le((unsigned char*) &body[0], BIN_LOG_HEADER_SIZE,
+           Binary_log_event::ROTATE_HEADER_LEN);
+  body+= next.substr(next.rfind('/') + 1);
+  uint32_t length= LOG_EVENT_HEADER_LEN + body.size() + m_checksum_len;
+
+  std::vector<unsigned char> event;
+  make_event(ROTATE_EVENT, m_server_id, LOG_EVENT_RELAY_LOG_F,
+             m_position + length, body, &event);
+  int error= append(&event[0], event.size());
+  int finish_error= finish_file();
+  return error != ERR_OK ? error : finish_error;
+}
+
+int Relay_log_writer::close()
+{
+  return finish_file();
+}
+
+/**
+  Builds an event of the writer, with a checksum if the events of the
+  master have one.
+*/
+void Relay_log_writer::make_event(unsigned char type, unsigned int server_id,
+                                  unsigned int flags, uint32_t log_pos,
+                                  const std::string &body,
+                                  std::vector<unsigned char> *event)
+{
+  event->assign(LOG_EVENT_HEADER_LEN, 0);
+  unsigned char *header= &(*event)[0];
+  header[EVENT_TYPE_OFFSET]= type;
+  store_le(header + SERVER_ID_OFFSET, server_id, 4);
+  store_le(header + EVENT_LEN_OFFSET,
+           LOG_EVENT_HEADER_LEN + body.size() + m_checksum_len, 4);
+  store_le(header + LOG_POS_OFFSET, log_pos, 4);
+  store_le(header + FLAGS_OFFSET, flags, 2);
+  event->insert(event->end(), body.begin(), body.end());
+  if (m_checksum_len)
+  {
+    unsigned char checksum[BINLOG_CHECKSUM_LEN];
+    store_le(checksum, checksum_crc32(0, &(*event)[0], event->size()), 4);
+    event->insert(event->end(), checksum, checksum + BINLOG_CHECKSUM_LEN);
+  }
+}
+
+/**
+  Copies a Format_description_event of the master, with the server id
+  of the writer. The one starting a file has no end position and is
+  flagged as in use until the file is closed.
+*/
+void Relay_log_writer::copy_fde(const unsigned char *fde, size_t length,
+                                bool header,
+                                std::vector<unsigned char> *event)
+{
+  event->assign(fde, fde + length);
+  unsigned char *buf= &(*event)[0];
+  store_le(buf + SERVER_ID_OFFSET, m_server_id, 4);
+  buf[FLAGS_OFFSET]&= ~LOG_EVENT_BINLOG_IN_USE_F;
+  if (header)
+    store_le(buf + LOG_POS_OFFSET, 0, 4);
+  /* The checksum is computed without the in use flag, as the server does */
+  if (length >= LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN &&
+      Log_event_footer::get_checksum_alg((const char*) buf, length) ==
+      BINLOG_CHECKSUM_ALG_CRC32)
+    store_le(buf + length - BINLOG_CHECKSUM_LEN,
+             checksum_crc32(0, buf, length - BINLOG_CHECKSUM_LEN), 4);
+  if (header)
+    buf[FLAGS_OFFSET]|= LOG_EVENT_BINLOG_IN_USE_F;
+}
+
+} } // namespace binary_log::system
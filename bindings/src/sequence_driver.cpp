@@ -0,0 +1,364 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "sequence_driver.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <algorithm>
+#include <fstream>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <dirent.h>
+
+namespace binary_log { namespace system {
+
+/**
+  Checks if the name ends with a '.' followed by digits only, as the
+  names of binary log files do.
+*/
+static bool is_binlog_file_name(const std::string &name)
+{
+  size_t dot= name.rfind('.');
+  if (dot == std::string::npos || dot == 0 || dot + 1 == name.size())
+    return false;
+  for (size_t i= dot + 1; i < name.size(); i++)
+    if (name[i] < '0' || name[i] > '9')
+      return false;
+  return true;
+}
+
+static std::string base_name(const std::string &path)
+{
+  size_t slash= path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+/**
+  Orders the names of binary log files by their base name, then by their
+  sequence number, which goes past 999999 with one more digit.
+*/
+static bool binlog_file_name_less(const std::string &a, const std::string &b)
+{
+  size_t a_dot= a.rfind('.');
+  size_t b_dot= b.rfind('.');
+  int cmp= a.compare(0, a_dot, b, 0, b_dot);
+  if (cmp != 0)
+    return cmp < 0;
+  return strtoull(a.c_str() + a_dot + 1, NULL, 10) <
+         strtoull(b.c_str() + b_dot + 1, NULL, 10);
+}
+
+/**
+  Returns the base name of the log of a binary log file, which is its
+  name without the directory and the sequence number.
+*/
+static std::string log_base_name(const std::string &path)
+{
+  std::string name= base_name(path);
+  return name.substr(0, name.rfind('.'));
+}
+
+int Binlog_sequence_driver::load_file_list()
+{
+  struct stat stat_buff;
+  std::vector<std::string> files;
+
+  if (stat(m_index_path.c_str(), &stat_buff) == -1)
+    return ERR_FAIL;
+
+  if (S_ISDIR(stat_buff.st_mode))
+  {
+    DIR *dir= opendir(m_index_path.c_str());
+    if (dir == NULL)
+      return ERR_FAIL;
+    std::string dir_path= m_index_path;
+    if (dir_path[dir_path.size() - 1] != '/')
+      dir_path+= '/';
+    std::vector<std::string> names;
+    while (struct dirent *entry= readdir(dir))
+    {
+      std::string name(entry->d_name);
+      if (is_binlog_file_name(name))
+        names.push_back(name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end(), binlog_file_name_less);
+
+    /*
+      A directory may hold the files of several logs, such as the binary
+      log and the relay log of a server, of which only one is read.
+    */
+    if (m_log_base_name.empty() && !names.empty())
+      m_log_base_name= log_base_name(names[0]);
+    for (size_t i= 0; i < names.size(); i++)
+      if (log_base_name(names[i]) == m_log_base_name)
+        files.push_back(dir_path + names[i]);
+  }
+  else
+  {
+    /*
+      The names in an index file are relative to the directory of the
+      index file, unless they are absolute.
+    */
+    std::ifstream index(m_index_path.c_str());
+    if (!index)
+      return ERR_FAIL;
+    std::string dir_path;
+    size_t slash= m_index_path.rfind('/');
+    if (slash != std::string::npos)
+      dir_path= m_index_path.substr(0, slash + 1);
+    std::string line;
+    while (std::getline(index, line))
+    {
+      if (!line.empty() && line[line.size() - 1] == '\r')
+        line.erase(line.size() - 1);
+      if (line.empty())
+        continue;
+      if (line[0] == '/')
+        files.push_back(line);
+      else
+      {
+        if (line.compare(0, 2, "./") == 0)
+          line.erase(0, 2);
+        files.push_back(dir_path + line);
+      }
+    }
+  }
+
+  /*
+    Files are only ever appended to the sequence, so the position of the
+    file being read is kept when the list is read again.
+  */
+  m_files.swap(files);
+  return ERR_OK;
+}
+
+int Binlog_sequence_driver::find_file(const std::string &name,
+                                      size_t *index) const
+{
+  bool by_base_name= name.find('/') == std::string::npos;
+  for (size_t i= 0; i < m_files.size(); i++)
+  {
+    if (m_files[i] == name ||
+        (by_base_name && base_name(m_files[i]) == name))
+    {
+      *index= i;
+      return ERR_OK;
+    }
+  }
+  return ERR_FAIL;
+}
+
+int Binlog_sequence_driver::open_file(size_t index, unsigned long position)
+{
+  delete m_driver;
+  delete m_next_driver;
+  m_next_driver= NULL;
+  m_driver= new Binlog_readahead_driver(m_files[index]);
+  m_current= index;
+  m_binlog_file_name= m_files[index];
+  m_fde_seen= false;
+  m_rotate_to.clear();
+  if (m_driver->connect(m_files[index], position) != ERR_OK)
+  {
+    delete m_driver;
+    m_driver= NULL;
+    return ERR_FAIL;
+  }
+  prefetch_next_file();
+  return ERR_OK;
+}
+
+void Binlog_sequence_driver::prefetch_next_file()
+{
+  if (m_next_driver != NULL || m_current + 1 >= m_files.size())
+    return;
+  /*
+    Connecting starts the readers of the driver, which read the first
+    blocks of the file while the current file is being decoded.
+  */
+  m_next_driver= new Binlog_readahead_driver(m_files[m_current + 1]);
+  if (m_next_driver->connect() != ERR_OK)
+  {
+    delete m_next_driver;
+    m_next_driver= NULL;
+  }
+}
+
+int Binlog_sequence_driver::open_next_file()
+{
+  /*
+    The server writes the Rotate_event before it creates the next file, so
+    the file it names may not be in the list yet. It is looked for again
+    at the next call.
+  */
+  size_t next= m_current + 1;
+  if (!m_rotate_to.empty() ? find_file(m_rotate_to, &next) != ERR_OK :
+                             next >= m_files.size())
+  {
+    std::string current= m_files[m_current];
+    if (load_file_list() != ERR_OK ||
+        find_file(current, &m_current) != ERR_OK)
+      return ERR_FAIL;
+    next= m_current + 1;
+    if (!m_rotate_to.empty() ? find_file(m_rotate_to, &next) != ERR_OK :
+                               next >= m_files.size())
+      return ERR_EOF;
+  }
+
+  if (next != m_current + 1 || m_next_driver == NULL)
+    return open_file(next, BIN_LOG_HEADER_SIZE);
+
+  delete m_driver;
+  m_driver= m_next_driver;
+  m_next_driver= NULL;
+  m_current++;
+  m_binlog_file_name= m_files[m_current];
+  m_fde_seen= false;
+  m_rotate_to.clear();
+  prefetch_next_file();
+  return ERR_OK;
+}
+
+/**
+  Keeps the file named by a Rotate_event, to be read after the current
+  one. A relay log also contains the Rotate_events of the master, which
+  have the server id of the master: only the ones of the server which
+  wrote the file, as its first Format_description_event tells, end it.
+*/
+void Binlog_sequence_driver::check_rotate(const unsigned char *event,
+                                          size_t length)
+{
+  if (length < LOG_EVENT_MINIMAL_HEADER_LEN)
+    return;
+  unsigned char type= event[EVENT_TYPE_OFFSET];
+  uint32_t server_id;
+  memcpy(&server_id, event + SERVER_ID_OFFSET, 4);
+  server_id= le32toh(server_id);
+
+  if (type == FORMAT_DESCRIPTION_EVENT)
+  {
+    m_checksum_len=
+      Log_event_footer::get_checksum_alg((const char*) event, length) ==
+      BINLOG_CHECKSUM_ALG_CRC32 ? BINLOG_CHECKSUM_LEN : 0;
+    if (!m_fde_seen)
+      m_server_id= server_id;
+    m_fde_seen= true;
+  }
+  else if (type == ROTATE_EVENT && m_fde_seen && server_id == m_server_id)
+  {
+    size_t ident_offset= LOG_EVENT_MINIMAL_HEADER_LEN +
+                         Binary_log_event::ROTATE_HEADER_LEN;
+    if (length > ident_offset + m_checksum_len)
+      m_rotate_to= base_name(std::string((const char*) event + ident_offset,
+                                         length - ident_offset -
+                                         m_checksum_len));
+  }
+}
+
+int Binlog_sequence_driver::connect()
+{
+  disconnect();
+  m_log_base_name= m_base_name;
+  if (load_file_list() != ERR_OK || m_files.empty())
+    return ERR_FAIL;
+  return open_file(0, BIN_LOG_HEADER_SIZE);
+}
+
+int Binlog_sequence_driver::connect(const std::string &filename,
+                                    unsigned long position)
+{
+  disconnect();
+  m_log_base_name= m_base_name;
+  if (m_log_base_name.empty() && is_binlog_file_name(base_name(filename)))
+    m_log_base_name= log_base_name(filename);
+  if (load_file_list() != ERR_OK)
+    return ERR_FAIL;
+  return set_position(filename, position);
+}
+
+int Binlog_sequence_driver::disconnect()
+{
+  delete m_driver;
+  delete m_next_driver;
+  m_driver= NULL;
+  m_next_driver= NULL;
+  return ERR_OK;
+}
+
+int Binlog_sequence_driver::set_position(const std::string &str,
+                                         unsigned long position)
+{
+  size_t index= m_current;
+  if (!str.empty() && find_file(str, &index) != ERR_OK)
+    return ERR_FAIL;
+  if (index >= m_files.size())
+    return ERR_FAIL;
+
+  if (index == m_current && m_driver != NULL)
+  {
+    m_rotate_to.clear();
+    return m_driver->set_position("", position);
+  }
+  return open_file(index, position);
+}
+
+int Binlog_sequence_driver::get_position(std::string *str,
+                                         unsigned long *position)
+{
+  if (m_driver == NULL)
+  {
+    if (str)
+      *str= m_binlog_file_name;
+    if (position)
+      *position= 0;
+    return ERR_OK;
+  }
+  return m_driver->get_position(str, position);
+}
+
+int Binlog_sequence_driver::get_next_event(std::pair<unsigned char *, size_t>
+                                           *buffer_buflen)
+{
+  if (m_driver == NULL)
+    return ERR_FAIL;
+
+  while (true)
+  {
+    int error= m_driver->get_next_event(buffer_buflen);
+    if (error == ERR_OK)
+      check_rotate(buffer_buflen->first, buffer_buflen->second);
+    if (error != ERR_EOF)
+      return error;
+    if ((error= open_next_file()) != ERR_OK)
+      return error;
+  }
+}
+
+size_t Binlog_sequence_driver::file_size() const
+{
+  return m_driver ? m_driver->file_size() : 0;
+}
+
+}// end namespace system
+}// end namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
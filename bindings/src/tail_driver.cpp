@@ -0,0 +1,462 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "tail_driver.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/**
+  Returned by wait_for_bytes() when the server has moved on to the next
+  file without writing a Rotate_event to the current one.
+*/
+#define TAIL_NEXT_FILE (-1)
+
+namespace binary_log { namespace system {
+
+/**
+  Reads exactly len bytes at offset.
+
+  @retval true  on success
+  @retval false on a read error or an unexpected end of file
+*/
+static bool read_at(int fd, unsigned char *dest, size_t len, off_t offset)
+{
+  while (len > 0)
+  {
+    ssize_t n= pread(fd, dest, len, offset);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    dest+= n;
+    len-= n;
+    offset+= n;
+  }
+  return true;
+}
+
+static std::string dir_name(const std::string &path)
+{
+  size_t slash= path.rfind('/');
+  if (slash == std::string::npos)
+    return ".";
+  if (slash == 0)
+    return "/";
+  return path.substr(0, slash);
+}
+
+int Binlog_tail_driver::connect()
+{
+  disconnect();
+
+  m_inotify_fd= inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (m_inotify_fd == -1)
+    return ERR_FAIL;
+
+  m_dir_wd= inotify_add_watch(m_inotify_fd,
+                              dir_name(m_binlog_file_name).c_str(),
+                              IN_CREATE | IN_MOVED_TO);
+  if (m_dir_wd == -1 || open_file(m_binlog_file_name, false) != ERR_OK)
+  {
+    disconnect();
+    return ERR_FAIL;
+  }
+
+  // Check if a valid MySQL binlog file is provided, if it has been written.
+  if (m_file_size >= BIN_LOG_HEADER_SIZE)
+  {
+    unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+    unsigned char header[BIN_LOG_HEADER_SIZE + LOG_EVENT_MINIMAL_HEADER_LEN];
+    if (!read_at(m_fd, header, BIN_LOG_HEADER_SIZE, 0) ||
+        memcmp(magic, header, BIN_LOG_HEADER_SIZE))
+    {
+      disconnect();
+      return ERR_FAIL;                          // Not a valid binlog file.
+    }
+    m_magic_checked= true;
+
+    // The first event must be a FDE, to check the binlog version
+    if (m_file_size >= sizeof(header) &&
+        (!read_at(m_fd, header, sizeof(header), 0) ||
+         header[BIN_LOG_HEADER_SIZE + EVENT_TYPE_OFFSET] !=
+         FORMAT_DESCRIPTION_EVENT))
+    {
+      disconnect();
+      return ERR_BINLOG_VERSION;
+    }
+  }
+
+  m_bytes_read= BIN_LOG_HEADER_SIZE;
+  m_fde_pending= false;
+  m_rotate_to.clear();
+  last_event_len= 0;
+  return ERR_OK;
+}
+
+int Binlog_tail_driver::connect(const std::string &filename,
+                                unsigned long position)
+{
+  m_binlog_file_name= filename;
+  if (connect() != ERR_OK)
+    return ERR_FAIL;
+  return set_position(filename, position);
+}
+
+int Binlog_tail_driver::disconnect()
+{
+  close_file();
+  if (m_inotify_fd != -1)
+    close(m_inotify_fd);
+  m_inotify_fd= -1;
+  m_dir_wd= -1;
+  return ERR_OK;
+}
+
+int Binlog_tail_driver::set_position(const std::string &str,
+                                     unsigned long position)
+{
+  if (!str.empty() && str != m_binlog_file_name)
+    return connect(str, position);
+
+  if (m_fd == -1 || position < BIN_LOG_HEADER_SIZE)
+    return ERR_FAIL;
+  /* A position beyond the end is allowed in follow mode */
+  if (!m_follow && (refresh_size() != ERR_OK || position > m_file_size))
+    return ERR_FAIL;
+
+  m_bytes_read= position;
+  m_rotate_to.clear();
+  /*
+    As with Binlog_file_driver, if nothing has been read yet and we start
+    from the middle of the file, the FDE is returned first.
+  */
+  m_fde_pending= (last_event_len == 0 && position > BIN_LOG_HEADER_SIZE);
+  return ERR_OK;
+}
+
+int Binlog_tail_driver::get_position(std::string *str, unsigned long *position)
+{
+  if (str)
+    *str= m_binlog_file_name;
+  if (position)
+    *position= m_bytes_read;
+  return ERR_OK;
+}
+
+int Binlog_tail_driver::open_file(const std::string &filename, bool wait)
+{
+  close_file();
+  m_binlog_file_name= filename;
+
+  /*
+    The server writes the Rotate_event before it creates the next file, so
+    the file may not exist yet.
+  */
+  while ((m_fd= open(filename.c_str(), O_RDONLY | O_CLOEXEC)) == -1)
+  {
+    if (errno != ENOENT || !wait || !m_follow)
+      return ERR_FAIL;
+    int error= wait_for_change();
+    if (error != ERR_OK)
+      return error;
+  }
+
+  /*
+    The watch is added before the size is checked, so that no write can
+    happen unnoticed in between.
+  */
+  m_file_wd= inotify_add_watch(m_inotify_fd, filename.c_str(), IN_MODIFY);
+  if (m_file_wd == -1)
+  {
+    close_file();
+    return ERR_FAIL;
+  }
+
+  m_file_size= 0;
+  m_magic_checked= false;
+  m_checksum_len= 0;
+  m_fde_seen= false;
+  return refresh_size();
+}
+
+void Binlog_tail_driver::close_file()
+{
+  if (m_file_wd != -1)
+    inotify_rm_watch(m_inotify_fd, m_file_wd);
+  m_file_wd= -1;
+  if (m_fd != -1)
+    close(m_fd);
+  m_fd= -1;
+}
+
+int Binlog_tail_driver::refresh_size()
+{
+  struct stat stat_buff;
+  if (fstat(m_fd, &stat_buff) == -1)
+    return ERR_FAIL;
+  m_file_size= stat_buff.st_size;
+  return ERR_OK;
+}
+
+/**
+  Blocks until the inotify descriptor reports a change, and drains all
+  the pending notifications.
+*/
+int Binlog_tail_driver::wait_for_change()
+{
+  struct pollfd pfd;
+  pfd.fd= m_inotify_fd;
+  pfd.events= POLLIN;
+
+  int ready;
+  while ((ready= poll(&pfd, 1, m_wait_timeout)) == -1 && errno == EINTR)
+    ;
+  if (ready == -1)
+    return ERR_FAIL;
+  if (ready == 0)
+    return ERR_EOF;                             // Timed out
+
+  /* The descriptor is non-blocking, so the reads stop once it is empty */
+  char events[sizeof(struct inotify_event) + NAME_MAX + 1]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t count;
+  while ((count= read(m_inotify_fd, events, sizeof(events))) > 0 ||
+         (count == -1 && errno == EINTR))
+    ;
+  if (count == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    return ERR_FAIL;
+  return ERR_OK;
+}
+
+/**
+  Waits until the file is at least end bytes long.
+
+  @retval ERR_OK         The bytes can be read
+  @retval ERR_EOF        The file is shorter and follow mode is off, or
+                         the wait timed out
+  @retval TAIL_NEXT_FILE The next file of the sequence exists and the
+                         current one is not growing anymore
+  @retval ERR_FAIL       An error occurred
+*/
+int Binlog_tail_driver::wait_for_bytes(unsigned long end)
+{
+  while (true)
+  {
+    if (refresh_size() != ERR_OK)
+      return ERR_FAIL;
+    if (m_file_size >= end)
+      return ERR_OK;
+    if (!m_follow)
+      return ERR_EOF;
+
+    /*
+      The server creates the next file only after it is done with the
+      current one, so once the next file exists the size is checked one
+      last time before moving on.
+    */
+    if (file_exists(next_file_name()))
+    {
+      if (refresh_size() != ERR_OK)
+        return ERR_FAIL;
+      if (m_file_size >= end)
+        return ERR_OK;
+      return TAIL_NEXT_FILE;
+    }
+
+    int error= wait_for_change();
+    if (error != ERR_OK)
+      return error;
+  }
+}
+
+/**
+  Returns the name of the file with the sequence number following the
+  one of the current file, keeping the width of the number.
+*/
+std::string Binlog_tail_driver::next_file_name() const
+{
+  size_t dot= m_binlog_file_name.rfind('.');
+  if (dot == std::string::npos || dot + 1 == m_binlog_file_name.size())
+    return std::string();
+  std::string number= m_binlog_file_name.substr(dot + 1);
+  if (number.find_first_not_of("0123456789") != std::string::npos)
+    return std::string();
+
+  char next[32];
+  snprintf(next, sizeof(next), "%0*lu", (int)number.size(),
+           strtoul(number.c_str(), NULL, 10) + 1);
+  return m_binlog_file_name.substr(0, dot + 1) + next;
+}
+
+bool Binlog_tail_driver::file_exists(const std::string &filename) const
+{
+  struct stat stat_buff;
+  return !filename.empty() && stat(filename.c_str(), &stat_buff) == 0;
+}
+
+int Binlog_tail_driver::reserve_buf(size_t size)
+{
+  if (size <= m_buf_size)
+    return ERR_OK;
+  unsigned char *new_buf= (unsigned char*) realloc(buf, size);
+  if (new_buf == NULL)
+    return ERR_FAIL;
+  buf= new_buf;
+  m_buf_size= size;
+  return ERR_OK;
+}
+
+int Binlog_tail_driver::get_next_event(std::pair<unsigned char *, size_t>
+                                       *buffer_buflen)
+{
+  if (m_fd == -1)
+    return ERR_FAIL;
+
+  int error;
+  while (true)
+  {
+    if (!m_rotate_to.empty())
+    {
+      std::string filename= m_rotate_to;
+      m_rotate_to.clear();
+      if ((error= open_file(filename, true)) != ERR_OK)
+        return error;
+      m_bytes_read= BIN_LOG_HEADER_SIZE;
+      m_fde_pending= false;
+    }
+
+    if (!m_magic_checked)
+    {
+      unsigned char magic[]= {0xfe, 0x62, 0x69, 0x6e, 0};
+      unsigned char magic_buf[BIN_LOG_HEADER_SIZE];
+      if ((error= wait_for_bytes(BIN_LOG_HEADER_SIZE)) != ERR_OK)
+        return error == TAIL_NEXT_FILE ? ERR_FAIL : error;
+      if (!read_at(m_fd, magic_buf, BIN_LOG_HEADER_SIZE, 0) ||
+          memcmp(magic, magic_buf, BIN_LOG_HEADER_SIZE))
+        return ERR_FAIL;                        // Not a valid binlog file.
+      m_magic_checked= true;
+    }
+
+    unsigned long event_pos= m_fde_pending ? BIN_LOG_HEADER_SIZE :
+                                             m_bytes_read;
+    unsigned char head[LOG_EVENT_MINIMAL_HEADER_LEN];
+    uint32_t data_len= 0;
+    error= wait_for_bytes(event_pos + LOG_EVENT_MINIMAL_HEADER_LEN);
+    if (error == ERR_OK)
+    {
+      if (!read_at(m_fd, head, sizeof(head), event_pos))
+        return ERR_FAIL;
+      memcpy(&data_len, head + EVENT_LEN_OFFSET, 4);
+      data_len= le32toh(data_len);
+      if (data_len < LOG_EVENT_MINIMAL_HEADER_LEN)
+        return ERR_FAIL;
+      /* Wait for the rest of a partially written event */
+      error= wait_for_bytes(event_pos + data_len);
+    }
+
+    if (error == TAIL_NEXT_FILE)
+    {
+      /* Whatever was left of the current file is never completed */
+      m_rotate_to= next_file_name();
+      continue;
+    }
+    if (error != ERR_OK)
+    {
+      if (error == ERR_EOF && !m_follow && event_pos != m_file_size)
+        return ERR_FAIL;                        // Truncated event
+      return error;
+    }
+
+    if (reserve_buf(data_len + 1) != ERR_OK ||
+        !read_at(m_fd, buf, data_len, event_pos))
+      return ERR_FAIL;
+    buf[data_len]= 0;
+    break;
+  }
+
+  uint32_t data_len;
+  memcpy(&data_len, buf + EVENT_LEN_OFFSET, 4);
+  data_len= le32toh(data_len);
+  unsigned char type= buf[EVENT_TYPE_OFFSET];
+  uint32_t server_id;
+  memcpy(&server_id, buf + SERVER_ID_OFFSET, 4);
+  server_id= le32toh(server_id);
+
+  if (type == FORMAT_DESCRIPTION_EVENT)
+  {
+    /*
+      A relay log also holds the FDE of the master after its own: only the
+      first one of the file tells the server which wrote it.
+    */
+    if (!m_fde_seen)
+      m_server_id= server_id;
+    m_fde_seen= true;
+    m_checksum_len=
+      Log_event_footer::get_checksum_alg((const char*) buf, data_len) ==
+      BINLOG_CHECKSUM_ALG_CRC32 ? BINLOG_CHECKSUM_LEN : 0;
+  }
+  else if (type == ROTATE_EVENT && m_follow && m_fde_seen &&
+           server_id == m_server_id)
+  {
+    /*
+      A relay log also contains the Rotate_events of the master, which have
+      the server id of the master; only the ones of the server which wrote
+      this file end it.
+    */
+    size_t ident_offset= LOG_EVENT_MINIMAL_HEADER_LEN +
+                         Binary_log_event::ROTATE_HEADER_LEN;
+    if (data_len > ident_offset + m_checksum_len)
+    {
+      std::string name((const char*) buf + ident_offset,
+                       data_len - ident_offset - m_checksum_len);
+      m_rotate_to= name[0] == '/' ? name :
+                   dir_name(m_binlog_file_name) + "/" + name;
+    }
+  }
+
+  if (m_fde_pending)
+    m_fde_pending= false;
+  else
+    m_bytes_read+= data_len;
+
+  last_event_len= data_len;
+  *buffer_buflen= std::make_pair(buf, (size_t)data_len);
+  return ERR_OK;
+}
+
+size_t Binlog_tail_driver::file_size() const
+{
+  return m_file_size;
+}
+
+}// end namespace system
+}// end namespace binary_log
+
+#endif /* HAVE_SYS_INOTIFY_H */
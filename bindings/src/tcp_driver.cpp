@@ -39,6 +39,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
 #include <streambuf>
 #include <cstdio>
 #include <exception>
+#include <sys/socket.h>
+#include <strings.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef BINLOG_THROUGH_GTID
+/** Flag of COM_BINLOG_DUMP_GTID telling that a GTID set follows */
+#define BINLOG_THROUGH_GTID 0x04
+#endif
 
 using binary_log::Error_code;
 namespace binary_log { namespace system {
@@ -91,15 +100,24 @@ int Binlog_tcp_driver::connect(const std::string& user,
   if (!m_mysql)
     return ERR_FAIL;
 
-  int err= sync_connect_and_authenticate(m_mysql, user, passwd, host, port, offset);
+  int err= sync_connect_and_authenticate(m_mysql, user, passwd, host, port,
+                                         offset, m_stream_checksum);
   if (err != ERR_OK)
     return err;
 
   const char *binlog_file= "";
   if (binlog_filename != "" || offset > 4)
+  {
+    m_binlog_file_name= binlog_filename;
+    m_binlog_offset= offset;
     start_binlog_dump(binlog_filename.c_str(), offset);
+  }
   else
+  {
+    /* The name of the first file comes with the first Rotate_event */
+    m_binlog_file_name= binlog_file;
     start_binlog_dump(binlog_file, m_binlog_offset);
+  }
   return ERR_OK;
 }
 
@@ -112,13 +130,15 @@ int Binlog_tcp_driver::connect(const std::string& user,
   @param passwd           password for connecting to the mysql-server
   @param host             host name
   @param port             port number
+  @param stream_checksum  ask for the checksum algorithm of the binlog of
+                          the server instead of none
   @retval ERR_OK          success
   @retval Other Value     failure
 */
 int sync_connect_and_authenticate(MYSQL *conn, const std::string &user,
                                   const std::string &passwd,
                                   const std::string &host, uint port,
-                                  long offset)
+                                  long offset, bool stream_checksum)
 {
 
   ushort binlog_flags= 0;
@@ -152,11 +172,13 @@ int sync_connect_and_authenticate(MYSQL *conn, const std::string &user,
   {
     /*
      Make a notice to the server that this client
-     is checksum-aware. It does not need the first fake Rotate
-     necessary checksummed.
+     is checksum-aware. Unless asked for the checksums, it does not need
+     the first fake Rotate necessary checksummed.
      That preference is specified below.
     */
-    if(mysql_query(conn, "SET @master_binlog_checksum='NONE'"))
+    if(mysql_query(conn, stream_checksum ?
+                   "SET @master_binlog_checksum= @@global.binlog_checksum" :
+                   "SET @master_binlog_checksum='NONE'"))
     {
        return ERR_CHECKSUM_QUERY_FAIL;
     }
@@ -209,49 +231,357 @@ void Binlog_tcp_driver::start_binlog_dump(const char *binlog_name,
   simple_command(m_mysql, COM_BINLOG_DUMP, buf, binlog_name_length + 10, 1);
 }
 
-int Binlog_tcp_driver::get_next_event(std::pair<unsigned char *, size_t> *buf_len_pair)
+/**
+  Requests the events of the transactions which are not in gtids.
+
+  The request has the flags, the server id, an empty binlog name with the
+  position 4, since the server looks the file up itself, and the GTID set
+  in the encoding of Gtid_set::encode().
+*/
+int Binlog_tcp_driver::start_binlog_dump_gtid(const Gtid_set &gtids)
+{
+  ushort binlog_flags= BINLOG_THROUGH_GTID;
+  int server_id= 1;
+  size_t gtids_length= gtids.encoded_length();
+  std::vector<uchar> buf(2 + 4 + 4 + 8 + 4 + gtids_length);
+  uchar *pos= &buf[0];
+
+  m_mysql->status= MYSQL_STATUS_READY;
+  int2store(pos, binlog_flags); pos+= 2;
+  int4store(pos, server_id); pos+= 4;
+  int4store(pos, 0); pos+= 4;                   // Length of the binlog name
+  int8store(pos, 4); pos+= 8;
+  int4store(pos, gtids_length); pos+= 4;
+  gtids.encode(pos);
+  if (simple_command(m_mysql, COM_BINLOG_DUMP_GTID, &buf[0], buf.size(), 1))
+    return ERR_FAIL;
+  return ERR_OK;
+}
+
+int Binlog_tcp_driver::read_event(unsigned char **event, size_t *event_len)
 {
   size_t buf_len;
+  while (true)
+  {
 #if MYSQL_VERSION_ID >= 50705
-   buf_len= cli_safe_read(m_mysql, NULL);
+    buf_len= cli_safe_read(m_mysql, NULL);
 #else
-  buf_len= cli_safe_read(m_mysql);
+    buf_len= cli_safe_read(m_mysql);
 #endif
-  if (buf_len == packet_error)
-     return ERR_FAIL;
+    if (buf_len != packet_error)
+      break;
+    if (!is_connection_error() || resume_stream() != ERR_OK)
+      return ERR_FAIL;
+  }
+  track_position(m_mysql->net.buff + 1, buf_len - 1);
+  bool boundary= track_transaction(m_mysql->net.buff + 1, buf_len - 1);
+  /*
+    The stream has moved on once it returns an event past the resume point.
+    The events the server makes up when a dump starts have no end position,
+    and do not count.
+  */
+  if (buf_len > LOG_POS_OFFSET + 4 &&
+      uint4korr(m_mysql->net.buff + 1 + LOG_POS_OFFSET) != 0 &&
+      (boundary || !(m_gtid_mode || m_resume_at_transaction)))
+    m_reconnect_failures= 0;
 
-  if (buf_len > last_event_len)
-    buf= (unsigned char*) realloc(buf, buf_len);
-  memcpy(buf, m_mysql->net.buff + 1, buf_len - 1);
-  buf_len--;
+  /*
+    Skip the OK byte of the packet. The client library terminates the
+    packet with a zero byte, so the byte following the event is readable
+    as with the driver buffer.
+  */
+  *event= m_mysql->net.buff + 1;
+  *event_len= buf_len - 1;
+  return ERR_OK;
+}
+
+int Binlog_tcp_driver::get_next_event(std::pair<unsigned char *, size_t> *buf_len_pair)
+{
+  unsigned char *event;
+  size_t buf_len;
+  int error= read_event(&event, &buf_len);
+  if (error != ERR_OK)
+    return error;
+
+  if (m_zero_copy)
+  {
+    *buf_len_pair= std::make_pair(event, buf_len);
+    return ERR_OK;
+  }
+
+  if (buf_len + 1 > last_event_len)
+    buf= (unsigned char*) realloc(buf, buf_len + 1);
+  memcpy(buf, event, buf_len);
   last_event_len= buf_len;
   *buf_len_pair= std::make_pair(buf, buf_len);
   return ERR_OK;
 }
 
+int Binlog_tcp_driver::get_next_event_buffer(Event_buffer **buffer,
+                                             size_t *length)
+{
+  unsigned char *event;
+  size_t event_len;
+  int error= read_event(&event, &event_len);
+  if (error != ERR_OK)
+    return error;
+
+  /* Copied once, with its zero byte, whether in zero-copy mode or not */
+  Event_buffer *next= Event_buffer::reuse(*buffer, event_len + 1);
+  *buffer= next;
+  if (!next)
+    return ERR_FAIL;
+  memcpy(next->data(), event, event_len + 1);
+  *length= event_len;
+  return ERR_OK;
+}
+
 int Binlog_tcp_driver::connect()
 {
-  return connect(m_user, m_passwd, m_host, m_port);
+  int err= connect(m_user, m_passwd, m_host, m_port);
+  if (err == ERR_OK)
+    start_tracking(false);
+  return err;
 }
 int Binlog_tcp_driver::connect(const std::string &binlog_filename,
                                unsigned long offset)
 {
-  return connect(m_user, m_passwd, m_host, m_port, binlog_filename, offset);
+  int err= connect(m_user, m_passwd, m_host, m_port, binlog_filename, offset);
+  if (err == ERR_OK)
+    start_tracking(false);
+  return err;
+}
+int Binlog_tcp_driver::connect(const Gtid_set &gtids)
+{
+  m_gtids= gtids;
+  int err= connect_gtid(m_gtids);
+  if (err == ERR_OK)
+    start_tracking(true);
+  return err;
+}
+
+int Binlog_tcp_driver::connect_gtid(const Gtid_set &gtids)
+{
+  m_mysql= mysql_init(NULL);
+  if (!m_mysql)
+    return ERR_FAIL;
+
+  int err= sync_connect_and_authenticate(m_mysql, m_user, m_passwd, m_host,
+                                         m_port, BIN_LOG_HEADER_SIZE,
+                                         m_stream_checksum);
+  if (err != ERR_OK)
+    return err;
+  /* The server names the file it starts from in the first Rotate_event */
+  m_binlog_file_name= "";
+  m_binlog_offset= BIN_LOG_HEADER_SIZE;
+  return start_binlog_dump_gtid(gtids);
+}
+
+/**
+  Resets the state used to resume the stream, after a connection which
+  the caller asked for.
+*/
+void Binlog_tcp_driver::start_tracking(bool gtid_mode)
+{
+  __atomic_store_n(&m_aborted, false, __ATOMIC_SEQ_CST);
+  m_reconnect_failures= 0;
+  m_gtid_mode= gtid_mode;
+  m_in_transaction= false;
+  m_trx_begun= false;
+  m_trx_file= m_binlog_file_name;
+  m_trx_offset= m_binlog_offset;
+  m_pending_gno= 0;
+}
+
+/**
+  Tells whether the last read failed because the connection was lost, and
+  the stream is to be resumed.
+*/
+bool Binlog_tcp_driver::is_connection_error()
+{
+  if (m_reconnect_attempts == 0 || m_mysql == NULL ||
+      __atomic_load_n(&m_aborted, __ATOMIC_SEQ_CST))
+    return false;
+  /* Errors sent by the server, such as a purged binlog, are final */
+  unsigned int error= mysql_errno(m_mysql);
+  return error >= CR_MIN_ERROR && error <= CR_MAX_ERROR;
+}
+
+/**
+  Reconnects to the server and requests the events from the resume point,
+  waiting between the attempts as set by set_auto_reconnect().
+
+  @retval ERR_OK   The stream is resumed
+  @retval ERR_FAIL All the attempts failed, or abort_read() was called
+*/
+int Binlog_tcp_driver::resume_stream()
+{
+  while (m_reconnect_failures < m_reconnect_attempts)
+  {
+    if (m_reconnect_failures > 0)
+    {
+      unsigned long delay= m_reconnect_delay;
+      for (unsigned int i= 1;
+           i < m_reconnect_failures && delay < m_reconnect_max_delay; i++)
+        delay*= 2;
+      if (delay > m_reconnect_max_delay)
+        delay= m_reconnect_max_delay;
+      /* Sleep in slices, so that abort_read() is not delayed */
+      for (unsigned long slept= 0;
+           slept < delay && !__atomic_load_n(&m_aborted, __ATOMIC_SEQ_CST);
+           slept+= 10)
+        usleep(10000);
+    }
+    m_reconnect_failures++;
+    if (__atomic_load_n(&m_aborted, __ATOMIC_SEQ_CST))
+      return ERR_FAIL;
+
+    close_stream();
+    int err;
+    if (m_gtid_mode)
+      err= connect_gtid(m_gtids);
+    else if (m_resume_at_transaction)
+      err= connect(m_user, m_passwd, m_host, m_port, m_trx_file, m_trx_offset);
+    else
+      err= connect(m_user, m_passwd, m_host, m_port, m_binlog_file_name,
+                   m_binlog_offset);
+    if (err == ERR_OK)
+    {
+      m_reconnect_count++;
+      /* The interrupted transaction is sent again from its start */
+      if (m_gtid_mode || m_resume_at_transaction)
+      {
+        m_in_transaction= false;
+        m_trx_begun= false;
+        m_pending_gno= 0;
+      }
+      return ERR_OK;
+    }
+  }
+  return ERR_FAIL;
+}
+
+/**
+  Tells whether the statement of a Query_event is exactly statement.
+*/
+static bool is_query(const unsigned char *event, size_t length,
+                     const char *statement)
+{
+  const size_t header= LOG_EVENT_HEADER_LEN;
+  if (length < header + Binary_log_event::QUERY_HEADER_LEN)
+    return false;
+  size_t db_len= event[header + Query_event::Q_DB_LEN_OFFSET];
+  uint16_t status_vars_len;
+  memcpy(&status_vars_len,
+         event + header + Query_event::Q_STATUS_VARS_LEN_OFFSET, 2);
+  size_t query= header + Binary_log_event::QUERY_HEADER_LEN +
+                le16toh(status_vars_len) + db_len + 1;
+  size_t statement_len= strlen(statement);
+  if (query + statement_len > length)
+    return false;
+  /* The statement may be followed by a checksum */
+  size_t rest= length - query - statement_len;
+  return (rest == 0 || rest == BINLOG_CHECKSUM_LEN) &&
+         !strncasecmp((const char*) event + query, statement, statement_len);
+}
+
+/**
+  Records where the transactions end, after track_position(), so that the
+  stream can be resumed at a transaction boundary.
+
+  @retval true  The event ends a transaction, or is outside of one
+
+  A transaction starts with a Gtid_event or a BEGIN, and ends with a
+  Xid_event, a COMMIT or ROLLBACK, or with the statement following a
+  Gtid_event without BEGIN, as for DDL. Events outside of a transaction
+  are boundaries.
+*/
+bool Binlog_tcp_driver::track_transaction(const unsigned char *event,
+                                          size_t length)
+{
+  if (length < LOG_EVENT_HEADER_LEN)
+    return false;
+  bool ends= !m_in_transaction;
+  switch (event[EVENT_TYPE_OFFSET])
+  {
+  case GTID_LOG_EVENT:
+    if (length >= LOG_EVENT_HEADER_LEN + 1 + 16 + 8)
+    {
+      uint64_t gno;
+      memcpy(m_pending_sid, event + LOG_EVENT_HEADER_LEN + 1, 16);
+      memcpy(&gno, event + LOG_EVENT_HEADER_LEN + 1 + 16, 8);
+      m_pending_gno= le64toh(gno);
+    }
+    m_in_transaction= true;
+    ends= false;
+    break;
+  case ANONYMOUS_GTID_LOG_EVENT:
+    m_in_transaction= true;
+    ends= false;
+    break;
+  case QUERY_EVENT:
+    if (is_query(event, length, "BEGIN"))
+    {
+      m_in_transaction= true;
+      m_trx_begun= true;
+      ends= false;
+    }
+    else
+      ends= !m_trx_begun || is_query(event, length, "COMMIT") ||
+            is_query(event, length, "ROLLBACK");
+    break;
+  case XID_EVENT:
+    ends= true;
+    break;
+  }
+
+  if (ends)
+  {
+    if (m_pending_gno > 0)
+      m_gtids.add(m_pending_sid, m_pending_gno);
+    m_pending_gno= 0;
+    m_in_transaction= false;
+    m_trx_begun= false;
+    m_trx_file= m_binlog_file_name;
+    m_trx_offset= m_binlog_offset;
+  }
+  return ends;
 }
+
 /**
  * Make synchronous reconnect.
  */
 void Binlog_tcp_driver::reconnect()
 {
-  disconnect();
-  connect(m_user, m_passwd, m_host, m_port);
+  close_stream();
+  connect(m_user, m_passwd, m_host, m_port, m_binlog_file_name,
+          m_binlog_offset);
 }
 
 int Binlog_tcp_driver::disconnect()
+{
+  close_stream();
+  close_control();
+  return ERR_OK;
+}
+
+void Binlog_tcp_driver::close_stream()
 {
   if (m_mysql)
     mysql_close(m_mysql);
-  return ERR_OK;
+  m_mysql= NULL;
+}
+
+
+void Binlog_tcp_driver::abort_read()
+{
+  __atomic_store_n(&m_aborted, true, __ATOMIC_SEQ_CST);
+  /*
+    Only the socket is shut down, the connection is closed by disconnect()
+    once the reading thread has returned.
+  */
+  if (m_mysql && m_mysql->net.fd != INVALID_SOCKET)
+    ::shutdown(m_mysql->net.fd, SHUT_RDWR);
 }
 
 
@@ -264,99 +594,195 @@ void Binlog_tcp_driver::shutdown(void)
 int Binlog_tcp_driver::set_position(const std::string &str, unsigned long position)
 {
   //validate the new position before we attempt to set.
-
-  MYSQL *mysql= mysql_init(NULL);
-  if (!mysql)
-    return ERR_FAIL;
-  int err= sync_connect_and_authenticate(mysql, m_user, m_passwd, m_host, m_port);
+  int err= refresh_binlog_map(false);
   if (err != ERR_OK)
     return err;
 
-  std::map<std::string, unsigned long> binlog_map;
-  if (fetch_binlog_name_and_size(mysql, &binlog_map))
-    return ERR_MYSQL_QUERY_FAIL;
-
-  mysql_close(mysql);
-
-  std::map<std::string, unsigned long>::iterator binlog_itr= binlog_map.find(str);
-  if (binlog_itr == binlog_map.end())
+  std::map<std::string, unsigned long>::iterator binlog_itr=
+    m_binlog_map.find(str);
+  /* The cached list may be older than the position, ask the server */
+  if (binlog_itr == m_binlog_map.end() || position > binlog_itr->second)
+  {
+    if ((err= refresh_binlog_map(true)) != ERR_OK)
+      return err;
+    binlog_itr= m_binlog_map.find(str);
+  }
+  if (binlog_itr == m_binlog_map.end())
     return ERR_FAIL;
   if (position > binlog_itr->second)
     return ERR_FAIL;
-  disconnect();
+  close_stream();
 
   if (connect(m_user, m_passwd, m_host, m_port, str, position))
     return ERR_CONNECT;
+  start_tracking(false);
   return ERR_OK;
 }
+
+int Binlog_tcp_driver::set_position(const Gtid_set &gtids)
+{
+  close_stream();
+  if (connect(gtids))
+    return ERR_CONNECT;
+  return ERR_OK;
+}
+
 int Binlog_tcp_driver::get_position(std::string *filename_ptr,
                                     unsigned long *position_ptr)
 {
-  MYSQL *mysql= mysql_init(NULL);
-  if (!mysql)
-    return ERR_FAIL;
-  int err= sync_connect_and_authenticate(mysql, m_user, m_passwd, m_host, m_port);
+  if (filename_ptr)
+    *filename_ptr= m_binlog_file_name;
+  if (position_ptr)
+    *position_ptr= m_binlog_offset;
+  return ERR_OK;
+}
+
+int Binlog_tcp_driver::get_master_position(std::string *filename_ptr,
+                                           unsigned long *position_ptr)
+{
+  int err= refresh_master_status(false);
   if (err != ERR_OK)
     return err;
 
-  if (fetch_master_status(mysql, &m_binlog_file_name, &m_binlog_offset))
-    return ERR_MYSQL_QUERY_FAIL;
-
-  mysql_close(mysql);
-   if (filename_ptr)
-    *filename_ptr= m_binlog_file_name;
+  if (filename_ptr)
+    *filename_ptr= m_master_file;
   if (position_ptr)
-    *position_ptr= m_binlog_offset;
+    *position_ptr= m_master_position;
   return ERR_OK;
 }
+
+static unsigned long long now_msec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+MYSQL *Binlog_tcp_driver::control_connection() const
+{
+  if (m_control)
+    return m_control;
+  MYSQL *mysql= mysql_init(NULL);
+  if (!mysql)
+    return NULL;
+  /* So that mysql_real_connect use TCP_IP_PROTOCOL. */
+  mysql_unix_port= 0;
+  if (!mysql_real_connect(mysql, m_host.c_str(), m_user.c_str(),
+                          m_passwd.c_str(), "", m_port, 0, 0))
+  {
+    mysql_close(mysql);
+    return NULL;
+  }
+  m_control= mysql;
+  return m_control;
+}
+
+void Binlog_tcp_driver::close_control() const
+{
+  if (m_control)
+    mysql_close(m_control);
+  m_control= NULL;
+  m_binlog_map_expiry= 0;
+  m_master_status_expiry= 0;
+}
+
+/**
+  Runs SHOW BINARY LOGS on the control connection, unless the cached
+  result is still valid and force is false. The query is retried once on
+  a new connection, since the server may have closed an idle one.
+*/
+int Binlog_tcp_driver::refresh_binlog_map(bool force) const
+{
+  unsigned long long now= now_msec();
+  if (!force && now < m_binlog_map_expiry)
+    return ERR_OK;
+  for (int attempt= 0; attempt < 2; attempt++)
+  {
+    MYSQL *mysql= control_connection();
+    if (!mysql)
+      return ERR_CONNECT;
+    std::map<std::string, unsigned long> binlog_map;
+    if (!fetch_binlog_name_and_size(mysql, &binlog_map))
+    {
+      m_binlog_map.swap(binlog_map);
+      m_binlog_map_expiry= now + m_metadata_ttl;
+      return ERR_OK;
+    }
+    close_control();
+  }
+  return ERR_MYSQL_QUERY_FAIL;
+}
+
+/**
+  Runs SHOW MASTER STATUS on the control connection, see
+  refresh_binlog_map().
+*/
+int Binlog_tcp_driver::refresh_master_status(bool force) const
+{
+  unsigned long long now= now_msec();
+  if (!force && now < m_master_status_expiry)
+    return ERR_OK;
+  for (int attempt= 0; attempt < 2; attempt++)
+  {
+    MYSQL *mysql= control_connection();
+    if (!mysql)
+      return ERR_CONNECT;
+    if (!fetch_master_status(mysql, &m_master_file, &m_master_position))
+    {
+      m_master_status_expiry= now + m_metadata_ttl;
+      return ERR_OK;
+    }
+    close_control();
+  }
+  return ERR_MYSQL_QUERY_FAIL;
+}
+
 bool fetch_master_status(MYSQL *mysql, std::string *filename,
                          unsigned long *position)
 {
   if (mysql_query(mysql, "show master status"))
-    return ERR_MYSQL_QUERY_FAIL;
+    return true;
   MYSQL_RES *res= mysql_use_result(mysql);
   if (!res)
-    return ERR_MYSQL_QUERY_FAIL;
+    return true;
   MYSQL_ROW row= mysql_fetch_row(res);
   if (!row)
-    return ERR_MYSQL_QUERY_FAIL;
+  {
+    mysql_free_result(res);
+    return true;
+  }
   *filename= row[0];
   *position= strtoul(row[1], NULL, 0);
-  return ERR_OK;
+  /* Reads the rest of the result, so that the connection can be reused */
+  mysql_free_result(res);
+  return false;
 }
 
 size_t Binlog_tcp_driver::file_size() const
 {
-  MYSQL *mysql= mysql_init(NULL);
-  if (!mysql)
-    return ERR_FAIL;
-  if (int err= sync_connect_and_authenticate(mysql, m_user, m_passwd,
-                                             m_host, m_port) != ERR_OK)
-    return err;
-  std::map<std::string, unsigned long> mp;
-  std::map<std::string, unsigned long>::iterator it;
-  fetch_binlog_name_and_size(mysql, &mp);
-  return static_cast<size_t>((*mp.begin()).second);
+  if (refresh_binlog_map(false) != ERR_OK || m_binlog_map.empty())
+    return 0;
+  return static_cast<size_t>((*m_binlog_map.begin()).second);
 }
 
 
 bool fetch_binlog_name_and_size(MYSQL *mysql, std::map<std::string, unsigned long> *binlog_map)
 {
   if (mysql_query(mysql, "show binary logs"))
-    return ERR_MYSQL_QUERY_FAIL;
+    return true;
   MYSQL_RES *res= mysql_use_result(mysql);
   if (!res)
-    return ERR_MYSQL_QUERY_FAIL;
+    return true;
   while (MYSQL_ROW row= mysql_fetch_row(res))
   {
     unsigned long position;
     std::string filename;
-    if (!row)
-      return ERR_MYSQL_QUERY_FAIL;
     filename= row[0];
     position= strtoul(row[1], NULL, 0);
     (*binlog_map).insert(std::make_pair(filename, position));
   }
-  return ERR_OK;
+  bool failed= mysql_errno(mysql) != 0;
+  mysql_free_result(res);
+  return failed;
 }
 }} // end namespace binary_log::system
@@ -122,20 +122,25 @@ int main(int argc, char** argv) {
     if (error_number == ERR_OK)
     {
       const char *error= NULL;
-      if (!(event= decode.decode_event((char*)buf_and_len.first, buf_and_len.second,
-                                        &error, 0)))
+      event= decode.decode_event((char*)buf_and_len.first, buf_and_len.second,
+                                 &error, 0);
+      if (event == NULL && error != NULL)
       {
-         std::cerr << error << std::endl;
-         break;
+        std::cerr << error << std::endl;
+        break;
       }
       if (argv[1][0]== 'f')
-        if ((error_number= static_cast<Binlog_file_driver*>(drv)->update_pos(event))
+        if ((error_number= static_cast<Binlog_file_driver*>(drv)->
+            update_pos(buf_and_len.second))
                            != ERR_OK)
         {
           const char* msg=  str_error(error_number);
           std::cerr << msg << std::endl;
           break;
         }
+      /* The filter of the decoder rejected the event */
+      if (event == NULL)
+        continue;
     }
     else
     {
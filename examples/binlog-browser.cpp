@@ -726,7 +726,9 @@ int main(int argc, char** argv)
       if (error_number == ERR_OK)
       {
         const char *error= NULL;
-        if (!(event= decode.decode_event((char*)buffer_buflen.first, buffer_buflen.second, &error, 1)))
+        event= decode.decode_event((char*)buffer_buflen.first, buffer_buflen.second,
+                                   &error, 1);
+        if (event == NULL && error != NULL)
         {
           cerr << error << endl;
           break;
@@ -734,13 +736,17 @@ int main(int argc, char** argv)
         //TODO: Consider modifying this
 
         if (transport_name == "file")
-          if ((error_number= static_cast<Binlog_file_driver*>(drv)->update_pos(event))
+          if ((error_number= static_cast<Binlog_file_driver*>(drv)->
+              update_pos(buffer_buflen.second))
                              != ERR_OK)
           {
             const char* msg=  str_error(error_number);
             std::cerr << msg << std::endl;
             break;
           }
+        /* The filter of the decoder rejected the event */
+        if (event == NULL)
+          continue;
       }
       else
       {
@@ -0,0 +1,71 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#include "binlog.h"
+#include <iostream>
+#include <stdlib.h>
+#include <string.h>
+/**
+  @file binlog-index
+
+  Builds the sidecar index of one or more binary log files, which is then
+  used by Binary_log::set_position_by_time() and
+  Binary_log::set_position_by_gtid() to seek into the files.
+ */
+
+using binary_log::Binlog_index;
+
+int main(int argc, char** argv) {
+  const char *base_name, *ptr;
+  unsigned long interval= BINLOG_INDEX_INTERVAL;
+  int first= 1;
+
+  if (argc > 2 && strcmp(argv[1], "--interval") == 0)
+  {
+    interval= strtoul(argv[2], NULL, 10);
+    first= 3;
+  }
+  if (first >= argc) {
+    ptr= strrchr(argv[0], '/');
+    base_name= (ptr == NULL? argv[0]: ptr + 1);
+    std::cerr << "Usage: " << base_name
+              << " [--interval <bytes>] <binlog-file> ..." << std::endl;
+    return 1;
+  }
+
+  int result= 0;
+  for (int i= first; i < argc; i++)
+  {
+    Binlog_index index;
+    int error= index.build(argv[i], interval);
+    if (error == ERR_OK)
+      error= index.save(Binlog_index::sidecar_name(argv[i]));
+    if (error != ERR_OK)
+    {
+      std::cerr << argv[i] << ": " << binary_log::str_error(error)
+                << std::endl;
+      result= 1;
+      continue;
+    }
+    std::cout << argv[i] << ": " << index.entries().size()
+              << " entries" << std::endl;
+  }
+  return result;
+}
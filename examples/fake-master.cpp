@@ -0,0 +1,137 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "fake_master.h"
+#include <iostream>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+/**
+  @file fake-master
+
+  Serves binary log files over the replication protocol, as a master
+  would, so that the TCP drivers can be run and measured without a MySQL
+  server, e.g. against the files of tests/std-data:
+
+    fake-master --port 13306 tests/std-data/searchbin.000001
+
+  and then mysql://root@127.0.0.1:13306. It runs until interrupted, and
+  then prints what it sent.
+ */
+
+using binary_log::system::Fake_master;
+using binary_log::system::Fake_master_stats;
+
+static void usage(const char *argv0)
+{
+  const char *ptr= strrchr(argv0, '/');
+  const char *base_name= (ptr == NULL? argv0: ptr + 1);
+  std::cerr << "Usage: " << base_name
+            << " [--port <port>] [--address <ip>] [--rate <events/s>]"
+               " [--write-size <bytes>] [--heartbeat <ms>]"
+               " [--disconnect-after <events>] [--eof]"
+               " <binlog-file> ..." << std::endl;
+}
+
+int main(int argc, char** argv) {
+  Fake_master master;
+  unsigned int port= 0;
+  std::string address("127.0.0.1");
+  int i;
+
+  for (i= 1; i < argc && strncmp(argv[i], "--", 2) == 0; i++)
+  {
+    if (strcmp(argv[i], "--eof") == 0)
+    {
+      master.set_eof_at_end(true);
+      continue;
+    }
+    if (i + 1 == argc)
+    {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *value= argv[++i];
+    if (strcmp(argv[i - 1], "--port") == 0)
+      port= strtoul(value, NULL, 10);
+    else if (strcmp(argv[i - 1], "--address") == 0)
+      address= value;
+    else if (strcmp(argv[i - 1], "--rate") == 0)
+      master.set_rate(strtoul(value, NULL, 10));
+    else if (strcmp(argv[i - 1], "--write-size") == 0)
+      master.set_write_size(strtoul(value, NULL, 10));
+    else if (strcmp(argv[i - 1], "--heartbeat") == 0)
+      master.set_heartbeat_period(strtoul(value, NULL, 10));
+    else if (strcmp(argv[i - 1], "--disconnect-after") == 0)
+      master.set_disconnect_after(strtoul(value, NULL, 10));
+    else
+    {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (i >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (; i < argc; i++)
+  {
+    int error= master.add_binlog(argv[i]);
+    if (error != ERR_OK)
+    {
+      std::cerr << argv[i] << ": " << binary_log::str_error(error)
+                << std::endl;
+      return 1;
+    }
+  }
+
+  /* The signals are taken by sigwait(), not by the threads serving */
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+  int error= master.start(port, address);
+  if (error != ERR_OK)
+  {
+    std::cerr << address << ":" << port << ": "
+              << binary_log::str_error(error) << std::endl;
+    return 1;
+  }
+  std::cout << "Listening on " << address << ":" << master.port()
+            << std::endl;
+
+  int signal;
+  sigwait(&signals, &signal);
+  master.stop();
+
+  Fake_master_stats stats;
+  master.get_stats(&stats);
+  std::cout << stats.connections << " connections, "
+            << stats.dumps << " dumps, "
+            << stats.events_sent << " events, "
+            << stats.heartbeats_sent << " heartbeats, "
+            << stats.bytes_sent << " bytes, "
+            << stats.disconnects << " disconnects" << std::endl;
+  return 0;
+}
@@ -19,6 +19,14 @@
 /* Headers we may use */
 #cmakedefine HAVE_STDINT_H @HAVE_STDINT_H@
 #cmakedefine HAVE_ENDIAN_H @HAVE_ENDIAN_H@
+#cmakedefine HAVE_SYS_MMAN_H @HAVE_SYS_MMAN_H@
+#cmakedefine HAVE_PTHREAD_H @HAVE_PTHREAD_H@
+#cmakedefine HAVE_SYS_INOTIFY_H @HAVE_SYS_INOTIFY_H@
+#cmakedefine HAVE_SYS_EPOLL_H @HAVE_SYS_EPOLL_H@
+#cmakedefine HAVE_SYS_AUXV_H @HAVE_SYS_AUXV_H@
+#cmakedefine HAVE_WMMINTRIN_H @HAVE_WMMINTRIN_H@
+#cmakedefine HAVE_SMMINTRIN_H @HAVE_SMMINTRIN_H@
+#cmakedefine HAVE_ARM_ACLE_H @HAVE_ARM_ACLE_H@
 /* Symbols we may use */
 #cmakedefine STANDALONE_BINLOG @STANDALONE_BINLOG@
 #cmakedefine IS_BIG_ENDIAN @IS_BIG_ENDIAN@
@@ -26,6 +34,7 @@
 #cmakedefine HAVE_LE32TOH @HAVE_LE32TOH@
 #cmakedefine HAVE_LE16TOH @HAVE_LE16TOH@
 #cmakedefine HAVE_STRNDUP @HAVE_STRNDUP@
+#cmakedefine HAVE_FDATASYNC @HAVE_FDATASYNC@
 #cmakedefine HAVE_ENDIAN_CONVERSION_MACROS @HAVE_ENDIAN_CONVERSION_MACROS@
 #cmakedefine SIZEOF_LONG_LONG   @SIZEOF_LONG_LONG@
 #cmakedefine HAVE_LONG_LONG 1
@@ -24,8 +24,17 @@ CHECK_INCLUDE_FILES(unistd.h HAVE_UNISTD_H)
 CHECK_INCLUDE_FILES(stdint.h HAVE_STDINT_H)
 # depending on the platform, we may or may not have this file
 CHECK_INCLUDE_FILES(endian.h HAVE_ENDIAN_H)
+CHECK_INCLUDE_FILES(sys/mman.h HAVE_SYS_MMAN_H)
+CHECK_INCLUDE_FILES(pthread.h HAVE_PTHREAD_H)
+CHECK_INCLUDE_FILES(sys/inotify.h HAVE_SYS_INOTIFY_H)
+CHECK_INCLUDE_FILES(sys/epoll.h HAVE_SYS_EPOLL_H)
+CHECK_INCLUDE_FILES(sys/auxv.h HAVE_SYS_AUXV_H)
+CHECK_INCLUDE_FILES(wmmintrin.h HAVE_WMMINTRIN_H)
+CHECK_INCLUDE_FILES(smmintrin.h HAVE_SMMINTRIN_H)
+CHECK_INCLUDE_FILES(arm_acle.h HAVE_ARM_ACLE_H)
 
 CHECK_FUNCTION_EXISTS(strndup HAVE_STRNDUP)
+CHECK_FUNCTION_EXISTS(fdatasync HAVE_FDATASYNC)
 
 # The header for glibc versions less than 2.9 will not
 # have the endian conversion macros defined
@@ -429,19 +429,23 @@ enum enum_binlog_checksum_alg
 /**
   Calculate a long checksum for a memoryblock.
 
+  The checksum is the CRC32 of zlib, computed with the CRC instructions
+  of the CPU when it has them, see crc32.cpp.
+
   @param crc       start value for crc
-  @param pos       pointer to memory block
+  @param pos       pointer to memory block, or NULL for the start value
   @param length    length of the block
 
   @return checksum for a memory block
 */
-inline uint32_t checksum_crc32(uint32_t crc, const unsigned char *pos,
-                               size_t length)
-{
-  BAPI_ASSERT(length <= UINT_MAX);
-  return static_cast<uint32_t>(crc32(static_cast<unsigned int>(crc), pos,
-                                     static_cast<unsigned int>(length)));
-}
+uint32_t checksum_crc32(uint32_t crc, const unsigned char *pos,
+                        size_t length);
+
+/**
+  @return the name of the implementation checksum_crc32() uses: "pclmul",
+          "armv8" or "zlib"
+*/
+const char *checksum_crc32_implementation();
 
 
 /*
@@ -830,6 +834,11 @@ protected:
   */
   Binary_log_event(const char **buf, uint16_t binlog_version,
                    const char *server_version);
+  /**
+    Reads the header of another event into this one, advancing the buffer
+    like the constructor above. Used to decode events in place.
+  */
+  void read_header(const char **buf, uint16_t binlog_version);
 public:
 #ifndef HAVE_MYSYS
   /*
@@ -0,0 +1,195 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/**
+  @file event_arena.h
+
+  @brief Contains a bump allocator holding the memory of decoded events,
+  which is released all at once.
+*/
+
+#ifndef EVENT_ARENA_INCLUDED
+#define	EVENT_ARENA_INCLUDED
+
+#include <new>
+#include <stddef.h>
+#include <stdlib.h>
+
+/** Default size of the chunks of an Event_arena, in bytes */
+#define EVENT_ARENA_CHUNK_SIZE (64 * 1024)
+/** Alignment of the memory returned by an Event_arena */
+#define EVENT_ARENA_ALIGN 16
+
+namespace binary_log {
+
+/**
+  @class Event_arena
+
+  A bump allocator: memory is taken from chunks by moving a pointer, and
+  is only given back by reset(), which rewinds the pointer to the first
+  chunk. The chunks are kept for the next use, so that an arena reset
+  after every event or every transaction stops calling malloc once it has
+  grown to the size of the largest one. Requests over a quarter of the
+  chunk size get blocks of their own, which reset() frees.
+
+  While an arena is the current one of a thread, see Scope, bapi_malloc(),
+  bapi_memdup() and bapi_strndup() allocate from it and bapi_free() leaves
+  its memory alone. Decoder::set_arena() uses that to build the events and
+  everything they allocate in an arena.
+
+  Objects built in an arena can register a cleanup with add_cleanup(),
+  run by reset() in the reverse order, with the arena current. That is
+  how the destructors of the events run, for their members which own
+  memory of their own.
+
+  An arena is used by one thread at a time.
+*/
+class Event_arena
+{
+public:
+  explicit Event_arena(size_t chunk_size= EVENT_ARENA_CHUNK_SIZE);
+  ~Event_arena();
+
+  /**
+    Allocates memory aligned on EVENT_ARENA_ALIGN bytes.
+
+    @return The memory, or NULL if a chunk cannot be allocated
+  */
+  void *alloc(size_t size)
+  {
+    size= (size + EVENT_ARENA_ALIGN - 1) & ~((size_t) EVENT_ARENA_ALIGN - 1);
+    if (size > (size_t) (m_end - m_ptr))
+      return alloc_slow(size);
+    void *ptr= m_ptr;
+    m_ptr+= size;
+    m_allocated+= size;
+    return ptr;
+  }
+
+  /** Whether the memory was allocated from this arena since the last reset */
+  bool owns(const void *ptr) const;
+
+  /**
+    Registers a function called with obj by the next reset().
+
+    @return false if the memory for the registration cannot be allocated
+  */
+  bool add_cleanup(void (*function)(void *), void *obj);
+
+  /**
+    Runs the cleanups and gives back all the memory allocated, which must
+    not be used any more.
+  */
+  void reset();
+
+  /** Bytes allocated since the last reset */
+  size_t allocated() const { return m_allocated; }
+  /** Bytes held in chunks, which reset() keeps */
+  size_t capacity() const { return m_capacity; }
+
+  /** The arena of the thread, NULL if none */
+  static Event_arena *current() { return m_current; }
+
+  /**
+    Makes an arena, or none if NULL, the current one of the thread during
+    its lifetime.
+  */
+  class Scope
+  {
+  public:
+    explicit Scope(Event_arena *arena) : m_saved(m_current)
+    {
+      m_current= arena;
+    }
+    ~Scope() { m_current= m_saved; }
+
+  private:
+    Event_arena *m_saved;
+  };
+
+private:
+  struct Chunk
+  {
+    Chunk *next;
+    size_t size;
+  };
+  struct Cleanup
+  {
+    void (*function)(void *);
+    void *obj;
+    Cleanup *next;
+  };
+
+  /** Size of the header of a chunk, keeping the memory after it aligned */
+  static const size_t CHUNK_HEADER= (sizeof(Chunk) + EVENT_ARENA_ALIGN - 1) &
+                                    ~((size_t) EVENT_ARENA_ALIGN - 1);
+
+  static char *chunk_begin(Chunk *chunk)
+  {
+    return reinterpret_cast<char *>(chunk) + CHUNK_HEADER;
+  }
+  static bool chunk_holds(const Chunk *chunk, const void *ptr)
+  {
+    const char *begin= reinterpret_cast<const char *>(chunk) + CHUNK_HEADER;
+    return static_cast<const char *>(ptr) >= begin &&
+           static_cast<const char *>(ptr) < begin + chunk->size;
+  }
+
+  void *alloc_slow(size_t size);
+
+  /* Not copyable */
+  Event_arena(const Event_arena&);
+  Event_arena &operator=(const Event_arena&);
+
+  size_t m_chunk_size;
+  /** The chunks, in the order they are used */
+  Chunk *m_first;
+  /** The chunk m_ptr is in, NULL before the first allocation */
+  Chunk *m_chunk;
+  char *m_ptr;
+  char *m_end;
+  /** The blocks of the large requests, freed by reset() */
+  Chunk *m_large;
+  Cleanup *m_cleanups;
+  size_t m_allocated;
+  size_t m_capacity;
+
+  static __thread Event_arena *m_current;
+};
+
+} // end namespace binary_log
+
+/**
+  Builds an object in an arena, or on the heap if the arena is NULL:
+  new (arena) T(...). The destructor of an object built in an arena is
+  called explicitly, usually from a cleanup, and its memory is given back
+  by Event_arena::reset().
+*/
+inline void *operator new(size_t size, binary_log::Event_arena *arena)
+{
+  void *ptr= arena ? arena->alloc(size) : ::operator new(size);
+  if (!ptr)
+    throw std::bad_alloc();
+  return ptr;
+}
+
+/** Called if the constructor of an object built in an arena throws */
+inline void operator delete(void *ptr, binary_log::Event_arena *arena)
+{
+  if (!arena)
+    ::operator delete(ptr);
+}
+
+#endif	/* EVENT_ARENA_INCLUDED */
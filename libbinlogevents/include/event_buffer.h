@@ -0,0 +1,285 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/**
+  @file event_buffer.h
+
+  @brief Contains a reference counted buffer holding events, which the
+  events decoded from it reference rather than copy.
+*/
+
+#ifndef EVENT_BUFFER_INCLUDED
+#define	EVENT_BUFFER_INCLUDED
+
+#include "event_arena.h"
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace binary_log {
+
+/**
+  @class Event_buffer
+
+  A block of memory shared by its references: it is freed when the last
+  one is released. A driver reads an event into a buffer, and the events
+  decoded from it, like a Rows_event, keep a reference to the parts they
+  need, see Buffer_slice. The driver reads the next event into the same
+  buffer if it is no longer shared, and into a new one otherwise, so that
+  the events can outlive the next read.
+
+  The count is updated atomically: the references may be released by
+  other threads, as the ones of Parallel_decoder.
+
+  The bytes either follow the buffer in the same allocation, see create(),
+  or belong to someone else, see wrap(): a driver which owns the memory it
+  reads into, like the mapping of Binlog_mmap_driver, hands it out without
+  copying it, and is told when the last reference to it is released.
+
+  While an Event_arena is the current one of the thread, create() takes
+  the buffer from it, as bapi_malloc() does: the last release then leaves
+  it to Event_arena::reset(), so the buffer must not outlive the events
+  of the arena.
+*/
+class Event_buffer
+{
+public:
+  /**
+    Called when the last reference to a buffer of wrap() is released,
+    with the arg, the data and the capacity it was wrapped with.
+  */
+  typedef void (*Release_func)(void *arg, unsigned char *data,
+                               size_t capacity);
+
+  /**
+    Allocates a buffer holding one reference.
+
+    @return The buffer, or NULL if out of memory
+  */
+  static Event_buffer *create(size_t capacity)
+  {
+    Event_arena *arena= Event_arena::current();
+    void *mem= arena ? arena->alloc(sizeof(Event_buffer) + capacity) :
+                       malloc(sizeof(Event_buffer) + capacity);
+    if (!mem)
+      return NULL;
+    Event_buffer *buffer=
+      new (mem) Event_buffer(reinterpret_cast<unsigned char *>
+                             (static_cast<Event_buffer *>(mem) + 1),
+                             capacity, NULL, NULL);
+    buffer->m_in_arena= arena != NULL;
+    return buffer;
+  }
+  /**
+    Allocates a buffer holding one reference to capacity bytes at data,
+    which it does not own: release_func is called when the last reference
+    is released, for the owner of the bytes to free them or to drop its own
+    reference to them.
+
+    @return The buffer, or NULL if out of memory
+  */
+  static Event_buffer *wrap(unsigned char *data, size_t capacity,
+                            Release_func release_func, void *arg)
+  {
+    void *mem= malloc(sizeof(Event_buffer));
+    return mem ? new (mem) Event_buffer(data, capacity, release_func, arg) :
+                 NULL;
+  }
+
+  void acquire() { __atomic_add_fetch(&m_refs, 1, __ATOMIC_RELAXED); }
+  void release()
+  {
+    if (__atomic_sub_fetch(&m_refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+      if (m_release_func)
+        m_release_func(m_release_arg, m_data, m_capacity);
+      if (!m_in_arena)
+        free(this);
+    }
+  }
+  /** Whether there is another reference than the caller's */
+  bool shared() const { return __atomic_load_n(&m_refs, __ATOMIC_ACQUIRE) > 1; }
+  /** Whether the bytes belong to someone else, see wrap() */
+  bool wrapped() const { return m_release_func != NULL; }
+
+  unsigned char *data() { return m_data; }
+  const unsigned char *data() const { return m_data; }
+  size_t capacity() const { return m_capacity; }
+
+  /** Whether the length bytes at ptr are in the buffer */
+  bool holds(const void *ptr, size_t length) const
+  {
+    const unsigned char *begin= static_cast<const unsigned char *>(ptr);
+    return begin >= data() && begin + length <= data() + m_capacity;
+  }
+
+  /**
+    Returns a buffer of at least capacity bytes for the caller to fill,
+    given the one it used last, or NULL: that one if the caller holds the
+    only reference and it is large enough, else a new one, the reference
+    to the old one being released.
+
+    @return The buffer, or NULL if out of memory
+  */
+  static Event_buffer *reuse(Event_buffer *buffer, size_t capacity)
+  {
+    if (buffer && !buffer->shared() && !buffer->wrapped() &&
+        buffer->capacity() >= capacity)
+      return buffer;
+    if (buffer)
+      buffer->release();
+    return create(capacity);
+  }
+  /**
+    Returns a buffer referencing capacity bytes at data, given the one the
+    caller used last, or NULL, as reuse() does for the buffers it fills:
+    that one if the caller holds the only reference and it wraps bytes too,
+    after calling its release_func for them, else a new one of wrap(), the
+    reference to the old one being released.
+
+    @return The buffer, or NULL if out of memory
+  */
+  static Event_buffer *rewrap(Event_buffer *buffer, unsigned char *data,
+                              size_t capacity, Release_func release_func,
+                              void *arg)
+  {
+    if (buffer && !buffer->shared() && buffer->wrapped())
+    {
+      buffer->m_release_func(buffer->m_release_arg, buffer->m_data,
+                             buffer->m_capacity);
+      buffer->m_data= data;
+      buffer->m_capacity= capacity;
+      buffer->m_release_func= release_func;
+      buffer->m_release_arg= arg;
+      return buffer;
+    }
+    if (buffer)
+      buffer->release();
+    return wrap(data, capacity, release_func, arg);
+  }
+
+private:
+  Event_buffer(unsigned char *data, size_t capacity,
+               Release_func release_func, void *arg)
+    : m_refs(1), m_data(data), m_capacity(capacity),
+      m_release_func(release_func), m_release_arg(arg), m_in_arena(false)
+  {}
+  /* Released, never deleted */
+  ~Event_buffer();
+
+  unsigned int m_refs;
+  unsigned char *m_data;
+  size_t m_capacity;
+  Release_func m_release_func;
+  void *m_release_arg;
+  /** Whether the buffer was taken from an Event_arena, see create() */
+  bool m_in_arena;
+};
+
+/**
+  @class Buffer_slice
+
+  A range of bytes in an Event_buffer, holding a reference to it. It reads
+  like the std::vector<uint8_t> it stands for in the events: copying a
+  slice shares the bytes instead of copying them.
+*/
+class Buffer_slice
+{
+public:
+  typedef const uint8_t *const_iterator;
+  typedef const_iterator iterator;
+
+  Buffer_slice() : m_buffer(NULL), m_data(NULL), m_size(0) {}
+  Buffer_slice(const Buffer_slice &other)
+    : m_buffer(other.m_buffer), m_data(other.m_data), m_size(other.m_size)
+  {
+    if (m_buffer)
+      m_buffer->acquire();
+  }
+  Buffer_slice &operator=(const Buffer_slice &other)
+  {
+    assign(other.m_buffer, other.m_data, other.m_size);
+    return *this;
+  }
+  ~Buffer_slice() { clear(); }
+
+  /** References size bytes of buffer, from data */
+  void assign(Event_buffer *buffer, const uint8_t *data, size_t size)
+  {
+    if (buffer)
+      buffer->acquire();
+    if (m_buffer)
+      m_buffer->release();
+    m_buffer= buffer;
+    m_data= data;
+    m_size= size;
+  }
+  /**
+    Copies size bytes into a buffer of its own, the one it references if
+    nothing else does and it is large enough.
+
+    @return false if out of memory, the slice is then empty
+  */
+  bool copy(const uint8_t *data, size_t size)
+  {
+    /*
+      Bytes of the buffer it references are kept alive by another
+      reference, which makes reuse() copy them into a new buffer rather
+      than over themselves.
+    */
+    Event_buffer *source= m_buffer && m_buffer->holds(data, size) ?
+                          m_buffer : NULL;
+    if (source)
+      source->acquire();
+    Event_buffer *buffer= Event_buffer::reuse(m_buffer, size);
+    m_buffer= buffer;
+    m_size= buffer ? size : 0;
+    m_data= buffer ? buffer->data() : NULL;
+    if (buffer)
+      memcpy(buffer->data(), data, size);
+    if (source)
+      source->release();
+    return buffer != NULL;
+  }
+  void clear()
+  {
+    if (m_buffer)
+      m_buffer->release();
+    m_buffer= NULL;
+    m_data= NULL;
+    m_size= 0;
+  }
+
+  size_t size() const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  const uint8_t *data() const { return m_data; }
+  const_iterator begin() const { return m_data; }
+  const_iterator end() const { return m_data + m_size; }
+  const uint8_t &operator[](size_t i) const { return m_data[i]; }
+
+  /** The buffer the bytes are in, NULL if the slice is empty */
+  Event_buffer *buffer() const { return m_buffer; }
+
+private:
+  Event_buffer *m_buffer;
+  const uint8_t *m_data;
+  size_t m_size;
+};
+
+} // end namespace binary_log
+
+#endif	/* EVENT_BUFFER_INCLUDED */
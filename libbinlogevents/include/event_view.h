@@ -0,0 +1,224 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/**
+  @file event_view.h
+
+  @brief Contains views reading the fields of an event from its buffer,
+  without decoding it into a Binary_log_event.
+*/
+
+#ifndef EVENT_VIEW_INCLUDED
+#define	EVENT_VIEW_INCLUDED
+
+#include "control_events.h"
+#include "rows_event.h"
+#include "statement_events.h"
+
+namespace binary_log {
+
+/**
+  @class Event_view
+
+  A view over the buffer of an event, whose accessors read the fields of
+  the common header from the buffer when they are called. A view neither
+  copies nor allocates anything; it is valid as long as the buffer is.
+
+  The views of the types of events, like Query_view, are built from an
+  Event_view and read the fields of their post-header and body the same
+  way. Their accessors return 0, or NULL for the strings, when the event
+  is too short for the field. The strings are not null terminated, their
+  length is returned through the length argument.
+
+  Decoder::view_event() returns the views of the events of a stream, and
+  Decoder::decode_event() decodes the event of a view when a
+  Binary_log_event is needed.
+*/
+class Event_view
+{
+public:
+  Event_view()
+    : m_buf(NULL), m_length(0), m_header_len(0), m_post_header_len(0),
+      m_checksum_len(0)
+  {}
+  /**
+    @param buf                The event, from its common header
+    @param length             The length of the event, checksum included
+    @param description_event  The Format_description_event the event
+                              follows, which tells the length of the
+                              headers and whether there is a checksum
+  */
+  Event_view(const char *buf, size_t length,
+             const Format_description_event *description_event);
+
+  Log_event_type type() const
+  {
+    return static_cast<Log_event_type>(
+      static_cast<unsigned char>(m_buf[EVENT_TYPE_OFFSET]));
+  }
+  uint32_t timestamp() const { return read32(0); }
+  uint32_t server_id() const { return read32(SERVER_ID_OFFSET); }
+  uint32_t event_length() const { return read32(EVENT_LEN_OFFSET); }
+  /** The end position of the event, 0 for the binlog version 1 */
+  uint32_t log_pos() const
+  {
+    return m_header_len > LOG_POS_OFFSET ? read32(LOG_POS_OFFSET) : 0;
+  }
+  uint16_t flags() const
+  {
+    return m_header_len > FLAGS_OFFSET ? read16(FLAGS_OFFSET) : 0;
+  }
+
+  /** The whole event */
+  const char *data() const { return m_buf; }
+  size_t length() const { return m_length; }
+  /** The event after the common header and the post-header */
+  const char *body() const { return m_buf + m_header_len + m_post_header_len; }
+  /** The length of the body, without the checksum */
+  size_t body_length() const
+  {
+    size_t headers= (size_t) m_header_len + m_post_header_len + m_checksum_len;
+    return m_length > headers ? m_length - headers : 0;
+  }
+
+protected:
+  uint16_t read16(size_t offset) const
+  {
+    uint16_t value;
+    memcpy(&value, m_buf + offset, 2);
+    return le16toh(value);
+  }
+  uint32_t read32(size_t offset) const
+  {
+    uint32_t value;
+    memcpy(&value, m_buf + offset, 4);
+    return le32toh(value);
+  }
+  uint64_t read64(size_t offset) const
+  {
+    uint64_t value;
+    memcpy(&value, m_buf + offset, 8);
+    return le64toh(value);
+  }
+  /** The post-header, NULL if it is shorter than length */
+  const char *post_header(size_t length) const
+  {
+    if ((size_t) m_post_header_len < length ||
+        (size_t) m_header_len + m_post_header_len + m_checksum_len > m_length)
+      return NULL;
+    return m_buf + m_header_len;
+  }
+  /** Reads the table id of a Table_map_event or a Rows_event */
+  uint64_t read_table_id() const;
+
+  const char *m_buf;
+  size_t m_length;
+  uint8_t m_header_len;
+  uint8_t m_post_header_len;
+  uint8_t m_checksum_len;
+};
+
+/**
+  A view over a Query_event.
+*/
+class Query_view : public Event_view
+{
+public:
+  explicit Query_view(const Event_view &view) : Event_view(view) {}
+
+  uint32_t thread_id() const;
+  uint32_t exec_time() const;
+  uint16_t error_code() const;
+  /** The default database, empty if there is none */
+  const char *db(size_t *length) const;
+  const char *query(size_t *length) const;
+
+private:
+  /** The status variables, NULL if the event is too short for them */
+  const char *status_vars(size_t *length) const;
+};
+
+/**
+  A view over a Rotate_event.
+*/
+class Rotate_view : public Event_view
+{
+public:
+  explicit Rotate_view(const Event_view &view) : Event_view(view) {}
+
+  /** The position in the next file, 4 if the event does not tell it */
+  uint64_t position() const;
+  /** The name of the next file */
+  const char *new_log_ident(size_t *length) const;
+};
+
+/**
+  A view over a Table_map_event.
+*/
+class Table_map_view : public Event_view
+{
+public:
+  explicit Table_map_view(const Event_view &view) : Event_view(view) {}
+
+  uint64_t table_id() const { return read_table_id(); }
+  const char *db(size_t *length) const;
+  const char *table(size_t *length) const;
+  unsigned long column_count() const;
+};
+
+/**
+  A view over a Write_rows_event, an Update_rows_event or a
+  Delete_rows_event.
+*/
+class Rows_view : public Event_view
+{
+public:
+  explicit Rows_view(const Event_view &view) : Event_view(view) {}
+
+  uint64_t table_id() const { return read_table_id(); }
+  /** The flags of the post-header, see Rows_event::enum_flag */
+  uint16_t rows_flags() const;
+};
+
+/**
+  A view over a Xid_event.
+*/
+class Xid_view : public Event_view
+{
+public:
+  explicit Xid_view(const Event_view &view) : Event_view(view) {}
+
+  uint64_t xid() const
+  {
+    return body_length() >= 8 ? read64(body() - m_buf) : 0;
+  }
+};
+
+/**
+  A view over a Gtid_event or an Anonymous_gtid_event.
+*/
+class Gtid_view : public Event_view
+{
+public:
+  explicit Gtid_view(const Event_view &view) : Event_view(view) {}
+
+  /** The 16 bytes of the UUID of the server, NULL if the event is short */
+  const unsigned char *sid() const;
+  int64_t gno() const;
+};
+
+} // end namespace binary_log
+
+#endif	/* EVENT_VIEW_INCLUDED */
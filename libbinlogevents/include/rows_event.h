@@ -28,6 +28,7 @@
 #define	ROWS_EVENT_INCLUDED
 
 #include "control_events.h"
+#include "event_buffer.h"
 #include "table_id.h"
 #include <vector>
 
@@ -49,6 +50,43 @@
 
 namespace binary_log
 {
+/**
+  How the values of a column of a table are laid out in the rows of a
+  Rows_event, computed once from its Table_map_event.
+*/
+struct Column_layout
+{
+  /** The type of the column, as in Table_map_event::m_coltype */
+  unsigned char type;
+  /**
+    The type the values are decoded as: MYSQL_TYPE_ENUM or
+    MYSQL_TYPE_SET for a MYSQL_TYPE_STRING whose metadata tells so, the
+    type otherwise
+  */
+  unsigned char real_type;
+  /** The size of the length before the values, 0 if they have a fixed size */
+  unsigned char length_bytes;
+  /** Whether the column can be NULL */
+  bool nullable;
+  /** The metadata of the column, from Table_map_event::m_field_metadata */
+  uint16_t metadata;
+  /**
+    The size of the values, if they have no length before them; UINT_MAX
+    for the types whose size is not known
+  */
+  uint32_t fixed_size;
+
+  /** The size of the value at value in a row image, its length included */
+  uint32_t value_size(const unsigned char *value) const
+  {
+    if (!length_bytes)
+      return fixed_size;
+    uint32_t length= 0;
+    memcpy(&length, value, length_bytes);
+    return length_bytes + le32toh(length);
+  }
+};
+
 /**
   @class Table_map_event
 
@@ -405,6 +443,32 @@ public:
   */
   Table_map_event(const char *buf, unsigned int event_len,
                   const Format_description_event *description_event);
+  /**
+    Decodes another Table_map_event into this one, reusing the memory
+    held for the previous one when it is large enough.
+  */
+  void reinit(const char *buf, unsigned int event_len,
+              const Format_description_event *description_event);
+
+  /**
+    Decodes the post-header of an event whose body is byte-identical to
+    the one schema was decoded from, and shares the names and the columns
+    of schema rather than decoding them again, see share_schema().
+  */
+  Table_map_event(const char *buf, unsigned int event_len,
+                  const Format_description_event *description_event,
+                  const Table_map_event &schema);
+  /** Decodes another event as the constructor above does */
+  void reinit(const char *buf, unsigned int event_len,
+              const Format_description_event *description_event,
+              const Table_map_event &schema);
+
+  /**
+    Takes the names and the columns of a decoded Table_map_event. The
+    columns are not copied: the event holds a reference to the m_schema
+    of the other one, and they must not be modified.
+  */
+  void share_schema(const Table_map_event &schema);
 
   Table_map_event(const Table_id& tid, unsigned long colcnt, const char *dbnam,
                   size_t dblen, const char *tblnam, size_t tbllen)
@@ -418,7 +482,9 @@ public:
       m_colcnt(colcnt),
       m_field_metadata_size(0),
       m_field_metadata(0),
-      m_null_bits(0)
+      m_null_bits(0),
+      m_columns(0),
+      m_schema(0)
   {
     if (dbnam)
       m_dbnam= std::string(dbnam, m_dblen);
@@ -449,13 +515,27 @@ public:
   unsigned long  m_field_metadata_size;
   unsigned char* m_field_metadata;        /** field metadata */
   unsigned char* m_null_bits;
+  /**
+    The layout of the m_colcnt columns, built when the event is decoded
+    so that the rows are read without going through the metadata of the
+    columns before each one again. NULL for the events built directly.
+  */
+  Column_layout* m_columns;
+  /**
+    The buffer holding m_coltype, m_field_metadata, m_null_bits and
+    m_columns in a decoded event, possibly shared with other events; NULL
+    in an event built directly, whose buffers are freed one by one.
+  */
+  Event_buffer *m_schema;
 
   Table_map_event()
     : Binary_log_event(TABLE_MAP_EVENT),
       m_coltype(0),
       m_field_metadata_size(0),
       m_field_metadata(0),
-      m_null_bits(0)
+      m_null_bits(0),
+      m_columns(0),
+      m_schema(0)
   {}
 
   unsigned long long get_table_id()
@@ -471,10 +551,32 @@ public:
     return m_dbnam;
   }
 
+  /**
+    Returns the size in bytes of the metadata of a column of a type, in
+    m_field_metadata. Metadata of a field depends on the field type (and
+    not the field value).
+  */
+  static unsigned int metadata_size(unsigned char type);
+
 #ifndef HAVE_MYSYS
   void print_event_info(std::ostream& info);
   void print_long_info(std::ostream& info);
 #endif
+
+private:
+  void decode_body(const char *buf, unsigned int event_len,
+                   const Format_description_event *description_event);
+  const char *decode_post_header(const char *buf, unsigned int event_len,
+                                 const Format_description_event
+                                 *description_event);
+  void build_columns();
+
+  /*
+    Not copyable: share_schema() takes a reference to the columns of
+    another event instead.
+  */
+  Table_map_event(const Table_map_event&);
+  Table_map_event &operator=(const Table_map_event&);
 };
 
 
@@ -548,7 +650,7 @@ public:
 
   <tr>
     <td>columns_before_image</td>
-    <td>vector of elements of type uint8_t</td>
+    <td>Buffer_slice of elements of type uint8_t</td>
     <td>Bit-field indicating whether each column is used
         one bit per column. For this field, the amount of storage
         required for N columns is INT((N + 7) / 8) bytes.</td>
@@ -556,7 +658,7 @@ public:
 
   <tr>
     <td>columns_after_image</td>
-    <td>vector of elements of type uint8_t</td>
+    <td>Buffer_slice of elements of type uint8_t</td>
     <td>variable-sized (for UPDATE_ROWS_EVENT only).
         Bit-field indicating whether each column is used in the
         UPDATE_ROWS_EVENT and WRITE_ROWS_EVENT after-image; one bit per column.
@@ -577,7 +679,7 @@ public:
 
   <tr>
     <td>row</td>
-    <td>vector of elements of type uint8_t</td>
+    <td>Buffer_slice of elements of type uint8_t</td>
     <td> A sequence of zero or more rows. The end is determined by the size
          of the event. Each row has the following format:
            - A Bit-field indicating whether each field in the row is NULL.
@@ -644,10 +746,7 @@ public:
     : Binary_log_event(type_arg),
       m_table_id(0),
       m_width(0),
-      m_extra_row_data(0),
-      columns_before_image(0),
-      columns_after_image(0),
-      row(0)
+      m_extra_row_data(0)
   {}
 
  /**
@@ -677,13 +776,30 @@ public:
                              -common_header_len
                              The content of this object
                              depends on the binlog-version currently in use.
+   @param buffer             The Event_buffer holding buf, whose bytes the
+                             column bitmaps and the rows reference, or NULL
+                             if they are to be copied
  */
  Rows_event(const char *buf, unsigned int event_len,
-             const Format_description_event *description_event);
+             const Format_description_event *description_event,
+             Event_buffer *buffer= NULL);
 
   virtual ~Rows_event();
 
+  /**
+    Decodes another event of the same type into this one. Without an
+    Event_buffer, the copy of the column bitmaps and of the rows reuses
+    the memory of the previous one when nothing else references it.
+  */
+  void reinit(const char *buf, unsigned int event_len,
+              const Format_description_event *description_event,
+              Event_buffer *buffer= NULL);
+
 protected:
+  void decode_body(const char *buf, unsigned int event_len,
+                   const Format_description_event *description_event,
+                   Event_buffer *buffer);
+
   Log_event_type  m_type;     /** Actual event type */
 
   /** Post header content */
@@ -697,9 +813,14 @@ protected:
 
   unsigned char* m_extra_row_data;
 
-  std::vector<uint8_t> columns_before_image;
-  std::vector<uint8_t> columns_after_image;
-  std::vector<uint8_t> row;
+  /**
+    The column bitmaps and the rows, from the end of the post-header to
+    the end of the event: the other slices are parts of it.
+  */
+  Buffer_slice m_body;
+  Buffer_slice columns_before_image;
+  Buffer_slice columns_after_image;
+  Buffer_slice row;
 
 public:
   unsigned long long get_table_id() const
@@ -744,6 +865,7 @@ public:
 #endif
 
   template <class Iterator_value_type> friend class Row_event_iterator;
+  friend class Column_batch;
 };
 
 
@@ -760,8 +882,9 @@ class Write_rows_event : public virtual Rows_event
 public:
 
   Write_rows_event(const char *buf, unsigned int event_len,
-                   const Format_description_event *description_event)
-    : Rows_event(buf, event_len, description_event)
+                   const Format_description_event *description_event,
+                   Event_buffer *buffer= NULL)
+    : Rows_event(buf, event_len, description_event, buffer)
   {
     this->header()->type_code= m_type;
   };
@@ -788,8 +911,9 @@ class Update_rows_event : public virtual Rows_event
 public:
 
   Update_rows_event(const char *buf, unsigned int event_len,
-                    const Format_description_event *description_event)
-    : Rows_event(buf, event_len, description_event)
+                    const Format_description_event *description_event,
+                    Event_buffer *buffer= NULL)
+    : Rows_event(buf, event_len, description_event, buffer)
   {
     this->header()->type_code= m_type;
   }
@@ -816,8 +940,9 @@ class Delete_rows_event : public virtual Rows_event
 {
 public:
   Delete_rows_event(const char *buf, unsigned int event_len,
-                    const Format_description_event *description_event)
-    : Rows_event(buf, event_len, description_event)
+                    const Format_description_event *description_event,
+                    Event_buffer *buffer= NULL)
+    : Rows_event(buf, event_len, description_event, buffer)
   {
     this->header()->type_code= m_type;
   }
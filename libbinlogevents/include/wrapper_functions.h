@@ -26,6 +26,7 @@
 #define WRAPPER_FUNCTIONS_INCLUDED
 
 #include "binlog_config.h"
+#include "event_arena.h"
 #ifndef STANDALONE_BINLOG
 #define HAVE_MYSYS 1
 #endif
@@ -89,7 +90,8 @@ inline char *strndup (const char *s, size_t n)
 
   If compiled with MySQL server,the strndup function from the mysys library is
   called, which allow instrumenting memory allocated. Else, the standard
-  string function is called.
+  string function is called. If the thread has a current Event_arena, the
+  string is allocated from it.
 
   @param destination The string to be duplicated
   @param n           The number of bytes to be copied
@@ -98,6 +100,17 @@ inline char *strndup (const char *s, size_t n)
 */
 inline const char* bapi_strndup(const char *destination, size_t n)
 {
+  if (binary_log::Event_arena *arena= binary_log::Event_arena::current())
+  {
+    size_t len= strnlen(destination, n);
+    char *dest= static_cast<char*>(arena->alloc(len + 1));
+    if (dest)
+    {
+      memcpy(dest, destination, len);
+      dest[len]= '\0';
+    }
+    return dest;
+  }
 #if HAVE_MYSYS
 /* Call the function in mysys library, required for memory instrumentation */
   return my_strndup(key_memory_log_event, destination, n, MYF(MY_WME));
@@ -109,7 +122,8 @@ inline const char* bapi_strndup(const char *destination, size_t n)
 
 /**
   This is a wrapper function, and returns a pointer to a new memory with the
-  contents copied from the input memory pointer, upto a given length
+  contents copied from the input memory pointer, upto a given length,
+  allocated from the current Event_arena of the thread if it has one
 
   @param source Pointer to the buffer from which data is to be copied
   @param len Length upto which the source should be copied
@@ -120,6 +134,12 @@ inline const char* bapi_strndup(const char *destination, size_t n)
 inline void* bapi_memdup(const void* source, size_t len)
 {
   void* dest;
+  if (binary_log::Event_arena *arena= binary_log::Event_arena::current())
+  {
+    if ((dest= arena->alloc(len)))
+      memcpy(dest, source, len);
+    return dest;
+  }
 #if HAVE_MYSYS
   /* Call the function in mysys library, required for memory instrumentation */
   dest= my_memdup(key_memory_log_event, source, len, MYF(MY_WME));
@@ -138,7 +158,9 @@ inline void* bapi_memdup(const void* source, size_t len)
 
   If compiled with the MySQL server, and memory is allocated using memory
   allocating methods from the mysys library, my_malloc is called. Otherwise,
-  the standard malloc() is called from the function.
+  the standard malloc() is called from the function. If the thread has a
+  current Event_arena, the memory is allocated from it, see
+  Event_arena::Scope.
 
   @param size         Size of the memory to be allocated.
   @param key_to_int   A mapping from the PSI_memory_key to an enum
@@ -148,6 +170,8 @@ inline void* bapi_memdup(const void* source, size_t len)
 inline void * bapi_malloc(size_t size, int flags)
 {
   void * dest= NULL;
+  if (binary_log::Event_arena *arena= binary_log::Event_arena::current())
+    return arena->alloc(size);
 #if HAVE_MYSYS
   dest= my_malloc(key_memory_log_event, size, MYF(flags));
 #else
@@ -163,12 +187,17 @@ inline void * bapi_malloc(size_t size, int flags)
 
   If compiled with the MySQL server, and memory is allocated using memory
   allocating methods from the mysys library, my_free is called. Otherwise,
-  the standard free() is called from the function.
+  the standard free() is called from the function. The memory of the
+  current Event_arena of the thread is left alone, Event_arena::reset()
+  gives it back.
 
   @param Pointer to the memory which is to be freed.
 */
 inline void bapi_free(void* ptr)
 {
+  binary_log::Event_arena *arena= binary_log::Event_arena::current();
+  if (arena && arena->owns(ptr))
+    return;
 #if HAVE_MYSYS
   return my_free(ptr);
 #else
@@ -294,6 +294,13 @@ Binary_log_event::Binary_log_event(const char **buf, uint16_t binlog_version,
   (*buf)+= LOG_EVENT_HEADER_LEN;
 }
 
+void Binary_log_event::read_header(const char **buf, uint16_t binlog_version)
+{
+  m_header= Log_event_header(*buf, binlog_version);
+  m_footer= Log_event_footer();
+  (*buf)+= LOG_EVENT_HEADER_LEN;
+}
+
 /*
   The destructor is pure virtual to prevent instantiation of the class.
 */
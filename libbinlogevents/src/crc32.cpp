@@ -0,0 +1,274 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+/**
+  @file crc32.cpp
+
+  @brief The CRC32 of the binlog checksums, computed with the carry-less
+  multiplication of x86 (PCLMULQDQ) or the CRC32 instructions of ARMv8
+  when the CPU has them, and with zlib otherwise.
+
+  The binlog uses the CRC32 of zlib (the IEEE polynomial), so the SSE4.2
+  CRC32 instruction, which computes CRC32C, cannot be used. PCLMULQDQ
+  folds 64 bytes per iteration instead, as described in "Fast CRC
+  Computation for Generic Polynomials Using PCLMULQDQ Instruction" by
+  Gopal et al., Intel 2009.
+*/
+
+#include "binlog_event.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && \
+    defined(HAVE_WMMINTRIN_H) && defined(HAVE_SMMINTRIN_H)
+#define HAVE_CRC32_PCLMUL 1
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__GNUC__) && \
+    defined(HAVE_ARM_ACLE_H) && defined(HAVE_SYS_AUXV_H)
+#define HAVE_CRC32_ARMV8 1
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+#ifdef __clang__
+#define CRC32_ARMV8_TARGET __attribute__((target("crc")))
+#else
+#define CRC32_ARMV8_TARGET __attribute__((target("+crc")))
+#endif
+#endif
+
+namespace binary_log
+{
+
+typedef uint32_t (*crc32_function)(uint32_t crc, const unsigned char *pos,
+                                   size_t length);
+
+static uint32_t crc32_zlib(uint32_t crc, const unsigned char *pos,
+                           size_t length)
+{
+  /* zlib takes the length as an unsigned int */
+  while (length > UINT_MAX)
+  {
+    crc= static_cast<uint32_t>(crc32(crc, pos, UINT_MAX));
+    pos+= UINT_MAX;
+    length-= UINT_MAX;
+  }
+  return static_cast<uint32_t>(crc32(static_cast<unsigned int>(crc), pos,
+                                     static_cast<unsigned int>(length)));
+}
+
+#ifdef HAVE_CRC32_PCLMUL
+/** Shortest buffer folded with PCLMULQDQ */
+#define CRC32_PCLMUL_MIN_LENGTH 64
+
+/**
+  Folds a buffer of a multiple of 16 bytes, at least 64, into the CRC.
+
+  @param crc  The CRC so far, inverted
+  @return the CRC, inverted
+*/
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_pclmul_fold(uint32_t crc, const unsigned char *pos,
+                                  size_t length)
+{
+  /* The constants of the IEEE polynomial, bit-reflected */
+  static const uint64_t k1k2[2] __attribute__((aligned(16)))=
+    { 0x0154442bd4ULL, 0x01c6e41596ULL };
+  static const uint64_t k3k4[2] __attribute__((aligned(16)))=
+    { 0x01751997d0ULL, 0x00ccaa009eULL };
+  static const uint64_t k5k0[2] __attribute__((aligned(16)))=
+    { 0x0163cd6124ULL, 0x0000000000ULL };
+  static const uint64_t poly[2] __attribute__((aligned(16)))=
+    { 0x01db710641ULL, 0x01f7011641ULL };
+
+  __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+  x1= _mm_loadu_si128((const __m128i*) (pos + 0x00));
+  x2= _mm_loadu_si128((const __m128i*) (pos + 0x10));
+  x3= _mm_loadu_si128((const __m128i*) (pos + 0x20));
+  x4= _mm_loadu_si128((const __m128i*) (pos + 0x30));
+  x1= _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  x0= _mm_load_si128((const __m128i*) k1k2);
+  pos+= 64;
+  length-= 64;
+
+  /* Fold four blocks of 16 bytes at a time */
+  while (length >= 64)
+  {
+    x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+    x6= _mm_clmulepi64_si128(x2, x0, 0x00);
+    x7= _mm_clmulepi64_si128(x3, x0, 0x00);
+    x8= _mm_clmulepi64_si128(x4, x0, 0x00);
+    x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+    x2= _mm_clmulepi64_si128(x2, x0, 0x11);
+    x3= _mm_clmulepi64_si128(x3, x0, 0x11);
+    x4= _mm_clmulepi64_si128(x4, x0, 0x11);
+    y5= _mm_loadu_si128((const __m128i*) (pos + 0x00));
+    y6= _mm_loadu_si128((const __m128i*) (pos + 0x10));
+    y7= _mm_loadu_si128((const __m128i*) (pos + 0x20));
+    y8= _mm_loadu_si128((const __m128i*) (pos + 0x30));
+    x1= _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+    x2= _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+    x3= _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+    x4= _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+    pos+= 64;
+    length-= 64;
+  }
+
+  /* Fold the four blocks into one */
+  x0= _mm_load_si128((const __m128i*) k3k4);
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+  x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+  x1= _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+  /* Fold the remaining blocks of 16 bytes */
+  while (length >= 16)
+  {
+    x2= _mm_loadu_si128((const __m128i*) pos);
+    x5= _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1= _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1= _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    pos+= 16;
+    length-= 16;
+  }
+
+  /* Fold 128 bits into 64 */
+  x2= _mm_clmulepi64_si128(x1, x0, 0x10);
+  x3= _mm_setr_epi32(~0, 0, ~0, 0);
+  x1= _mm_srli_si128(x1, 8);
+  x1= _mm_xor_si128(x1, x2);
+  x0= _mm_loadl_epi64((const __m128i*) k5k0);
+  x2= _mm_srli_si128(x1, 4);
+  x1= _mm_and_si128(x1, x3);
+  x1= _mm_clmulepi64_si128(x1, x0, 0x00);
+  x1= _mm_xor_si128(x1, x2);
+
+  /* Barrett reduction to 32 bits */
+  x0= _mm_load_si128((const __m128i*) poly);
+  x2= _mm_and_si128(x1, x3);
+  x2= _mm_clmulepi64_si128(x2, x0, 0x10);
+  x2= _mm_and_si128(x2, x3);
+  x2= _mm_clmulepi64_si128(x2, x0, 0x00);
+  x1= _mm_xor_si128(x1, x2);
+  return static_cast<uint32_t>(_mm_extract_epi32(x1, 1));
+}
+
+static uint32_t crc32_pclmul(uint32_t crc, const unsigned char *pos,
+                             size_t length)
+{
+  if (length >= CRC32_PCLMUL_MIN_LENGTH)
+  {
+    size_t folded= length & ~static_cast<size_t>(15);
+    crc= ~crc32_pclmul_fold(~crc, pos, folded);
+    pos+= folded;
+    length-= folded;
+  }
+  return length ? crc32_zlib(crc, pos, length) : crc;
+}
+#endif
+
+#ifdef HAVE_CRC32_ARMV8
+CRC32_ARMV8_TARGET
+static uint32_t crc32_armv8(uint32_t crc, const unsigned char *pos,
+                            size_t length)
+{
+  crc= ~crc;
+  while (length && (reinterpret_cast<uintptr_t>(pos) & 7))
+  {
+    crc= __crc32b(crc, *pos++);
+    length--;
+  }
+  while (length >= 8)
+  {
+    uint64_t word;
+    memcpy(&word, pos, 8);
+    crc= __crc32d(crc, word);
+    pos+= 8;
+    length-= 8;
+  }
+  while (length--)
+    crc= __crc32b(crc, *pos++);
+  return ~crc;
+}
+#endif
+
+/**
+  Picks the fastest implementation the CPU runs.
+*/
+static crc32_function resolve_crc32(const char **name)
+{
+#ifdef HAVE_CRC32_PCLMUL
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1"))
+  {
+    *name= "pclmul";
+    return crc32_pclmul;
+  }
+#endif
+#ifdef HAVE_CRC32_ARMV8
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32)
+  {
+    *name= "armv8";
+    return crc32_armv8;
+  }
+#endif
+  *name= "zlib";
+  return crc32_zlib;
+}
+
+/*
+  Resolved on first use rather than by a static initializer, so that the
+  checksum works during the static initialization of other files too.
+  Threads racing to resolve it store the same values.
+*/
+static const char *crc32_name= NULL;
+static crc32_function crc32_implementation= NULL;
+
+static crc32_function get_crc32_implementation()
+{
+  crc32_function function=
+    __atomic_load_n(&crc32_implementation, __ATOMIC_ACQUIRE);
+  if (function == NULL)
+  {
+    const char *name;
+    function= resolve_crc32(&name);
+    __atomic_store_n(&crc32_name, name, __ATOMIC_RELAXED);
+    __atomic_store_n(&crc32_implementation, function, __ATOMIC_RELEASE);
+  }
+  return function;
+}
+
+uint32_t checksum_crc32(uint32_t crc, const unsigned char *pos, size_t length)
+{
+  if (pos == NULL)
+    return 0;
+  return get_crc32_implementation()(crc, pos, length);
+}
+
+const char *checksum_crc32_implementation()
+{
+  get_crc32_implementation();
+  return __atomic_load_n(&crc32_name, __ATOMIC_RELAXED);
+}
+
+} // end namespace binary_log
@@ -0,0 +1,130 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "event_arena.h"
+
+namespace binary_log {
+
+__thread Event_arena *Event_arena::m_current= NULL;
+
+Event_arena::Event_arena(size_t chunk_size)
+  : m_chunk_size(chunk_size < 1024 ? 1024 : chunk_size),
+    m_first(NULL), m_chunk(NULL), m_ptr(NULL), m_end(NULL), m_large(NULL),
+    m_cleanups(NULL), m_allocated(0), m_capacity(0)
+{
+}
+
+Event_arena::~Event_arena()
+{
+  reset();
+  while (m_first)
+  {
+    Chunk *next= m_first->next;
+    free(m_first);
+    m_first= next;
+  }
+}
+
+void *Event_arena::alloc_slow(size_t size)
+{
+  if (size > m_chunk_size / 4)
+  {
+    Chunk *block= static_cast<Chunk *>(malloc(CHUNK_HEADER + size));
+    if (!block)
+      return NULL;
+    block->size= size;
+    block->next= m_large;
+    m_large= block;
+    m_allocated+= size;
+    return chunk_begin(block);
+  }
+
+  /* The chunks after the current one are free since the last reset */
+  Chunk *next= m_chunk ? m_chunk->next : m_first;
+  if (!next)
+  {
+    next= static_cast<Chunk *>(malloc(CHUNK_HEADER + m_chunk_size));
+    if (!next)
+      return NULL;
+    next->size= m_chunk_size;
+    next->next= NULL;
+    if (m_chunk)
+      m_chunk->next= next;
+    else
+      m_first= next;
+    m_capacity+= m_chunk_size;
+  }
+  m_chunk= next;
+  m_ptr= chunk_begin(next);
+  m_end= m_ptr + next->size;
+  return alloc(size);
+}
+
+bool Event_arena::owns(const void *ptr) const
+{
+  if (m_chunk)
+  {
+    for (const Chunk *chunk= m_first; ; chunk= chunk->next)
+    {
+      if (chunk_holds(chunk, ptr))
+        return static_cast<const char *>(ptr) < m_ptr || chunk != m_chunk;
+      if (chunk == m_chunk)
+        break;
+    }
+  }
+  for (const Chunk *block= m_large; block; block= block->next)
+    if (chunk_holds(block, ptr))
+      return true;
+  return false;
+}
+
+bool Event_arena::add_cleanup(void (*function)(void *), void *obj)
+{
+  Cleanup *cleanup= static_cast<Cleanup *>(alloc(sizeof(Cleanup)));
+  if (!cleanup)
+    return false;
+  cleanup->function= function;
+  cleanup->obj= obj;
+  cleanup->next= m_cleanups;
+  m_cleanups= cleanup;
+  return true;
+}
+
+void Event_arena::reset()
+{
+  if (m_cleanups)
+  {
+    /* The destructors give the memory of the arena to bapi_free() */
+    Scope scope(this);
+    while (m_cleanups)
+    {
+      Cleanup *cleanup= m_cleanups;
+      m_cleanups= cleanup->next;
+      cleanup->function(cleanup->obj);
+    }
+  }
+  while (m_large)
+  {
+    Chunk *next= m_large->next;
+    free(m_large);
+    m_large= next;
+  }
+  m_chunk= m_first;
+  m_ptr= m_first ? chunk_begin(m_first) : NULL;
+  m_end= m_first ? m_ptr + m_first->size : NULL;
+  m_allocated= 0;
+}
+
+} // end namespace binary_log
@@ -0,0 +1,223 @@
+/* Copyright (c) 2016, Oracle and/or its affiliates. All rights reserved.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; version 2 of the License.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
+
+#include "event_view.h"
+
+namespace binary_log {
+
+/* The post-header of a Gtid_event, as it is since 5.6 */
+static const size_t GTID_SID_OFFSET= 1;
+static const size_t GTID_GNO_OFFSET= GTID_SID_OFFSET + 16;
+static const size_t GTID_MIN_POST_HEADER_LEN= GTID_GNO_OFFSET + 8;
+
+Event_view::Event_view(const char *buf, size_t length,
+                       const Format_description_event *description_event)
+  : m_buf(buf), m_length(length),
+    m_header_len(description_event->common_header_len),
+    m_post_header_len(0), m_checksum_len(0)
+{
+  unsigned int event_type= type();
+  enum_binlog_checksum_alg alg;
+  if (event_type == FORMAT_DESCRIPTION_EVENT)
+    alg= Log_event_footer::get_checksum_alg(buf, length);
+  else
+    alg= description_event->footer()->checksum_alg;
+  /* As Decoder::decode_event(), an FDE has room for a checksum */
+  if (alg != BINLOG_CHECKSUM_ALG_UNDEF &&
+      (event_type == FORMAT_DESCRIPTION_EVENT ||
+       alg != BINLOG_CHECKSUM_ALG_OFF))
+    m_checksum_len= BINLOG_CHECKSUM_LEN;
+  if (event_type > 0 &&
+      event_type <= description_event->post_header_len.size())
+    m_post_header_len= description_event->post_header_len[event_type - 1];
+}
+
+uint64_t Event_view::read_table_id() const
+{
+  const char *post= post_header(6);
+  if (!post)
+    return 0;
+  uint64_t table_id= 0;
+  /* Before 5.1.4, the table id had 4 bytes */
+  memcpy(&table_id, post, m_post_header_len == 6 ? 4 : 6);
+  return le64toh(table_id);
+}
+
+/**
+  Reads a packed integer, as the column count of a Table_map_event.
+
+  @return false if it does not end before end
+*/
+static bool read_packed(const unsigned char *pos, const unsigned char *end,
+                        unsigned long *value)
+{
+  if (pos >= end)
+    return false;
+  size_t length;
+  switch (*pos) {
+  case 252:
+    length= 2;
+    break;
+  case 253:
+    length= 3;
+    break;
+  case 254:
+    length= 8;
+    break;
+  default:
+    *value= *pos;
+    return true;
+  }
+  if (end - pos <= (ptrdiff_t) length)
+    return false;
+  uint64_t packed= 0;
+  memcpy(&packed, pos + 1, length);
+  *value= (unsigned long) le64toh(packed);
+  return true;
+}
+
+uint32_t Query_view::thread_id() const
+{
+  const char *post= post_header(Binary_log_event::QUERY_HEADER_MINIMAL_LEN);
+  return post ? read32(post - m_buf + Query_event::Q_THREAD_ID_OFFSET) : 0;
+}
+
+uint32_t Query_view::exec_time() const
+{
+  const char *post= post_header(Binary_log_event::QUERY_HEADER_MINIMAL_LEN);
+  return post ? read32(post - m_buf + Query_event::Q_EXEC_TIME_OFFSET) : 0;
+}
+
+uint16_t Query_view::error_code() const
+{
+  const char *post= post_header(Binary_log_event::QUERY_HEADER_MINIMAL_LEN);
+  return post ? read16(post - m_buf + Query_event::Q_ERR_CODE_OFFSET) : 0;
+}
+
+const char *Query_view::status_vars(size_t *length) const
+{
+  const char *post= post_header(Binary_log_event::QUERY_HEADER_MINIMAL_LEN);
+  if (!post)
+    return NULL;
+  *length= 0;
+  /* The status variables came with 5.0 */
+  if (m_post_header_len > Query_event::Q_STATUS_VARS_LEN_OFFSET)
+    *length= read16(post - m_buf + Query_event::Q_STATUS_VARS_LEN_OFFSET);
+  size_t db_len= (unsigned char) post[Query_event::Q_DB_LEN_OFFSET];
+  if (*length + db_len + 1 > body_length())
+    return NULL;
+  return body();
+}
+
+const char *Query_view::db(size_t *length) const
+{
+  size_t status_vars_len;
+  const char *vars= status_vars(&status_vars_len);
+  if (!vars)
+    return NULL;
+  *length= (unsigned char) m_buf[m_header_len + Query_event::Q_DB_LEN_OFFSET];
+  return vars + status_vars_len;
+}
+
+const char *Query_view::query(size_t *length) const
+{
+  size_t status_vars_len;
+  const char *vars= status_vars(&status_vars_len);
+  if (!vars)
+    return NULL;
+  size_t db_len=
+    (unsigned char) m_buf[m_header_len + Query_event::Q_DB_LEN_OFFSET];
+  *length= body_length() - status_vars_len - db_len - 1;
+  return vars + status_vars_len + db_len + 1;
+}
+
+uint64_t Rotate_view::position() const
+{
+  const char *post= post_header(Binary_log_event::ROTATE_HEADER_LEN);
+  return post ? read64(post - m_buf + Rotate_event::R_POS_OFFSET) : 4;
+}
+
+const char *Rotate_view::new_log_ident(size_t *length) const
+{
+  if (m_header_len + m_post_header_len > m_length)
+    return NULL;
+  *length= body_length();
+  return body();
+}
+
+const char *Table_map_view::db(size_t *length) const
+{
+  if (!post_header(6) || body_length() < 1)
+    return NULL;
+  *length= (unsigned char) body()[0];
+  if (*length + 2 > body_length())
+    return NULL;
+  return body() + 1;
+}
+
+const char *Table_map_view::table(size_t *length) const
+{
+  size_t db_len;
+  if (!db(&db_len) || db_len + 3 > body_length())
+    return NULL;
+  *length= (unsigned char) body()[db_len + 2];
+  if (db_len + 2 + *length + 2 > body_length())
+    return NULL;
+  return body() + db_len + 3;
+}
+
+unsigned long Table_map_view::column_count() const
+{
+  size_t table_len;
+  const char *name= table(&table_len);
+  if (!name)
+    return 0;
+  const unsigned char *end=
+    reinterpret_cast<const unsigned char *>(body() + body_length());
+  unsigned long count;
+  if (!read_packed(reinterpret_cast<const unsigned char *>(name) +
+                   table_len + 1, end, &count))
+    return 0;
+  return count;
+}
+
+uint16_t Rows_view::rows_flags() const
+{
+  const char *post= post_header(6);
+  if (!post)
+    return 0;
+  size_t offset= m_post_header_len == 6 ? 4 : ROWS_FLAGS_OFFSET;
+  if (offset + 2 > m_post_header_len)
+    return 0;
+  return read16(post - m_buf + offset);
+}
+
+const unsigned char *Gtid_view::sid() const
+{
+  const char *post= post_header(GTID_MIN_POST_HEADER_LEN);
+  if (!post)
+    return NULL;
+  return reinterpret_cast<const unsigned char *>(post) + GTID_SID_OFFSET;
+}
+
+int64_t Gtid_view::gno() const
+{
+  const char *post= post_header(GTID_MIN_POST_HEADER_LEN);
+  if (!post)
+    return 0;
+  return (int64_t) read64(post - m_buf + GTID_GNO_OFFSET);
+}
+
+} // end namespace binary_log
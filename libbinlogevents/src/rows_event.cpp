@@ -14,7 +14,9 @@
    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301  USA */
 
 #include "rows_event.h"
+#include "binary_log_funcs.h"
 #include <stdlib.h>
+#include <climits>
 #include <cstring>
 #include <string>
 
@@ -72,11 +74,76 @@ Table_map_event::Table_map_event(const char *buf, unsigned int event_len,
                      description_event->server_version),
     m_table_id(0), m_flags(0), m_data_size(0),
     m_dbnam(""), m_dblen(0), m_tblnam(""), m_tbllen(0),
-    m_colcnt(0), m_field_metadata_size(0), m_field_metadata(0), m_null_bits(0)
+    m_colcnt(0), m_coltype(0), m_field_metadata_size(0), m_field_metadata(0),
+    m_null_bits(0), m_columns(0), m_schema(0)
 {
   //buf is advanced in Binary_log_event constructor to point to
   //beginning of post-header
-  unsigned int bytes_read= 0;
+  decode_body(buf, event_len, description_event);
+}
+
+Table_map_event::Table_map_event(const char *buf, unsigned int event_len,
+                                 const Format_description_event*
+                                 description_event,
+                                 const Table_map_event &schema)
+  : Binary_log_event(&buf, description_event->binlog_version,
+                     description_event->server_version),
+    m_table_id(0), m_flags(0), m_data_size(0),
+    m_dbnam(""), m_dblen(0), m_tblnam(""), m_tbllen(0),
+    m_colcnt(0), m_coltype(0), m_field_metadata_size(0), m_field_metadata(0),
+    m_null_bits(0), m_columns(0), m_schema(0)
+{
+  decode_post_header(buf, event_len, description_event);
+  share_schema(schema);
+}
+
+void Table_map_event::reinit(const char *buf, unsigned int event_len,
+                             const Format_description_event *description_event)
+{
+  read_header(&buf, description_event->binlog_version);
+  decode_body(buf, event_len, description_event);
+}
+
+void Table_map_event::reinit(const char *buf, unsigned int event_len,
+                             const Format_description_event *description_event,
+                             const Table_map_event &schema)
+{
+  read_header(&buf, description_event->binlog_version);
+  decode_post_header(buf, event_len, description_event);
+  share_schema(schema);
+}
+
+void Table_map_event::share_schema(const Table_map_event &schema)
+{
+  if (&schema == this)
+    return;
+  m_dbnam.assign(schema.m_dbnam);
+  m_dblen= schema.m_dblen;
+  m_tblnam.assign(schema.m_tblnam);
+  m_tbllen= schema.m_tbllen;
+  m_colcnt= schema.m_colcnt;
+  m_field_metadata_size= schema.m_field_metadata_size;
+  if (schema.m_schema)
+    schema.m_schema->acquire();
+  if (m_schema)
+    m_schema->release();
+  m_schema= schema.m_schema;
+  m_coltype= schema.m_coltype;
+  m_field_metadata= schema.m_field_metadata;
+  m_null_bits= schema.m_null_bits;
+  m_columns= schema.m_columns;
+}
+
+/**
+  Reads the post-header of the event.
+
+  @return The body of the event
+*/
+const char *Table_map_event::decode_post_header(const char *buf,
+                                                unsigned int event_len,
+                                                const Format_description_event*
+                                                description_event)
+{
   uint8_t common_header_len= description_event->common_header_len;
   uint8_t post_header_len=
                       description_event->post_header_len[TABLE_MAP_EVENT - 1];
@@ -106,8 +173,19 @@ Table_map_event::Table_map_event(const char *buf, unsigned int event_len,
   memcpy(&m_flags, post_start, sizeof(m_flags));
   m_flags= le16toh(m_flags);
 
+  return buf + post_header_len;
+}
+
+void Table_map_event::decode_body(const char *buf, unsigned int event_len,
+                                  const Format_description_event*
+                                  description_event)
+{
+  unsigned int bytes_read= 0;
+  uint8_t common_header_len= description_event->common_header_len;
+
   /* Read the variable part of the event */
-  const char *const vpart= buf + post_header_len;
+  const char *const vpart= decode_post_header(buf, event_len,
+                                              description_event);
 
   /* Extract the length of the various parts from the buffer */
   unsigned char const *const ptr_dblen= (unsigned char const*)vpart + 0;
@@ -122,40 +200,188 @@ Table_map_event::Table_map_event(const char *buf, unsigned int event_len,
   unsigned char *ptr_after_colcnt= (unsigned char*) ptr_colcnt;
   m_colcnt= get_field_length(&ptr_after_colcnt);
 
-  m_coltype= static_cast<unsigned char*>(bapi_malloc(m_colcnt, 16));
-  m_dbnam= std::string((const char*)ptr_dblen  + 1, m_dblen);
-  m_tblnam= std::string((const char*)ptr_tbllen  + 1, m_tbllen);
-
-  memcpy(m_coltype, ptr_after_colcnt, m_colcnt);
+  m_dbnam.assign((const char*)ptr_dblen  + 1, m_dblen);
+  m_tblnam.assign((const char*)ptr_tbllen  + 1, m_tbllen);
 
+  const unsigned char *coltype= ptr_after_colcnt;
+  const unsigned char *metadata= NULL;
+  const unsigned char *null_bits= NULL;
   ptr_after_colcnt= ptr_after_colcnt + m_colcnt;
   bytes_read= (unsigned int) (ptr_after_colcnt + common_header_len -
                              (unsigned char *)buf);
+  m_field_metadata_size= 0;
   if (bytes_read < event_len)
   {
-    m_field_metadata_size= get_field_length(&ptr_after_colcnt);
-    if (m_field_metadata_size > (m_colcnt * 2))
-      return;
-    unsigned int num_null_bytes= (m_colcnt + 7) / 8;
+    unsigned long metadata_size= get_field_length(&ptr_after_colcnt);
+    if (metadata_size <= (m_colcnt * 2))
+    {
+      m_field_metadata_size= metadata_size;
+      metadata= ptr_after_colcnt;
+      null_bits= ptr_after_colcnt + metadata_size;
+    }
+  }
+
+  /*
+    The types, the metadata, the null bits and the layout of the columns
+    share one buffer, which the pooled events reuse and the events of a
+    table map cache share.
+  */
+  size_t null_bytes= null_bits ? (m_colcnt + 7) / 8 : 0;
+  size_t columns_offset= (m_colcnt + m_field_metadata_size + null_bytes + 7) &
+                         ~((size_t) 7);
+  m_schema= Event_buffer::reuse(m_schema, columns_offset +
+                                          m_colcnt * sizeof(Column_layout));
+  if (!m_schema)
+  {
+    m_colcnt= 0;
+    m_field_metadata_size= 0;
+    m_coltype= m_field_metadata= m_null_bits= NULL;
+    m_columns= NULL;
+    return;
+  }
+  unsigned char *mem= m_schema->data();
+  m_coltype= mem;
+  memcpy(m_coltype, coltype, m_colcnt);
+  m_field_metadata= metadata ? mem + m_colcnt : NULL;
+  if (metadata)
+    memcpy(m_field_metadata, metadata, m_field_metadata_size);
+  m_null_bits= null_bits ? mem + m_colcnt + m_field_metadata_size : NULL;
+  if (null_bits)
+    memcpy(m_null_bits, null_bits, null_bytes);
+  m_columns= reinterpret_cast<Column_layout*>(mem + columns_offset);
+  build_columns();
+}
+
+unsigned int Table_map_event::metadata_size(unsigned char type)
+{
+  switch (type)
+  {
+  case MYSQL_TYPE_DOUBLE:
+  case MYSQL_TYPE_FLOAT:
+  case MYSQL_TYPE_BLOB:
+#if MYSQL_VERSION_ID >= 50604
+  case MYSQL_TYPE_DATETIME2:
+  case MYSQL_TYPE_TIMESTAMP2:
+  case MYSQL_TYPE_TIME2:
+#endif
+  case MYSQL_TYPE_GEOMETRY:
+    return 1;
+  case MYSQL_TYPE_BIT:
+  case MYSQL_TYPE_VARCHAR:
+  case MYSQL_TYPE_NEWDECIMAL:
+  case MYSQL_TYPE_STRING:
+  case MYSQL_TYPE_VAR_STRING:
+  case MYSQL_TYPE_ENUM:
+    return 2;
+  default:
+    return 0;
+  }
+}
 
-    m_null_bits= static_cast<unsigned char*>(bapi_malloc(num_null_bytes, 0));
+/**
+  Builds m_columns from the types, the metadata and the null bits, in one
+  pass over the columns.
+*/
+void Table_map_event::build_columns()
+{
+  unsigned long offset= 0;
+  for (unsigned long col= 0; col < m_colcnt; col++)
+  {
+    Column_layout *column= &m_columns[col];
+    unsigned char type= m_coltype[col];
+    const unsigned char *meta= m_field_metadata + offset;
+    unsigned int size= metadata_size(type);
+    uint16_t metadata= 0;
 
-    m_field_metadata= static_cast<unsigned char*>(bapi_malloc(m_field_metadata_size,
-                                                  0));
-    memcpy(m_field_metadata, ptr_after_colcnt, m_field_metadata_size);
-    ptr_after_colcnt= (unsigned char*)ptr_after_colcnt + m_field_metadata_size;
-    memcpy(m_null_bits, ptr_after_colcnt, num_null_bytes);
+    if (m_field_metadata && offset + size <= m_field_metadata_size)
+    {
+      if (size == 1)
+        metadata= meta[0];
+      else if (size == 2)
+      {
+        switch (type)
+        {
+        case MYSQL_TYPE_VARCHAR:
+          memcpy(&metadata, meta, 2);
+          metadata= le16toh(metadata);
+          break;
+        case MYSQL_TYPE_SET:
+        case MYSQL_TYPE_ENUM:
+        case MYSQL_TYPE_STRING:
+        case MYSQL_TYPE_NEWDECIMAL:
+          /* <TYPE><PACK_LENGTH>, the type in the most significant byte */
+          metadata= (meta[0] << 8U) | meta[1];
+          break;
+        case MYSQL_TYPE_BIT:
+          metadata= meta[0] | (meta[1] << 8U);
+          break;
+        }
+      }
+    }
+    offset+= size;
+
+    column->type= type;
+    column->real_type= type;
+    column->metadata= metadata;
+    column->nullable= m_null_bits && ((m_null_bits[col / 8] >> (col % 8)) & 1);
+    column->length_bytes= 0;
+    column->fixed_size= 0;
+    switch (type)
+    {
+    case MYSQL_TYPE_SET:
+    case MYSQL_TYPE_ENUM:
+    case MYSQL_TYPE_STRING:
+      {
+        unsigned char real_type= metadata >> 8U;
+        if (real_type == MYSQL_TYPE_ENUM || real_type == MYSQL_TYPE_SET)
+        {
+          column->real_type= real_type;
+          column->fixed_size= metadata & 0xff;
+        }
+        else
+          column->length_bytes=
+            max_display_length_for_field(MYSQL_TYPE_STRING, metadata) > 255 ?
+            2 : 1;
+        break;
+      }
+    case MYSQL_TYPE_VARCHAR:
+      column->length_bytes= metadata > 255 ? 2 : 1;
+      break;
+    case MYSQL_TYPE_TINY_BLOB:
+    case MYSQL_TYPE_MEDIUM_BLOB:
+    case MYSQL_TYPE_LONG_BLOB:
+    case MYSQL_TYPE_BLOB:
+    case MYSQL_TYPE_GEOMETRY:
+      /* The metadata is the size of the length, from 1 to 4 */
+      if (metadata >= 1 && metadata <= 4)
+        column->length_bytes= (unsigned char) metadata;
+      else
+        column->fixed_size= UINT_MAX;
+      break;
+    default:
+      /* The other types do not read the value */
+      column->fixed_size= calc_field_size(type, NULL, metadata);
+      break;
+    }
   }
 }
 
 Table_map_event::~Table_map_event()
 {
+  if (m_schema)
+    m_schema->release();
+  else
+  {
+    /* The buffers of an event which was not decoded */
     bapi_free(m_null_bits);
-    m_null_bits= NULL;
     bapi_free(m_field_metadata);
-    m_field_metadata= NULL;
     bapi_free(m_coltype);
-    m_coltype= NULL;
+  }
+  m_null_bits= NULL;
+  m_field_metadata= NULL;
+  m_coltype= NULL;
+  m_columns= NULL;
+  m_schema= NULL;
 }
 
 
@@ -164,14 +390,41 @@ Table_map_event::~Table_map_event()
                       Rows_event Methods
 *****************************************************************************/
 Rows_event::Rows_event(const char *buf, unsigned int event_len,
-                       const Format_description_event *description_event)
+                       const Format_description_event *description_event,
+                       Event_buffer *buffer)
   : Binary_log_event(&buf, description_event->binlog_version,
                      description_event->server_version),
-    m_table_id(0), m_width(0), m_extra_row_data(0),
-    columns_before_image(0), columns_after_image(0), row(0)
+    m_table_id(0), m_width(0), m_extra_row_data(0)
 {
   //buf is advanced in Binary_log_event constructor to point to
   //beginning of post-header
+  decode_body(buf, event_len, description_event, buffer);
+}
+
+void Rows_event::reinit(const char *buf, unsigned int event_len,
+                        const Format_description_event *description_event,
+                        Event_buffer *buffer)
+{
+  read_header(&buf, description_event->binlog_version);
+  m_table_id= 0;
+  m_width= 0;
+  if (m_extra_row_data)
+  {
+    bapi_free(m_extra_row_data);
+    m_extra_row_data= NULL;
+  }
+  /* Leaves m_body alone, for its copy to reuse its memory */
+  columns_before_image.clear();
+  columns_after_image.clear();
+  row.clear();
+  decode_body(buf, event_len, description_event, buffer);
+  header()->type_code= m_type;
+}
+
+void Rows_event::decode_body(const char *buf, unsigned int event_len,
+                             const Format_description_event *description_event,
+                             Event_buffer *buffer)
+{
   uint8_t const common_header_len= description_event->common_header_len;
   Log_event_type event_type= header()->type_code;
   m_type= event_type;
@@ -254,44 +507,43 @@ Rows_event::Rows_event(const char *buf, unsigned int event_len,
   unsigned char *ptr_after_width= (unsigned char*) ptr_width;
   m_width = get_field_length(&ptr_after_width);
   n_bits_len= (m_width + 7) / 8;
-  columns_before_image.reserve((m_width + 7) / 8);
-  unsigned char *ch;
-  ch= ptr_after_width;
-  for(unsigned long i= 0; i < (m_width + 7) / 8; i++)
-  {
-    columns_before_image.push_back(*ch);
-    ch++;
-  }
 
-  ptr_after_width+= (m_width + 7) / 8;
+  /*
+    The bitmaps and the rows reference the buffer of the event when there
+    is one, rather than copying it. As the rows used to be, the body ends
+    with the byte after the event, the first one of the checksum or the
+    zero the drivers put after their events.
+  */
+  size_t const body_offset= ptr_after_width + common_header_len -
+                            (const unsigned char *) buf;
+  size_t const bitmaps_len= (m_width + 7) / 8 *
+                            ((event_type == UPDATE_ROWS_EVENT ||
+                              event_type == UPDATE_ROWS_EVENT_V1) ? 2 : 1);
+  if (body_offset + bitmaps_len > event_len)
+    return;
+  size_t const body_size= event_len - body_offset + 1;
+  if (buffer && buffer->holds(ptr_after_width, body_size))
+    m_body.assign(buffer, ptr_after_width, body_size);
+  else if (!m_body.copy(ptr_after_width, body_size))
+    return;
+  const unsigned char *body= m_body.data();
+  Event_buffer *body_buffer= m_body.buffer();
+
+  columns_before_image.assign(body_buffer, body, (m_width + 7) / 8);
+  body+= (m_width + 7) / 8;
 
-  columns_after_image= columns_before_image;
   if ((event_type == UPDATE_ROWS_EVENT) ||
       (event_type == UPDATE_ROWS_EVENT_V1))
   {
-    columns_after_image.reserve((m_width + 7) / 8);
-    columns_after_image.clear();
-    ch= ptr_after_width;
-    for(unsigned long i= 0; i < (m_width + 7) / 8; i++)
-    {
-      columns_after_image.push_back(*ch);
-      ch++;
-    }
-    ptr_after_width+= (m_width + 7) / 8;
+    columns_after_image.assign(body_buffer, body, (m_width + 7) / 8);
+    body+= (m_width + 7) / 8;
   }
+  else
+    columns_after_image= columns_before_image;
 
-  const unsigned char* ptr_rows_data= (unsigned char*) ptr_after_width;
-
-  size_t const data_size= event_len -
-                          (ptr_rows_data + common_header_len -
-                          (const unsigned char *) buf);
+  size_t const data_size= m_body.data() + body_size - 1 - body;
 
-  row.reserve(data_size + 1);
-  for (unsigned long i= 0; i < data_size + 1; i++)
-  {
-    row.push_back(*ptr_rows_data);
-    ptr_rows_data++;
-  }
+  row.assign(body_buffer, body, data_size + 1);
   BAPI_ASSERT( row.size() == data_size + 1);
   return;
 }
@@ -0,0 +1,1002 @@
+/*
+  Copyright (c) 2016, Oracle and/or its affiliates. All rights
+  reserved.
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; version 2 of
+  the License.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+  02110-1301  USA
+*/
+
+#include "binlog.h"
+#include "fake_master.h"
+
+#ifdef HAVE_PTHREAD_H
+#include <my_global.h>
+#include <mysql_com.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef BINLOG_DUMP_NON_BLOCK
+/** Flag of COM_BINLOG_DUMP asking for an EOF packet after the last event */
+#define BINLOG_DUMP_NON_BLOCK 0x01
+#endif
+#ifndef BINLOG_THROUGH_GTID
+/** Flag of COM_BINLOG_DUMP_GTID telling that a GTID set follows */
+#define BINLOG_THROUGH_GTID 0x04
+#endif
+
+/** Payload length of a packet continued by the next one */
+#define MAX_PACKET_LENGTH 0xffffff
+
+/** What the fake master tells the clients it supports */
+#define FAKE_MASTER_SERVER_FLAGS (CLIENT_LONG_PASSWORD | CLIENT_FOUND_ROWS | \
+                                  CLIENT_LONG_FLAG | CLIENT_CONNECT_WITH_DB | \
+                                  CLIENT_PROTOCOL_41 | CLIENT_TRANSACTIONS | \
+                                  CLIENT_SECURE_CONNECTION | CLIENT_PLUGIN_AUTH)
+
+/* Error codes of the server */
+#define ER_UNKNOWN_COM_ERROR 1047
+#define ER_NOT_SUPPORTED_YET 1235
+#define ER_MASTER_FATAL_ERROR_READING_BINLOG 1236
+
+/** SERVER_STATUS_AUTOCOMMIT, as in every OK and EOF packet */
+#define FAKE_MASTER_STATUS 0x0002
+/** utf8_general_ci */
+#define FAKE_MASTER_CHARSET 33
+
+namespace binary_log { namespace system {
+
+static const char native_password_plugin[]= "mysql_native_password";
+
+static unsigned long long now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/** Appends a string prefixed with its length-encoded length */
+static void store_lenenc_string(std::vector<unsigned char> *buf,
+                                const std::string &str)
+{
+  unsigned char length[9];
+  unsigned char *end= net_store_length(length, str.size());
+  buf->insert(buf->end(), length, end);
+  buf->insert(buf->end(), str.begin(), str.end());
+}
+
+static std::string to_upper(const std::string &str)
+{
+  std::string upper(str);
+  for (size_t i= 0; i < upper.size(); i++)
+    upper[i]= (char) toupper((unsigned char) upper[i]);
+  return upper;
+}
+
+/**
+  Returns the value of a SET statement assigning a variable, without
+  quotes, or an empty string if the statement does not assign it.
+*/
+static std::string assigned_value(const std::string &query,
+                                  const char *variable)
+{
+  size_t pos= query.find(variable);
+  if (pos == std::string::npos)
+    return "";
+  pos= query.find('=', pos + strlen(variable));
+  if (pos == std::string::npos)
+    return "";
+  std::string value;
+  for (pos++; pos < query.size() && query[pos] != ','; pos++)
+    if (!isspace((unsigned char) query[pos]) && query[pos] != '\'' &&
+        query[pos] != '"')
+      value+= query[pos];
+  return value;
+}
+
+/**
+  Tells whether an event is a Rotate_event to a file, with or without a
+  checksum.
+*/
+static bool rotates_to(const unsigned char *event, size_t length,
+                       const std::string &name)
+{
+  size_t start= LOG_EVENT_HEADER_LEN + Binary_log_event::ROTATE_HEADER_LEN;
+  if (length < start || event[EVENT_TYPE_OFFSET] != ROTATE_EVENT)
+    return false;
+  size_t name_length= length - start;
+  return (name_length == name.size() ||
+          name_length == name.size() + BINLOG_CHECKSUM_LEN) &&
+         memcmp(event + start, name.data(), name.size()) == 0;
+}
+
+/** Reads a little-endian 8 byte integer */
+static uint64_t read_le64(const unsigned char *buf)
+{
+  uint64_t value;
+  memcpy(&value, buf, 8);
+  return le64toh(value);
+}
+
+/**
+  Reads a GTID set in the encoding of Gtid_set::encode().
+
+  @retval ERR_OK    The set is read
+  @retval ERR_FAIL  The encoding is malformed
+*/
+static int decode_gtid_set(const unsigned char *buf, size_t length,
+                           Gtid_set *gtids)
+{
+  const unsigned char *end= buf + length;
+  if (length < 8)
+    return ERR_FAIL;
+  uint64_t sids= read_le64(buf);
+  buf+= 8;
+  for (uint64_t i= 0; i < sids; i++)
+  {
+    if ((size_t) (end - buf) < 16 + 8)
+      return ERR_FAIL;
+    const unsigned char *sid= buf;
+    uint64_t intervals= read_le64(buf + 16);
+    buf+= 16 + 8;
+    if ((uint64_t) (end - buf) / 16 < intervals)
+      return ERR_FAIL;
+    for (uint64_t j= 0; j < intervals; j++, buf+= 16)
+    {
+      int64_t first= (int64_t) read_le64(buf);
+      int64_t next= (int64_t) read_le64(buf + 8);
+      if (first < 1 || next <= first)
+        return ERR_FAIL;
+      gtids->add(sid, first, next - 1);
+    }
+  }
+  return buf == end ? ERR_OK : ERR_FAIL;
+}
+
+Fake_master::Fake_master()
+  : m_binlog_checksum(false), m_rate(0), m_write_size(FAKE_MASTER_WRITE_SIZE),
+    m_heartbeat_period(0), m_disconnect_after(0), m_eof_at_end(false),
+    m_version(FAKE_MASTER_VERSION), m_listen_fd(-1), m_port(0),
+    m_running(false), m_stop(false)
+{
+  memset(&m_stats, 0, sizeof(m_stats));
+  pthread_mutex_init(&m_mutex, NULL);
+  /* The waits of the clients are measured with the monotonic clock */
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&m_stop_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+Fake_master::~Fake_master()
+{
+  stop();
+  pthread_cond_destroy(&m_stop_cond);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+int Fake_master::add_binlog(const std::string &path)
+{
+  FILE *file= fopen(path.c_str(), "rb");
+  if (file == NULL)
+    return ERR_FAIL;
+  Binlog binlog;
+  size_t pos= path.rfind('/');
+  binlog.name= pos == std::string::npos ? path : path.substr(pos + 1);
+  unsigned char buf[64 * 1024];
+  size_t length;
+  while ((length= fread(buf, 1, sizeof(buf), file)) > 0)
+    binlog.data.insert(binlog.data.end(), buf, buf + length);
+  bool failed= ferror(file) != 0;
+  fclose(file);
+
+  if (failed || binlog.data.size() < BIN_LOG_HEADER_SIZE ||
+      memcmp(&binlog.data[0], "\xfe" "bin", BIN_LOG_HEADER_SIZE) != 0)
+    return ERR_FAIL;
+
+  /* The checksum algorithm of the first file is the one of the server */
+  const unsigned char *fde= &binlog.data[BIN_LOG_HEADER_SIZE];
+  if (m_binlogs.empty() &&
+      binlog.data.size() >= BIN_LOG_HEADER_SIZE + LOG_EVENT_HEADER_LEN &&
+      fde[EVENT_TYPE_OFFSET] == FORMAT_DESCRIPTION_EVENT)
+  {
+    uint32_t fde_length= uint4korr(fde + EVENT_LEN_OFFSET);
+    if (fde_length <= binlog.data.size() - BIN_LOG_HEADER_SIZE)
+      m_binlog_checksum=
+        Log_event_footer::get_checksum_alg((const char*) fde, fde_length) ==
+        BINLOG_CHECKSUM_ALG_CRC32;
+  }
+  m_binlogs.push_back(binlog);
+  return ERR_OK;
+}
+
+int Fake_master::start(unsigned int port, const std::string &address)
+{
+  if (m_running)
+    return ERR_FAIL;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family= AF_INET;
+  addr.sin_port= htons(port);
+  if (inet_pton(AF_INET, address.c_str(), &addr.sin_addr) != 1)
+    return ERR_CONNECT;
+
+  m_listen_fd= socket(AF_INET, SOCK_STREAM, 0);
+  if (m_listen_fd < 0)
+    return ERR_CONNECT;
+  int on= 1;
+  setsockopt(m_listen_fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  socklen_t addr_len= sizeof(addr);
+  if (bind(m_listen_fd, (struct sockaddr*) &addr, sizeof(addr)) != 0 ||
+      listen(m_listen_fd, 64) != 0 ||
+      getsockname(m_listen_fd, (struct sockaddr*) &addr, &addr_len) != 0)
+  {
+    close(m_listen_fd);
+    m_listen_fd= -1;
+    return ERR_CONNECT;
+  }
+  m_port= ntohs(addr.sin_port);
+
+  m_stop= false;
+  if (pthread_create(&m_listener, NULL, listener_thread, this) != 0)
+  {
+    close(m_listen_fd);
+    m_listen_fd= -1;
+    return ERR_CONNECT;
+  }
+  m_running= true;
+  return ERR_OK;
+}
+
+void Fake_master::stop()
+{
+  if (!m_running)
+    return;
+
+  pthread_mutex_lock(&m_mutex);
+  m_stop= true;
+  pthread_cond_broadcast(&m_stop_cond);
+  /* Wakes up the threads blocked on the sockets */
+  shutdown(m_listen_fd, SHUT_RDWR);
+  for (std::list<Client*>::iterator it= m_clients.begin();
+       it != m_clients.end(); ++it)
+    if ((*it)->fd >= 0)
+      shutdown((*it)->fd, SHUT_RDWR);
+  pthread_mutex_unlock(&m_mutex);
+
+  pthread_join(m_listener, NULL);
+  reap_clients(true);
+  close(m_listen_fd);
+  m_listen_fd= -1;
+  m_running= false;
+}
+
+void Fake_master::get_stats(Fake_master_stats *stats) const
+{
+  stats->connections= __atomic_load_n(&m_stats.connections, __ATOMIC_RELAXED);
+  stats->dumps= __atomic_load_n(&m_stats.dumps, __ATOMIC_RELAXED);
+  stats->events_sent= __atomic_load_n(&m_stats.events_sent, __ATOMIC_RELAXED);
+  stats->heartbeats_sent= __atomic_load_n(&m_stats.heartbeats_sent,
+                                          __ATOMIC_RELAXED);
+  stats->bytes_sent= __atomic_load_n(&m_stats.bytes_sent, __ATOMIC_RELAXED);
+  stats->disconnects= __atomic_load_n(&m_stats.disconnects, __ATOMIC_RELAXED);
+}
+
+void *Fake_master::listener_thread(void *arg)
+{
+  static_cast<Fake_master*>(arg)->run_listener();
+  return NULL;
+}
+
+void *Fake_master::client_thread(void *arg)
+{
+  Client *client= static_cast<Client*>(arg);
+  client->master->run_client(client);
+  return NULL;
+}
+
+void Fake_master::run_listener()
+{
+  for (;;)
+  {
+    int fd= accept(m_listen_fd, NULL, NULL);
+    if (fd < 0)
+    {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      break;
+    }
+    int on= 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    Client *client= new Client();
+    client->master= this;
+    client->fd= fd;
+    client->done= false;
+    client->seq= 0;
+    client->checksum_aware= false;
+    client->checksum= false;
+    client->heartbeat_period= m_heartbeat_period;
+    client->events_sent= 0;
+
+    reap_clients(false);
+    pthread_mutex_lock(&m_mutex);
+    bool stopped= m_stop;
+    if (!stopped &&
+        pthread_create(&client->thread, NULL, client_thread, client) == 0)
+      m_clients.push_back(client);
+    else
+    {
+      close(fd);
+      delete client;
+    }
+    pthread_mutex_unlock(&m_mutex);
+    if (stopped)
+      break;
+  }
+}
+
+/**
+  Joins the threads of the clients which are done, or of all of them.
+*/
+void Fake_master::reap_clients(bool all)
+{
+  std::list<Client*> reaped;
+  pthread_mutex_lock(&m_mutex);
+  for (std::list<Client*>::iterator it= m_clients.begin();
+       it != m_clients.end();)
+  {
+    if (all || (*it)->done)
+    {
+      reaped.push_back(*it);
+      it= m_clients.erase(it);
+    }
+    else
+      ++it;
+  }
+  pthread_mutex_unlock(&m_mutex);
+
+  for (std::list<Client*>::iterator it= reaped.begin();
+       it != reaped.end(); ++it)
+  {
+    pthread_join((*it)->thread, NULL);
+    delete *it;
+  }
+}
+
+/**
+  Waits until a delay has passed or the server stops.
+
+  @return true if the server stops
+*/
+bool Fake_master::wait(unsigned long long usec)
+{
+  unsigned long long deadline_usec= now_usec() + usec;
+  struct timespec deadline;
+  deadline.tv_sec= deadline_usec / 1000000;
+  deadline.tv_nsec= (deadline_usec % 1000000) * 1000;
+
+  pthread_mutex_lock(&m_mutex);
+  while (!m_stop &&
+         pthread_cond_timedwait(&m_stop_cond, &m_mutex, &deadline) != ETIMEDOUT)
+    ;
+  bool stopped= m_stop;
+  pthread_mutex_unlock(&m_mutex);
+  return stopped;
+}
+
+void Fake_master::run_client(Client *client)
+{
+  uint32_t connection_id= (uint32_t)
+    __atomic_add_fetch(&m_stats.connections, 1, __ATOMIC_RELAXED);
+
+  /* The challenge is not checked, any password is accepted */
+  unsigned char challenge[SCRAMBLE_LENGTH];
+  unsigned int seed= connection_id ^ (unsigned int) now_usec();
+  for (size_t i= 0; i < sizeof(challenge); i++)
+    challenge[i]= (unsigned char) (rand_r(&seed) % 94 + 33);
+
+  std::vector<unsigned char> handshake;
+  handshake.push_back(10);
+  handshake.insert(handshake.end(), m_version.begin(), m_version.end());
+  handshake.push_back(0);
+  unsigned char buf[4];
+  int4store(buf, connection_id);
+  handshake.insert(handshake.end(), buf, buf + 4);
+  handshake.insert(handshake.end(), challenge, challenge + 8);
+  handshake.push_back(0);
+  int2store(buf, FAKE_MASTER_SERVER_FLAGS & 0xffff);
+  handshake.insert(handshake.end(), buf, buf + 2);
+  handshake.push_back(FAKE_MASTER_CHARSET);
+  int2store(buf, FAKE_MASTER_STATUS);
+  handshake.insert(handshake.end(), buf, buf + 2);
+  int2store(buf, FAKE_MASTER_SERVER_FLAGS >> 16);
+  handshake.insert(handshake.end(), buf, buf + 2);
+  handshake.push_back(SCRAMBLE_LENGTH + 1);
+  handshake.insert(handshake.end(), 10, 0);
+  handshake.insert(handshake.end(), challenge + 8,
+                   challenge + SCRAMBLE_LENGTH);
+  handshake.push_back(0);
+  handshake.insert(handshake.end(), native_password_plugin,
+                   native_password_plugin + sizeof(native_password_plugin));
+  queue_packet(client, &handshake[0], handshake.size());
+
+  std::vector<unsigned char> packet;
+  if (flush(client, true) == ERR_OK && read_packet(client, &packet) == ERR_OK)
+  {
+    send_ok(client);
+    while (flush(client, true) == ERR_OK &&
+           read_packet(client, &packet) == ERR_OK && !packet.empty())
+    {
+      unsigned char command= packet[0];
+      if (command == COM_QUIT)
+        break;
+      if (command == COM_BINLOG_DUMP || command == COM_BINLOG_DUMP_GTID)
+      {
+        /* As on a master, the connection ends with the dump */
+        if (command == COM_BINLOG_DUMP)
+          dump(client, &packet[0], packet.size());
+        else
+          dump_gtid(client, &packet[0], packet.size());
+        flush(client, true);
+        break;
+      }
+      if (command == COM_QUERY)
+        handle_query(client, std::string(packet.begin() + 1, packet.end()));
+      else if (command == COM_PING || command == COM_REGISTER_SLAVE)
+        send_ok(client);
+      else
+        send_error(client, ER_UNKNOWN_COM_ERROR, "Unknown command");
+    }
+  }
+
+  pthread_mutex_lock(&m_mutex);
+  close(client->fd);
+  client->fd= -1;
+  client->done= true;
+  pthread_mutex_unlock(&m_mutex);
+}
+
+/**
+  Reads a packet, putting together a payload split over several packets.
+
+  @retval ERR_OK       The payload is read
+  @retval ERR_CONNECT  The connection is closed
+*/
+int Fake_master::read_packet(Client *client,
+                             std::vector<unsigned char> *payload)
+{
+  payload->clear();
+  for (;;)
+  {
+    unsigned char header[4];
+    size_t got= 0;
+    while (got < sizeof(header))
+    {
+      ssize_t n= recv(client->fd, header + got, sizeof(header) - got, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return ERR_CONNECT;
+      got+= n;
+    }
+    size_t length= uint3korr(header);
+    client->seq= (unsigned char) (header[3] + 1);
+
+    size_t start= payload->size();
+    payload->resize(start + length);
+    got= 0;
+    while (got < length)
+    {
+      ssize_t n= recv(client->fd, &(*payload)[start + got], length - got, 0);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return ERR_CONNECT;
+      got+= n;
+    }
+    if (length < MAX_PACKET_LENGTH)
+      return ERR_OK;
+  }
+}
+
+/** Appends a payload to the output, in as many packets as it needs */
+void Fake_master::queue_packet(Client *client, const unsigned char *payload,
+                               size_t length)
+{
+  for (;;)
+  {
+    size_t chunk= std::min(length, (size_t) MAX_PACKET_LENGTH);
+    unsigned char header[4];
+    int3store(header, chunk);
+    header[3]= client->seq++;
+    client->out.insert(client->out.end(), header, header + 4);
+    client->out.insert(client->out.end(), payload, payload + chunk);
+    payload+= chunk;
+    length-= chunk;
+    if (chunk < MAX_PACKET_LENGTH)
+      break;
+  }
+}
+
+/**
+  Writes the output in writes of the write size.
+
+  @param all  Also writes the bytes short of a full write
+
+  @retval ERR_OK       Written
+  @retval ERR_CONNECT  The connection is closed
+*/
+int Fake_master::flush(Client *client, bool all)
+{
+  std::vector<unsigned char> &out= client->out;
+  size_t start= 0;
+  int error= ERR_OK;
+  while (out.size() - start >= m_write_size || (all && start < out.size()))
+  {
+    size_t length= std::min(m_write_size, out.size() - start);
+    ssize_t n= send(client->fd, &out[start], length, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+    {
+      error= ERR_CONNECT;
+      start= out.size();
+      break;
+    }
+    start+= n;
+  }
+  __atomic_add_fetch(&m_stats.bytes_sent, start, __ATOMIC_RELAXED);
+  out.erase(out.begin(), out.begin() + start);
+  return error;
+}
+
+/** Appends an event packet, the event following the OK byte */
+void Fake_master::queue_event(Client *client, const unsigned char *event,
+                              size_t length)
+{
+  if (length + 1 >= MAX_PACKET_LENGTH)
+  {
+    std::vector<unsigned char> payload(1, 0);
+    payload.insert(payload.end(), event, event + length);
+    queue_packet(client, &payload[0], payload.size());
+    return;
+  }
+  unsigned char header[5];
+  int3store(header, length + 1);
+  header[3]= client->seq++;
+  header[4]= 0;
+  client->out.insert(client->out.end(), header, header + 5);
+  client->out.insert(client->out.end(), event, event + length);
+}
+
+void Fake_master::send_ok(Client *client)
+{
+  static const unsigned char ok[]= { 0, 0, 0, FAKE_MASTER_STATUS, 0, 0, 0 };
+  queue_packet(client, ok, sizeof(ok));
+}
+
+void Fake_master::send_error(Client *client, unsigned int code,
+                             const std::string &message)
+{
+  std::vector<unsigned char> packet(3);
+  packet[0]= 0xff;
+  int2store(&packet[1], code);
+  const char state[]= "#HY000";
+  packet.insert(packet.end(), state, state + 6);
+  packet.insert(packet.end(), message.begin(), message.end());
+  queue_packet(client, &packet[0], packet.size());
+}
+
+/** Sends a result set of strings */
+void Fake_master::send_result(Client *client,
+                              const std::vector<std::string> &columns,
+                              const std::vector<std::vector<std::string> >
+                                &rows)
+{
+  static const unsigned char eof[]= { 0xfe, 0, 0, FAKE_MASTER_STATUS, 0 };
+  std::vector<unsigned char> packet(9);
+  packet.resize(net_store_length(&packet[0], columns.size()) - &packet[0]);
+  queue_packet(client, &packet[0], packet.size());
+
+  for (size_t i= 0; i < columns.size(); i++)
+  {
+    packet.clear();
+    store_lenenc_string(&packet, "def");
+    store_lenenc_string(&packet, "");
+    store_lenenc_string(&packet, "");
+    store_lenenc_string(&packet, "");
+    store_lenenc_string(&packet, columns[i]);
+    store_lenenc_string(&packet, "");
+    /* Length of the fixed fields, charset, length, type, flags, decimals */
+    unsigned char fields[13]= { 0x0c };
+    int2store(fields + 1, FAKE_MASTER_CHARSET);
+    int4store(fields + 3, 256);
+    fields[7]= MYSQL_TYPE_VAR_STRING;
+    packet.insert(packet.end(), fields, fields + sizeof(fields));
+    queue_packet(client, &packet[0], packet.size());
+  }
+  queue_packet(client, eof, sizeof(eof));
+
+  for (size_t i= 0; i < rows.size(); i++)
+  {
+    packet.clear();
+    for (size_t j= 0; j < rows[i].size(); j++)
+      store_lenenc_string(&packet, rows[i][j]);
+    queue_packet(client, &packet[0], packet.size());
+  }
+  queue_packet(client, eof, sizeof(eof));
+}
+
+int Fake_master::handle_query(Client *client, const std::string &query)
+{
+  std::string upper= to_upper(query);
+  size_t start= upper.find_first_not_of(" \t\r\n");
+  size_t end= upper.find_last_not_of(" \t\r\n;");
+  upper= start == std::string::npos ? "" : upper.substr(start, end - start + 1);
+
+  std::vector<std::string> columns;
+  std::vector<std::vector<std::string> > rows;
+  if (upper.compare(0, 4, "SET ") == 0)
+  {
+    std::string value= assigned_value(upper, "@MASTER_BINLOG_CHECKSUM");
+    if (value == "@@GLOBAL.BINLOG_CHECKSUM")
+      client->checksum= m_binlog_checksum;
+    else if (value == "CRC32" || value == "NONE")
+      client->checksum= value == "CRC32";
+    else if (!value.empty())
+    {
+      send_error(client, ER_NOT_SUPPORTED_YET,
+                 "Unknown binlog checksum algorithm " + value);
+      return ERR_FAIL;
+    }
+    if (!value.empty())
+      client->checksum_aware= true;
+    /* The period is in nanoseconds */
+    value= assigned_value(upper, "@MASTER_HEARTBEAT_PERIOD");
+    if (!value.empty())
+      client->heartbeat_period= strtoull(value.c_str(), NULL, 10) / 1000000;
+    send_ok(client);
+    return ERR_OK;
+  }
+
+  if (upper == "SELECT @MASTER_BINLOG_CHECKSUM" ||
+      upper == "SELECT @@GLOBAL.BINLOG_CHECKSUM")
+  {
+    bool checksum= upper[8] == '@' ? client->checksum : m_binlog_checksum;
+    columns.push_back(query.substr(query.find('@'), end - query.find('@') + 1));
+    rows.push_back(std::vector<std::string>(1, checksum ? "CRC32" : "NONE"));
+  }
+  else if (upper == "SHOW MASTER STATUS")
+  {
+    const char *names[]= { "File", "Position", "Binlog_Do_DB",
+                           "Binlog_Ignore_DB", "Executed_Gtid_Set" };
+    columns.assign(names, names + 5);
+    if (!m_binlogs.empty())
+    {
+      char size[32];
+      sprintf(size, "%lu", (unsigned long) m_binlogs.back().data.size());
+      const char *row[]= { m_binlogs.back().name.c_str(), size, "", "", "" };
+      rows.push_back(std::vector<std::string>(row, row + 5));
+    }
+  }
+  else if (upper == "SHOW BINARY LOGS" || upper == "SHOW MASTER LOGS")
+  {
+    columns.push_back("Log_name");
+    columns.push_back("File_size");
+    for (size_t i= 0; i < m_binlogs.size(); i++)
+    {
+      char size[32];
+      sprintf(size, "%lu", (unsigned long) m_binlogs[i].data.size());
+      const char *row[]= { m_binlogs[i].name.c_str(), size };
+      rows.push_back(std::vector<std::string>(row, row + 2));
+    }
+  }
+  else
+  {
+    send_error(client, ER_NOT_SUPPORTED_YET,
+               "This query is not supported by the fake master");
+    return ERR_FAIL;
+  }
+  send_result(client, columns, rows);
+  return ERR_OK;
+}
+
+/**
+  Sends an event the master makes up, which has no position in the binlog.
+*/
+void Fake_master::send_made_up_event(Client *client, unsigned char type,
+                                     uint32_t log_pos,
+                                     const std::string &body)
+{
+  std::vector<unsigned char> packet(1 + LOG_EVENT_HEADER_LEN);
+  unsigned char *header= &packet[1];
+  size_t length= LOG_EVENT_HEADER_LEN + body.size() +
+                 (client->checksum ? BINLOG_CHECKSUM_LEN : 0);
+  header[EVENT_TYPE_OFFSET]= type;
+  int4store(header + SERVER_ID_OFFSET, FAKE_MASTER_SERVER_ID);
+  int4store(header + EVENT_LEN_OFFSET, length);
+  int4store(header + LOG_POS_OFFSET, log_pos);
+  int2store(header + FLAGS_OFFSET, LOG_EVENT_ARTIFICIAL_F);
+  packet.insert(packet.end(), body.begin(), body.end());
+  if (client->checksum)
+  {
+    unsigned char checksum[BINLOG_CHECKSUM_LEN];
+    int4store(checksum, checksum_crc32(0, &packet[1], packet.size() - 1));
+    packet.insert(packet.end(), checksum, checksum + BINLOG_CHECKSUM_LEN);
+  }
+  queue_packet(client, &packet[0], packet.size());
+}
+
+/**
+  Streams the binlog files from the position requested by a
+  COM_BINLOG_DUMP packet.
+
+  @retval ERR_OK       The dump ended, with an EOF packet or an error
+                       packet
+  @retval ERR_CONNECT  The connection is closed, or the server stops
+*/
+int Fake_master::dump(Client *client, const unsigned char *packet,
+                      size_t length)
+{
+  if (length < 11)
+  {
+    send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+               "Malformed COM_BINLOG_DUMP packet");
+    return ERR_OK;
+  }
+  unsigned long pos= uint4korr(packet + 1);
+  unsigned int flags= uint2korr(packet + 5);
+  std::string name((const char*) packet + 11, length - 11);
+  return stream(client, name, pos, flags, NULL);
+}
+
+/**
+  Streams the binlog files from the position requested by a
+  COM_BINLOG_DUMP_GTID packet, without the transactions of its GTID set.
+
+  @retval ERR_OK       The dump ended, with an EOF packet or an error
+                       packet
+  @retval ERR_CONNECT  The connection is closed, or the server stops
+*/
+int Fake_master::dump_gtid(Client *client, const unsigned char *packet,
+                           size_t length)
+{
+  /* The flags, the server id, the name with its length, the position */
+  size_t name_length= length < 11 ? 0 : uint4korr(packet + 7);
+  bool valid= length >= 11 && length - 11 >= name_length &&
+              length - 11 - name_length >= 8;
+  unsigned int flags= valid ? uint2korr(packet + 1) : 0;
+  size_t rest= 11 + name_length + 8;
+  Gtid_set gtids;
+  /* The GTID set, with its length */
+  if (valid && (flags & BINLOG_THROUGH_GTID))
+    valid= length - rest >= 4 && uint4korr(packet + rest) == length - rest - 4 &&
+           decode_gtid_set(packet + rest + 4, length - rest - 4,
+                           &gtids) == ERR_OK;
+  if (!valid)
+  {
+    send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+               "Malformed COM_BINLOG_DUMP_GTID packet");
+    return ERR_OK;
+  }
+  std::string name((const char*) packet + 11, name_length);
+  unsigned long pos= (unsigned long) read_le64(packet + 11 + name_length);
+  return stream(client, name, pos, flags, &gtids);
+}
+
+/**
+  Streams the binlog files from a position, for both dump commands.
+
+  @param name   The file to start from, the first one if empty
+  @param skip   The GTIDs of the transactions not to send, or NULL
+*/
+int Fake_master::stream(Client *client, const std::string &name,
+                        unsigned long pos, unsigned int flags,
+                        const Gtid_set *skip)
+{
+  __atomic_add_fetch(&m_stats.dumps, 1, __ATOMIC_RELAXED);
+
+  size_t index= 0;
+  while (index < m_binlogs.size() && !name.empty() &&
+         m_binlogs[index].name != name)
+    index++;
+  if (index == m_binlogs.size())
+  {
+    send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+               "Could not find first log file name in binary log index file");
+    return ERR_OK;
+  }
+  if (pos < BIN_LOG_HEADER_SIZE)
+    pos= BIN_LOG_HEADER_SIZE;
+  if (pos > m_binlogs[index].data.size())
+  {
+    send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+               "Client requested master to start replication from position "
+               "> file size");
+    return ERR_OK;
+  }
+  /* A master refuses the clients which do not know about checksums */
+  if (m_binlog_checksum && !client->checksum_aware)
+  {
+    send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+               "Slave can not handle replication events with the checksum "
+               "that master is configured to log");
+    return ERR_OK;
+  }
+
+  std::string rotate(8, '\0');
+  int8store(&rotate[0], (unsigned long long) pos);
+  send_made_up_event(client, ROTATE_EVENT, 0,
+                     rotate + m_binlogs[index].name);
+
+  /*
+    The client needs the Format_description_event of the file even when
+    starting in the middle of it. It is sent with no end position, so
+    that the client does not take it for its position.
+  */
+  const std::vector<unsigned char> &first= m_binlogs[index].data;
+  if (pos > BIN_LOG_HEADER_SIZE &&
+      first.size() >= BIN_LOG_HEADER_SIZE + LOG_EVENT_HEADER_LEN &&
+      first[BIN_LOG_HEADER_SIZE + EVENT_TYPE_OFFSET] ==
+        FORMAT_DESCRIPTION_EVENT)
+  {
+    const unsigned char *fde= &first[BIN_LOG_HEADER_SIZE];
+    uint32_t fde_length= uint4korr(fde + EVENT_LEN_OFFSET);
+    if (fde_length >= LOG_EVENT_HEADER_LEN + BINLOG_CHECKSUM_LEN &&
+        fde_length <= first.size() - BIN_LOG_HEADER_SIZE)
+    {
+      std::vector<unsigned char> event(1, 0);
+      event.insert(event.end(), fde, fde + fde_length);
+      int4store(&event[1 + LOG_POS_OFFSET], 0);
+      if (Log_event_footer::get_checksum_alg((const char*) fde, fde_length) ==
+          BINLOG_CHECKSUM_ALG_CRC32)
+        int4store(&event[1 + fde_length - BINLOG_CHECKSUM_LEN],
+                  checksum_crc32(0, &event[1],
+                                 fde_length - BINLOG_CHECKSUM_LEN));
+      queue_packet(client, &event[0], event.size());
+    }
+  }
+
+  unsigned long long start_usec= now_usec();
+  unsigned long long paced= 0;
+  /* Set from a Gtid_log_event in skip to the next Gtid_log_event */
+  bool skipping= false;
+  for (;;)
+  {
+    const Binlog &binlog= m_binlogs[index];
+    const unsigned char *data= &binlog.data[0];
+    size_t last_event= 0;
+    while (pos < binlog.data.size())
+    {
+      size_t left= binlog.data.size() - pos;
+      uint32_t event_length= left < LOG_EVENT_HEADER_LEN ? 0 :
+                             uint4korr(data + pos + EVENT_LEN_OFFSET);
+      if (event_length < LOG_EVENT_HEADER_LEN || event_length > left)
+      {
+        send_error(client, ER_MASTER_FATAL_ERROR_READING_BINLOG,
+                   "log event entry exceeded max_allowed_packet; "
+                   "or bogus data in log event");
+        return ERR_OK;
+      }
+
+      const unsigned char *event= data + pos;
+      last_event= pos;
+      pos+= event_length;
+      if (skip)
+      {
+        /* The flags of the Gtid_log_event precede its UUID and GNO */
+        const unsigned char *gtid= event + LOG_EVENT_HEADER_LEN + 1;
+        unsigned char type= event[EVENT_TYPE_OFFSET];
+        if (type == GTID_LOG_EVENT &&
+            event_length >= LOG_EVENT_HEADER_LEN + 1 + 16 + 8)
+          skipping= skip->contains(gtid, (int64_t) read_le64(gtid + 16));
+        else if (type == ANONYMOUS_GTID_LOG_EVENT)
+          skipping= false;
+        if (skipping && type != FORMAT_DESCRIPTION_EVENT &&
+            type != ROTATE_EVENT && type != PREVIOUS_GTIDS_LOG_EVENT &&
+            type != STOP_EVENT)
+          continue;
+      }
+
+      if (m_rate)
+      {
+        unsigned long long due= start_usec + paced++ * 1000000ULL / m_rate;
+        unsigned long long now= now_usec();
+        if (due > now &&
+            (flush(client, true) != ERR_OK || wait(due - now)))
+          return ERR_CONNECT;
+      }
+
+      queue_event(client, event, event_length);
+      client->events_sent++;
+      __atomic_add_fetch(&m_stats.events_sent, 1, __ATOMIC_RELAXED);
+
+      if (m_disconnect_after && client->events_sent % m_disconnect_after == 0)
+      {
+        flush(client, true);
+        __atomic_add_fetch(&m_stats.disconnects, 1, __ATOMIC_RELAXED);
+        return ERR_CONNECT;
+      }
+      if (flush(client, false) != ERR_OK)
+        return ERR_CONNECT;
+    }
+
+    if (index + 1 < m_binlogs.size())
+    {
+      bool rotated= last_event &&
+                    rotates_to(data + last_event, pos - last_event,
+                               m_binlogs[index + 1].name);
+      index++;
+      pos= BIN_LOG_HEADER_SIZE;
+      if (!rotated)
+      {
+        std::string rotate(8, '\0');
+        int8store(&rotate[0], (unsigned long long) pos);
+        send_made_up_event(client, ROTATE_EVENT, 0,
+                           rotate + m_binlogs[index].name);
+      }
+      continue;
+    }
+
+    if (m_eof_at_end || (flags & BINLOG_DUMP_NON_BLOCK))
+    {
+      static const unsigned char eof[]= { 0xfe, 0, 0, FAKE_MASTER_STATUS, 0 };
+      queue_packet(client, eof, sizeof(eof));
+      return ERR_OK;
+    }
+
+    /* Nothing more to send: wait for the client to go, or for a stop */
+    if (flush(client, true) != ERR_OK)
+      return ERR_CONNECT;
+    for (;;)
+    {
+      unsigned long period= client->heartbeat_period;
+      if (wait(period ? period * 1000ULL : 1000000ULL))
+        return ERR_CONNECT;
+      if (period)
+      {
+        send_made_up_event(client, HEARTBEAT_LOG_EVENT, (uint32_t) pos,
+                           binlog.name);
+        __atomic_add_fetch(&m_stats.heartbeats_sent, 1, __ATOMIC_RELAXED);
+      }
+      else
+      {
+        /* Only a closed connection is noticed */
+        char byte;
+        if (recv(client->fd, &byte, 1, MSG_DONTWAIT | MSG_PEEK) == 0)
+          return ERR_CONNECT;
+      }
+      if (flush(client, true) != ERR_OK)
+        return ERR_CONNECT;
+    }
+  }
+}
+
+} } // namespace binary_log::system
+
+#endif /* HAVE_PTHREAD_H */
@@ -0,0 +1,229 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+/**
+  @file fake_master.h
+
+  @brief Contains a server speaking the master side of the replication
+  protocol, which streams binlog files read from disk.
+*/
+
+#ifndef FAKE_MASTER_INCLUDED
+#define	FAKE_MASTER_INCLUDED
+
+#include "binlog_driver.h"
+#include "gtid_set.h"
+#include <list>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+
+/** Default size of the writes to a client, in bytes */
+#define FAKE_MASTER_WRITE_SIZE (64 * 1024)
+/** Server id of the events the fake master makes up */
+#define FAKE_MASTER_SERVER_ID 1
+/** Default version announced in the handshake */
+#define FAKE_MASTER_VERSION "5.7.18-fake-log"
+
+namespace binary_log {
+namespace system {
+
+/**
+  Counters of a Fake_master, over all its clients.
+*/
+struct Fake_master_stats
+{
+  unsigned long long connections;
+  unsigned long long dumps;
+  unsigned long long events_sent;
+  unsigned long long heartbeats_sent;
+  unsigned long long bytes_sent;
+  /** Connections closed by set_disconnect_after() */
+  unsigned long long disconnects;
+};
+
+/**
+  @class Fake_master
+
+  A server which answers the handshake, COM_REGISTER_SLAVE,
+  COM_BINLOG_DUMP and COM_BINLOG_DUMP_GTID of replication clients like a
+  master would, streaming
+  the events of binlog files read from disk. It makes the TCP path of the
+  clients testable and measurable without a MySQL server.
+
+  Every client is served by its own thread. Any user and password are
+  accepted. A dump starts with a fake Rotate_event, as on a master, goes
+  through the files in the order they were added, and then waits for the
+  client to disconnect, sending heartbeats if the client or
+  set_heartbeat_period() asks for them. A file which does not end with a
+  Rotate_event is followed by a fake one naming the next file.
+
+  The queries the clients of this library send are answered:
+  SET @master_binlog_checksum, SET @master_heartbeat_period,
+  SELECT @master_binlog_checksum, SELECT @@global.binlog_checksum,
+  SHOW MASTER STATUS and SHOW BINARY LOGS; other SET statements succeed
+  without effect and other queries fail.
+
+  COM_BINLOG_DUMP_GTID starts from the file and position of the request,
+  the first file when it names none, and skips the transactions whose
+  Gtid_log_event is in the GTID set of the request. The events outside of
+  the transactions, like the Format_description_events and the
+  Rotate_events, are always sent.
+
+  The files are read when they are added, and must not be added once
+  the server is started.
+*/
+class Fake_master
+{
+public:
+  Fake_master();
+  ~Fake_master();
+
+  /**
+    Reads a binlog file, served under its base name.
+
+    @retval ERR_OK    The file is read
+    @retval ERR_FAIL  The file cannot be read or is not a binlog file
+  */
+  int add_binlog(const std::string &path);
+
+  /** Limits the events sent to each client per second, 0 for no limit */
+  void set_rate(unsigned long events_per_second) { m_rate= events_per_second; }
+  /**
+    Sets the size of the writes to the sockets. The packets are gathered
+    up to this size, and larger ones are written in pieces of this size,
+    so that 1 sends every byte by itself.
+  */
+  void set_write_size(size_t size) { m_write_size= size ? size : 1; }
+  /**
+    Sets the period of the heartbeats sent once the files are all sent,
+    in milliseconds, unless the client asks for another one. 0 sends them
+    only when asked.
+  */
+  void set_heartbeat_period(unsigned long msec) { m_heartbeat_period= msec; }
+  /** Closes the connection of a client every that many events, 0 never */
+  void set_disconnect_after(unsigned long events)
+  { m_disconnect_after= events; }
+  /**
+    Ends the dumps with an EOF packet after the last event, as a master
+    does for BINLOG_DUMP_NON_BLOCK, rather than waiting for the client.
+  */
+  void set_eof_at_end(bool eof) { m_eof_at_end= eof; }
+  void set_server_version(const std::string &version) { m_version= version; }
+
+  /**
+    Starts listening and serving clients in a thread.
+
+    @param port     The TCP port, or 0 for a free one, see port()
+    @param address  The IPv4 address to listen on
+
+    @retval ERR_OK      Listening
+    @retval ERR_CONNECT The socket cannot be opened
+    @retval ERR_FAIL    The server is already started
+  */
+  int start(unsigned int port= 0,
+            const std::string &address= "127.0.0.1");
+  /** Closes the connections of the clients and stops listening */
+  void stop();
+  unsigned int port() const { return m_port; }
+
+  void get_stats(Fake_master_stats *stats) const;
+
+private:
+  struct Binlog
+  {
+    std::string name;
+    std::vector<unsigned char> data;
+  };
+
+  struct Client
+  {
+    Fake_master *master;
+    int fd;
+    pthread_t thread;
+    /** Set by the thread when it is done, under m_mutex */
+    bool done;
+    unsigned char seq;
+    /** Packets not written yet */
+    std::vector<unsigned char> out;
+    /** Set once the client sets @master_binlog_checksum */
+    bool checksum_aware;
+    /** Whether the events made up for the client have a checksum */
+    bool checksum;
+    unsigned long heartbeat_period;
+    unsigned long long events_sent;
+  };
+
+  static void *listener_thread(void *arg);
+  static void *client_thread(void *arg);
+  void run_listener();
+  void run_client(Client *client);
+  void reap_clients(bool all);
+
+  int read_packet(Client *client, std::vector<unsigned char> *payload);
+  void queue_packet(Client *client, const unsigned char *payload,
+                    size_t length);
+  void queue_event(Client *client, const unsigned char *event,
+                   size_t length);
+  int flush(Client *client, bool all);
+  void send_ok(Client *client);
+  void send_error(Client *client, unsigned int code,
+                  const std::string &message);
+  void send_result(Client *client, const std::vector<std::string> &columns,
+                   const std::vector<std::vector<std::string> > &rows);
+  void send_made_up_event(Client *client, unsigned char type,
+                          uint32_t log_pos, const std::string &body);
+  int handle_query(Client *client, const std::string &query);
+  int dump(Client *client, const unsigned char *packet, size_t length);
+  int dump_gtid(Client *client, const unsigned char *packet, size_t length);
+  int stream(Client *client, const std::string &name, unsigned long pos,
+             unsigned int flags, const Gtid_set *skip);
+  bool wait(unsigned long long usec);
+
+  std::vector<Binlog> m_binlogs;
+  bool m_binlog_checksum;
+  unsigned long m_rate;
+  size_t m_write_size;
+  unsigned long m_heartbeat_period;
+  unsigned long m_disconnect_after;
+  bool m_eof_at_end;
+  std::string m_version;
+
+  int m_listen_fd;
+  unsigned int m_port;
+  pthread_t m_listener;
+  bool m_running;
+
+  mutable pthread_mutex_t m_mutex;
+  /** Signalled on stop, wakes up the clients waiting */
+  pthread_cond_t m_stop_cond;
+  bool m_stop;
+  std::list<Client*> m_clients;
+  Fake_master_stats m_stats;
+};
+
+} // namespace binary_log::system
+} // namespace binary_log
+
+#endif /* HAVE_PTHREAD_H */
+
+#endif	/* FAKE_MASTER_INCLUDED */
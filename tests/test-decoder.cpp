@@ -0,0 +1,1271 @@
+/*
+Copyright (c) 2016, Oracle and/or its affiliates. All rights
+reserved.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; version 2 of
+the License.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+02110-1301  USA
+*/
+
+#include "binlog.h"
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+using binary_log::system::Binary_log_driver;
+
+#ifndef STD_DATA_DIR
+#define STD_DATA_DIR "std-data"
+#endif
+
+class TestDecoder : public ::testing::Test {
+protected:
+  TestDecoder() { }
+  virtual ~TestDecoder() { }
+};
+
+TEST_F(TestDecoder, Checksum) {
+  const char *implementation= binary_log::checksum_crc32_implementation();
+  EXPECT_TRUE(strcmp(implementation, "pclmul") == 0 ||
+              strcmp(implementation, "armv8") == 0 ||
+              strcmp(implementation, "zlib") == 0);
+
+  // Every length and alignment gives the CRC32 of zlib
+  std::vector<unsigned char> buf(1200);
+  for (size_t i= 0; i < buf.size(); i++)
+    buf[i]= (unsigned char) (i * 131 + (i >> 3));
+  EXPECT_EQ(binary_log::checksum_crc32(0, NULL, 0), 0U);
+  for (size_t offset= 0; offset < 8; offset++)
+    for (size_t length= 0; length + offset <= buf.size(); length+= 7)
+      ASSERT_EQ(binary_log::checksum_crc32(0, &buf[offset], length),
+                crc32(0, &buf[offset], length)) << offset << " " << length;
+  uint32_t crc= binary_log::checksum_crc32(0, &buf[0], 100);
+  EXPECT_EQ(binary_log::checksum_crc32(crc, &buf[100], 1000),
+            crc32(0, &buf[0], 1100));
+
+  // The Rotate_event starting a dump may have a checksum
+  std::string rotate("\4\0\0\0\0\0\0\0master-bin.000002", 25);
+  std::vector<unsigned char> event(LOG_EVENT_HEADER_LEN);
+  event[EVENT_TYPE_OFFSET]= binary_log::ROTATE_EVENT;
+  event.insert(event.end(), rotate.begin(), rotate.end());
+  for (int with_checksum= 0; with_checksum < 2; with_checksum++)
+  {
+    std::vector<unsigned char> ev(event);
+    if (with_checksum)
+    {
+      uint32_t checksum= htole32(crc32(0, &ev[0], ev.size()));
+      ev.insert(ev.end(), (unsigned char*) &checksum,
+                (unsigned char*) &checksum + 4);
+    }
+    std::string file;
+    unsigned long position= 0;
+    unsigned int checksum_len= 0;
+    Binary_log_driver::track_event_position(&ev[0], ev.size(), &file,
+                                            &position, &checksum_len);
+    EXPECT_EQ(file, "master-bin.000002");
+    EXPECT_EQ(position, 4U);
+  }
+}
+
+/* The sanitizers replace malloc() themselves */
+#if defined(__SANITIZE_ADDRESS__)
+#define WITH_ASAN 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define WITH_ASAN 1
+#endif
+#endif
+
+#if defined(__GLIBC__) && !defined(WITH_ASAN)
+static const bool allocations_counted= true;
+
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+
+/** Set while an Allocation_counter counts */
+static bool count_allocations= false;
+static unsigned long long heap_allocations= 0;
+
+static void count_allocation()
+{
+  if (__atomic_load_n(&count_allocations, __ATOMIC_RELAXED))
+    __atomic_add_fetch(&heap_allocations, 1, __ATOMIC_RELAXED);
+}
+
+/*
+  operator new, bapi_malloc(), strndup() and Event_buffer all allocate
+  with malloc(), which glibc lets the program replace.
+*/
+extern "C" void *malloc(size_t size)
+{
+  count_allocation();
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+  count_allocation();
+  return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  count_allocation();
+  return __libc_realloc(ptr, size);
+}
+
+/**
+  Counts the heap allocations of all the threads from its construction to
+  its destruction.
+*/
+class Allocation_counter
+{
+public:
+  Allocation_counter()
+  {
+    __atomic_store_n(&heap_allocations, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&count_allocations, true, __ATOMIC_SEQ_CST);
+  }
+  ~Allocation_counter()
+  {
+    __atomic_store_n(&count_allocations, false, __ATOMIC_SEQ_CST);
+  }
+  unsigned long long count() const
+  {
+    return __atomic_load_n(&heap_allocations, __ATOMIC_RELAXED);
+  }
+};
+#else
+/** Without a replaceable malloc(), the allocations are not checked */
+static const bool allocations_counted= false;
+
+class Allocation_counter
+{
+public:
+  unsigned long long count() const { return 0; }
+};
+#endif
+
+/** Builds an event of the 5.7 format, without checksum */
+static std::string make_event(unsigned char type, const std::string &body)
+{
+  std::string event(LOG_EVENT_HEADER_LEN, '\0');
+  event[EVENT_TYPE_OFFSET]= type;
+  uint32_t length= htole32(LOG_EVENT_HEADER_LEN + body.size());
+  memcpy(&event[EVENT_LEN_OFFSET], &length, 4);
+  return event + body;
+}
+
+/**
+  Builds the Format_description_event of a 5.7 server without checksums,
+  followed by a transaction: GTID, BEGIN, a Table_map_event of
+  db.table_with_a_long_name(INT, VARCHAR(255)), a Write_rows_event and a
+  XID.
+*/
+static std::vector<std::string> make_transaction()
+{
+  typedef binary_log::Binary_log_event Event;
+  std::string post_header_len(Event::LOG_EVENT_TYPES, '\0');
+  post_header_len[binary_log::QUERY_EVENT - 1]= Event::QUERY_HEADER_LEN;
+  post_header_len[binary_log::ROTATE_EVENT - 1]= Event::ROTATE_HEADER_LEN;
+  post_header_len[binary_log::FORMAT_DESCRIPTION_EVENT - 1]=
+    Event::FORMAT_DESCRIPTION_HEADER_LEN;
+  post_header_len[binary_log::TABLE_MAP_EVENT - 1]= Event::TABLE_MAP_HEADER_LEN;
+  post_header_len[binary_log::WRITE_ROWS_EVENT - 1]= Event::ROWS_HEADER_LEN_V2;
+  post_header_len[binary_log::UPDATE_ROWS_EVENT - 1]= Event::ROWS_HEADER_LEN_V2;
+  post_header_len[binary_log::DELETE_ROWS_EVENT - 1]= Event::ROWS_HEADER_LEN_V2;
+  post_header_len[binary_log::GTID_LOG_EVENT - 1]=
+    binary_log::Gtid_event::POST_HEADER_LENGTH;
+  std::string fde(2, '\0');
+  fde[0]= 4;
+  std::string version("5.7.18-log");
+  version.resize(50, '\0');
+  fde+= version + std::string(4, '\0');
+  fde+= (char) LOG_EVENT_HEADER_LEN;
+  fde+= post_header_len;
+  fde+= (char) binary_log::BINLOG_CHECKSUM_ALG_OFF;
+  fde+= std::string(4, '\0');
+
+  std::vector<std::string> events;
+  events.push_back(make_event(binary_log::FORMAT_DESCRIPTION_EVENT, fde));
+  events.push_back(make_event(binary_log::GTID_LOG_EVENT,
+                              std::string(42, '\1')));
+  std::string begin(13, '\0');
+  begin[8]= 2;
+  events.push_back(make_event(binary_log::QUERY_EVENT,
+                              begin + std::string("db\0BEGIN", 8)));
+  std::string table_map("\x21\0\0\0\0\0\1\0", 8);
+  table_map+= std::string("\2db\0\x16table_with_a_long_name\0", 28);
+  table_map+= std::string("\2\3\x0f\2\xff\0\3", 7);
+  events.push_back(make_event(binary_log::TABLE_MAP_EVENT, table_map));
+  std::string rows("\x21\0\0\0\0\0\1\0\2\0\2\3", 12);
+  rows+= std::string(100, '\0');
+  events.push_back(make_event(binary_log::WRITE_ROWS_EVENT, rows));
+  events.push_back(make_event(binary_log::XID_EVENT,
+                              std::string("\x2a\0\0\0\0\0\0\0", 8)));
+
+  return events;
+}
+
+TEST_F(TestDecoder, EventArena) {
+  binary_log::Event_arena arena(4096);
+  {
+    binary_log::Event_arena::Scope scope(&arena);
+    void *ptr= bapi_malloc(100, 0);
+    ASSERT_TRUE(ptr != NULL);
+    EXPECT_TRUE(arena.owns(ptr));
+    EXPECT_EQ((size_t) ptr % EVENT_ARENA_ALIGN, 0U);
+    bapi_free(ptr);
+    // Large requests get a block of their own
+    void *large= bapi_malloc(10000, 0);
+    ASSERT_TRUE(large != NULL);
+    EXPECT_TRUE(arena.owns(large));
+    const char *str= bapi_strndup("master-bin.000001", 10);
+    EXPECT_TRUE(arena.owns(str));
+    EXPECT_STREQ(str, "master-bin");
+  }
+  void *heap= bapi_malloc(100, 0);
+  EXPECT_FALSE(arena.owns(heap));
+  bapi_free(heap);
+  EXPECT_GE(arena.allocated(), 10100U);
+  arena.reset();
+  EXPECT_EQ(arena.allocated(), 0U);
+
+  std::string rotate("\4\0\0\0\0\0\0\0master-bin.000002", 25);
+  std::vector<char> event(LOG_EVENT_HEADER_LEN);
+  event[EVENT_TYPE_OFFSET]= binary_log::ROTATE_EVENT;
+  event.insert(event.end(), rotate.begin(), rotate.end());
+  uint32_t length= event.size();
+  memcpy(&event[EVENT_LEN_OFFSET], &length, 4);
+
+  binary_log::Decoder decoder;
+  decoder.set_arena(&arena);
+  const char *error= NULL;
+  binary_log::Binary_log_event *first= NULL;
+  size_t capacity= 0;
+  for (int round= 0; round < 3; round++)
+  {
+    // A transaction of events, released at once
+    for (int i= 0; i < 100; i++)
+    {
+      binary_log::Binary_log_event *ev=
+        decoder.decode_event(&event[0], event.size(), &error, false);
+      ASSERT_TRUE(ev != NULL) << error;
+      ASSERT_EQ(ev->get_event_type(), binary_log::ROTATE_EVENT);
+      binary_log::Rotate_event *rev= static_cast<binary_log::Rotate_event*>(ev);
+      EXPECT_TRUE(arena.owns(ev));
+      EXPECT_TRUE(arena.owns(rev->new_log_ident));
+      EXPECT_STREQ(rev->new_log_ident, "master-bin.000002");
+      if (i == 0)
+      {
+        // The memory is used again after a reset
+        if (round == 0)
+          first= ev;
+        EXPECT_EQ(ev, first);
+      }
+    }
+    if (round == 0)
+      capacity= arena.capacity();
+    // The chunks are kept
+    EXPECT_EQ(arena.capacity(), capacity);
+    arena.reset();
+  }
+
+  /*
+    The columns of a Table_map_event and the body of a Rows_event are
+    decoded into the arena too. The names of the table map are short
+    enough for std::string not to allocate them.
+  */
+  std::vector<std::string> events= make_transaction();
+  std::string table_map_body("\x21\0\0\0\0\0\1\0\2db\0\1t\0", 14);
+  table_map_body+= std::string("\2\3\x0f\2\xff\0\3", 7);
+  events[3]= make_event(binary_log::TABLE_MAP_EVENT, table_map_body);
+  ASSERT_TRUE(decoder.decode_event(events[0].data(), events[0].size(),
+                                   &error, false) != NULL) << error;
+  for (int round= 0; round < 2; round++)
+  {
+    size_t allocated= arena.allocated();
+    Allocation_counter counter;
+    binary_log::Table_map_event *table_map=
+      static_cast<binary_log::Table_map_event*>(
+        decoder.decode_event(events[3].data(), events[3].size(), &error,
+                             false));
+    ASSERT_TRUE(table_map != NULL) << error;
+    EXPECT_TRUE(arena.owns(table_map->m_coltype));
+    EXPECT_TRUE(arena.owns(table_map->m_columns));
+    binary_log::Binary_log_event *rows=
+      decoder.decode_event(events[4].data(), events[4].size(), &error,
+                           false);
+    ASSERT_TRUE(rows != NULL) << error;
+    if (allocations_counted)
+    {
+      EXPECT_EQ(counter.count(), 0U);
+    }
+    // The 100 bytes of the rows
+    EXPECT_GT(arena.allocated() - allocated, 100U);
+    arena.reset();
+  }
+
+  // Without an arena the events are on the heap
+  decoder.set_arena(NULL);
+  binary_log::Binary_log_event *ev=
+    decoder.decode_event(&event[0], event.size(), &error, false);
+  ASSERT_TRUE(ev != NULL);
+  EXPECT_FALSE(arena.owns(ev));
+  delete ev;
+}
+
+TEST_F(TestDecoder, EventPool) {
+  std::vector<std::string> events= make_transaction();
+  std::string fde_event= events[0];
+  events.erase(events.begin());
+
+  binary_log::Decoder decoder;
+  decoder.set_event_pool(4);
+  const char *error= NULL;
+  decoder.release_event(decoder.decode_event(fde_event.data(),
+                                             fde_event.size(), &error,
+                                             false));
+
+  std::vector<binary_log::Binary_log_event*> first, decoded;
+  decoded.reserve(events.size());
+  unsigned char *coltype= NULL;
+  Allocation_counter *counter= NULL;
+  for (int round= 0; round < 10; round++)
+  {
+    // The first round fills the pool
+    if (round == 1)
+      counter= new Allocation_counter();
+    decoded.clear();
+    for (size_t i= 0; i < events.size(); i++)
+    {
+      const std::string &event= events[i];
+      binary_log::Binary_log_event *ev=
+        decoder.decode_event(event.data(), event.size(), &error, false);
+      ASSERT_TRUE(ev != NULL) << error;
+      decoded.push_back(ev);
+    }
+    binary_log::Table_map_event *table=
+      static_cast<binary_log::Table_map_event*>(decoded[2]);
+    EXPECT_EQ(table->get_table_id(), 0x21U);
+    EXPECT_EQ(table->m_tblnam, "table_with_a_long_name");
+    EXPECT_EQ(table->m_colcnt, 2U);
+    // The buffers from bapi_malloc() are kept too
+    if (round == 0)
+      coltype= table->m_coltype;
+    EXPECT_EQ(table->m_coltype, coltype);
+    EXPECT_EQ(table->m_coltype[1], 0x0f);
+    binary_log::Rows_event *rows_ev=
+      dynamic_cast<binary_log::Rows_event*>(decoded[3]);
+    ASSERT_TRUE(rows_ev != NULL);
+    EXPECT_EQ(rows_ev->get_event_type(), binary_log::WRITE_ROWS_EVENT);
+    EXPECT_EQ(rows_ev->get_width(), 2U);
+    EXPECT_EQ(static_cast<binary_log::Xid_event*>(decoded[4])->xid, 42U);
+    if (round == 0)
+      first= decoded;
+    // The events are decoded in place
+    EXPECT_EQ(decoded, first);
+    for (size_t i= 0; i < decoded.size(); i++)
+      decoder.release_event(decoded[i]);
+  }
+  /*
+    The events and their buffers are all reused. The counter itself is
+    allocated before it counts.
+  */
+  unsigned long long allocations= counter->count();
+  delete counter;
+  if (allocations_counted)
+  {
+    EXPECT_EQ(allocations, 0U);
+  }
+
+  // Without a pool, every event is allocated
+  decoder.set_event_pool(0);
+  Allocation_counter no_pool;
+  delete decoder.decode_event(events[4].data(), events[4].size(), &error,
+                              false);
+  if (allocations_counted)
+  {
+    EXPECT_GT(no_pool.count(), 0U);
+  }
+}
+
+TEST_F(TestDecoder, EventView) {
+  std::vector<std::string> events= make_transaction();
+  std::string rotate("\4\0\0\0\0\0\0\0master-bin.000002", 25);
+  events.push_back(make_event(binary_log::ROTATE_EVENT, rotate));
+  for (size_t i= 0; i < events.size(); i++)
+  {
+    uint32_t timestamp= htole32(1500000000 + i);
+    uint32_t server_id= htole32(7);
+    uint32_t log_pos= htole32(1000 + 100 * i);
+    memcpy(&events[i][0], &timestamp, 4);
+    memcpy(&events[i][SERVER_ID_OFFSET], &server_id, 4);
+    memcpy(&events[i][LOG_POS_OFFSET], &log_pos, 4);
+  }
+
+  binary_log::Decoder decoder;
+  const char *error= NULL;
+  std::vector<binary_log::Event_view> views(events.size());
+  {
+    Allocation_counter fde;
+    ASSERT_TRUE(decoder.view_event(events[0].data(), events[0].size(),
+                                   &views[0], &error, true)) << error;
+    // Only the Format_description_event is decoded
+    if (allocations_counted)
+    {
+      EXPECT_GT(fde.count(), 0U);
+    }
+  }
+  Allocation_counter counter;
+  for (size_t i= 1; i < events.size(); i++)
+    ASSERT_TRUE(decoder.view_event(events[i].data(), events[i].size(),
+                                   &views[i], &error, false)) << error;
+
+  for (size_t i= 0; i < views.size(); i++)
+  {
+    EXPECT_EQ(views[i].timestamp(), 1500000000U + i);
+    EXPECT_EQ(views[i].server_id(), 7U);
+    EXPECT_EQ(views[i].log_pos(), 1000U + 100 * i);
+    EXPECT_EQ(views[i].event_length(), events[i].size());
+    EXPECT_EQ(views[i].flags(), 0);
+  }
+  EXPECT_EQ(views[0].type(), binary_log::FORMAT_DESCRIPTION_EVENT);
+
+  // The views read the buffers, they allocate nothing
+  binary_log::Gtid_view gtid(views[1]);
+  const unsigned char *sid= gtid.sid();
+  int64_t gno= gtid.gno();
+  binary_log::Query_view query(views[2]);
+  size_t db_len= 0, query_len= 0;
+  const char *db= query.db(&db_len);
+  const char *statement= query.query(&query_len);
+  binary_log::Table_map_view table_map(views[3]);
+  size_t map_db_len= 0, table_len= 0;
+  const char *map_db= table_map.db(&map_db_len);
+  const char *table= table_map.table(&table_len);
+  unsigned long columns= table_map.column_count();
+  binary_log::Rows_view rows(views[4]);
+  uint64_t xid= binary_log::Xid_view(views[5]).xid();
+  binary_log::Rotate_view rotate_view(views[6]);
+  size_t ident_len= 0;
+  const char *ident= rotate_view.new_log_ident(&ident_len);
+  if (allocations_counted)
+  {
+    EXPECT_EQ(counter.count(), 0U);
+  }
+
+  EXPECT_EQ(gtid.type(), binary_log::GTID_LOG_EVENT);
+  ASSERT_TRUE(sid != NULL);
+  EXPECT_EQ(sid[15], 1);
+  EXPECT_EQ(gno, 0x0101010101010101LL);
+  ASSERT_TRUE(db != NULL && statement != NULL);
+  EXPECT_EQ(std::string(db, db_len), "db");
+  EXPECT_EQ(std::string(statement, query_len), "BEGIN");
+  EXPECT_EQ(query.error_code(), 0);
+  EXPECT_EQ(table_map.table_id(), 0x21U);
+  ASSERT_TRUE(map_db != NULL && table != NULL);
+  EXPECT_EQ(std::string(map_db, map_db_len), "db");
+  EXPECT_EQ(std::string(table, table_len), "table_with_a_long_name");
+  EXPECT_EQ(columns, 2U);
+  EXPECT_EQ(rows.type(), binary_log::WRITE_ROWS_EVENT);
+  EXPECT_EQ(rows.table_id(), 0x21U);
+  EXPECT_EQ(rows.rows_flags(), binary_log::Rows_event::STMT_END_F);
+  EXPECT_EQ(xid, 42U);
+  EXPECT_EQ(rotate_view.position(), 4U);
+  ASSERT_TRUE(ident != NULL);
+  EXPECT_EQ(std::string(ident, ident_len), "master-bin.000002");
+
+  // A view is decoded when asked
+  binary_log::Binary_log_event *ev= decoder.decode_event(views[3], &error,
+                                                         false);
+  ASSERT_TRUE(ev != NULL) << error;
+  EXPECT_EQ(static_cast<binary_log::Table_map_event*>(ev)->m_tblnam,
+            "table_with_a_long_name");
+  delete ev;
+
+  // A short event is checked
+  std::string truncated= events[3].substr(0, LOG_EVENT_HEADER_LEN + 12);
+  uint32_t truncated_length= htole32(truncated.size());
+  memcpy(&truncated[EVENT_LEN_OFFSET], &truncated_length, 4);
+  binary_log::Event_view view;
+  ASSERT_TRUE(decoder.view_event(truncated.data(), truncated.size(), &view,
+                                 &error, false));
+  binary_log::Table_map_view short_map(view);
+  size_t length;
+  EXPECT_TRUE(short_map.db(&length) != NULL);
+  EXPECT_TRUE(short_map.table(&length) == NULL);
+  EXPECT_EQ(short_map.column_count(), 0U);
+}
+
+TEST_F(TestDecoder, EventFilter) {
+  std::vector<std::string> events= make_transaction();
+  // The rows of a table of another database, after the ones of db
+  std::string table_map("\x22\0\0\0\0\0\1\0", 8);
+  table_map+= std::string("\5other\0\1t\0\1\3\0\0", 14);
+  events.insert(events.end() - 1,
+                make_event(binary_log::TABLE_MAP_EVENT, table_map));
+  std::string rows("\x22\0\0\0\0\0\1\0\2\0\1\1", 12);
+  rows+= std::string(20, '\0');
+  events.insert(events.end() - 1,
+                make_event(binary_log::WRITE_ROWS_EVENT, rows));
+  uint32_t server_id= htole32(7);
+  memcpy(&events[1][SERVER_ID_OFFSET], &server_id, 4);
+
+  binary_log::Event_filter db_filter;
+  db_filter.add_table("db");
+  binary_log::Event_filter xid_filter;
+  xid_filter.add_event_type(binary_log::XID_EVENT);
+  binary_log::Event_filter server_filter;
+  server_filter.ignore_server_id(7);
+  server_filter.ignore_table("db", "table_with_a_long_name");
+  const binary_log::Event_filter *filters[]=
+    { NULL, &db_filter, &xid_filter, &server_filter };
+  // FDE, GTID, BEGIN, Table_map db, rows db, Table_map other, rows other, XID
+  const char *decoded[]=
+    { "11111111", "11111001", "10000001", "10100111" };
+
+  for (size_t f= 0; f < sizeof(filters) / sizeof(filters[0]); f++)
+  {
+    binary_log::Decoder decoder;
+    decoder.set_filter(filters[f]);
+    for (size_t i= 0; i < events.size(); i++)
+    {
+      const char *error= "not set";
+      Allocation_counter counter;
+      binary_log::Binary_log_event *ev=
+        decoder.decode_event(events[i].data(), events[i].size(), &error,
+                             true);
+      unsigned long long used= counter.count();
+      if (decoded[f][i] == '1')
+      {
+        ASSERT_TRUE(ev != NULL) << "filter " << f << " event " << i << ": "
+                                << error;
+        EXPECT_EQ(ev->get_event_type(),
+                  (unsigned char) events[i][EVENT_TYPE_OFFSET]);
+        delete ev;
+      }
+      else
+      {
+        EXPECT_TRUE(ev == NULL) << "filter " << f << " event " << i;
+        EXPECT_TRUE(error == NULL);
+        // Only the decision on a new table id is stored
+        if (allocations_counted &&
+            events[i][EVENT_TYPE_OFFSET] != binary_log::TABLE_MAP_EVENT)
+        {
+          EXPECT_EQ(used, 0U) << "filter " << f << " event " << i;
+        }
+        delete ev;
+      }
+    }
+  }
+}
+
+/** A Write_rows_event showing the slices of its rows */
+class Rows_probe : public binary_log::Write_rows_event
+{
+public:
+  Rows_probe(const char *buf, unsigned int event_len,
+             const binary_log::Format_description_event *fde,
+             binary_log::Event_buffer *buffer)
+    : binary_log::Rows_event(buf, event_len, fde, buffer),
+      binary_log::Write_rows_event(buf, event_len, fde, buffer)
+  {}
+  const binary_log::Buffer_slice &rows() const { return row; }
+};
+
+TEST_F(TestDecoder, EventBuffer) {
+  std::vector<std::string> events= make_transaction();
+  std::string rows("\x21\0\0\0\0\0\1\0\2\0\2\3", 12);
+  rows+= std::string("\0\x2a\0\0\0\3abc", 9);
+  events[4]= make_event(binary_log::WRITE_ROWS_EVENT, rows);
+
+  binary_log::Decoder decoder;
+  const char *error= NULL;
+  binary_log::Binary_log_event *fde=
+    decoder.decode_event(events[0].data(), events[0].size(), &error, false);
+  ASSERT_TRUE(fde != NULL) << error;
+  binary_log::Binary_log_event *table_map=
+    decoder.decode_event(events[3].data(), events[3].size(), &error, false);
+  ASSERT_TRUE(table_map != NULL) << error;
+
+  // What a driver does in get_next_event_buffer()
+  const std::string &event= events[4];
+  binary_log::Event_buffer *buffer=
+    binary_log::Event_buffer::reuse(NULL, event.size() + 1);
+  memcpy(buffer->data(), event.data(), event.size());
+  buffer->data()[event.size()]= 0;
+
+  binary_log::Format_description_event *description=
+    dynamic_cast<binary_log::Format_description_event*>(fde);
+  Rows_probe *shared= new Rows_probe((const char *) buffer->data(),
+                                     event.size(), description, buffer);
+  EXPECT_EQ(shared->rows().buffer(), buffer);
+  EXPECT_TRUE(buffer->holds(shared->rows().data(), shared->rows().size()));
+  EXPECT_EQ(shared->rows().size(), 10U);
+  EXPECT_TRUE(buffer->shared());
+
+  // The next event goes to another buffer, the first one is still read
+  binary_log::Event_buffer *next=
+    binary_log::Event_buffer::reuse(buffer, event.size() + 1);
+  EXPECT_NE(next, buffer);
+  memset(next->data(), 0, event.size() + 1);
+  binary_log::Row_event_set row_set(shared,
+    static_cast<binary_log::Table_map_event*>(table_map));
+  binary_log::Row_event_set::iterator it= row_set.begin();
+  binary_log::Row_of_fields fields= *it;
+  ASSERT_EQ(fields.size(), 2U);
+  EXPECT_EQ(fields[0].as_int32(), 42);
+  unsigned long length;
+  unsigned char *str= fields[1].as_c_str(length);
+  EXPECT_EQ(std::string((char *) str, length), "abc");
+  EXPECT_TRUE(++it == row_set.end());
+  delete shared;
+
+  // Without a buffer the rows are copied, once
+  Rows_probe copied(event.data(), event.size(), description, NULL);
+  EXPECT_TRUE(copied.rows().buffer() != NULL);
+  EXPECT_TRUE(copied.rows().buffer()->holds(copied.rows().data(), 10));
+  EXPECT_EQ(memcmp(copied.rows().data(), &event[event.size() - 9], 9), 0);
+
+  // Through the Decoder, the event holds the buffer until it is deleted
+  memcpy(next->data(), event.data(), event.size());
+  binary_log::Binary_log_event *ev=
+    decoder.decode_event(next, event.size(), &error, false);
+  ASSERT_TRUE(ev != NULL) << error;
+  EXPECT_TRUE(next->shared());
+  delete ev;
+  EXPECT_FALSE(next->shared());
+  next->release();
+  delete table_map;
+  delete fde;
+
+  // A slice copies bytes of its own buffer into another one
+  binary_log::Buffer_slice slice;
+  ASSERT_TRUE(slice.copy((const uint8_t *) "abcdef", 6));
+  binary_log::Event_buffer *own= slice.buffer();
+  ASSERT_TRUE(slice.copy(slice.data() + 2, 3));
+  EXPECT_NE(slice.buffer(), own);
+  EXPECT_EQ(std::string((const char *) slice.data(), slice.size()), "cde");
+}
+
+TEST_F(TestDecoder, ColumnLayout) {
+  std::vector<std::string> events= make_transaction();
+  // (42, "abc"), then (NULL, "xy")
+  std::string rows("\x21\0\0\0\0\0\1\0\2\0\2\3", 12);
+  rows+= std::string("\0\x2a\0\0\0\3abc", 9);
+  rows+= std::string("\1\2xy", 4);
+  events[4]= make_event(binary_log::WRITE_ROWS_EVENT, rows);
+
+  binary_log::Decoder decoder;
+  decoder.set_event_pool(1);
+  const char *error= NULL;
+  std::vector<binary_log::Binary_log_event*> decoded;
+  for (size_t i= 0; i < events.size(); i++)
+  {
+    decoded.push_back(decoder.decode_event(events[i].data(),
+                                           events[i].size(), &error, false));
+    ASSERT_TRUE(decoded.back() != NULL) << error;
+  }
+  binary_log::Table_map_event *table_map=
+    static_cast<binary_log::Table_map_event*>(decoded[3]);
+  ASSERT_TRUE(table_map->m_columns != NULL);
+  const binary_log::Column_layout &id= table_map->m_columns[0];
+  EXPECT_EQ(id.type, MYSQL_TYPE_LONG);
+  EXPECT_EQ(id.length_bytes, 0);
+  EXPECT_EQ(id.fixed_size, 4U);
+  EXPECT_TRUE(id.nullable);
+  const binary_log::Column_layout &name= table_map->m_columns[1];
+  EXPECT_EQ(name.type, MYSQL_TYPE_VARCHAR);
+  EXPECT_EQ(name.real_type, MYSQL_TYPE_VARCHAR);
+  EXPECT_EQ(name.metadata, 255);
+  EXPECT_EQ(name.length_bytes, 1);
+  EXPECT_TRUE(name.nullable);
+
+  binary_log::Row_event_set row_set(
+    static_cast<binary_log::Rows_event*>(decoded[4]), table_map);
+  // Skips the first row from the layout alone
+  binary_log::Row_event_set::iterator it= row_set.begin();
+  ++it;
+  ASSERT_TRUE(it != row_set.end());
+  binary_log::Row_of_fields fields= *it;
+  ASSERT_EQ(fields.size(), 2U);
+  EXPECT_TRUE(fields[0].is_null());
+  unsigned long length;
+  unsigned char *str= fields[1].as_c_str(length);
+  EXPECT_EQ(std::string((char *) str, length), "xy");
+  EXPECT_TRUE(++it == row_set.end());
+
+  // A pooled Table_map_event rebuilds the layout of the next table
+  decoder.release_event(table_map);
+  std::string other("\x22\0\0\0\0\0\1\0\5other\0\1t\0", 18);
+  // VARCHAR(300) NOT NULL, INT, BLOB NOT NULL
+  other+= std::string("\3\x0f\3\xfc\3\x2c\1\2\2", 9);
+  std::string event= make_event(binary_log::TABLE_MAP_EVENT, other);
+  binary_log::Binary_log_event *ev=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_EQ(ev, table_map) << error;
+  EXPECT_EQ(table_map->m_columns[0].metadata, 300);
+  EXPECT_EQ(table_map->m_columns[0].length_bytes, 2);
+  EXPECT_FALSE(table_map->m_columns[0].nullable);
+  EXPECT_EQ(table_map->m_columns[1].type, MYSQL_TYPE_LONG);
+  EXPECT_EQ(table_map->m_columns[1].fixed_size, 4U);
+  EXPECT_TRUE(table_map->m_columns[1].nullable);
+  EXPECT_EQ(table_map->m_columns[2].type, MYSQL_TYPE_BLOB);
+  EXPECT_EQ(table_map->m_columns[2].length_bytes, 2);
+  EXPECT_FALSE(table_map->m_columns[2].nullable);
+
+  for (size_t i= 0; i < decoded.size(); i++)
+    if (decoded[i] != table_map)
+      delete decoded[i];
+  delete table_map;
+}
+
+TEST_F(TestDecoder, TableMapCache) {
+  std::vector<std::string> events= make_transaction();
+  binary_log::Decoder decoder;
+  decoder.set_table_map_cache(16);
+  decoder.set_event_pool(1);
+  const char *error= NULL;
+  for (size_t i= 0; i < 3; i++)
+    decoder.release_event(decoder.decode_event(events[i].data(),
+                                               events[i].size(), &error,
+                                               false));
+
+  // Two events of the same table map share the columns
+  binary_log::Table_map_event *first=
+    static_cast<binary_log::Table_map_event*>(
+      decoder.decode_event(events[3].data(), events[3].size(), &error,
+                           false));
+  ASSERT_TRUE(first != NULL) << error;
+  binary_log::Table_map_event *second=
+    static_cast<binary_log::Table_map_event*>(
+      decoder.decode_event(events[3].data(), events[3].size(), &error,
+                           false));
+  ASSERT_TRUE(second != NULL) << error;
+  EXPECT_NE(first, second);
+  EXPECT_TRUE(first->m_schema != NULL);
+  EXPECT_EQ(first->m_schema, second->m_schema);
+  EXPECT_EQ(first->m_coltype, second->m_coltype);
+  EXPECT_EQ(second->get_table_id(), 0x21U);
+  EXPECT_EQ(second->m_tblnam, "table_with_a_long_name");
+  EXPECT_EQ(second->m_colcnt, 2U);
+  EXPECT_EQ(second->m_columns[1].metadata, 255);
+  delete first;
+
+  // A pooled event decodes the same table map again without allocating
+  decoder.release_event(second);
+  Allocation_counter counter;
+  binary_log::Binary_log_event *ev=
+    decoder.decode_event(events[3].data(), events[3].size(), &error, false);
+  if (allocations_counted)
+  {
+    EXPECT_EQ(counter.count(), 0U);
+  }
+  ASSERT_EQ(ev, second) << error;
+  EXPECT_EQ(second->m_columns[0].type, MYSQL_TYPE_LONG);
+
+  // The table id mapped to another table gets its own columns
+  decoder.release_event(second);
+  std::string other("\x21\0\0\0\0\0\1\0\5other\0\1t\0", 18);
+  other+= std::string("\3\x0f\3\xfc\3\x2c\1\2\2", 9);
+  std::string event= make_event(binary_log::TABLE_MAP_EVENT, other);
+  ev= decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_EQ(ev, second) << error;
+  EXPECT_EQ(second->m_tblnam, "t");
+  EXPECT_EQ(second->m_colcnt, 3U);
+  EXPECT_EQ(second->m_columns[0].metadata, 300);
+  EXPECT_EQ(second->m_columns[2].type, MYSQL_TYPE_BLOB);
+  binary_log::Table_map_event *third=
+    static_cast<binary_log::Table_map_event*>(
+      decoder.decode_event(event.data(), event.size(), &error, false));
+  ASSERT_TRUE(third != NULL) << error;
+  EXPECT_EQ(third->m_schema, second->m_schema);
+  EXPECT_EQ(third->m_columns[1].fixed_size, 4U);
+
+  // The events outlive the cache
+  decoder.set_table_map_cache(0);
+  EXPECT_EQ(third->m_columns[0].length_bytes, 2);
+  delete third;
+  delete second;
+}
+
+/** A Table_map_event of a table of three columns, mapped to table_id */
+static std::string make_table_map(unsigned char table_id)
+{
+  std::string body("\0\0\0\0\0\0\1\0\5other\0\1t\0", 18);
+  body[0]= table_id;
+  body+= std::string("\3\x0f\3\xfc\3\x2c\1\2\2", 9);
+  return make_event(binary_log::TABLE_MAP_EVENT, body);
+}
+
+TEST_F(TestDecoder, TableMapCacheLru) {
+  std::vector<std::string> events= make_transaction();
+  binary_log::Decoder decoder;
+  decoder.set_table_map_cache(2);
+  const char *error= NULL;
+  for (size_t i= 0; i < 3; i++)
+    decoder.release_event(decoder.decode_event(events[i].data(),
+                                               events[i].size(), &error,
+                                               false));
+
+  binary_log::Table_map_event *maps[4];
+  const unsigned char table_ids[4]= { 1, 2, 1, 3 };
+  for (size_t i= 0; i < 4; i++)
+  {
+    std::string event= make_table_map(table_ids[i]);
+    maps[i]= static_cast<binary_log::Table_map_event*>(
+      decoder.decode_event(event.data(), event.size(), &error, false));
+    ASSERT_TRUE(maps[i] != NULL) << error;
+  }
+  EXPECT_EQ(maps[2]->m_schema, maps[0]->m_schema);
+
+  // Table id 3 dropped 2, mapped less recently than 1, though higher
+  std::string event= make_table_map(1);
+  binary_log::Binary_log_event *one=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(one != NULL) << error;
+  EXPECT_EQ(static_cast<binary_log::Table_map_event*>(one)->m_schema,
+            maps[0]->m_schema);
+  event= make_table_map(2);
+  binary_log::Binary_log_event *two=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(two != NULL) << error;
+  EXPECT_NE(static_cast<binary_log::Table_map_event*>(two)->m_schema,
+            maps[1]->m_schema);
+  EXPECT_EQ(static_cast<binary_log::Table_map_event*>(two)->m_colcnt, 3U);
+
+  delete two;
+  delete one;
+  for (size_t i= 0; i < 4; i++)
+    delete maps[i];
+}
+
+TEST_F(TestDecoder, ColumnBatch) {
+  std::vector<std::string> events= make_transaction();
+  // (42, "abc"), (NULL, "xy"), (-7, "")
+  std::string rows("\x21\0\0\0\0\0\1\0\2\0\2\3", 12);
+  rows+= std::string("\0\x2a\0\0\0\3abc", 9);
+  rows+= std::string("\1\2xy", 4);
+  rows+= std::string("\0\xf9\xff\xff\xff\0", 6);
+  events[4]= make_event(binary_log::WRITE_ROWS_EVENT, rows);
+
+  binary_log::Decoder decoder;
+  const char *error= NULL;
+  std::vector<binary_log::Binary_log_event*> decoded;
+  for (size_t i= 0; i < events.size(); i++)
+  {
+    decoded.push_back(decoder.decode_event(events[i].data(),
+                                           events[i].size(), &error, false));
+    ASSERT_TRUE(decoded.back() != NULL) << error;
+  }
+  binary_log::Table_map_event *table_map=
+    static_cast<binary_log::Table_map_event*>(decoded[3]);
+  binary_log::Column_batch batch;
+  ASSERT_TRUE(batch.decode(*static_cast<binary_log::Rows_event*>(decoded[4]),
+                           *table_map));
+  ASSERT_EQ(batch.row_count(), 3U);
+  ASSERT_EQ(batch.column_count(), 2U);
+  const binary_log::Column_vector &id= batch.column(0);
+  EXPECT_EQ(id.kind, binary_log::COLUMN_INT64);
+  ASSERT_EQ(id.int64_values.size(), 3U);
+  EXPECT_EQ(id.int64_values[0], 42);
+  EXPECT_TRUE(id.is_null(1));
+  EXPECT_EQ(id.int64_values[2], -7);
+  EXPECT_EQ(id.null_count, 1U);
+  EXPECT_EQ(id.validity[0], 5);
+  const binary_log::Column_vector &name= batch.column(1);
+  EXPECT_EQ(name.kind, binary_log::COLUMN_BINARY);
+  ASSERT_EQ(name.offsets.size(), 4U);
+  EXPECT_EQ(name.offsets[1], 3U);
+  EXPECT_EQ(name.offsets[2], 5U);
+  EXPECT_EQ(name.offsets[3], 5U);
+  EXPECT_EQ(std::string(name.bytes.begin(), name.bytes.end()), "abcxy");
+  EXPECT_EQ(name.null_count, 0U);
+
+  // DOUBLE, TINYINT, BLOB
+  std::string table("\x22\0\0\0\0\0\1\0\2db\0\1u\0", 15);
+  table+= std::string("\3\5\1\xfc\2\x08\x02\7", 8);
+  std::string event= make_event(binary_log::TABLE_MAP_EVENT, table);
+  binary_log::Binary_log_event *other_map=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(other_map != NULL) << error;
+  std::string row("\x22\0\0\0\0\0\1\0\2\0\3\7", 12);
+  row+= std::string("\0\0\0\0\0\0\0\x04\x40\xff\3\0xyz", 15);
+  event= make_event(binary_log::WRITE_ROWS_EVENT, row);
+  binary_log::Binary_log_event *other_rows=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(other_rows != NULL) << error;
+  ASSERT_TRUE(batch.decode(*static_cast<binary_log::Rows_event*>(other_rows),
+                           *static_cast<binary_log::Table_map_event*>(
+                             other_map)));
+  ASSERT_EQ(batch.row_count(), 1U);
+  ASSERT_EQ(batch.column_count(), 3U);
+  EXPECT_EQ(batch.column(0).kind, binary_log::COLUMN_DOUBLE);
+  EXPECT_EQ(batch.column(0).double_values[0], 2.5);
+  EXPECT_EQ(batch.column(1).int64_values[0], -1);
+  EXPECT_EQ(std::string(batch.column(2).bytes.begin(),
+                        batch.column(2).bytes.end()), "xyz");
+
+  // A DOUBLE cut short is an error
+  event= make_event(binary_log::WRITE_ROWS_EVENT, row.substr(0, 17));
+  binary_log::Binary_log_event *short_double=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(short_double != NULL) << error;
+  EXPECT_FALSE(batch.decode(
+    *static_cast<binary_log::Rows_event*>(short_double),
+    *static_cast<binary_log::Table_map_event*>(other_map)));
+  EXPECT_EQ(batch.row_count(), 0U);
+  EXPECT_EQ(batch.column_count(), 0U);
+  delete short_double;
+
+  // So is a DOUBLE whose metadata does not give it 8 bytes
+  std::string bad_table(table);
+  bad_table[20]= 2;
+  event= make_event(binary_log::TABLE_MAP_EVENT, bad_table);
+  binary_log::Binary_log_event *bad_map=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(bad_map != NULL) << error;
+  EXPECT_EQ(static_cast<binary_log::Table_map_event*>(bad_map)->
+              m_columns[0].fixed_size, 2U);
+  EXPECT_FALSE(batch.decode(
+    *static_cast<binary_log::Rows_event*>(other_rows),
+    *static_cast<binary_log::Table_map_event*>(bad_map)));
+  EXPECT_EQ(batch.row_count(), 0U);
+  EXPECT_EQ(batch.column_count(), 0U);
+  delete bad_map;
+  delete other_rows;
+
+  // The image after an update holds the second column only
+  std::string update("\x21\0\0\0\0\0\1\0\2\0\2\3\2", 13);
+  update+= std::string("\0\1\0\0\0\1a", 7);
+  update+= std::string("\0\1b", 3);
+  event= make_event(binary_log::UPDATE_ROWS_EVENT, update);
+  binary_log::Binary_log_event *updated=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(updated != NULL) << error;
+  ASSERT_TRUE(batch.decode(*static_cast<binary_log::Rows_event*>(updated),
+                           *table_map));
+  ASSERT_EQ(batch.row_count(), 2U);
+  EXPECT_EQ(batch.column(0).int64_values[0], 1);
+  EXPECT_TRUE(batch.column(0).is_null(1));
+  EXPECT_EQ(std::string(batch.column(1).bytes.begin(),
+                        batch.column(1).bytes.end()), "ab");
+
+  // A row cut short is an error
+  event= make_event(binary_log::WRITE_ROWS_EVENT, rows.substr(0, 20));
+  binary_log::Binary_log_event *broken=
+    decoder.decode_event(event.data(), event.size(), &error, false);
+  ASSERT_TRUE(broken != NULL) << error;
+  EXPECT_FALSE(batch.decode(*static_cast<binary_log::Rows_event*>(broken),
+                            *table_map));
+  EXPECT_EQ(batch.row_count(), 0U);
+
+  delete broken;
+  delete updated;
+  delete other_map;
+  for (size_t i= 0; i < decoded.size(); i++)
+    delete decoded[i];
+}
+
+#ifdef HAVE_SYS_MMAN_H
+static std::string read_file(const std::string &path)
+{
+  std::string data;
+  FILE *file= fopen(path.c_str(), "rb");
+  char chunk[4096];
+  size_t count;
+  while (file && (count= fread(chunk, 1, sizeof(chunk), file)) > 0)
+    data.append(chunk, count);
+  if (file)
+    fclose(file);
+  return data;
+}
+
+static void write_file(const std::string &path, const std::string &data)
+{
+  FILE *file= fopen(path.c_str(), "wb");
+  fwrite(data.data(), 1, data.size(), file);
+  fclose(file);
+}
+
+TEST_F(TestDecoder, BinlogIndex) {
+  using binary_log::Binlog_index;
+  using binary_log::Binlog_index_entry;
+  std::string source= std::string(STD_DATA_DIR) + "/searchbin.000001";
+  std::string data= read_file(source);
+  char dir[]= "/tmp/binlog-index-XXXXXX";
+  ASSERT_TRUE(mkdtemp(dir));
+  std::string path= std::string(dir) + "/master-bin.000001";
+  std::string sidecar= Binlog_index::sidecar_name(path);
+
+  // An interval of one byte samples every transaction
+  Binlog_index all;
+  ASSERT_EQ(all.build(source, 1), 0);
+  std::vector<Binlog_index_entry> starts= all.entries();
+  ASSERT_GT(starts.size(), 4U);
+  EXPECT_EQ(all.binlog_size(), data.size());
+
+  /*
+    The timestamps go back and forth, as those of transactions which do
+    not commit in the order they start.
+  */
+  const uint32_t base= 1000000;
+  std::vector<uint32_t> timestamps;
+  std::string early(data);
+  for (size_t i= 0; i < starts.size(); i++)
+  {
+    timestamps.push_back(base + (i * 7) % 13);
+    uint32_t timestamp= htole32(timestamps[i]);
+    memcpy(&data[starts[i].offset], &timestamp, 4);
+    timestamp= htole32(timestamps[i] - 1000);
+    memcpy(&early[starts[i].offset], &timestamp, 4);
+  }
+  write_file(path, data);
+
+  unsigned long intervals[]= { 1, 300, 2000, 1UL << 30 };
+  for (size_t i= 0; i < sizeof(intervals)/sizeof(*intervals); i++)
+  {
+    Binlog_index index;
+    ASSERT_EQ(index.build(path, intervals[i]), 0);
+    ASSERT_EQ(index.save(sidecar), 0);
+    Binlog_index loaded;
+    ASSERT_EQ(loaded.load(sidecar), 0);
+    EXPECT_FALSE(loaded.is_stale(path));
+    EXPECT_EQ(loaded.binlog_size(), index.binlog_size());
+    EXPECT_EQ(loaded.fde(), index.fde());
+    ASSERT_EQ(loaded.entries().size(), index.entries().size());
+    for (size_t j= 0; j < index.entries().size(); j++)
+    {
+      EXPECT_EQ(loaded.entries()[j].offset, index.entries()[j].offset);
+      EXPECT_EQ(loaded.entries()[j].timestamp, index.entries()[j].timestamp);
+      EXPECT_EQ(loaded.entries()[j].max_timestamp,
+                index.entries()[j].max_timestamp);
+    }
+
+    // The first transaction of the file at or after the time is found
+    for (time_t when= base - 1; when <= base + 13; when++)
+    {
+      size_t first= 0;
+      while (first < timestamps.size() && (time_t) timestamps[first] < when)
+        first++;
+      unsigned long position= 0;
+      if (first == timestamps.size())
+        EXPECT_EQ(loaded.find_time(path, when, &position),
+                  binary_log::ERR_EOF) << intervals[i] << " " << when;
+      else
+      {
+        EXPECT_EQ(loaded.find_time(path, when, &position), 0);
+        EXPECT_EQ(position, starts[first].offset)
+          << intervals[i] << " " << when;
+      }
+    }
+  }
+
+  // An index of an older format, or of something else, is not loaded
+  write_file(sidecar, std::string("BLIX\1\0\0\0", 8));
+  Binlog_index index;
+  EXPECT_EQ(index.load(sidecar), binary_log::ERR_FAIL);
+  write_file(sidecar, "garbage");
+  EXPECT_EQ(index.load(sidecar), binary_log::ERR_FAIL);
+
+  /*
+    A sidecar saved when the file held earlier timestamps, and was
+    shorter, would skip to the last transaction: it is rebuilt.
+  */
+  write_file(path, early);
+  ASSERT_EQ(index.build(path, 1), 0);
+  ASSERT_EQ(index.save(sidecar), 0);
+  write_file(path, data + std::string(1, '\0'));
+  ASSERT_EQ(index.load(sidecar), 0);
+  EXPECT_TRUE(index.is_stale(path));
+
+  binary_log::system::Binlog_mmap_driver drv(path);
+  binary_log::Binary_log binlog(&drv);
+  ASSERT_EQ(binlog.connect(), 0);
+  ASSERT_EQ(binlog.set_position_by_time(base), 0);
+  std::string file;
+  EXPECT_EQ(binlog.get_position(file), starts[0].offset);
+
+  /*
+    The seek saved the rebuilt index, up to the last complete event, which
+    the next seek reuses as is once the partial event is gone.
+  */
+  binlog.disconnect();
+  write_file(path, data);
+  ASSERT_EQ(binlog.connect(), 0);
+  ASSERT_EQ(index.load(sidecar), 0);
+  EXPECT_FALSE(index.is_stale(path));
+  EXPECT_EQ(index.binlog_size(), data.size());
+  struct utimbuf old_times= { 1000, 1000 };
+  ASSERT_EQ(utime(sidecar.c_str(), &old_times), 0);
+  ASSERT_EQ(binlog.set_position_by_time(base + 12), 0);
+  struct stat stat_buff;
+  ASSERT_EQ(stat(sidecar.c_str(), &stat_buff), 0);
+  EXPECT_EQ(stat_buff.st_mtime, 1000);
+  size_t first= 0;
+  while (timestamps[first] < base + 12)
+    first++;
+  EXPECT_EQ(binlog.get_position(file), starts[first].offset);
+  binlog.disconnect();
+
+  unlink(sidecar.c_str());
+  unlink(path.c_str());
+  rmdir(dir);
+}
+
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_SYS_MMAN_H)
+/** The type, position and length of an event, to compare decoders */
+static std::string describe_event(binary_log::Binary_log_event *ev,
+                                  unsigned long position)
+{
+  char description[64];
+  snprintf(description, sizeof(description), "%d@%lu:%lu",
+           (int) ev->get_event_type(), position,
+           (unsigned long) ev->header()->data_written);
+  return description;
+}
+
+/** Decodes the events of a file one after the other, with one Decoder */
+static std::vector<std::string> decode_serially(const std::string &path)
+{
+  std::vector<std::string> events;
+  std::string data= read_file(path);
+  binary_log::Decoder decoder;
+  size_t pos= 4;
+  while (pos + LOG_EVENT_MINIMAL_HEADER_LEN <= data.size())
+  {
+    uint32_t length;
+    memcpy(&length, data.data() + pos + EVENT_LEN_OFFSET, 4);
+    length= le32toh(length);
+    std::string event= data.substr(pos, length);
+    const char *error= NULL;
+    binary_log::Binary_log_event *ev=
+      decoder.decode_event(event.c_str(), length, &error, false);
+    if (ev == NULL)
+    {
+      ADD_FAILURE() << path << ": " << error;
+      break;
+    }
+    events.push_back(describe_event(ev, pos));
+    delete ev;
+    pos+= length;
+  }
+  return events;
+}
+
+TEST_F(TestDecoder, ParallelDecoder) {
+  const char *files[]= {
+    "binlog_savepoint.000001",
+    "binlog_transaction.000001",
+    "searchbin.000001",
+    "logs_5_1/mysql-5.1.000001",
+    "logs_5_5/mysql-5.5.000001",
+    "logs_5_6/mysql-5.6.000001",
+    "logs_5_7/mysql-5.7.000001",
+  };
+
+  // The events come in the order of the file, however small the chunks
+  for (size_t i= 0; i < sizeof(files)/sizeof(*files); i++)
+  {
+    std::string path= std::string(STD_DATA_DIR) + "/" + files[i];
+    std::vector<std::string> expected= decode_serially(path);
+    size_t chunk_sizes[]= { 1, 1000, PARALLEL_DECODER_CHUNK_SIZE };
+    for (size_t j= 0; j < 3; j++)
+    {
+      binary_log::Parallel_decoder decoder(3, chunk_sizes[j]);
+      ASSERT_EQ(decoder.open(path), 0) << path;
+      std::vector<std::string> events;
+      binary_log::Binary_log_event *ev;
+      unsigned long position;
+      int error;
+      while ((error= decoder.next_event(&ev, &position)) == 0)
+      {
+        events.push_back(describe_event(ev, position));
+        delete ev;
+      }
+      EXPECT_EQ(error, binary_log::ERR_EOF) << path;
+      EXPECT_EQ(events, expected) << path << " " << chunk_sizes[j];
+      EXPECT_EQ(decoder.close(), 0);
+    }
+  }
+
+  /*
+    An event whose checksum does not match stops the decoding there: the
+    events before it are returned, then the error of its worker.
+  */
+  std::string path= std::string(STD_DATA_DIR) + "/logs_5_7/mysql-5.7.000001";
+  std::string data= read_file(path);
+  std::vector<std::string> expected= decode_serially(path);
+  ASSERT_GT(expected.size(), 4U);
+  unsigned long bad_position=
+    strtoul(expected[4].substr(expected[4].find('@') + 1).c_str(), NULL, 10);
+  data[bad_position + LOG_EVENT_HEADER_LEN]^= 0x01;
+  char corrupt[]= "/tmp/parallel-decoder-XXXXXX";
+  int fd= mkstemp(corrupt);
+  ASSERT_NE(fd, -1);
+  ASSERT_EQ(write(fd, data.data(), data.size()), (ssize_t) data.size());
+  ::close(fd);
+
+  binary_log::Parallel_decoder checked(3, 1, true);
+  ASSERT_EQ(checked.open(corrupt), 0);
+  std::vector<std::string> events;
+  binary_log::Binary_log_event *ev;
+  unsigned long position;
+  int error;
+  while ((error= checked.next_event(&ev, &position)) == 0)
+  {
+    events.push_back(describe_event(ev, position));
+    delete ev;
+  }
+  EXPECT_EQ(error, binary_log::ERR_FAIL);
+  EXPECT_TRUE(checked.get_error() != NULL);
+  EXPECT_EQ(events, std::vector<std::string>(expected.begin(),
+                                             expected.begin() + 4));
+  // The error stays
+  EXPECT_EQ(checked.next_event(&ev, &position), binary_log::ERR_FAIL);
+  EXPECT_EQ(checked.close(), 0);
+  unlink(corrupt);
+
+  /*
+    Closing while the workers have filled the reorder buffer, and while
+    they are decoding, deletes the events which were not returned.
+  */
+  path= std::string(STD_DATA_DIR) + "/searchbin.000001";
+  binary_log::Parallel_decoder stopped(2, 1);
+  ASSERT_EQ(stopped.open(path), 0);
+  ASSERT_EQ(stopped.next_event(&ev, &position), 0);
+  delete ev;
+  usleep(10000);
+  EXPECT_EQ(stopped.close(), 0);
+  EXPECT_EQ(stopped.next_event(&ev, &position), binary_log::ERR_FAIL);
+  ASSERT_EQ(stopped.open(path), 0);
+  EXPECT_EQ(stopped.close(), 0);
+  {
+    // The destructor closes the decoder too
+    binary_log::Parallel_decoder destroyed(4, 1);
+    ASSERT_EQ(destroyed.open(path), 0);
+  }
+}
+#endif
+
+int main(int argc, char **argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}